@@ -0,0 +1,129 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstdlib>
+#include <new>
+#include "alloctrack.h"
+#include "stats.h"
+
+#ifndef TRACK_ALLOC
+
+// every allocation in the compiler passes through here, so counting is one add
+void *operator new(size_t size) {
+    hotCounters.allocations++;
+    hotCounters.bytesAllocated += size;
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == NULL) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+#else
+
+const char *allocSubsystemNames[ALLOC_SUBSYSTEMS] = {
+    "other", "scanner", "parser", "symbols", "output", "cache", "ir"
+};
+
+// sits in front of every block so delete knows what it's giving back,
+// sized to keep the block behind it aligned like malloc's
+struct alignas(16) AllocHeader {
+    size_t size;
+    int subsystem;
+};
+
+static AllocCounters subsystems[ALLOC_SUBSYSTEMS];
+static long liveBytes = 0, peakLiveBytes = 0;
+static thread_local int currentSubsystem = ALLOC_OTHER;
+static thread_local AllocCounters *currentPhase = NULL;
+
+void *operator new(size_t size) {
+    hotCounters.allocations++;
+    hotCounters.bytesAllocated += size;
+    AllocHeader *header = (AllocHeader*)malloc(sizeof(AllocHeader) + size);
+    if (header == NULL) throw std::bad_alloc();
+    header->size = size;
+    header->subsystem = currentSubsystem;
+
+    liveBytes += size;
+    if (liveBytes > peakLiveBytes) peakLiveBytes = liveBytes;
+    AllocCounters &owner = subsystems[currentSubsystem];
+    owner.count++;
+    owner.bytes += size;
+    owner.liveBytes += size;
+    if (owner.liveBytes > owner.peakLiveBytes) owner.peakLiveBytes = owner.liveBytes;
+    if (currentPhase != NULL) {
+        currentPhase->count++;
+        currentPhase->bytes += size;
+        if (liveBytes > currentPhase->peakLiveBytes) currentPhase->peakLiveBytes = liveBytes;
+    }
+    return header + 1;
+}
+
+void operator delete(void *memory) noexcept {
+    if (memory == NULL) return;
+    AllocHeader *header = (AllocHeader*)memory - 1;
+    liveBytes -= header->size;
+    subsystems[header->subsystem].liveBytes -= header->size;
+    free(header);
+}
+
+long allocLiveBytes() {
+    return liveBytes;
+}
+
+long allocPeakLiveBytes() {
+    return peakLiveBytes;
+}
+
+AllocCounters allocSubsystem(int subsystem) {
+    return subsystems[subsystem];
+}
+
+// starts a new compile's numbers, blocks still live carry over as live
+void allocReset() {
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+        subsystems[i].count = 0;
+        subsystems[i].bytes = 0;
+        subsystems[i].peakLiveBytes = subsystems[i].liveBytes;
+    }
+    peakLiveBytes = liveBytes;
+}
+
+AllocScope::AllocScope(int subsystem) {
+    this->previous = currentSubsystem;
+    currentSubsystem = subsystem;
+}
+
+AllocScope::~AllocScope() {
+    currentSubsystem = this->previous;
+}
+
+AllocPhase::AllocPhase(AllocCounters *phase) {
+    this->previous = currentPhase;
+    currentPhase = phase;
+    if (liveBytes > phase->peakLiveBytes) phase->peakLiveBytes = liveBytes;
+}
+
+AllocPhase::~AllocPhase() {
+    currentPhase = this->previous;
+}
+
+#endif
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void *memory) noexcept {
+    operator delete(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    operator delete(memory);
+}
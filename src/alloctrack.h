@@ -0,0 +1,61 @@
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+// allocation tracking by phase and subsystem, compiled in with
+// make TRACK_ALLOC=1, otherwise every hook below expands to nothing
+
+// subsystems allocations are charged to
+#define ALLOC_OTHER 0
+#define ALLOC_SCANNER 1
+#define ALLOC_PARSER 2
+#define ALLOC_SYMBOLS 3
+#define ALLOC_OUTPUT 4
+#define ALLOC_CACHE 5
+#define ALLOC_IR 6
+#define ALLOC_SUBSYSTEMS 7
+
+// what one phase or subsystem allocated
+struct AllocCounters {
+    long count = 0;
+    long bytes = 0;
+    long liveBytes = 0;     // allocated and not yet freed, subsystems only
+    long peakLiveBytes = 0; // for a phase, the process wide high water while it ran
+};
+
+#ifdef TRACK_ALLOC
+
+extern const char *allocSubsystemNames[ALLOC_SUBSYSTEMS];
+
+// live and peak bytes for the whole process, and per subsystem
+long allocLiveBytes();
+long allocPeakLiveBytes();
+AllocCounters allocSubsystem(int subsystem);
+void allocReset();
+
+// charges allocations in the enclosing block to a subsystem, nesting restores
+class AllocScope {
+    int previous;
+
+    public:
+        AllocScope(int subsystem);
+        ~AllocScope();
+};
+
+// charges allocations to a phase while it's the innermost one running
+class AllocPhase {
+    AllocCounters *previous;
+
+    public:
+        AllocPhase(AllocCounters *phase);
+        ~AllocPhase();
+};
+
+#define ALLOC_SUBSYSTEM(subsystem) AllocScope allocScope(subsystem)
+
+#else
+
+#define ALLOC_SUBSYSTEM(subsystem)
+
+#endif
+
+#endif
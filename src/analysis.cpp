@@ -0,0 +1,574 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include "analysis.h"
+
+Cfg::Cfg(Function *function) {
+    this->function = function;
+    this->indexById.assign(function->nextBlockId, -1);
+    if (function->entry() == NULL) return;
+
+    // iterative depth first search, numbering blocks as they finish
+    std::vector<Block*> postorder;
+    std::vector<bool> seen(function->nextBlockId, false);
+    std::vector<std::pair<Block*, size_t> > stack;
+    stack.push_back(std::make_pair(function->entry(), 0));
+    seen[function->entry()->id] = true;
+    while (!stack.empty()) {
+        Block *block = stack.back().first;
+        Instruction *last = block->terminator();
+        size_t next = stack.back().second;
+        if (last != NULL && next < last->targets.size()) {
+            stack.back().second++;
+            Block *succ = last->targets[next];
+            if (!seen[succ->id]) {
+                seen[succ->id] = true;
+                stack.push_back(std::make_pair(succ, 0));
+            }
+            continue;
+        }
+        postorder.push_back(block);
+        stack.pop_back();
+    }
+
+    this->blocks.assign(postorder.rbegin(), postorder.rend());
+    for (size_t i = 0; i < this->blocks.size(); i++) this->indexById[this->blocks[i]->id] = i;
+
+    this->succs.resize(this->blocks.size());
+    this->preds.resize(this->blocks.size());
+    for (size_t i = 0; i < this->blocks.size(); i++) {
+        Block *block = this->blocks[i];
+        Instruction *last = block->terminator();
+        if (last != NULL) {
+            for (size_t j = 0; j < last->targets.size(); j++) this->succs[i].push_back(this->indexById[last->targets[j]->id]);
+            if (last->op == OP_RET) this->exits.push_back(i);
+        }
+        for (size_t j = 0; j < block->preds.size(); j++) {
+            int pred = this->indexOf(block->preds[j]);
+            if (pred >= 0) this->preds[i].push_back(pred);
+        }
+    }
+}
+
+int Cfg::indexOf(Block *block) const {
+    if (block->id < 0 || block->id >= (int)this->indexById.size()) return -1;
+    int index = this->indexById[block->id];
+    return index >= 0 && this->blocks[index] == block ? index : -1;
+}
+
+DominatorTree::DominatorTree(const Cfg &cfg) : cfg(cfg) {
+    int count = cfg.size();
+    this->idom.assign(count, -1);
+    this->children.resize(count);
+    this->depth.assign(count, 0);
+    this->first.assign(count, 0);
+    this->last.assign(count, 0);
+    if (count == 0) return;
+
+    // blocks are numbered in reverse postorder, so walking up from the
+    // higher number always meets the common dominator
+    this->idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < count; i++) {
+            int dominator = -1;
+            const std::vector<int> &preds = cfg.preds[i];
+            for (size_t j = 0; j < preds.size(); j++) {
+                int a = preds[j];
+                if (this->idom[a] < 0) continue;
+                if (dominator < 0) { dominator = a; continue; }
+                int b = dominator;
+                while (a != b) {
+                    while (a > b) a = this->idom[a];
+                    while (b > a) b = this->idom[b];
+                }
+                dominator = a;
+            }
+            if (dominator >= 0 && this->idom[i] != dominator) {
+                this->idom[i] = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    for (int i = 1; i < count; i++) {
+        this->children[this->idom[i]].push_back(i);
+        this->depth[i] = this->depth[this->idom[i]] + 1; // idoms come earlier in rpo
+    }
+
+    // number the tree in preorder, a block dominates exactly the range up to its last descendant
+    int number = 0;
+    std::vector<std::pair<int, size_t> > stack;
+    stack.push_back(std::make_pair(0, 0));
+    this->first[0] = number++;
+    while (!stack.empty()) {
+        int block = stack.back().first;
+        size_t next = stack.back().second;
+        if (next < this->children[block].size()) {
+            stack.back().second++;
+            int child = this->children[block][next];
+            this->first[child] = number++;
+            stack.push_back(std::make_pair(child, 0));
+            continue;
+        }
+        this->last[block] = number - 1;
+        stack.pop_back();
+    }
+}
+
+bool DominatorTree::dominates(Block *a, Block *b) const {
+    int from = this->cfg.indexOf(a), to = this->cfg.indexOf(b);
+    if (from < 0 || to < 0) return false;
+    return this->dominates(from, to);
+}
+
+PostDominatorTree::PostDominatorTree(const Cfg &cfg) : cfg(cfg) {
+    int count = cfg.size();
+    this->exit = count;
+    this->ipdom.assign(count + 1, -1);
+    this->order.assign(count + 1, -1);
+
+    // depth first from the exit along reversed edges, the exit's are the rets
+    std::vector<int> postorder;
+    std::vector<std::pair<int, size_t> > stack;
+    stack.push_back(std::make_pair(count, 0));
+    this->order[count] = 0;
+    while (!stack.empty()) {
+        int block = stack.back().first;
+        const std::vector<int> &next = block == count ? cfg.exits : cfg.preds[block];
+        size_t at = stack.back().second;
+        if (at < next.size()) {
+            stack.back().second++;
+            if (this->order[next[at]] < 0) {
+                this->order[next[at]] = 0;
+                stack.push_back(std::make_pair(next[at], 0));
+            }
+            continue;
+        }
+        postorder.push_back(block);
+        stack.pop_back();
+    }
+    std::vector<int> rpo(postorder.rbegin(), postorder.rend());
+    for (size_t i = 0; i < rpo.size(); i++) this->order[rpo[i]] = i;
+
+    std::vector<bool> returns(count, false);
+    for (size_t i = 0; i < cfg.exits.size(); i++) returns[cfg.exits[i]] = true;
+
+    this->ipdom[count] = count;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); i++) {
+            int block = rpo[i];
+            int dominator = -1;
+            std::vector<int> succs = cfg.succs[block];
+            if (returns[block]) succs.push_back(count);
+            for (size_t j = 0; j < succs.size(); j++) {
+                int a = succs[j];
+                if (this->ipdom[a] < 0) continue;
+                if (dominator < 0) { dominator = a; continue; }
+                int b = dominator;
+                while (a != b) {
+                    while (this->order[a] > this->order[b]) a = this->ipdom[a];
+                    while (this->order[b] > this->order[a]) b = this->ipdom[b];
+                }
+                dominator = a;
+            }
+            if (dominator >= 0 && this->ipdom[block] != dominator) {
+                this->ipdom[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+    this->ipdom.pop_back();
+}
+
+bool Loop::contains(const Loop *other) const {
+    while (other != NULL && other != this) other = other->parent;
+    return other == this;
+}
+
+LoopForest::LoopForest(const Cfg &cfg, const DominatorTree &dominators) : cfg(cfg) {
+    int count = cfg.size();
+    this->loopOf.assign(count, NULL);
+    std::vector<int> mark(count, -1);
+
+    // headers in postorder, so a loop is found before any loop around it. the
+    // body is walked backward from the latches, and an inner loop already
+    // found stands in for all of its blocks through its header
+    for (int header = count - 1; header >= 0; header--) {
+        std::vector<int> work;
+        for (size_t i = 0; i < cfg.preds[header].size(); i++) {
+            int pred = cfg.preds[header][i];
+            if (dominators.dominates(header, pred)) work.push_back(pred);
+        }
+        if (work.empty()) continue;
+
+        Loop *loop = new Loop();
+        loop->header = header;
+        for (size_t i = 0; i < work.size(); i++) {
+            if (std::find(loop->latches.begin(), loop->latches.end(), work[i]) == loop->latches.end()) loop->latches.push_back(work[i]);
+        }
+        loop->blocks.push_back(header);
+        this->loopOf[header] = loop;
+        mark[header] = header;
+
+        while (!work.empty()) {
+            int block = work.back();
+            work.pop_back();
+            Loop *inner = this->loopOf[block];
+            if (inner != NULL) {
+                while (inner->parent != NULL) inner = inner->parent;
+                if (inner == loop) continue;
+                inner->parent = loop;
+                loop->children.push_back(inner);
+                loop->blocks.insert(loop->blocks.end(), inner->blocks.begin(), inner->blocks.end());
+                block = inner->header;
+                if (mark[block] == header) continue;
+                mark[block] = header;
+            }
+            else {
+                if (mark[block] == header) continue;
+                mark[block] = header;
+                this->loopOf[block] = loop;
+                loop->blocks.push_back(block);
+            }
+            for (size_t i = 0; i < cfg.preds[block].size(); i++) work.push_back(cfg.preds[block][i]);
+        }
+        this->loops.push_back(loop);
+    }
+
+    // outer loops were found last, so walking backward sets parents' depths first
+    for (int i = this->loops.size() - 1; i >= 0; i--) {
+        Loop *loop = this->loops[i];
+        if (loop->parent == NULL) {
+            loop->depth = 1;
+            this->roots.push_back(loop);
+        }
+        else loop->depth = loop->parent->depth + 1;
+    }
+}
+
+LoopForest::~LoopForest() {
+    for (size_t i = 0; i < this->loops.size(); i++) delete this->loops[i];
+}
+
+bool LoopForest::contains(const Loop *loop, int block) const {
+    return loop->contains(this->loopOf[block]);
+}
+
+std::vector<int> LoopForest::exits(const Loop *loop) const {
+    std::vector<int> found;
+    for (size_t i = 0; i < loop->blocks.size(); i++) {
+        const std::vector<int> &succs = this->cfg.succs[loop->blocks[i]];
+        for (size_t j = 0; j < succs.size(); j++) {
+            if (!this->contains(loop, succs[j]) && std::find(found.begin(), found.end(), succs[j]) == found.end()) found.push_back(succs[j]);
+        }
+    }
+    return found;
+}
+
+void solveDataflow(const Cfg &cfg, const DataflowProblem &problem, DataflowSolution &solution) {
+    int count = cfg.size();
+    bool forward = problem.forward;
+    solution.in.assign(count, Bitset(problem.bits, problem.intersection));
+    solution.out.assign(count, Bitset(problem.bits, problem.intersection));
+    solution.visits = 0;
+
+    // position p in the worklist is block p going forward and block count-1-p
+    // going backward, so scanning up the pending set follows the right order.
+    // a block whose result changes only re-queues its dependents, and the scan
+    // wraps around until nothing is pending
+    Bitset pending(count, true);
+    int cursor = 0;
+    while (true) {
+        int position = pending.findNext(cursor);
+        if (position < 0) position = pending.findNext(0);
+        if (position < 0) break;
+        pending.reset(position);
+        cursor = position + 1;
+
+        int block = forward ? position : count - 1 - position;
+        const std::vector<int> &sources = forward ? cfg.preds[block] : cfg.succs[block];
+        std::vector<Bitset> &flowing = forward ? solution.out : solution.in;
+        Bitset &meet = forward ? solution.in[block] : solution.out[block];
+        Bitset &result = forward ? solution.out[block] : solution.in[block];
+
+        if (sources.empty()) meet = problem.boundary;
+        else {
+            meet = flowing[sources[0]];
+            for (size_t i = 1; i < sources.size(); i++) {
+                if (problem.intersection) meet.intersectWith(flowing[sources[i]]);
+                else meet.unionWith(flowing[sources[i]]);
+            }
+        }
+        solution.visits++;
+        if (!result.transfer(problem.gen[block], meet, problem.kill[block])) continue;
+
+        const std::vector<int> &dependents = forward ? cfg.succs[block] : cfg.preds[block];
+        for (size_t i = 0; i < dependents.size(); i++) pending.set(forward ? dependents[i] : count - 1 - dependents[i]);
+    }
+}
+
+Liveness::Liveness(const Cfg &cfg, const std::vector<std::vector<Instruction*> > *reads) : cfg(cfg) {
+    Function *function = cfg.function;
+    this->numbers.assign(function->nextValueId, -1);
+
+    // only values used outside their own block, or by a phi, need a bit
+    for (int i = 0; i < cfg.size(); i++) {
+        std::list<Instruction*> &instructions = cfg.blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *value = *it;
+            if (value->type == IR_VOID) continue;
+            for (size_t j = 0; j < value->users.size(); j++) {
+                if (value->users[j]->op == OP_PHI || value->users[j]->block != value->block) {
+                    this->numbers[value->id] = this->values.size();
+                    this->values.push_back(value);
+                    break;
+                }
+            }
+        }
+    }
+
+    DataflowProblem problem;
+    problem.forward = false;
+    problem.bits = this->values.size();
+    problem.gen.assign(cfg.size(), Bitset(problem.bits));
+    problem.kill.assign(cfg.size(), Bitset(problem.bits));
+    problem.boundary.resize(problem.bits);
+
+    // phi operands used at the end of each block, added to the live out sets
+    // once solved since they needn't be live into the successor
+    std::vector<std::vector<int> > phiUses(cfg.size());
+    for (int i = 0; i < cfg.size(); i++) {
+        Block *block = cfg.blocks[i];
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            Instruction *instruction = *it;
+            int number = this->numberOf(instruction);
+            if (number >= 0) problem.kill[i].set(number);
+            const std::vector<Instruction*> &operands = reads != NULL && instruction->op != OP_PHI ? (*reads)[instruction->id] : instruction->operands;
+            for (size_t j = 0; j < operands.size(); j++) {
+                Instruction *operand = operands[j];
+                int used = this->numberOf(operand);
+                if (used < 0) continue;
+                if (instruction->op == OP_PHI) {
+                    int pred = cfg.indexOf(block->preds[j]);
+                    if (pred < 0) continue;
+                    phiUses[pred].push_back(used);
+                    if (operand->block != cfg.blocks[pred]) problem.gen[pred].set(used);
+                }
+                else if (operand->block != block) problem.gen[i].set(used);
+            }
+        }
+    }
+
+    solveDataflow(cfg, problem, this->solution);
+    for (int i = 0; i < cfg.size(); i++) {
+        for (size_t j = 0; j < phiUses[i].size(); j++) this->solution.out[i].set(phiUses[i][j]);
+    }
+}
+
+int Liveness::numberOf(Instruction *value) const {
+    if (value->id < 0 || value->id >= (int)this->numbers.size()) return -1;
+    int number = this->numbers[value->id];
+    return number >= 0 && this->values[number] == value ? number : -1;
+}
+
+bool Liveness::liveIn(int block, Instruction *value) const {
+    int number = this->numberOf(value);
+    return number >= 0 && this->solution.in[block].test(number);
+}
+
+bool Liveness::liveOut(int block, Instruction *value) const {
+    int number = this->numberOf(value);
+    return number >= 0 && this->solution.out[block].test(number);
+}
+
+ReachingStores::ReachingStores(const Cfg &cfg) : cfg(cfg) {
+    // stores grouped by the place they write
+    std::map<std::pair<Instruction*, long>, std::vector<int> > places;
+    std::vector<std::pair<Instruction*, long> > placeOf;
+    std::vector<int> blockOf;
+    for (int i = 0; i < cfg.size(); i++) {
+        std::list<Instruction*> &instructions = cfg.blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *store = *it;
+            if (store->op != OP_STORE) continue;
+            Instruction *address = store->operands[0];
+            std::pair<Instruction*, long> place(address, LONG_MIN);
+            if (address->op == OP_INDEX && address->operands[1]->isConstant()) {
+                place = std::make_pair(address->operands[0], (long)address->operands[1]->intValue);
+            }
+            places[place].push_back(this->stores.size());
+            placeOf.push_back(place);
+            blockOf.push_back(i);
+            this->stores.push_back(store);
+        }
+    }
+
+    DataflowProblem problem;
+    problem.bits = this->stores.size();
+    problem.gen.assign(cfg.size(), Bitset(problem.bits));
+    problem.kill.assign(cfg.size(), Bitset(problem.bits));
+    problem.boundary.resize(problem.bits);
+
+    std::map<std::pair<Instruction*, long>, Bitset> sets;
+    for (std::map<std::pair<Instruction*, long>, std::vector<int> >::iterator it = places.begin(); it != places.end(); it++) {
+        Bitset &set = sets[it->first];
+        set.resize(problem.bits);
+        for (size_t i = 0; i < it->second.size(); i++) set.set(it->second[i]);
+    }
+
+    // stores come in block order, so a later store to the same place replaces the earlier one's gen
+    for (size_t i = 0; i < this->stores.size(); i++) {
+        Bitset &same = sets[placeOf[i]];
+        problem.kill[blockOf[i]].unionWith(same);
+        problem.gen[blockOf[i]].subtract(same);
+        problem.gen[blockOf[i]].set(i);
+    }
+
+    solveDataflow(cfg, problem, this->solution);
+}
+
+CallGraph::CallGraph(Module *module) {
+    this->module = module;
+    int count = module->functions.size();
+    for (int i = 0; i < count; i++) this->numbers[module->functions[i]] = i;
+    this->callees.resize(count);
+    this->callSites.assign(count, 0);
+    this->component.assign(count, -1);
+    this->recursive.assign(count, false);
+    for (int i = 0; i < count; i++) {
+        Function *function = module->functions[i];
+        for (size_t j = 0; j < function->blocks.size(); j++) {
+            std::list<Instruction*> &instructions = function->blocks[j]->instructions;
+            for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+                if ((*it)->op != OP_CALL) continue;
+                int callee = this->indexOf(module->find((*it)->name));
+                if (callee < 0) continue;
+                this->callSites[callee]++;
+                if (callee == i) this->recursive[i] = true;
+                if (std::find(this->callees[i].begin(), this->callees[i].end(), callee) == this->callees[i].end()) this->callees[i].push_back(callee);
+            }
+        }
+    }
+
+    // tarjan's algorithm, which finishes each component after every one it
+    // reaches, so the order they finish in is callees first
+    std::vector<int> order(count, -1), low(count, 0), stack;
+    std::vector<bool> onStack(count, false);
+    std::vector<std::pair<int, size_t> > work;
+    int next = 0, components = 0;
+    for (int root = 0; root < count; root++) {
+        if (order[root] >= 0) continue;
+        work.push_back(std::make_pair(root, 0));
+        order[root] = low[root] = next++;
+        stack.push_back(root);
+        onStack[root] = true;
+        while (!work.empty()) {
+            int function = work.back().first;
+            size_t at = work.back().second;
+            if (at < this->callees[function].size()) {
+                work.back().second++;
+                int callee = this->callees[function][at];
+                if (order[callee] < 0) {
+                    order[callee] = low[callee] = next++;
+                    stack.push_back(callee);
+                    onStack[callee] = true;
+                    work.push_back(std::make_pair(callee, 0));
+                }
+                else if (onStack[callee]) low[function] = std::min(low[function], order[callee]);
+                continue;
+            }
+            work.pop_back();
+            if (!work.empty()) low[work.back().first] = std::min(low[work.back().first], low[function]);
+            if (low[function] != order[function]) continue;
+
+            int size = 0;
+            while (true) {
+                int member = stack.back();
+                stack.pop_back();
+                onStack[member] = false;
+                this->component[member] = components;
+                this->bottomUp.push_back(module->functions[member]);
+                size++;
+                if (member == function) break;
+            }
+            if (size > 1) {
+                for (int i = this->bottomUp.size() - size; i < (int)this->bottomUp.size(); i++) this->recursive[this->indexOf(this->bottomUp[i])] = true;
+            }
+            components++;
+        }
+    }
+}
+
+int CallGraph::indexOf(Function *function) const {
+    std::unordered_map<Function*, int>::const_iterator found = this->numbers.find(function);
+    return found == this->numbers.end() ? -1 : found->second;
+}
+
+MemoryRoots::MemoryRoots(Function *function) {
+    this->function = function;
+    if (function->module != NULL) {
+        for (size_t i = 0; i < function->module->globals.size(); i++) this->globals[function->module->globals[i].name] = this->count++;
+    }
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = function->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op == OP_ALLOCA) this->allocas[*it] = this->count++;
+        }
+    }
+
+    // an alloca escapes when its address, or an element's, is passed to a call
+    this->escaped.resize(this->count);
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = function->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op != OP_CALL) continue;
+            for (size_t j = 0; j < (*it)->operands.size(); j++) {
+                if ((*it)->operands[j]->type != IR_PTR) continue;
+                int root = this->rootOf((*it)->operands[j]);
+                if (root == ROOT_UNKNOWN) this->escaped.fill();
+                else if (root != ROOT_PARAMS && !this->isGlobal(root)) this->escaped.set(root);
+            }
+        }
+    }
+}
+
+int MemoryRoots::rootOf(Instruction *address) const {
+    while (address->op == OP_INDEX) address = address->operands[0];
+    if (address->op == OP_ALLOCA) {
+        std::unordered_map<Instruction*, int>::const_iterator found = this->allocas.find(address);
+        return found == this->allocas.end() ? ROOT_UNKNOWN : found->second;
+    }
+    if (address->op == OP_GLOBAL) {
+        std::map<std::string, int>::const_iterator found = this->globals.find(address->name);
+        return found == this->globals.end() ? ROOT_UNKNOWN : found->second;
+    }
+    if (address->op == OP_PARAM) return ROOT_PARAMS;
+    return ROOT_UNKNOWN;
+}
+
+// a pointer parameter can point into a global array, so an access to either
+// may be an access to the other
+void MemoryRoots::addAliases(Bitset &into, int root) const {
+    if (root == ROOT_UNKNOWN) {
+        into.fill();
+        return;
+    }
+    into.set(root);
+    if (root == ROOT_PARAMS) {
+        for (std::map<std::string, int>::const_iterator it = this->globals.begin(); it != this->globals.end(); it++) into.set(it->second);
+    }
+    else if (this->isGlobal(root)) into.set(ROOT_PARAMS);
+}
+
+void MemoryRoots::addCallEffects(Bitset &into, Instruction *call) const {
+    Function *callee = this->function->module == NULL ? NULL : this->function->module->find(call->name);
+    if (callee != NULL && callee->external) return;
+    this->addAliases(into, ROOT_PARAMS);
+    into.unionWith(this->escaped);
+}
@@ -0,0 +1,196 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bitset.h"
+#include "ir.h"
+
+// the blocks the entry reaches, in reverse postorder, with edges as positions
+// in that order. every analysis below indexes its results the same way, so a
+// block's number here is also its rpo number
+class Cfg {
+    std::vector<int> indexById; // by block id, -1 for unreachable blocks
+
+    public:
+        Function *function;
+        std::vector<Block*> blocks;            // blocks[0] is the entry
+        std::vector<std::vector<int> > succs;  // edges appear as often as the branches make them
+        std::vector<std::vector<int> > preds;  // in each block's preds order
+        std::vector<int> exits;                // blocks ending in ret
+
+        Cfg(Function *function);
+
+        int size() const { return blocks.size(); }
+        // -1 when the entry can't reach the block
+        int indexOf(Block *block) const;
+};
+
+// immediate dominators by cooper, harvey and kennedy's iteration over reverse
+// postorder, with the tree numbered depth first so dominance is two compares
+class DominatorTree {
+    std::vector<int> first, last; // preorder number of each block and of its last descendant
+
+    public:
+        const Cfg &cfg;
+        std::vector<int> idom;                    // the entry is its own
+        std::vector<std::vector<int> > children;
+        std::vector<int> depth;                   // 0 for the entry
+
+        DominatorTree(const Cfg &cfg);
+
+        bool dominates(int a, int b) const { return first[a] <= first[b] && first[b] <= last[a]; }
+        bool dominates(Block *a, Block *b) const;
+};
+
+// immediate postdominators, the same iteration run over the reversed edges
+// from a virtual exit that every ret leads to. blocks that never reach a ret,
+// such as an endless loop, have none
+class PostDominatorTree {
+    std::vector<int> order; // position of each block in the reversed graph's rpo, the exit first
+
+    public:
+        const Cfg &cfg;
+        int exit;                // cfg.size(), standing for the virtual exit
+        std::vector<int> ipdom;  // exit for blocks ending in ret, -1 for blocks that can't reach one
+
+        PostDominatorTree(const Cfg &cfg);
+
+        bool reachesExit(int block) const { return ipdom[block] >= 0; }
+};
+
+// a natural loop: the header and every block that reaches a back edge into it
+// without going through the header
+struct Loop {
+    int header;
+    Loop *parent = NULL;
+    std::vector<Loop*> children;
+    std::vector<int> blocks;  // header first, nested loops' blocks included
+    std::vector<int> latches; // sources of the back edges
+    int depth = 1;            // 1 for outermost loops
+
+    bool contains(const Loop *other) const;
+};
+
+// the loop nesting forest, loops with the same header merged into one. an
+// edge to a block that doesn't dominate its source isn't a back edge, so the
+// rare irreducible cycle simply isn't treated as a loop
+class LoopForest {
+    public:
+        const Cfg &cfg;
+        std::vector<Loop*> loops;  // inner loops before the loops holding them
+        std::vector<Loop*> roots;
+        std::vector<Loop*> loopOf; // innermost loop of each block, NULL outside every loop
+
+        LoopForest(const Cfg &cfg, const DominatorTree &dominators);
+        ~LoopForest();
+        LoopForest(const LoopForest&) = delete;
+        LoopForest &operator=(const LoopForest&) = delete;
+
+        int depth(int block) const { return loopOf[block] == NULL ? 0 : loopOf[block]->depth; }
+        bool contains(const Loop *loop, int block) const;
+        // blocks outside the loop that an edge leaves it for
+        std::vector<int> exits(const Loop *loop) const;
+};
+
+// a gen/kill problem over a cfg's blocks, out = gen | (in & ~kill) going
+// forward and in = gen | (out & ~kill) going backward
+struct DataflowProblem {
+    bool forward = true;
+    bool intersection = false;   // must problems meet by intersection, may problems by union
+    int bits = 0;
+    std::vector<Bitset> gen, kill;
+    Bitset boundary;             // what flows into the entry, or out of blocks without successors
+};
+
+struct DataflowSolution {
+    std::vector<Bitset> in, out; // at the top and the bottom of each block
+    long visits = 0;             // transfer functions applied, for benchmarks
+};
+
+// iterates to the fixpoint, taking pending blocks in reverse postorder going
+// forward and postorder going backward, so an acyclic function needs a
+// single pass and each loop costs about one more per level of nesting
+void solveDataflow(const Cfg &cfg, const DataflowProblem &problem, DataflowSolution &solution);
+
+// the values live at each block boundary. values that never cross one aren't
+// numbered at all, which keeps the sets small on long straight line code. a
+// phi's operand counts as used at the end of the predecessor it comes from.
+// given reads, by instruction id, each instruction other than a phi uses
+// those in place of its operands, the way code generation reads them
+class Liveness {
+    std::vector<int> numbers; // by value id, -1 for values that never cross a block
+
+    public:
+        const Cfg &cfg;
+        std::vector<Instruction*> values;
+        DataflowSolution solution;
+
+        Liveness(const Cfg &cfg, const std::vector<std::vector<Instruction*> > *reads = NULL);
+
+        int numberOf(Instruction *value) const;
+        bool liveIn(int block, Instruction *value) const;
+        bool liveOut(int block, Instruction *value) const;
+};
+
+// the stores that may reach each block boundary. a store only kills stores to
+// exactly the same place (the same address value, or the same constant element
+// of the same array), and calls kill nothing
+class ReachingStores {
+    public:
+        const Cfg &cfg;
+        std::vector<Instruction*> stores;
+        DataflowSolution solution;
+
+        ReachingStores(const Cfg &cfg);
+};
+
+// which functions call which, and the strongly connected components that
+// recursion forms. functions are numbered by their place in the module
+class CallGraph {
+    std::unordered_map<Function*, int> numbers;
+
+    public:
+        Module *module;
+        std::vector<std::vector<int> > callees; // distinct, by function
+        std::vector<int> callSites;             // calls to each function across the module
+        std::vector<int> component;             // functions share one only when they're mutually recursive
+        std::vector<bool> recursive;            // can end up calling itself
+        std::vector<Function*> bottomUp;        // callees before their callers, but for recursion
+
+        CallGraph(Module *module);
+
+        // -1 for a function outside the module
+        int indexOf(Function *function) const;
+};
+
+// memory split into roots that can't overlap: each global, each alloca, and
+// whatever pointer parameters reach, which may be a global array but never
+// one of this call's own allocas
+#define ROOT_PARAMS  0
+#define ROOT_UNKNOWN -1 // an address nothing can place, which may be anything
+
+class MemoryRoots {
+    std::map<std::string, int> globals;
+    std::unordered_map<Instruction*, int> allocas;
+
+    public:
+        Function *function;
+        int count = 1;  // ROOT_PARAMS, then globals, then allocas
+        Bitset escaped; // allocas whose address reaches a call
+
+        MemoryRoots(Function *function);
+
+        // the root an address lies in, following index back to the array it steps into
+        int rootOf(Instruction *address) const;
+        bool isGlobal(int root) const { return root >= 1 && root <= (int)globals.size(); }
+        // adds the roots an access to root may touch, itself included
+        void addAliases(Bitset &into, int root) const;
+        // adds the roots a call may read or write: nothing for runtime routines,
+        // otherwise globals, what pointer parameters reach and escaped allocas
+        void addCallEffects(Bitset &into, Instruction *call) const;
+};
+
+#endif
@@ -0,0 +1,615 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "analysis.h"
+#include "benchbackend.h"
+#include "driver.h"
+#include "generator.h"
+#include "ir.h"
+#include "parser.h"
+#include "perf.h"
+#include "scanner.h"
+#include "stats.h"
+#include "verify.h"
+
+#define BENCH_DEFAULT_FILE BUILD_DIR "bench.json"
+#define BENCH_THRESHOLD 10.0  // percent slower (or bigger) that counts as a regression
+#define BENCH_MIN_MS 300.0    // keep repeating a corpus until this much time is spent
+#define BENCH_MIN_RUNS 3
+
+// the generated corpus, each entry stresses a different dimension
+struct Corpus {
+    const char *name;
+    int procedures, statements, depth, expressionLength, identifiers, arraySize;
+};
+
+static const Corpus corpora[] = {
+    {"small",       4,  20,  3,  4,   8,  16},
+    {"medium",     32,  60,  3,  4,   8,  16},
+    {"large",      64, 120,  4,  4,   8,  16},
+    {"wide-expr",  16,  40,  3, 32,   8,  16},
+    {"deep-nest",  16,  80, 10,  4,   8,  16},
+    {"many-names", 16,  40,  3,  4, 200,  16},
+};
+
+// synthetic ir functions for the dataflow analyses, to see how they grow with block count
+struct SolverCorpus {
+    const char *name;
+    int blocks;
+};
+
+static const SolverCorpus solverCorpora[] = {
+    {"solver-1k",   1024},
+    {"solver-4k",   4096},
+    {"solver-16k", 16384},
+    {"solver-32k", 32768},
+};
+
+// generated programs taken through lowering, the -O2 pipeline and code generation
+// everything else is the generator's default, so backend-big is exactly the
+// program "gen -procs 64 -statements 120" writes
+struct BackendCorpus {
+    const char *name;
+    int procedures, statements;
+};
+
+static const BackendCorpus backendCorpora[] = {
+    {"backend-medium", 32,  60},
+    {"backend-big",    64, 120},
+};
+
+// programs from the tests compiled for native code and run in the bench
+// process, each timed with its loops vectorized and with them kept scalar
+struct RunCorpus {
+    const char *name;
+    const char *path;  // relative to src, where bench is run from like compile
+    const char *input; // what the program reads
+    bool fastMath;
+};
+
+static const RunCorpus runCorpora[] = {
+    {"run-arraysum",   "../test/correct/arraySum.src", "1000\n", false},
+    {"run-saxpy",      "../test/correct/saxpy.src",    "1000\n", false},
+    {"run-saxpy-fast", "../test/correct/saxpy.src",    "1000\n", true},
+};
+
+// the metrics where bigger is worse, and so can regress
+// instruction counts only exist with -perf and are far steadier than times
+static const char *costMetrics[] = {"scanMs", "parseMs", "printMs", "totalMs", "peakRssKb",
+    "scanInstructions", "parseInstructions", "printInstructions",
+    "cfgMs", "dominatorMs", "loopMs", "livenessMs", "reachingMs",
+    "lowerMs", "optimizeMs", "iselMs", "regallocMs", "emitMs", "encodeMs", "codeBytes", "vectorUs"};
+
+static const char *phaseNames[] = {"scan", "parse", "print"};
+static bool usePerf = false;
+
+// a single scan, parse and tree print, the same work compile does minus file output
+// with counters, each phase's hardware counts land in the matching sample
+static void compileOnce(std::string &source, double &scanMs, double &parseMs, double &printMs, long &tokens,
+    PerfSample *counters = NULL) {
+    char name[] = "bench.src";
+    PerfSample before;
+
+    if (counters != NULL) before = perfCounters().read();
+    double start = wallClockMs();
+    scan.init(name, source, false);
+    int nextWord = 0;
+    while (nextWord != T_EOF) nextWord = scan.getNextToken();
+    std::list<Word> words = scan.getWordList();
+    double scanned = wallClockMs();
+    if (counters != NULL) {
+        counters[0] = perfDelta(before, perfCounters().read());
+        before = perfCounters().read();
+    }
+
+    Parser parser = Parser(words, scan.getSymbolTable(), false);
+    parser.parse();
+    double parsed = wallClockMs();
+    if (counters != NULL) {
+        counters[1] = perfDelta(before, perfCounters().read());
+        before = perfCounters().read();
+    }
+
+    std::ostringstream treeOut;
+    parser.printTree(treeOut);
+    double printed = wallClockMs();
+    if (counters != NULL) counters[2] = perfDelta(before, perfCounters().read());
+
+    scanMs = scanned - start;
+    parseMs = parsed - scanned;
+    printMs = printed - parsed;
+    tokens = words.size();
+}
+
+// runs in a forked child, so peak RSS belongs to this corpus alone
+static Metrics measure(const Corpus &corpus) {
+    GeneratorOptions options;
+    options.name = "Bench";
+    options.procedures = corpus.procedures;
+    options.statements = corpus.statements;
+    options.depth = corpus.depth;
+    options.expressionLength = corpus.expressionLength;
+    options.identifiers = corpus.identifiers;
+    options.arraySize = corpus.arraySize;
+    std::string source = generateProgram(options);
+
+    // the scanner and parser report progress on cout
+    std::cout.rdbuf(NULL);
+
+    Metrics metrics;
+    double scanMs, parseMs, printMs;
+    long tokens;
+    long nodes = hotCounters.nodes;
+    PerfSample counters[3];
+    bool counting = usePerf && perfCounters().open();
+    compileOnce(source, scanMs, parseMs, printMs, tokens, counting ? counters : NULL);
+    nodes = hotCounters.nodes - nodes;
+
+    // counters come from the first compile, cold caches included like a real one
+    for (int phase = 0; phase < 3 && counting; phase++) {
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            if (counters[phase].values[i] < 0) continue;
+            std::string name = PerfCounters::names[i];
+            name[0] = toupper(name[0]);
+            metrics[phaseNames[phase] + name] = counters[phase].values[i];
+        }
+    }
+
+    // the parse tree is never freed, so take the peak after exactly one compile
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    metrics["peakRssKb"] = usage.ru_maxrss;
+
+    // best of several runs, the least disturbed by everything else on the machine
+    int runs = 1;
+    double spent = scanMs + parseMs + printMs;
+    while (runs < BENCH_MIN_RUNS || spent < BENCH_MIN_MS) {
+        double s, p, t;
+        compileOnce(source, s, p, t, tokens);
+        if (s < scanMs) scanMs = s;
+        if (p < parseMs) parseMs = p;
+        if (t < printMs) printMs = t;
+        spent += s + p + t;
+        runs++;
+    }
+
+    metrics["bytes"] = source.size();
+    metrics["tokens"] = tokens;
+    metrics["nodes"] = nodes;
+    metrics["runs"] = runs;
+    metrics["scanMs"] = scanMs;
+    metrics["parseMs"] = parseMs;
+    metrics["printMs"] = printMs;
+    metrics["totalMs"] = scanMs + parseMs + printMs;
+    metrics["scanMBPerSec"] = source.size() / 1048576.0 / (scanMs / 1000.0);
+    metrics["scanTokensPerSec"] = tokens / (scanMs / 1000.0);
+    metrics["parseTokensPerSec"] = tokens / (parseMs / 1000.0);
+    return metrics;
+}
+
+// builds a function of about the requested number of blocks out of straight
+// runs, if/else diamonds and loops nested up to four deep. operands are mostly
+// recent values but now and then ones defined far back, so some live ranges
+// span most of the function, and stores go to a handful of array elements
+class SolverFunction {
+    Function *function;
+    unsigned state;
+    std::vector<Instruction*> values; // those dominating the block being filled
+    std::vector<Instruction*> slots;
+
+    int random(int range) {
+        this->state ^= this->state << 13;
+        this->state ^= this->state >> 17;
+        this->state ^= this->state << 5;
+        return this->state % range;
+    }
+
+    Instruction *operand() {
+        if (this->random(4) == 0) return this->values[this->random(this->values.size())];
+        int window = this->values.size() < 16 ? this->values.size() : 16;
+        return this->values[this->values.size() - 1 - this->random(window)];
+    }
+
+    Instruction *binary(Block *block, int op, int type) {
+        Instruction *result = block->append(this->function->create(op, type));
+        result->addOperand(this->operand());
+        result->addOperand(this->operand());
+        return result;
+    }
+
+    void store(Block *block, Instruction *value) {
+        Instruction *store = block->append(this->function->create(OP_STORE, IR_VOID));
+        store->elemType = IR_INT;
+        store->addOperand(this->slots[this->random(this->slots.size())]);
+        store->addOperand(value);
+    }
+
+    // fills about budget blocks starting with at, returns the block control leaves by
+    Block *region(Block *at, int budget, int depth) {
+        while (budget > 0) {
+            int shape = this->random(depth < 4 && budget > 4 ? 3 : 2);
+            if (shape == 0) {
+                this->values.push_back(this->binary(at, OP_ADD, IR_INT));
+                Block *next = this->function->addBlock();
+                this->function->branch(at, next);
+                at = next;
+                budget -= 1;
+            }
+            else if (shape == 1) {
+                Block *left = this->function->addBlock(), *right = this->function->addBlock(), *join = this->function->addBlock();
+                this->function->condBranch(at, this->binary(at, OP_LT, IR_BOOL), left, right);
+                Instruction *leftValue = this->binary(left, OP_ADD, IR_INT);
+                this->store(left, leftValue);
+                this->function->branch(left, join);
+                Instruction *rightValue = this->binary(right, OP_SUB, IR_INT);
+                this->function->branch(right, join);
+                Instruction *phi = join->append(this->function->create(OP_PHI, IR_INT));
+                phi->addOperand(leftValue);
+                phi->addOperand(rightValue);
+                this->values.push_back(phi);
+                at = join;
+                budget -= 3;
+            }
+            else {
+                Block *header = this->function->addBlock(), *body = this->function->addBlock(), *exit = this->function->addBlock();
+                Instruction *start = this->operand();
+                this->function->branch(at, header);
+                Instruction *counter = header->append(this->function->create(OP_PHI, IR_INT));
+                counter->addOperand(start);
+                size_t outside = this->values.size();
+                this->values.push_back(counter);
+                this->function->condBranch(header, this->binary(header, OP_LT, IR_BOOL), body, exit);
+
+                int inner = 1 + this->random(budget / 2);
+                Block *latch = this->region(body, inner, depth + 1);
+                Instruction *step = this->binary(latch, OP_ADD, IR_INT);
+                this->store(latch, step);
+                this->function->branch(latch, header);
+                counter->addOperand(step);
+
+                this->values.resize(outside + 1);
+                at = exit;
+                budget -= 3 + inner;
+            }
+        }
+        return at;
+    }
+
+    public:
+        SolverFunction(Module &module, int blocks, unsigned seed) {
+            this->state = seed;
+            this->function = module.addFunction("solver", IR_VOID);
+            this->function->paramTypes = {IR_INT, IR_INT};
+            this->function->paramNames = {"A", "B"};
+            Block *entry = this->function->addBlock();
+            for (int i = 0; i < 2; i++) {
+                Instruction *param = entry->append(this->function->create(OP_PARAM, IR_INT));
+                param->intValue = i;
+                this->values.push_back(param);
+            }
+            Instruction *array = entry->append(this->function->create(OP_ALLOCA, IR_PTR));
+            array->elemType = IR_INT;
+            array->intValue = 8;
+            for (int i = 0; i < 8; i++) {
+                Instruction *index = entry->append(this->function->create(OP_CONST, IR_INT));
+                index->intValue = i;
+                Instruction *slot = entry->append(this->function->create(OP_INDEX, IR_PTR));
+                slot->elemType = IR_INT;
+                slot->addOperand(array);
+                slot->addOperand(index);
+                this->slots.push_back(slot);
+            }
+            Block *last = this->region(entry, blocks - 1, 0);
+            last->append(this->function->create(OP_RET, IR_VOID));
+        }
+
+        Function *get() { return this->function; }
+};
+
+// runs in a forked child like measure, timing each analysis on its own
+static Metrics measureSolver(const SolverCorpus &corpus) {
+    Module module;
+    Function *function = SolverFunction(module, corpus.blocks, 0x9e3779b9u).get();
+    Metrics metrics;
+    if (!verifyFunction(function, std::cerr)) return metrics;
+
+    double cfgMs = 0, dominatorMs = 0, loopMs = 0, livenessMs = 0, reachingMs = 0, spent = 0;
+    int runs = 0;
+    while (runs < BENCH_MIN_RUNS || spent < BENCH_MIN_MS) {
+        double start = wallClockMs();
+        Cfg cfg(function);
+        double built = wallClockMs();
+        DominatorTree dominators(cfg);
+        double dominated = wallClockMs();
+        LoopForest loops(cfg, dominators);
+        double nested = wallClockMs();
+        Liveness liveness(cfg);
+        double live = wallClockMs();
+        ReachingStores reaching(cfg);
+        double reached = wallClockMs();
+
+        if (runs == 0 || built - start < cfgMs) cfgMs = built - start;
+        if (runs == 0 || dominated - built < dominatorMs) dominatorMs = dominated - built;
+        if (runs == 0 || nested - dominated < loopMs) loopMs = nested - dominated;
+        if (runs == 0 || live - nested < livenessMs) livenessMs = live - nested;
+        if (runs == 0 || reached - live < reachingMs) reachingMs = reached - live;
+        spent += reached - start;
+        if (runs++ > 0) continue;
+
+        metrics["blocks"] = cfg.size();
+        metrics["instructions"] = function->instructionCount();
+        metrics["loops"] = loops.loops.size();
+        metrics["values"] = liveness.values.size();
+        metrics["stores"] = reaching.stores.size();
+        metrics["livenessPasses"] = (double)liveness.solution.visits / cfg.size();
+        metrics["reachingPasses"] = (double)reaching.solution.visits / cfg.size();
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    metrics["peakRssKb"] = usage.ru_maxrss;
+    metrics["runs"] = runs;
+    metrics["cfgMs"] = cfgMs;
+    metrics["dominatorMs"] = dominatorMs;
+    metrics["loopMs"] = loopMs;
+    metrics["livenessMs"] = livenessMs;
+    metrics["reachingMs"] = reachingMs;
+    return metrics;
+}
+
+// runs in a forked child like measure
+static Metrics measureBackend(const BackendCorpus &corpus) {
+    GeneratorOptions options;
+    options.procedures = corpus.procedures;
+    options.statements = corpus.statements;
+    std::string source = generateProgram(options);
+
+    // the scanner, parser and lowering report progress on cout
+    std::cout.rdbuf(NULL);
+    return timeBackend(source, BENCH_MIN_RUNS, BENCH_MIN_MS);
+}
+
+// runs in a forked child like measure, reading the input from a file it
+// rewinds and writing the program's output nowhere
+static Metrics measureRun(const RunCorpus &corpus) {
+    std::ifstream file(corpus.path);
+    if (!file) return Metrics();
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    FILE *input = tmpfile();
+    if (input == NULL || fputs(corpus.input, input) < 0 || fflush(input) != 0) return Metrics();
+    if (dup2(fileno(input), STDIN_FILENO) < 0 || freopen("/dev/null", "w", stdout) == NULL) return Metrics();
+
+    std::cout.rdbuf(NULL);
+    return timeNativeRun(source, corpus.fastMath, BENCH_MIN_RUNS, BENCH_MIN_MS);
+}
+
+// one line per corpus, so a baseline can be read back a line at a time
+static std::string metricsJson(std::string name, Metrics &metrics) {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\"name\": " << jsonString(name);
+    for (auto const &metric : metrics) out << ", " << jsonString(metric.first) << ": " << metric.second;
+    out << "}";
+    return out.str();
+}
+
+// reads back a line metricsJson wrote
+static bool parseMetrics(std::string line, std::string &name, Metrics &metrics) {
+    size_t at = line.find("{\"name\": \"");
+    if (at == std::string::npos) return false;
+    at += 10;
+    size_t end = line.find('"', at);
+    if (end == std::string::npos) return false;
+    name = line.substr(at, end - at);
+
+    while ((at = line.find(", \"", end)) != std::string::npos) {
+        at += 3;
+        end = line.find('"', at);
+        if (end == std::string::npos || line.compare(end, 3, "\": ") != 0) break;
+        std::string key = line.substr(at, end - at);
+        metrics[key] = strtod(line.c_str() + end + 3, NULL);
+    }
+    return true;
+}
+
+// forks a child to take the measurements and reads its metrics line back
+static bool runIsolated(std::string name, std::function<Metrics()> measurement, Metrics &metrics) {
+    int results[2];
+    if (pipe(results) != 0) return false;
+    std::cout.flush();
+
+    pid_t child = fork();
+    if (child < 0) return false;
+    if (child == 0) {
+        close(results[0]);
+        Metrics measured = measurement();
+        if (measured.empty()) _exit(1);
+        std::string line = metricsJson(name, measured) + "\n";
+        ssize_t written = write(results[1], line.data(), line.size());
+        _exit(written == (ssize_t)line.size() ? 0 : 1);
+    }
+
+    close(results[1]);
+    std::string line;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(results[0], buffer, sizeof(buffer))) > 0) line.append(buffer, got);
+    close(results[0]);
+    int status;
+    waitpid(child, &status, 0);
+
+    std::string measured;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && parseMetrics(line, measured, metrics);
+}
+
+static std::map<std::string, Metrics> readBaseline(std::string path) {
+    std::map<std::string, Metrics> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string name;
+        Metrics metrics;
+        if (parseMetrics(line, name, metrics)) baseline[name] = metrics;
+    }
+    return baseline;
+}
+
+// prints each cost metric against the baseline, returns how many regressed
+static int compare(std::string name, Metrics &now, std::map<std::string, Metrics> &baseline, double threshold) {
+    if (baseline.count(name) == 0) {
+        std::cout << "  " << name << ": not in the baseline\n";
+        return 0;
+    }
+    Metrics &before = baseline[name];
+    int regressions = 0;
+    for (const char *metric : costMetrics) {
+        if (before.count(metric) == 0 || before[metric] <= 0.0) continue;
+        double change = (now[metric] - before[metric]) / before[metric] * 100.0;
+        bool regressed = change > threshold;
+        if (regressed) regressions++;
+        printf("  %-11s %-10s %12.3f -> %12.3f  %+7.1f%%%s\n", name.c_str(), metric,
+            before[metric], now[metric], change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+// the counter metrics of one phase on a line, if there are any
+static void printCounters(Metrics &metrics) {
+    for (const char *phase : phaseNames) {
+        std::string line = "";
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            std::string name = PerfCounters::names[i];
+            std::string key = phase + std::string(1, toupper(name[0])) + name.substr(1);
+            if (metrics.count(key) == 0) continue;
+            char value[64];
+            snprintf(value, sizeof(value), " %s %.0f", name.c_str(), metrics[key]);
+            line += value;
+        }
+        if (line != "") printf("  %-6s%s\n", phase, line.c_str());
+    }
+}
+
+// bench [-o file] [-compare baseline] [-threshold percent] [-perf]
+// measures every corpus, writes the results as json and optionally compares
+// them against an earlier run, exiting 1 when anything regressed
+int main(int argc, char **argv) {
+    std::string outputPath = BENCH_DEFAULT_FILE;
+    std::string baselinePath = "";
+    double threshold = BENCH_THRESHOLD;
+    bool explicitOutput = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+            explicitOutput = true;
+        }
+        else if (strcmp(argv[i], "-compare") == 0 && i + 1 < argc) baselinePath = argv[++i];
+        else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "-perf") == 0) usePerf = true;
+        else {
+            std::cout << "usage: bench [-o file] [-compare baseline.json] [-threshold percent] [-perf]\n";
+            return 1;
+        }
+    }
+
+    // comparing leaves the baseline alone unless told where to write
+    if (baselinePath != "" && !explicitOutput) outputPath = "";
+
+    std::map<std::string, Metrics> baseline;
+    if (baselinePath != "") {
+        baseline = readBaseline(baselinePath);
+        if (baseline.empty()) {
+            std::cout << "No benchmark results found in " << baselinePath << "\n";
+            return 1;
+        }
+    }
+
+    // checked up front so the reason is printed once, children open their own
+    if (usePerf) {
+        PerfCounters probe;
+        if (!probe.open()) std::cout << "Performance counters unavailable, " << probe.unavailableReason << "\n";
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"compilerVersion\": " << jsonString(COMPILER_VERSION) << ",\n  \"corpora\": [\n";
+    int regressions = 0;
+    bool first = true;
+    for (const Corpus &corpus : corpora) {
+        Metrics metrics;
+        if (!runIsolated(corpus.name, [&corpus]() { return measure(corpus); }, metrics)) {
+            std::cout << "Benchmark of " << corpus.name << " failed\n";
+            return 1;
+        }
+        printf("%-11s %8.0f tokens  scan %8.3f ms (%6.1f MB/s)  parse %8.3f ms (%10.0f tokens/s)  print %7.3f ms  peak %7.0f KB\n",
+            corpus.name, metrics["tokens"], metrics["scanMs"], metrics["scanMBPerSec"],
+            metrics["parseMs"], metrics["parseTokensPerSec"], metrics["printMs"], metrics["peakRssKb"]);
+        printCounters(metrics);
+        if (baselinePath != "") regressions += compare(corpus.name, metrics, baseline, threshold);
+
+        json << (first ? "" : ",\n") << "    " << metricsJson(corpus.name, metrics);
+        first = false;
+    }
+    for (const SolverCorpus &corpus : solverCorpora) {
+        Metrics metrics;
+        if (!runIsolated(corpus.name, [&corpus]() { return measureSolver(corpus); }, metrics)) {
+            std::cout << "Benchmark of " << corpus.name << " failed\n";
+            return 1;
+        }
+        printf("%-11s %8.0f blocks %6.0f live values  cfg %7.3f ms  dominators %7.3f ms  loops %7.3f ms  liveness %8.3f ms (%4.2f passes)  reaching %8.3f ms (%4.2f passes)  peak %7.0f KB\n",
+            corpus.name, metrics["blocks"], metrics["values"], metrics["cfgMs"], metrics["dominatorMs"], metrics["loopMs"],
+            metrics["livenessMs"], metrics["livenessPasses"], metrics["reachingMs"], metrics["reachingPasses"], metrics["peakRssKb"]);
+        if (baselinePath != "") regressions += compare(corpus.name, metrics, baseline, threshold);
+
+        json << ",\n    " << metricsJson(corpus.name, metrics);
+    }
+    for (const BackendCorpus &corpus : backendCorpora) {
+        Metrics metrics;
+        if (!runIsolated(corpus.name, [&corpus]() { return measureBackend(corpus); }, metrics)) {
+            std::cout << "Benchmark of " << corpus.name << " failed\n";
+            return 1;
+        }
+        printf("%-14s %7.0f ir instructions  lower %8.3f ms  optimize %9.3f ms  isel %8.3f ms  regalloc %9.3f ms  emit %8.3f ms  encode %8.3f ms  %6.0f of %6.0f values spilled  %8.0f code bytes  peak %7.0f KB\n",
+            corpus.name, metrics["irInstructions"], metrics["lowerMs"], metrics["optimizeMs"], metrics["iselMs"],
+            metrics["regallocMs"], metrics["emitMs"], metrics["encodeMs"], metrics["spilled"], metrics["values"],
+            metrics["codeBytes"], metrics["peakRssKb"]);
+        if (baselinePath != "") regressions += compare(corpus.name, metrics, baseline, threshold);
+
+        json << ",\n    " << metricsJson(corpus.name, metrics);
+    }
+    for (const RunCorpus &corpus : runCorpora) {
+        Metrics metrics;
+        if (!runIsolated(corpus.name, [&corpus]() { return measureRun(corpus); }, metrics)) {
+            std::cout << "Benchmark of " << corpus.name << " failed\n";
+            return 1;
+        }
+        printf("%-14s vectorized %8.3f us  scalar %8.3f us  %5.2fx  %6.0f and %6.0f code bytes\n",
+            corpus.name, metrics["vectorUs"], metrics["scalarUs"], metrics["speedup"],
+            metrics["vectorCodeBytes"], metrics["scalarCodeBytes"]);
+        if (baselinePath != "") regressions += compare(corpus.name, metrics, baseline, threshold);
+
+        json << ",\n    " << metricsJson(corpus.name, metrics);
+    }
+    json << "\n  ]\n}\n";
+
+    if (outputPath != "") {
+        std::ofstream out(outputPath, std::ofstream::out | std::ofstream::trunc);
+        out << json.str();
+        std::cout << "Wrote benchmark results to \"" << outputPath << "\"\n";
+    }
+    if (baselinePath != "") {
+        std::cout << regressions << " regression(s) beyond " << threshold << "%\n";
+        if (regressions > 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstdio>
+#include <sstream>
+#include <sys/resource.h>
+#include "benchbackend.h"
+#include "codegen.h"
+#include "elfobject.h"
+#include "jit.h"
+#include "lower.h"
+#include "parser.h"
+#include "passmanager.h"
+#include "scanner.h"
+#include "stats.h"
+
+// the source is parsed once, then each run lowers it again, since the
+// passes change the module they are given
+Metrics timeBackend(std::string source, int minRuns, double minMs) {
+    Metrics metrics;
+    char name[] = "bench.src";
+    scan.init(name, source, false);
+    int nextWord = 0;
+    while (nextWord != T_EOF) nextWord = scan.getNextToken();
+    std::list<Word> words = scan.getWordList();
+    Parser parser = Parser(words, scan.getSymbolTable(), false);
+    parser.parse();
+    if (parser.errorCount() > 0) return metrics;
+
+    double lowerMs = 0, optimizeMs = 0, iselMs = 0, regallocMs = 0, emitMs = 0, encodeMs = 0, spent = 0;
+    int runs = 0;
+    while (runs < minRuns || spent < minMs) {
+        PassManager passManager;
+        std::string unknown;
+        passManager.setPipeline(pipelines[2], unknown);
+        std::ostringstream problems;
+        SelectionStats selection;
+        RegisterStats registers;
+        EncodeStats encoding;
+        MachineCode code(encoding);
+        std::string undefined;
+
+        double start = wallClockMs();
+        Module *module = lowerProgram(parser.getTree(), false);
+        if (module == NULL) return Metrics();
+        double lowered = wallClockMs();
+        bool valid = passManager.run(module, problems);
+        double optimized = wallClockMs();
+        if (valid) generateCode(module, code, true, true, selection, registers);
+        double generated = wallClockMs();
+        bool finished = valid && code.finish(undefined);
+        std::string object = finished ? writeObject(code) : "";
+        double encoded = wallClockMs();
+
+        int instructions = 0;
+        for (Function *function : module->functions) instructions += function->instructionCount();
+        delete module;
+        if (!finished) return Metrics();
+
+        // code generation is selection, allocation and writing out what they chose
+        double emitted = generated - optimized - selection.ms - registers.ms;
+        if (runs == 0 || lowered - start < lowerMs) lowerMs = lowered - start;
+        if (runs == 0 || optimized - lowered < optimizeMs) optimizeMs = optimized - lowered;
+        if (runs == 0 || selection.ms < iselMs) iselMs = selection.ms;
+        if (runs == 0 || registers.ms < regallocMs) regallocMs = registers.ms;
+        if (runs == 0 || emitted < emitMs) emitMs = emitted;
+        if (runs == 0 || encoded - generated < encodeMs) encodeMs = encoded - generated;
+        spent += encoded - start;
+        if (runs++ > 0) continue;
+
+        metrics["bytes"] = source.size();
+        metrics["irInstructions"] = instructions;
+        metrics["machineInstructions"] = encoding.instructions;
+        metrics["codeBytes"] = encoding.bytes;
+        metrics["objectBytes"] = object.size();
+        metrics["values"] = registers.values;
+        metrics["spilled"] = registers.spilled;
+        metrics["spillStores"] = registers.stores;
+        metrics["reloads"] = registers.reloads;
+        metrics["folded"] = selection.folded;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    metrics["peakRssKb"] = usage.ru_maxrss;
+    metrics["runs"] = runs;
+    metrics["lowerMs"] = lowerMs;
+    metrics["optimizeMs"] = optimizeMs;
+    metrics["iselMs"] = iselMs;
+    metrics["regallocMs"] = regallocMs;
+    metrics["emitMs"] = emitMs;
+    metrics["encodeMs"] = encodeMs;
+    return metrics;
+}
+
+// the object for the lowered program, empty when it doesn't compile
+static std::string nativeObject(Node *tree, bool fastMath, bool vectors, int &codeBytes) {
+    PassManager passManager;
+    std::string unknown, undefined;
+    passManager.setPipeline(pipelines[2], unknown);
+    passManager.fastMath = fastMath;
+    passManager.vectors = vectors;
+    std::ostringstream problems;
+    SelectionStats selection;
+    RegisterStats registers;
+    EncodeStats encoding;
+    MachineCode code(encoding);
+
+    Module *module = lowerProgram(tree, false);
+    if (module == NULL) return "";
+    bool valid = passManager.run(module, problems);
+    if (valid) generateCode(module, code, true, true, selection, registers);
+    delete module;
+    if (!valid || !code.finish(undefined)) return "";
+    codeBytes = encoding.bytes;
+    return writeObject(code);
+}
+
+Metrics timeNativeRun(std::string source, bool fastMath, int minRuns, double minMs) {
+    Metrics metrics;
+    char name[] = "bench.src";
+    scan.init(name, source, false);
+    int nextWord = 0;
+    while (nextWord != T_EOF) nextWord = scan.getNextToken();
+    std::list<Word> words = scan.getWordList();
+    Parser parser = Parser(words, scan.getSymbolTable(), false);
+    parser.parse();
+    if (parser.errorCount() > 0) return metrics;
+
+    const char *names[] = {"vector", "scalar"};
+    double best[2] = {0, 0};
+    for (int vectors = 0; vectors < 2; vectors++) {
+        int codeBytes = 0;
+        std::string object = nativeObject(parser.getTree(), fastMath, vectors == 0, codeBytes);
+        JitProgram program;
+        if (object.empty() || !program.load(object)) return Metrics();
+        metrics[names[vectors] + std::string("CodeBytes")] = codeBytes;
+
+        double spent = 0;
+        for (int runs = 0; runs < minRuns || spent < minMs; runs++) {
+            rewind(stdin);
+            if (!program.run()) return Metrics();
+            if (runs == 0 || program.ms < best[vectors]) best[vectors] = program.ms;
+            spent += program.ms;
+        }
+    }
+    // a run takes microseconds, which milliseconds to three places would round away
+    metrics["vectorUs"] = best[0] * 1000.0;
+    metrics["scalarUs"] = best[1] * 1000.0;
+    metrics["speedup"] = best[0] > 0 ? best[1] / best[0] : 0;
+    return metrics;
+}
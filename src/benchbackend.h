@@ -0,0 +1,23 @@
+#ifndef BENCHBACKEND_H
+#define BENCHBACKEND_H
+
+#include <map>
+#include <string>
+
+// one corpus' numbers, kept as name/value pairs so baselines compare generically
+typedef std::map<std::string, double> Metrics;
+
+// takes source through lowering, the -O2 pipeline, instruction selection,
+// register allocation and encoding, keeping the best time of each over at
+// least minRuns runs and minMs ms of them, empty if it doesn't compile.
+// apart from bench.cpp, since the process headers it needs name glibc's
+// ucontext registers the same as the allocator's
+Metrics timeBackend(std::string source, int minRuns, double minMs);
+
+// compiles source at -O2 for native code twice, with loops vectorized and
+// kept scalar, loads both into this process and times each one's main the
+// same way, stdin rewound before every run. empty if it doesn't compile or
+// a run stops with a runtime error
+Metrics timeNativeRun(std::string source, bool fastMath, int minRuns, double minMs);
+
+#endif
@@ -0,0 +1,88 @@
+//  recursive descent compiler by Andrew Miller
+
+#include "bitset.h"
+
+void Bitset::resize(int size, bool full) {
+    this->bits = size;
+    this->words.assign((size + 63) / 64, full ? ~(uint64_t)0 : 0);
+    if (full && (size & 63) != 0) this->words.back() = ((uint64_t)1 << (size & 63)) - 1;
+}
+
+void Bitset::clear() {
+    for (size_t i = 0; i < this->words.size(); i++) this->words[i] = 0;
+}
+
+void Bitset::fill() {
+    this->resize(this->bits, true);
+}
+
+bool Bitset::unionWith(const Bitset &other) {
+    uint64_t changed = 0;
+    for (size_t i = 0; i < this->words.size(); i++) {
+        uint64_t merged = this->words[i] | other.words[i];
+        changed |= merged ^ this->words[i];
+        this->words[i] = merged;
+    }
+    return changed != 0;
+}
+
+bool Bitset::intersectWith(const Bitset &other) {
+    uint64_t changed = 0;
+    for (size_t i = 0; i < this->words.size(); i++) {
+        uint64_t merged = this->words[i] & other.words[i];
+        changed |= merged ^ this->words[i];
+        this->words[i] = merged;
+    }
+    return changed != 0;
+}
+
+bool Bitset::subtract(const Bitset &other) {
+    uint64_t changed = 0;
+    for (size_t i = 0; i < this->words.size(); i++) {
+        uint64_t merged = this->words[i] & ~other.words[i];
+        changed |= merged ^ this->words[i];
+        this->words[i] = merged;
+    }
+    return changed != 0;
+}
+
+bool Bitset::transfer(const Bitset &gen, const Bitset &in, const Bitset &kill) {
+    uint64_t changed = 0;
+    for (size_t i = 0; i < this->words.size(); i++) {
+        uint64_t result = gen.words[i] | (in.words[i] & ~kill.words[i]);
+        changed |= result ^ this->words[i];
+        this->words[i] = result;
+    }
+    return changed != 0;
+}
+
+int Bitset::count() const {
+    int total = 0;
+    for (size_t i = 0; i < this->words.size(); i++) total += __builtin_popcountll(this->words[i]);
+    return total;
+}
+
+bool Bitset::empty() const {
+    for (size_t i = 0; i < this->words.size(); i++) {
+        if (this->words[i] != 0) return false;
+    }
+    return true;
+}
+
+bool Bitset::intersects(const Bitset &other) const {
+    for (size_t i = 0; i < this->words.size(); i++) {
+        if ((this->words[i] & other.words[i]) != 0) return true;
+    }
+    return false;
+}
+
+int Bitset::findNext(int from) const {
+    if (from >= this->bits) return -1;
+    size_t word = from >> 6;
+    uint64_t remaining = this->words[word] & (~(uint64_t)0 << (from & 63));
+    while (remaining == 0) {
+        if (++word >= this->words.size()) return -1;
+        remaining = this->words[word];
+    }
+    return word * 64 + __builtin_ctzll(remaining);
+}
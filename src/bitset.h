@@ -0,0 +1,43 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// fixed size set of small integers, 64 to a word, for dataflow facts
+class Bitset {
+    std::vector<uint64_t> words;
+    int bits = 0;
+
+    public:
+        Bitset() = default;
+        Bitset(int size, bool full = false) { resize(size, full); }
+
+        void resize(int size, bool full = false);
+        int size() const { return bits; }
+
+        bool test(int bit) const { return (words[bit >> 6] >> (bit & 63)) & 1; }
+        void set(int bit) { words[bit >> 6] |= (uint64_t)1 << (bit & 63); }
+        void reset(int bit) { words[bit >> 6] &= ~((uint64_t)1 << (bit & 63)); }
+        void clear();
+        void fill();
+
+        // each returns whether this set changed
+        bool unionWith(const Bitset &other);
+        bool intersectWith(const Bitset &other);
+        bool subtract(const Bitset &other);
+        // this = gen | (in & ~kill), the transfer function of every gen/kill problem
+        bool transfer(const Bitset &gen, const Bitset &in, const Bitset &kill);
+
+        int count() const;
+        bool empty() const;
+        bool intersects(const Bitset &other) const;
+        // the first set bit at or after from, -1 when there isn't one
+        int findNext(int from) const;
+
+        bool operator==(const Bitset &other) const { return bits == other.bits && words == other.words; }
+        bool operator!=(const Bitset &other) const { return !(*this == other); }
+};
+
+#endif
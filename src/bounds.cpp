@@ -0,0 +1,426 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <unordered_map>
+#include "passes.h"
+
+#define RANGE_DEPTH 4 // how far back through adds a range at a point is chased
+
+// the values an int may hold, kept wide so arithmetic on the ends can't wrap
+struct Range {
+    long long lo, hi;
+};
+
+static const Range everything = {INT_MIN, INT_MAX};
+
+// lo to hi, unless an end fell outside an int, where the arithmetic wrapped
+static Range fit(long long lo, long long hi) {
+    if (lo < INT_MIN || hi > INT_MAX) return everything;
+    Range range = {lo, hi};
+    return range;
+}
+
+// a check a loop's unchecked copy can leave out, on the loop's variable
+// plus offset
+struct CoveredCheck {
+    Instruction *check;
+    long long offset;
+};
+
+// bounds check elimination. a value range for every int, from constants,
+// arithmetic and loop variables stepping towards a limit, narrowed at each
+// check by the branches and earlier checks that dominate it, drops the
+// checks that can't fail. then a counted loop, a header that only tests its
+// variable against a limit and one block of body, whose body still checks
+// the variable plus a constant gets a copy in front of it without those
+// checks. the copy runs only while every one of them would pass, the
+// original loop takes over from there, so a check that fails still fails
+// at the same point
+class BoundsChecks {
+    Function *function;
+    AnalysisCache &analyses;
+    const Cfg *cfg = NULL;
+    const DominatorTree *dominators = NULL;
+    const LoopForest *loops = NULL;
+    std::vector<const Loop*> loopAt;             // by header
+    std::unordered_map<int, Range> ranges;       // everywhere, by id
+    std::map<Block*, std::vector<Block*> > ahead; // the blocks made for each header, to go before it
+
+    bool inLoop(const Loop *loop, Block *block);
+    bool inductionRange(Instruction *phi, Range &range);
+    Range rangeOf(Instruction *value);
+    bool precedes(Instruction *earlier, Instruction *at);
+    void refine(Range &range, Instruction *value, Instruction *test, bool holds);
+    Range rangeAt(Instruction *value, Instruction *at, int depth);
+    bool removeProven();
+    bool split(const Loop *loop);
+
+    public:
+        BoundsChecks(Function *function, AnalysisCache &analyses) : function(function), analyses(analyses) {}
+        int run();
+};
+
+bool BoundsChecks::inLoop(const Loop *loop, Block *block) {
+    int index = this->cfg->indexOf(block);
+    return index >= 0 && this->loops->contains(loop, index);
+}
+
+// a header phi that starts outside and steps by a constant each time round,
+// tested against a limit before the step can be taken, so it never wraps
+bool BoundsChecks::inductionRange(Instruction *phi, Range &range) {
+    Block *header = phi->block;
+    int index = this->cfg->indexOf(header);
+    const Loop *loop = index >= 0 ? this->loopAt[index] : NULL;
+    if (loop == NULL || header->preds.size() != 2) return false;
+    int latch = this->inLoop(loop, header->preds[0]) ? 0 : 1;
+    if (this->inLoop(loop, header->preds[1 - latch]) || !this->inLoop(loop, header->preds[latch])) return false;
+
+    Instruction *next = phi->operands[latch];
+    if (next->op != OP_ADD) return false;
+    Instruction *amount = next->operands[0] == phi ? next->operands[1] : next->operands[1] == phi ? next->operands[0] : NULL;
+    if (amount == NULL || !amount->isConstant() || amount->intValue == 0) return false;
+    long long step = amount->intValue;
+
+    Instruction *branch = header->terminator();
+    if (branch->op != OP_CONDBR || !this->inLoop(loop, branch->targets[0]) || this->inLoop(loop, branch->targets[1])) return false;
+    Instruction *test = branch->operands[0];
+    if (test->op < OP_LT || test->op > OP_GE || test->operands[0]->type != IR_INT) return false;
+    int op = test->op;
+    Instruction *limit = test->operands[1];
+    if (test->operands[1] == phi) {
+        op = op == OP_LT ? OP_GT : op == OP_LE ? OP_GE : op == OP_GT ? OP_LT : OP_LE;
+        limit = test->operands[0];
+    }
+    else if (test->operands[0] != phi) return false;
+
+    Range start = this->rangeOf(phi->operands[1 - latch]);
+    Range bound = this->rangeOf(limit);
+    if (step > 0 && (op == OP_LT || op == OP_LE)) {
+        long long last = (op == OP_LT ? bound.hi - 1 : bound.hi) + step;
+        if (last > INT_MAX) return false;
+        range = fit(start.lo, std::max(start.hi, last));
+        return true;
+    }
+    if (step < 0 && (op == OP_GT || op == OP_GE)) {
+        long long last = (op == OP_GT ? bound.lo + 1 : bound.lo) + step;
+        if (last < INT_MIN) return false;
+        range = fit(std::min(start.lo, last), start.hi);
+        return true;
+    }
+    return false;
+}
+
+Range BoundsChecks::rangeOf(Instruction *value) {
+    if (value->type != IR_INT) return everything;
+    std::unordered_map<int, Range>::iterator known = this->ranges.find(value->id);
+    if (known != this->ranges.end()) return known->second;
+    // a cycle back through phis gives up
+    this->ranges[value->id] = everything;
+
+    Range range = everything;
+    switch (value->op) {
+        case OP_CONST:
+            range.lo = range.hi = value->intValue;
+            break;
+        case OP_ADD: case OP_SUB: {
+            Range a = this->rangeOf(value->operands[0]), b = this->rangeOf(value->operands[1]);
+            range = value->op == OP_ADD ? fit(a.lo + b.lo, a.hi + b.hi) : fit(a.lo - b.hi, a.hi - b.lo);
+            break;
+        }
+        case OP_MUL: {
+            Range a = this->rangeOf(value->operands[0]), b = this->rangeOf(value->operands[1]);
+            long long ends[4] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+            range = fit(*std::min_element(ends, ends + 4), *std::max_element(ends, ends + 4));
+            break;
+        }
+        case OP_NEG: {
+            Range a = this->rangeOf(value->operands[0]);
+            range = fit(-a.hi, -a.lo);
+            break;
+        }
+        case OP_DIV:
+            if (value->operands[1]->isConstant() && value->operands[1]->intValue > 0) {
+                Range a = this->rangeOf(value->operands[0]);
+                range.lo = a.lo / value->operands[1]->intValue;
+                range.hi = a.hi / value->operands[1]->intValue;
+            }
+            break;
+        case OP_BTOI:
+            range.lo = 0;
+            range.hi = 1;
+            break;
+        case OP_PHI:
+            if (this->inductionRange(value, range)) break;
+            range = this->rangeOf(value->operands[0]);
+            for (size_t i = 1; i < value->operands.size(); i++) {
+                Range other = this->rangeOf(value->operands[i]);
+                range.lo = std::min(range.lo, other.lo);
+                range.hi = std::max(range.hi, other.hi);
+            }
+            break;
+    }
+    this->ranges[value->id] = range;
+    return range;
+}
+
+// whether earlier runs before at every time at runs
+bool BoundsChecks::precedes(Instruction *earlier, Instruction *at) {
+    if (earlier->block != at->block) {
+        int from = this->cfg->indexOf(earlier->block), to = this->cfg->indexOf(at->block);
+        return from >= 0 && to >= 0 && this->dominators->dominates(from, to);
+    }
+    for (std::list<Instruction*>::iterator it = at->block->instructions.begin(); *it != at; it++) {
+        if (*it == earlier) return true;
+    }
+    return false;
+}
+
+// what knowing test came out as holds says about value
+void BoundsChecks::refine(Range &range, Instruction *value, Instruction *test, bool holds) {
+    if (test->op < OP_EQ || test->op > OP_GE || test->operands[0]->type != IR_INT) return;
+    int op = test->op;
+    Instruction *other = test->operands[1];
+    if (test->operands[1] == value) {
+        op = op == OP_LT ? OP_GT : op == OP_LE ? OP_GE : op == OP_GT ? OP_LT : op == OP_GE ? OP_LE : op;
+        other = test->operands[0];
+    }
+    else if (test->operands[0] != value) return;
+    if (!holds) op = op == OP_LT ? OP_GE : op == OP_LE ? OP_GT : op == OP_GT ? OP_LE : op == OP_GE ? OP_LT : op == OP_EQ ? OP_NE : OP_EQ;
+
+    Range bound = this->rangeOf(other);
+    switch (op) {
+        case OP_LT: range.hi = std::min(range.hi, bound.hi - 1); break;
+        case OP_LE: range.hi = std::min(range.hi, bound.hi); break;
+        case OP_GT: range.lo = std::max(range.lo, bound.lo + 1); break;
+        case OP_GE: range.lo = std::max(range.lo, bound.lo); break;
+        case OP_EQ:
+            range.lo = std::max(range.lo, bound.lo);
+            range.hi = std::min(range.hi, bound.hi);
+            break;
+    }
+}
+
+// value's range where at is, narrowed by the branches taken to get there
+// and the checks of it already passed
+Range BoundsChecks::rangeAt(Instruction *value, Instruction *at, int depth) {
+    Range range = this->rangeOf(value);
+    if (value->type != IR_INT) return range;
+
+    int block = this->cfg->indexOf(at->block);
+    for (int dominator = block; dominator >= 0; dominator = dominator == 0 ? -1 : this->dominators->idom[dominator]) {
+        Block *entered = this->cfg->blocks[dominator];
+        if (entered->preds.size() != 1) continue;
+        Instruction *branch = entered->preds[0]->terminator();
+        if (branch->op != OP_CONDBR || branch->targets[0] == branch->targets[1]) continue;
+        this->refine(range, value, branch->operands[0], entered == branch->targets[0]);
+    }
+    for (size_t i = 0; i < value->users.size(); i++) {
+        Instruction *check = value->users[i];
+        if (check->op != OP_CHECK || check == at || !this->precedes(check, at)) continue;
+        range.lo = std::max(range.lo, 0LL);
+        range.hi = std::min(range.hi, (long long)check->intValue - 1);
+    }
+
+    // an offset from something narrowed too
+    if (depth < RANGE_DEPTH && (value->op == OP_ADD || value->op == OP_SUB)) {
+        for (int side = 0; side < 2; side++) {
+            Instruction *amount = value->operands[1 - side];
+            if (!amount->isConstant() || (side == 1 && value->op == OP_SUB)) continue;
+            long long by = value->op == OP_ADD ? amount->intValue : -(long long)amount->intValue;
+            Range from = this->rangeAt(value->operands[side], at, depth + 1);
+            Range shifted = fit(from.lo + by, from.hi + by);
+            range.lo = std::max(range.lo, shifted.lo);
+            range.hi = std::min(range.hi, shifted.hi);
+        }
+    }
+    return range;
+}
+
+bool BoundsChecks::removeProven() {
+    std::vector<Instruction*> checks;
+    for (int i = 0; i < this->cfg->size(); i++) {
+        std::list<Instruction*> &instructions = this->cfg->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op == OP_CHECK) checks.push_back(*it);
+        }
+    }
+    // in reverse postorder, so a check that goes was only ever proven by
+    // facts that still hold for the ones it dominates
+    bool removed = false;
+    for (size_t i = 0; i < checks.size(); i++) {
+        Range range = this->rangeAt(checks[i]->operands[0], checks[i], 0);
+        if (range.lo < 0 || range.hi >= checks[i]->intValue) continue;
+        checks[i]->block->erase(checks[i]);
+        removed = true;
+    }
+    return removed;
+}
+
+bool BoundsChecks::split(const Loop *loop) {
+    if (loop->blocks.size() != 2 || loop->latches.size() != 1) return false;
+    Block *header = this->cfg->blocks[loop->header];
+    Block *body = this->cfg->blocks[loop->latches[0]];
+    if (body == header || header->preds.size() != 2 || body->preds.size() != 1) return false;
+    int latch = header->predIndex(body);
+    Block *preheader = header->preds[1 - latch];
+    Instruction *enter = preheader->terminator();
+    Instruction *branch = header->terminator();
+    std::vector<Instruction*> phis = header->phis();
+    if (enter->op != OP_BR || branch->op != OP_CONDBR || branch->targets[0] != body || branch->targets[1] == body) return false;
+    Instruction *test = branch->operands[0];
+    if (header->instructions.size() != phis.size() + 2 || test->block != header || test->users.size() != 1) return false;
+
+    // the variable counting up to the limit, and from where
+    int op = test->op;
+    Instruction *variable = test->operands[0], *limit = test->operands[1];
+    if (op == OP_GT || op == OP_GE) {
+        op = op == OP_GT ? OP_LT : OP_LE;
+        std::swap(variable, limit);
+    }
+    if ((op != OP_LT && op != OP_LE) || variable->op != OP_PHI || variable->block != header || variable->type != IR_INT) return false;
+    if (this->inLoop(loop, limit->block)) return false;
+    Instruction *next = variable->operands[latch];
+    if (next->op != OP_ADD || next->block != body) return false;
+    Instruction *amount = next->operands[0] == variable ? next->operands[1] : next->operands[1] == variable ? next->operands[0] : NULL;
+    if (amount == NULL || !amount->isConstant() || amount->intValue <= 0) return false;
+    Range start = this->rangeAt(variable->operands[1 - latch], enter, 0);
+
+    // the body's checks of variable plus a constant that pass for as long
+    // as the variable stays below cap
+    std::vector<CoveredCheck> covered;
+    long long cap = INT_MAX;
+    for (std::list<Instruction*>::iterator it = body->instructions.begin(); it != body->instructions.end(); it++) {
+        if ((*it)->op != OP_CHECK) continue;
+        Instruction *index = (*it)->operands[0];
+        long long offset = 0;
+        if (index != variable) {
+            if (index->op != OP_ADD && index->op != OP_SUB) continue;
+            int side = index->operands[0] == variable ? 0 : index->operands[1] == variable && index->op == OP_ADD ? 1 : -1;
+            if (side < 0 || !index->operands[1 - side]->isConstant()) continue;
+            offset = index->op == OP_ADD ? index->operands[1 - side]->intValue : -(long long)index->operands[1 - side]->intValue;
+        }
+        if (start.lo + offset < 0) continue;
+        CoveredCheck check = {*it, offset};
+        covered.push_back(check);
+        cap = std::min(cap, (*it)->intValue - offset);
+    }
+    // variable <= limit runs while variable < limit + 1
+    if (op == OP_LE) cap--;
+    if (covered.empty() || cap < INT_MIN) return false;
+
+    // what the phis start from and come back with, before the edges move
+    std::vector<Instruction*> starts, nexts;
+    for (size_t i = 0; i < phis.size(); i++) {
+        starts.push_back(phis[i]->operands[1 - latch]);
+        nexts.push_back(phis[i]->operands[latch]);
+    }
+
+    // how far the copy goes, the nearer of the limit and the cap
+    Block *top = this->function->addBlock();
+    Block *copy = this->function->addBlock();
+    std::vector<Block*> &made = this->ahead[header];
+    Instruction *bound = limit;
+    if (!limit->isConstant() || limit->intValue > cap) {
+        Instruction *capped = this->function->create(OP_CONST, IR_INT);
+        capped->intValue = (int)cap;
+        preheader->insertBefore(enter, capped);
+        bound = capped;
+    }
+    if (!limit->isConstant()) {
+        Block *capping = this->function->addBlock();
+        Block *join = this->function->addBlock();
+        Instruction *under = this->function->create(OP_LT, IR_BOOL);
+        under->addOperand(limit);
+        under->addOperand(bound);
+        preheader->insertBefore(enter, under);
+        header->removePred(preheader);
+        preheader->erase(enter);
+        this->function->condBranch(preheader, under, join, capping);
+        this->function->branch(capping, join);
+        Instruction *nearer = join->append(this->function->create(OP_PHI, IR_INT));
+        nearer->addOperand(limit);
+        nearer->addOperand(bound);
+        bound = nearer;
+        this->function->branch(join, top);
+        made.push_back(capping);
+        made.push_back(join);
+    }
+    else {
+        header->removePred(preheader);
+        enter->targets[0] = top;
+        top->preds.push_back(preheader);
+    }
+    made.push_back(top);
+    made.push_back(copy);
+
+    std::map<Instruction*, Instruction*> values; // from the loop to the copy
+    std::vector<Instruction*> tops;
+    for (size_t i = 0; i < phis.size(); i++) {
+        Instruction *phi = top->append(this->function->create(OP_PHI, phis[i]->type));
+        phi->addOperand(starts[i]);
+        values[phis[i]] = phi;
+        tops.push_back(phi);
+    }
+    Instruction *within = this->function->create(op, IR_BOOL);
+    within->addOperand(values[variable]);
+    within->addOperand(bound);
+    top->append(within);
+    this->function->condBranch(top, within, copy, header);
+
+    for (std::list<Instruction*>::iterator it = body->instructions.begin(); it != body->instructions.end(); it++) {
+        Instruction *instruction = *it;
+        bool skip = instruction->isTerminator();
+        for (size_t i = 0; i < covered.size() && !skip; i++) skip = covered[i].check == instruction;
+        if (skip) continue;
+        Instruction *clone = this->function->create(instruction->op, instruction->type);
+        clone->intValue = instruction->intValue;
+        clone->floatValue = instruction->floatValue;
+        clone->name = instruction->name;
+        clone->elemType = instruction->elemType;
+        for (size_t i = 0; i < instruction->operands.size(); i++) {
+            std::map<Instruction*, Instruction*>::iterator found = values.find(instruction->operands[i]);
+            clone->addOperand(found == values.end() ? instruction->operands[i] : found->second);
+        }
+        values[instruction] = copy->append(clone);
+    }
+    this->function->branch(copy, top);
+    for (size_t i = 0; i < phis.size(); i++) {
+        std::map<Instruction*, Instruction*>::iterator found = values.find(nexts[i]);
+        tops[i]->addOperand(found == values.end() ? nexts[i] : found->second);
+        // the original loop starts where the copy stopped
+        phis[i]->addOperand(tops[i]);
+    }
+    return true;
+}
+
+int BoundsChecks::run() {
+    this->loops = &this->analyses.getLoops();
+    this->cfg = &this->loops->cfg;
+    this->dominators = &this->analyses.getDominators();
+    this->loopAt.assign(this->cfg->size(), NULL);
+    for (size_t i = 0; i < this->loops->loops.size(); i++) this->loopAt[this->loops->loops[i]->header] = this->loops->loops[i];
+
+    bool removed = this->removeProven();
+    size_t existing = this->function->blocks.size();
+    bool split = false;
+    for (size_t i = 0; i < this->loops->loops.size(); i++) split = this->split(this->loops->loops[i]) || split;
+    if (!split) return removed ? CHANGED_INSTRUCTIONS : CHANGED_NONE;
+
+    // the new blocks were added last, and go just ahead of their loops
+    std::vector<Block*> blocks;
+    for (size_t i = 0; i < existing; i++) {
+        Block *block = this->function->blocks[i];
+        std::map<Block*, std::vector<Block*> >::iterator made = this->ahead.find(block);
+        if (made != this->ahead.end()) blocks.insert(blocks.end(), made->second.begin(), made->second.end());
+        blocks.push_back(block);
+    }
+    this->function->blocks = blocks;
+    return CHANGED_CFG;
+}
+
+int eliminateBoundsChecks(Function *function, AnalysisCache &analyses) {
+    BoundsChecks checks(function, analyses);
+    return checks.run();
+}
@@ -0,0 +1,594 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include "bytecode.h"
+#include "stats.h"
+
+// an opcode's name, and how its operands are listed: r a register, k an int
+// constant, x float bits, l a jump target, g a global slot, s a string, f a
+// function, c a call's arguments, taking c and d, and m a message
+struct OpInfo {
+    const char *name;
+    const char *operands;
+};
+
+static const OpInfo opInfo[BC_COUNT] = {
+    {"move", "rr"}, {"int", "rk"}, {"float", "rx"}, {"string", "rs"}, {"global", "rg"}, {"alloca", "rk"},
+    {"add.i", "rrr"}, {"sub.i", "rrr"}, {"mul.i", "rrr"}, {"div.i", "rrr"},
+    {"add.ik", "rrk"}, {"sub.ik", "rrk"}, {"mul.ik", "rrk"}, {"div.ik", "rrk"},
+    {"neg.i", "rr"}, {"and", "rrr"}, {"or", "rrr"}, {"not.i", "rr"}, {"not.b", "rr"}, {"test", "rr"},
+    {"eq.i", "rrr"}, {"ne.i", "rrr"}, {"lt.i", "rrr"}, {"le.i", "rrr"}, {"gt.i", "rrr"}, {"ge.i", "rrr"},
+    {"eq.ik", "rrk"}, {"ne.ik", "rrk"}, {"lt.ik", "rrk"}, {"le.ik", "rrk"}, {"gt.ik", "rrk"}, {"ge.ik", "rrk"},
+    {"add.f", "rrr"}, {"sub.f", "rrr"}, {"mul.f", "rrr"}, {"div.f", "rrr"}, {"neg.f", "rr"},
+    {"eq.f", "rrr"}, {"ne.f", "rrr"}, {"lt.f", "rrr"}, {"le.f", "rrr"}, {"gt.f", "rrr"}, {"ge.f", "rrr"},
+    {"itof", "rr"}, {"index", "rrr"}, {"load", "rr"}, {"store", "rr"},
+    {"load.index", "rrr"}, {"store.index", "rrr"}, {"load.index.k", "rrk"}, {"store.index.k", "rkr"},
+    {"load.global", "rg"}, {"store.global", "gr"}, {"add.load.i", "rrrr"}, {"add.load.f", "rrrr"},
+    {"jump", "l"}, {"jump.if", "rl"}, {"jump.unless", "rl"},
+    {"jeq.i", "rrl"}, {"jne.i", "rrl"}, {"jlt.i", "rrl"}, {"jle.i", "rrl"}, {"jgt.i", "rrl"}, {"jge.i", "rrl"},
+    {"jeq.ik", "rkl"}, {"jne.ik", "rkl"}, {"jlt.ik", "rkl"}, {"jle.ik", "rkl"}, {"jgt.ik", "rkl"}, {"jge.ik", "rkl"},
+    {"jeq.f", "rrl"}, {"jne.f", "rrl"}, {"jlt.f", "rrl"}, {"jle.f", "rrl"}, {"jgt.f", "rrl"}, {"jge.f", "rrl"},
+    {"check", "rk"}, {"call", "rfc"}, {"ret", "r"}, {"ret.void", ""},
+    {"put.i", "rr"}, {"put.f", "rr"}, {"put.b", "rr"}, {"put.s", "rr"},
+    {"get.i", "r"}, {"get.f", "r"}, {"get.b", "r"}, {"get.s", "r"},
+    {"sqrt", "rr"}, {"strcmp", "rrr"}, {"fail", "m"},
+};
+
+// the runtime routines, each its own opcode
+static const std::map<std::string, int> routines = {
+    {"PUTINTEGER", BC_PUT_I}, {"PUTFLOAT", BC_PUT_F}, {"PUTBOOL", BC_PUT_B}, {"PUTSTRING", BC_PUT_S},
+    {"GETINTEGER", BC_GET_I}, {"GETFLOAT", BC_GET_F}, {"GETBOOL", BC_GET_B}, {"GETSTRING", BC_GET_S},
+    {"SQRT", BC_SQRT}, {"strcmp", BC_STRCMP},
+};
+
+// a comparison with its operands swapped, and the one true when it's false,
+// both counted from OP_EQ
+static const int swapped[6] = {0, 1, 4, 5, 2, 3};
+static const int inverse[6] = {1, 0, 5, 4, 3, 2};
+
+static bool isComparison(Instruction *instruction) {
+    return instruction->op >= OP_EQ && instruction->op <= OP_GE;
+}
+
+static bool isIntConstant(Instruction *value) {
+    return value->op == OP_CONST && (value->type == IR_INT || value->type == IR_BOOL);
+}
+
+// a jump operand to point at a label once every label has its place
+struct Fixup {
+    int at;    // in the body
+    int field; // 0 for a, 1 for b, 2 for c
+    int label;
+};
+
+// moves into a block's phis along one edge, written once the blocks are
+struct EdgeStub {
+    int label;
+    Block *from, *to;
+};
+
+class BytecodeCompiler {
+    Module *module;
+    BcModule *out;
+    BytecodeStats &stats;
+    std::map<std::string, int> functionIndex;
+    std::map<std::string, int> globalSlot;
+
+    // the function being compiled
+    Function *function = NULL;
+    BcFunction *target = NULL;
+    std::vector<BcInstruction> prologue, body;
+    std::vector<int> registerOf; // by value id, -1 until it's given one
+    std::vector<bool> folded;    // by value id, written as part of the instruction using it
+    std::vector<int> foldedLoad; // by value id of an add, the operand loaded as part of it, or -1
+    std::map<Block*, int> blockLabel; // a block's label is where it is in the function
+    std::vector<int> labelAt;         // by label, where it is in the body
+    std::vector<Fixup> fixups;
+    std::vector<EdgeStub> stubs;
+    int scratch = -1;
+
+    int emit(int op, int a = 0, int b = 0, int c = 0, int d = 0);
+    void jump(int op, int a, int b, int c, int field, int label);
+    int reg(Instruction *value);
+    int arrayLength(Instruction *base);
+    std::string outOfRange(int index, int length);
+    void decideFolds();
+    void compileFunction(Function *function, BcFunction &into);
+    void compileInstruction(Instruction *instruction, Block *next);
+    void arithmetic(Instruction *instruction);
+    void load(int dest, Instruction *address);
+    void store(Instruction *address, int value);
+    void call(Instruction *instruction);
+    void branch(Instruction *instruction, Block *next);
+    int edgeLabel(Block *from, Block *to);
+    void phiMoves(Block *from, Block *to);
+    void fail(std::string message);
+
+    public:
+        BytecodeCompiler(Module *module, BcModule *out, BytecodeStats &stats) : module(module), out(out), stats(stats) {}
+        void compile();
+};
+
+int BytecodeCompiler::emit(int op, int a, int b, int c, int d) {
+    BcInstruction instruction;
+    instruction.op = op;
+    instruction.a = a;
+    instruction.b = b;
+    instruction.c = c;
+    instruction.d = d;
+    this->body.push_back(instruction);
+    return this->body.size() - 1;
+}
+
+// an instruction whose field is a jump to label
+void BytecodeCompiler::jump(int op, int a, int b, int c, int field, int label) {
+    Fixup fixup;
+    fixup.at = this->emit(op, a, b, c);
+    fixup.field = field;
+    fixup.label = label;
+    this->fixups.push_back(fixup);
+}
+
+// the register holding value, giving it one the first time it's asked for.
+// constants and globals are set once in the prologue
+int BytecodeCompiler::reg(Instruction *value) {
+    int &assigned = this->registerOf[value->id];
+    if (assigned >= 0) return assigned;
+    if (value->op == OP_PARAM) return assigned = value->intValue;
+    assigned = this->target->registers++;
+    if (value->op == OP_CONST || value->op == OP_GLOBAL) {
+        BcInstruction set;
+        set.a = assigned;
+        if (value->op == OP_GLOBAL) {
+            set.op = BC_GLOBAL;
+            set.b = this->globalSlot[value->name];
+        }
+        else if (value->type == IR_FLOAT) {
+            set.op = BC_FLOAT;
+            memcpy(&set.b, &value->floatValue, sizeof(float));
+        }
+        else if (value->type == IR_STRING) {
+            set.op = BC_STRING;
+            set.b = this->out->strings.size();
+            this->out->strings.push_back(value->name);
+        }
+        else {
+            set.op = BC_INT;
+            set.b = value->intValue;
+        }
+        this->prologue.push_back(set);
+    }
+    return assigned;
+}
+
+// elements in the array at base, or -1 when only the running program knows
+int BytecodeCompiler::arrayLength(Instruction *base) {
+    if (base->op == OP_ALLOCA) return base->intValue;
+    if (base->op == OP_GLOBAL) {
+        Global *global = this->module->findGlobal(base->name);
+        if (global != NULL) return global->length;
+    }
+    return -1;
+}
+
+std::string BytecodeCompiler::outOfRange(int index, int length) {
+    return "index " + std::to_string(index) + " out of range for an array of " + std::to_string(length);
+}
+
+void BytecodeCompiler::fail(std::string message) {
+    this->emit(BC_FAIL, this->out->messages.size());
+    this->out->messages.push_back(message + " in @" + this->function->name);
+}
+
+// which instructions are written as part of their user. values keep their
+// registers for the whole call, so a pure instruction reads the same
+// operands wherever it's written. a load only moves within its block, and
+// not past a store or a call
+void BytecodeCompiler::decideFolds() {
+    std::vector<Block*> &blocks = this->function->blocks;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        std::list<Instruction*> &instructions = blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->op == OP_INDEX) {
+                // an element known to be out of range is left to fail where the index is
+                Instruction *index = instruction->operands[1];
+                int length = this->arrayLength(instruction->operands[0]);
+                if (isIntConstant(index) && length >= 0 && (index->intValue < 0 || index->intValue >= length)) continue;
+                bool accessed = !instruction->users.empty();
+                for (size_t u = 0; u < instruction->users.size(); u++) {
+                    Instruction *user = instruction->users[u];
+                    if (user->op == OP_LOAD) continue;
+                    if (user->op != OP_STORE || user->operands[0] != instruction || user->operands[1] == instruction) accessed = false;
+                }
+                this->folded[instruction->id] = accessed;
+            }
+            else if (isComparison(instruction) && instruction->users.size() == 1) {
+                Instruction *user = instruction->users[0];
+                this->folded[instruction->id] = user->op == OP_CONDBR && user->block == instruction->block;
+            }
+        }
+    }
+
+    // loads of an element straight into an add, once every index is decided
+    for (size_t i = 0; i < blocks.size(); i++) {
+        std::list<Instruction*> &instructions = blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *add = *it;
+            if (add->op != OP_ADD) continue;
+            for (int o = 1; o >= 0 && this->foldedLoad[add->id] < 0; o--) {
+                Instruction *load = add->operands[o];
+                if (load->op != OP_LOAD || load->users.size() != 1 || load->block != add->block) continue;
+                Instruction *address = load->operands[0];
+                if (address->op != OP_INDEX || !this->folded[address->id] || isIntConstant(address->operands[1])) continue;
+                std::list<Instruction*>::iterator between = std::find(instructions.begin(), it, load);
+                bool clear = between != it;
+                for (; between != it && clear; between++) clear = (*between)->op != OP_STORE && (*between)->op != OP_CALL;
+                if (!clear) continue;
+                this->folded[load->id] = true;
+                this->foldedLoad[add->id] = o;
+            }
+        }
+    }
+}
+
+void BytecodeCompiler::compileFunction(Function *function, BcFunction &into) {
+    this->function = function;
+    this->target = &into;
+    into.name = function->name;
+    into.params = function->paramTypes.size();
+    into.registers = into.params;
+    this->prologue.clear();
+    this->body.clear();
+    this->registerOf.assign(function->nextValueId, -1);
+    this->folded.assign(function->nextValueId, false);
+    this->foldedLoad.assign(function->nextValueId, -1);
+    this->labelAt.assign(function->blocks.size(), 0);
+    this->fixups.clear();
+    this->stubs.clear();
+    this->scratch = -1;
+    this->decideFolds();
+
+    // stubs are labelled after the blocks
+    std::vector<Block*> &blocks = function->blocks;
+    this->blockLabel.clear();
+    for (size_t i = 0; i < blocks.size(); i++) this->blockLabel[blocks[i]] = i;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        this->labelAt[i] = this->body.size();
+        Block *next = i + 1 < blocks.size() ? blocks[i + 1] : NULL;
+        std::list<Instruction*> &instructions = blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            this->compileInstruction(*it, next);
+        }
+    }
+    for (size_t i = 0; i < this->stubs.size(); i++) {
+        this->labelAt[this->stubs[i].label] = this->body.size();
+        this->phiMoves(this->stubs[i].from, this->stubs[i].to);
+        this->jump(BC_JUMP, 0, 0, 0, 0, this->blockLabel[this->stubs[i].to]);
+    }
+
+    // the prologue goes first, moving every jump target along
+    int offset = this->prologue.size();
+    for (size_t i = 0; i < this->fixups.size(); i++) {
+        BcInstruction &instruction = this->body[this->fixups[i].at];
+        int *field = this->fixups[i].field == 0 ? &instruction.a : this->fixups[i].field == 1 ? &instruction.b : &instruction.c;
+        *field = this->labelAt[this->fixups[i].label] + offset;
+    }
+    into.code = this->prologue;
+    into.code.insert(into.code.end(), this->body.begin(), this->body.end());
+    this->stats.instructions += into.code.size();
+}
+
+void BytecodeCompiler::compileInstruction(Instruction *instruction, Block *next) {
+    if (this->folded[instruction->id]) return;
+    Instruction *a = instruction->operands.size() > 0 ? instruction->operands[0] : NULL;
+    bool floats = a != NULL && a->type == IR_FLOAT;
+    switch (instruction->op) {
+        // their registers are set by the prologue, the call and the edges in
+        case OP_CONST: case OP_GLOBAL: case OP_PARAM: case OP_PHI: break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: this->arithmetic(instruction); break;
+        case OP_NEG: this->emit(floats ? BC_NEG_F : BC_NEG_I, this->reg(instruction), this->reg(a)); break;
+        case OP_AND: case OP_OR:
+            this->emit(instruction->op == OP_AND ? BC_AND : BC_OR, this->reg(instruction), this->reg(a), this->reg(instruction->operands[1]));
+            break;
+        case OP_NOT: this->emit(instruction->type == IR_BOOL ? BC_NOT_B : BC_NOT_I, this->reg(instruction), this->reg(a)); break;
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE: {
+            int cc = instruction->op - OP_EQ;
+            Instruction *b = instruction->operands[1];
+            if (floats) this->emit(BC_EQ_F + cc, this->reg(instruction), this->reg(a), this->reg(b));
+            else if (isIntConstant(b)) this->emit(BC_EQ_IK + cc, this->reg(instruction), this->reg(a), b->intValue);
+            else if (isIntConstant(a)) this->emit(BC_EQ_IK + swapped[cc], this->reg(instruction), this->reg(b), a->intValue);
+            else this->emit(BC_EQ_I + cc, this->reg(instruction), this->reg(a), this->reg(b));
+            break;
+        }
+        case OP_ITOF: this->emit(BC_ITOF, this->reg(instruction), this->reg(a)); break;
+        case OP_BTOI: case OP_ITOB: this->emit(BC_TEST, this->reg(instruction), this->reg(a)); break;
+        case OP_ALLOCA: this->emit(BC_ALLOCA, this->reg(instruction), instruction->intValue); break;
+        case OP_INDEX: {
+            Instruction *index = instruction->operands[1];
+            int length = this->arrayLength(a);
+            if (isIntConstant(index) && length >= 0 && (index->intValue < 0 || index->intValue >= length)) {
+                this->fail(this->outOfRange(index->intValue, length));
+            }
+            else this->emit(BC_INDEX, this->reg(instruction), this->reg(a), this->reg(index));
+            break;
+        }
+        case OP_LOAD: this->load(this->reg(instruction), a); break;
+        case OP_STORE: this->store(a, this->reg(instruction->operands[1])); break;
+        case OP_CHECK:
+            if (!isIntConstant(a)) this->emit(BC_CHECK, this->reg(a), instruction->intValue);
+            else if (a->intValue < 0 || a->intValue >= instruction->intValue) this->fail(this->outOfRange(a->intValue, instruction->intValue));
+            break;
+        case OP_CALL: this->call(instruction); break;
+        case OP_BR: case OP_CONDBR: this->branch(instruction, next); break;
+        case OP_RET:
+            if (a == NULL) this->emit(BC_RET_VOID);
+            else this->emit(BC_RET, this->reg(a));
+            break;
+    }
+}
+
+void BytecodeCompiler::arithmetic(Instruction *instruction) {
+    Instruction *a = instruction->operands[0], *b = instruction->operands[1];
+    int dest = this->reg(instruction);
+    int offset = instruction->op - OP_ADD;
+    bool commutes = instruction->op == OP_ADD || instruction->op == OP_MUL;
+    if (instruction->op == OP_ADD && this->foldedLoad[instruction->id] >= 0) {
+        Instruction *loaded = instruction->operands[this->foldedLoad[instruction->id]];
+        Instruction *other = instruction->operands[1 - this->foldedLoad[instruction->id]];
+        Instruction *address = loaded->operands[0];
+        this->emit(instruction->type == IR_FLOAT ? BC_ADD_LOAD_F : BC_ADD_LOAD_I, dest, this->reg(other),
+            this->reg(address->operands[0]), this->reg(address->operands[1]));
+        this->stats.superinstructions++;
+    }
+    else if (instruction->type == IR_FLOAT) this->emit(BC_ADD_F + offset, dest, this->reg(a), this->reg(b));
+    // dividing by a constant 0 or -1 still needs its checks
+    else if (isIntConstant(b) && (instruction->op != OP_DIV || (b->intValue != 0 && b->intValue != -1))) {
+        this->emit(BC_ADD_IK + offset, dest, this->reg(a), b->intValue);
+    }
+    else if (isIntConstant(a) && commutes) this->emit(BC_ADD_IK + offset, dest, this->reg(b), a->intValue);
+    else this->emit(BC_ADD_I + offset, dest, this->reg(a), this->reg(b));
+}
+
+// a load through address, as one instruction with an index folded into it
+void BytecodeCompiler::load(int dest, Instruction *address) {
+    if (address->op == OP_GLOBAL) {
+        this->emit(BC_LOAD_GLOBAL, dest, this->globalSlot[address->name]);
+        return;
+    }
+    if (!this->folded[address->id]) {
+        this->emit(BC_LOAD, dest, this->reg(address));
+        return;
+    }
+    Instruction *base = address->operands[0], *index = address->operands[1];
+    if (!isIntConstant(index)) this->emit(BC_LOAD_INDEX, dest, this->reg(base), this->reg(index));
+    else if (base->op == OP_GLOBAL) this->emit(BC_LOAD_GLOBAL, dest, this->globalSlot[base->name] + index->intValue);
+    else this->emit(BC_LOAD_INDEX_K, dest, this->reg(base), index->intValue);
+    this->stats.superinstructions++;
+}
+
+void BytecodeCompiler::store(Instruction *address, int value) {
+    if (address->op == OP_GLOBAL) {
+        this->emit(BC_STORE_GLOBAL, this->globalSlot[address->name], value);
+        return;
+    }
+    if (!this->folded[address->id]) {
+        this->emit(BC_STORE, this->reg(address), value);
+        return;
+    }
+    Instruction *base = address->operands[0], *index = address->operands[1];
+    if (!isIntConstant(index)) this->emit(BC_STORE_INDEX, this->reg(base), this->reg(index), value);
+    else if (base->op == OP_GLOBAL) this->emit(BC_STORE_GLOBAL, this->globalSlot[base->name] + index->intValue, value);
+    else this->emit(BC_STORE_INDEX_K, this->reg(base), index->intValue, value);
+    this->stats.superinstructions++;
+}
+
+// calls stop the way the interpreter's do when there's nothing to call
+void BytecodeCompiler::call(Instruction *instruction) {
+    Function *callee = this->module->find(instruction->name);
+    std::vector<int> args;
+    for (size_t i = 0; i < instruction->operands.size(); i++) args.push_back(this->reg(instruction->operands[i]));
+    int dest = this->reg(instruction);
+    if (callee == NULL) {
+        this->fail("call to unknown @" + instruction->name);
+        return;
+    }
+    if (callee->external) {
+        std::map<std::string, int>::const_iterator routine = routines.find(callee->name);
+        if (routine == routines.end()) {
+            this->emit(BC_FAIL, this->out->messages.size());
+            this->out->messages.push_back("unknown runtime routine in @" + callee->name);
+        }
+        else this->emit(routine->second, dest, args.size() > 0 ? args[0] : 0, args.size() > 1 ? args[1] : 0);
+        return;
+    }
+    if (callee->entry() == NULL) {
+        this->emit(BC_FAIL, this->out->messages.size());
+        this->out->messages.push_back("call to @" + callee->name + " which has no body in @" + callee->name);
+        return;
+    }
+    this->emit(BC_CALL, dest, this->functionIndex[callee->name], this->target->args.size(), args.size());
+    this->target->args.insert(this->target->args.end(), args.begin(), args.end());
+}
+
+// where a branch from one block to another goes: the block itself, or a stub
+// moving the values its phis take along the edge first
+int BytecodeCompiler::edgeLabel(Block *from, Block *to) {
+    if (to->phis().empty()) return this->blockLabel[to];
+    EdgeStub stub;
+    stub.label = this->labelAt.size();
+    stub.from = from;
+    stub.to = to;
+    this->labelAt.push_back(0);
+    this->stubs.push_back(stub);
+    return stub.label;
+}
+
+void BytecodeCompiler::branch(Instruction *instruction, Block *next) {
+    Block *from = instruction->block;
+    if (instruction->op == OP_BR) {
+        Block *to = instruction->targets[0];
+        this->phiMoves(from, to);
+        if (to != next) this->jump(BC_JUMP, 0, 0, 0, 0, this->blockLabel[to]);
+        return;
+    }
+
+    int ifTrue = this->edgeLabel(from, instruction->targets[0]);
+    int ifFalse = this->edgeLabel(from, instruction->targets[1]);
+    int nextLabel = next != NULL ? this->blockLabel[next] : -1;
+    bool trueNext = ifTrue == nextLabel, falseNext = ifFalse == nextLabel;
+    Instruction *condition = instruction->operands[0];
+    if (this->folded[condition->id]) {
+        int cc = condition->op - OP_EQ;
+        Instruction *a = condition->operands[0], *b = condition->operands[1];
+        int op, first, second;
+        if (a->type == IR_FLOAT) {
+            op = BC_JEQ_F;
+            first = this->reg(a);
+            second = this->reg(b);
+        }
+        else if (isIntConstant(b)) {
+            op = BC_JEQ_IK;
+            first = this->reg(a);
+            second = b->intValue;
+        }
+        else if (isIntConstant(a)) {
+            op = BC_JEQ_IK;
+            cc = swapped[cc];
+            first = this->reg(b);
+            second = a->intValue;
+        }
+        else {
+            op = BC_JEQ_I;
+            first = this->reg(a);
+            second = this->reg(b);
+        }
+        // a float comparison can't be turned around, it's false either way on a nan
+        if (trueNext && !falseNext && op != BC_JEQ_F) this->jump(op + inverse[cc], first, second, 0, 2, ifFalse);
+        else {
+            this->jump(op + cc, first, second, 0, 2, ifTrue);
+            if (!falseNext) this->jump(BC_JUMP, 0, 0, 0, 0, ifFalse);
+        }
+        this->stats.superinstructions++;
+    }
+    else if (trueNext && !falseNext) this->jump(BC_JUMP_UNLESS, this->reg(condition), 0, 0, 1, ifFalse);
+    else {
+        this->jump(BC_JUMP_IF, this->reg(condition), 0, 0, 1, ifTrue);
+        if (!falseNext) this->jump(BC_JUMP, 0, 0, 0, 0, ifFalse);
+    }
+}
+
+// the phis of to take their values all at once, so the moves are ordered to
+// write no register another still has to read, going through the scratch
+// register to break a cycle
+void BytecodeCompiler::phiMoves(Block *from, Block *to) {
+    std::vector<Instruction*> phis = to->phis();
+    if (phis.empty()) return;
+    int pred = to->predIndex(from);
+    std::vector<std::pair<int, int> > pending;
+    for (size_t i = 0; i < phis.size(); i++) {
+        int dest = this->reg(phis[i]), source = this->reg(phis[i]->operands[pred]);
+        if (dest != source) pending.push_back(std::make_pair(dest, source));
+    }
+    while (!pending.empty()) {
+        size_t ready = pending.size();
+        for (size_t i = 0; i < pending.size() && ready == pending.size(); i++) {
+            bool read = false;
+            for (size_t j = 0; j < pending.size() && !read; j++) read = j != i && pending[j].second == pending[i].first;
+            if (!read) ready = i;
+        }
+        if (ready < pending.size()) {
+            this->emit(BC_MOVE, pending[ready].first, pending[ready].second);
+            pending.erase(pending.begin() + ready);
+        }
+        else {
+            if (this->scratch < 0) this->scratch = this->target->registers++;
+            int parked = pending[0].first;
+            this->emit(BC_MOVE, this->scratch, parked);
+            for (size_t j = 0; j < pending.size(); j++) {
+                if (pending[j].second == parked) pending[j].second = this->scratch;
+            }
+        }
+        this->stats.moves++;
+    }
+}
+
+void BytecodeCompiler::compile() {
+    for (size_t i = 0; i < this->module->globals.size(); i++) {
+        this->globalSlot[this->module->globals[i].name] = this->out->globalSlots;
+        this->out->globalSlots += this->module->globals[i].length;
+    }
+    std::vector<Function*> bodies;
+    for (size_t i = 0; i < this->module->functions.size(); i++) {
+        Function *function = this->module->functions[i];
+        if (function->external || function->entry() == NULL) continue;
+        this->functionIndex[function->name] = bodies.size();
+        if (function->name == "main") this->out->main = bodies.size();
+        bodies.push_back(function);
+    }
+    this->out->functions.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) this->compileFunction(bodies[i], this->out->functions[i]);
+    this->stats.functions += bodies.size();
+}
+
+BcModule *compileBytecode(Module *module, BytecodeStats &stats) {
+    double start = wallClockMs();
+    BcModule *out = new BcModule();
+    BytecodeCompiler compiler(module, out, stats);
+    compiler.compile();
+    stats.ms += wallClockMs() - start;
+    return out;
+}
+
+void disassemble(BcModule *module, std::ostream &out) {
+    for (size_t f = 0; f < module->functions.size(); f++) {
+        BcFunction &function = module->functions[f];
+        out << (f == 0 ? "" : "\n") << "function @" << function.name << ", " << function.params << " param(s), "
+            << function.registers << " register(s)\n";
+        for (size_t i = 0; i < function.code.size(); i++) {
+            BcInstruction &instruction = function.code[i];
+            const OpInfo &info = opInfo[instruction.op];
+            std::ostringstream line;
+            line << "    " << i;
+            while (line.str().size() < 10) line << ' ';
+            line << info.name;
+            int fields[4] = {instruction.a, instruction.b, instruction.c, instruction.d};
+            for (int k = 0; info.operands[k] != '\0'; k++) {
+                int field = fields[k];
+                line << (k == 0 ? std::string(line.str().size() < 24 ? 24 - line.str().size() : 1, ' ') : ", ");
+                switch (info.operands[k]) {
+                    case 'r': line << "r" << field; break;
+                    case 'k': line << field; break;
+                    case 'x': {
+                        float value;
+                        memcpy(&value, &field, sizeof(float));
+                        line << value;
+                        break;
+                    }
+                    case 'l': line << "-> " << field; break;
+                    case 'g': line << "[" << field << "]"; break;
+                    case 's': line << jsonString(module->strings[field]); break;
+                    case 'f': line << "@" << module->functions[field].name; break;
+                    case 'c':
+                        line << "(";
+                        for (int a = 0; a < instruction.d; a++) line << (a == 0 ? "r" : ", r") << function.args[field + a];
+                        line << ")";
+                        break;
+                    case 'm': line << jsonString(module->messages[field]); break;
+                }
+            }
+            out << line.str() << "\n";
+        }
+    }
+}
+
+std::string BytecodeStats::toJson() {
+    std::ostringstream json;
+    json << "{\"functions\": " << this->functions << ", \"instructions\": " << this->instructions
+        << ", \"superinstructions\": " << this->superinstructions << ", \"moves\": " << this->moves
+        << ", \"ms\": " << this->ms << "}";
+    return json.str();
+}
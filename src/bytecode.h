@@ -0,0 +1,150 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ir.h"
+
+// bytecode opcodes. every value has a register of its own in its function's
+// frame, a slot holding an int, a float, a string or an address, and each
+// opcode is typed: _I for int and bool, _F for float. a K takes its last
+// operand as a constant rather than a register. operands are given as
+// dest, sources, then a jump target
+#define BC_MOVE          0  // a = b
+#define BC_INT           1  // a = int constant b, bools too
+#define BC_FLOAT         2  // a = float constant with the bits b
+#define BC_STRING        3  // a = module string b
+#define BC_GLOBAL        4  // a = address of global slot b
+#define BC_ALLOCA        5  // a = address of b fresh zeroed slots, freed on return
+#define BC_ADD_I         6  // a = b + c, wrapping
+#define BC_SUB_I         7
+#define BC_MUL_I         8
+#define BC_DIV_I         9  // a runtime error when c is zero
+#define BC_ADD_IK        10 // a = b + c
+#define BC_SUB_IK        11
+#define BC_MUL_IK        12
+#define BC_DIV_IK        13 // c is neither 0 nor -1
+#define BC_NEG_I         14 // a = -b
+#define BC_AND           15 // a = b & c, logical on bools
+#define BC_OR            16
+#define BC_NOT_I         17 // a = ~b
+#define BC_NOT_B         18 // a = !b
+#define BC_TEST          19 // a = b != 0
+#define BC_EQ_I          20 // a = b == c, the six comparisons in order
+#define BC_NE_I          21
+#define BC_LT_I          22
+#define BC_LE_I          23
+#define BC_GT_I          24
+#define BC_GE_I          25
+#define BC_EQ_IK         26 // a = b == c
+#define BC_NE_IK         27
+#define BC_LT_IK         28
+#define BC_LE_IK         29
+#define BC_GT_IK         30
+#define BC_GE_IK         31
+#define BC_ADD_F         32
+#define BC_SUB_F         33
+#define BC_MUL_F         34
+#define BC_DIV_F         35
+#define BC_NEG_F         36
+#define BC_EQ_F          37
+#define BC_NE_F          38
+#define BC_LT_F          39
+#define BC_LE_F          40
+#define BC_GT_F          41
+#define BC_GE_F          42
+#define BC_ITOF          43
+#define BC_INDEX         44 // a = address b, element c
+#define BC_LOAD          45 // a = *b
+#define BC_STORE         46 // *a = b
+#define BC_LOAD_INDEX    47 // a = b[c], an index and its load as one
+#define BC_STORE_INDEX   48 // a[b] = c
+#define BC_LOAD_INDEX_K  49 // a = b[c]
+#define BC_STORE_INDEX_K 50 // a[b] = c, b a constant
+#define BC_LOAD_GLOBAL   51 // a = global slot b
+#define BC_STORE_GLOBAL  52 // global slot a = b
+#define BC_ADD_LOAD_I    53 // a = b + c[d], an element loaded and added in one
+#define BC_ADD_LOAD_F    54
+#define BC_JUMP          55 // to a
+#define BC_JUMP_IF       56 // to b when a is true
+#define BC_JUMP_UNLESS   57 // to b when a is false
+#define BC_JEQ_I         58 // to c when a == b, a comparison and its branch in one
+#define BC_JNE_I         59
+#define BC_JLT_I         60
+#define BC_JLE_I         61
+#define BC_JGT_I         62
+#define BC_JGE_I         63
+#define BC_JEQ_IK        64 // to c when a == b
+#define BC_JNE_IK        65
+#define BC_JLT_IK        66
+#define BC_JLE_IK        67
+#define BC_JGT_IK        68
+#define BC_JGE_IK        69
+#define BC_JEQ_F         70
+#define BC_JNE_F         71
+#define BC_JLT_F         72
+#define BC_JLE_F         73
+#define BC_JGT_F         74
+#define BC_JGE_F         75
+#define BC_CHECK         76 // a runtime error unless 0 <= a < b
+#define BC_CALL          77 // a = function b of the d arguments at c in the function's argument list
+#define BC_RET           78 // returns a
+#define BC_RET_VOID      79
+#define BC_PUT_I         80 // writes b, a = true
+#define BC_PUT_F         81
+#define BC_PUT_B         82
+#define BC_PUT_S         83
+#define BC_GET_I         84 // a = the next word read
+#define BC_GET_F         85
+#define BC_GET_B         86
+#define BC_GET_S         87
+#define BC_SQRT          88 // a = sqrt of int b
+#define BC_STRCMP        89 // a = -1, 0 or 1 as string b orders against c
+#define BC_FAIL          90 // stops the program with module message a
+#define BC_COUNT         91
+
+struct BcInstruction {
+    int op;
+    int a = 0, b = 0, c = 0, d = 0;
+};
+
+// a function's bytecode. its parameters are registers 0 up, and the
+// constants and globals it needs in registers are set at its start
+struct BcFunction {
+    std::string name;
+    int params = 0;
+    int registers = 0;
+    std::vector<BcInstruction> code;
+    std::vector<int> args; // the registers each call passes, one run per call
+};
+
+struct BcModule {
+    std::vector<BcFunction> functions;
+    int main = -1;                     // @main's index in functions
+    int globalSlots = 0;               // every global's elements, one slot each
+    std::vector<std::string> strings;  // string constants
+    std::vector<std::string> messages; // the runtime errors BC_FAIL stops with
+};
+
+// counted over a module, reported under -stats as bytecode
+struct BytecodeStats {
+    int functions = 0;
+    int instructions = 0;
+    int superinstructions = 0; // instructions standing for more than one ir instruction
+    int moves = 0;             // copies written for phis
+    double ms = 0.0;
+
+    std::string toJson();
+};
+
+// turns a module's ir into bytecode for the vm. phis become moves on the
+// edges into their blocks, constant operands are folded into the K forms,
+// and indexes, loads and comparisons used once are folded into the
+// instruction using them as superinstructions
+BcModule *compileBytecode(Module *module, BytecodeStats &stats);
+
+// a listing of every function's bytecode, one instruction per line
+void disassemble(BcModule *module, std::ostream &out);
+
+#endif
@@ -0,0 +1,224 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "cache.h"
+#include "driver.h"
+#include "protocol.h"
+#include "sha256.h"
+
+// frame types used inside a cache entry, alongside F_STDOUT and F_OUTPUT
+#define F_KEY 'K'
+
+// creates each missing directory along path
+static void makeDirectories(std::string path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+    mkdir(path.c_str(), 0755);
+}
+
+// writes to a private temporary name and renames it into place, so readers
+// only ever see a missing file or a complete one
+static bool writeFileAtomic(std::string path, std::string contents) {
+    static int sequence = 0;
+    std::string temporary = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(sequence++);
+    std::ofstream out(temporary, std::ofstream::binary | std::ofstream::trunc);
+    out << contents;
+    out.close();
+    if (!out || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+CompileCache::CompileCache() {
+    char *directory = getenv("COMPILE_CACHE_DIR");
+    char *megabytes = getenv("COMPILE_CACHE_MB");
+    this->dir = (directory != NULL && directory[0] != '\0') ? directory : BUILD_DIR CACHE_DIR;
+    if (this->dir.back() != '/') this->dir += '/';
+    long limit = (megabytes != NULL) ? atol(megabytes) : CACHE_DEFAULT_MB;
+    this->maxBytes = (limit > 0 ? limit : CACHE_DEFAULT_MB) * 1024 * 1024;
+}
+
+CompileCache::CompileCache(std::string directory, long byteLimit) {
+    this->dir = directory;
+    if (this->dir.back() != '/') this->dir += '/';
+    this->maxBytes = byteLimit;
+}
+
+CompileCache::~CompileCache() {
+    if (this->evictionPending) this->evict();
+}
+
+// the key covers everything that can change the outputs of a compile
+std::string CompileCache::makeKey(std::string optionsKey, std::string source) {
+    Sha256 hasher;
+    hasher.update(std::string(COMPILER_VERSION) + '\0' + optionsKey + '\0');
+    hasher.update(source);
+    return hasher.hexDigest();
+}
+
+// entries fan out over 256 subdirectories named by the first key byte
+std::string CompileCache::entryPath(std::string key) {
+    return this->dir + key.substr(0, 2) + "/" + key;
+}
+
+bool CompileCache::lookup(std::string key, CacheEntry &entry) {
+    std::string path = this->entryPath(key);
+    std::string contents;
+    Frame frame;
+    size_t offset = 0;
+
+    // the stored key guards against truncated or foreign files
+    if (!readFile(path, contents) || !nextFrame(contents, offset, frame)
+        || frame.type != F_KEY || frame.payload != key) {
+        this->counters.misses++;
+        this->saveCounters();
+        return false;
+    }
+
+    entry = CacheEntry();
+    while (nextFrame(contents, offset, frame)) {
+        if (frame.type == F_STDOUT) entry.printed += frame.payload;
+        else if (frame.type == F_OUTPUT) {
+            size_t split = frame.payload.find('\0');
+            if (split == std::string::npos) continue;
+            entry.outputs.push_back(std::make_pair(frame.payload.substr(0, split), frame.payload.substr(split + 1)));
+        }
+    }
+
+    // a hit refreshes the modification time, which is what eviction orders by
+    utimensat(AT_FDCWD, path.c_str(), NULL, 0);
+    this->counters.hits++;
+    this->saveCounters();
+    return true;
+}
+
+void CompileCache::store(std::string key, CacheEntry entry) {
+    std::string contents;
+    appendFrame(contents, F_KEY, key);
+    appendFrame(contents, F_STDOUT, entry.printed);
+    for (auto const &output : entry.outputs) {
+        appendFrame(contents, F_OUTPUT, output.first + '\0' + output.second);
+    }
+
+    makeDirectories(this->dir + key.substr(0, 2));
+    if (!writeFileAtomic(this->entryPath(key), contents)) return;
+    this->counters.stores++;
+    this->evict();
+    this->saveCounters();
+}
+
+bool CompileCache::loadBlob(std::string key, std::string &blob) {
+    std::string path = this->entryPath(key);
+    std::string contents;
+    Frame frame;
+    size_t offset = 0;
+
+    if (!readFile(path, contents) || !nextFrame(contents, offset, frame)
+        || frame.type != F_KEY || frame.payload != key) return false;
+    blob = contents.substr(offset);
+    utimensat(AT_FDCWD, path.c_str(), NULL, 0);
+    return true;
+}
+
+void CompileCache::storeBlob(std::string key, std::string blob) {
+    std::string contents;
+    appendFrame(contents, F_KEY, key);
+    contents += blob;
+
+    makeDirectories(this->dir + key.substr(0, 2));
+    if (!writeFileAtomic(this->entryPath(key), contents)) return;
+    this->evictionPending = true;
+}
+
+// removes the least recently used entries until the directory fits its limit
+void CompileCache::evict() {
+    this->evictionPending = false;
+    struct Candidate {
+        struct timespec used;
+        long size;
+        std::string path;
+    };
+    std::vector<Candidate> entries;
+    long total = 0;
+
+    DIR *top = opendir(this->dir.c_str());
+    if (top == NULL) return;
+    for (struct dirent *sub = readdir(top); sub != NULL; sub = readdir(top)) {
+        if (sub->d_name[0] == '.' || strlen(sub->d_name) != 2) continue;
+        std::string subPath = this->dir + sub->d_name + "/";
+        DIR *bucket = opendir(subPath.c_str());
+        if (bucket == NULL) continue;
+        for (struct dirent *file = readdir(bucket); file != NULL; file = readdir(bucket)) {
+            if (file->d_name[0] == '.' || strchr(file->d_name, '.') != NULL) continue;
+            struct stat info;
+            std::string path = subPath + file->d_name;
+            if (stat(path.c_str(), &info) != 0) continue;
+            entries.push_back({ info.st_mtim, (long)info.st_size, path });
+            total += info.st_size;
+        }
+        closedir(bucket);
+    }
+    closedir(top);
+
+    if (total <= this->maxBytes) return;
+    std::sort(entries.begin(), entries.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+        return a.used.tv_nsec < b.used.tv_nsec;
+    });
+    for (size_t i = 0; i < entries.size() && total > this->maxBytes; i++) {
+        if (unlink(entries[i].path.c_str()) != 0) continue;
+        total -= entries[i].size;
+        this->counters.evictions++;
+    }
+}
+
+static CacheCounters parseCounters(std::string contents) {
+    CacheCounters totals;
+    std::istringstream in(contents);
+    std::string name;
+    long value;
+    while (in >> name >> value) {
+        if (name == "hits") totals.hits = value;
+        else if (name == "misses") totals.misses = value;
+        else if (name == "stores") totals.stores = value;
+        else if (name == "evictions") totals.evictions = value;
+    }
+    return totals;
+}
+
+CacheCounters CompileCache::totalCounters() {
+    std::string contents;
+    readFile(this->dir + "counters", contents);
+    return parseCounters(contents);
+}
+
+// folds this process's counters into the directory's running totals
+// concurrent compiles can lose an increment, never corrupt the file
+void CompileCache::saveCounters() {
+    CacheCounters totals = this->totalCounters();
+    totals.hits += this->counters.hits - this->saved.hits;
+    totals.misses += this->counters.misses - this->saved.misses;
+    totals.stores += this->counters.stores - this->saved.stores;
+    totals.evictions += this->counters.evictions - this->saved.evictions;
+
+    std::ostringstream out;
+    out << "hits " << totals.hits << "\nmisses " << totals.misses
+        << "\nstores " << totals.stores << "\nevictions " << totals.evictions << "\n";
+    makeDirectories(this->dir.substr(0, this->dir.size() - 1));
+    if (writeFileAtomic(this->dir + "counters", out.str())) {
+        this->saved = this->counters;
+    }
+}
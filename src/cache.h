@@ -0,0 +1,61 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <list>
+#include <string>
+
+// cache directory and size bound used when the environment doesn't say
+#define CACHE_DIR "cache/"
+#define CACHE_DEFAULT_MB 64
+
+// everything a compile produced: what it printed and the files it wrote
+struct CacheEntry {
+    std::string printed;
+    std::list<std::pair<std::string, std::string>> outputs;
+};
+
+// hit/miss bookkeeping, kept per process and summed on disk
+struct CacheCounters {
+    long hits = 0, misses = 0, stores = 0, evictions = 0;
+};
+
+// content addressed store of finished compiles
+// entries are named by a SHA-256 of the compiler version, options and source
+// bytes, written atomically, and evicted least recently used first once the
+// directory grows past its byte limit
+class CompileCache {
+    std::string dir;
+    long maxBytes;
+    CacheCounters counters, saved; // saved is what has reached the disk
+    bool evictionPending = false;
+
+    std::string entryPath(std::string key);
+    void evict();
+    void saveCounters();
+
+    public:
+        // COMPILE_CACHE_DIR and COMPILE_CACHE_MB override the defaults
+        CompileCache();
+        CompileCache(std::string directory, long byteLimit);
+
+        // blob stores defer their eviction pass to here
+        ~CompileCache();
+
+        static std::string makeKey(std::string optionsKey, std::string source);
+
+        bool lookup(std::string key, CacheEntry &entry);
+        void store(std::string key, CacheEntry entry);
+
+        // raw artifacts that share the directory and its eviction, such as
+        // the per-procedure results kept for incremental compiles
+        // these don't move the hit/miss counters, their callers keep their own
+        bool loadBlob(std::string key, std::string &blob);
+        void storeBlob(std::string key, std::string blob);
+
+        CacheCounters getCounters() { return counters; }
+
+        // counters summed over every process that has used this directory
+        CacheCounters totalCounters();
+};
+
+#endif
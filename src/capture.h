@@ -0,0 +1,29 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <streambuf>
+#include <string>
+
+// copies everything written to a stream into a string on its way through
+// install with stream.rdbuf(&capture) and put the original back afterwards
+class CaptureBuf : public std::streambuf {
+    std::streambuf *original;
+
+    protected:
+        int overflow(int c) {
+            if (c == EOF) return c;
+            this->captured += (char)c;
+            return this->original->sputc(c);
+        }
+        std::streamsize xsputn(const char *s, std::streamsize n) {
+            this->captured.append(s, n);
+            return this->original->sputn(s, n);
+        }
+        int sync() { return this->original->pubsync(); }
+
+    public:
+        std::string captured;
+        CaptureBuf(std::streambuf *target) { original = target; }
+};
+
+#endif
@@ -0,0 +1,113 @@
+//  recursive descent compiler by Andrew Miller
+//  thin client for the compile server, used exactly like compile
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "driver.h"
+#include "link.h"
+#include "protocol.h"
+
+int main(int argc, char **argv) {
+    // Check arg count
+    if (argc < 2) {
+        std::cout << "Parser requires filename argument\n";
+        return 0;
+    }
+    // Check file exists
+    char *filename = argv[1];
+    struct stat buffer;
+    if (stat(filename, &buffer) != 0) {
+        std::cout << "No source file detected with name: \"" << filename << "\"\n";
+        return 0;
+    }
+    std::cout << "File detected...\n";
+
+    std::ifstream inputFile(filename);
+    std::string contents((std::istreambuf_iterator<char>(inputFile)),
+        std::istreambuf_iterator<char>());
+
+    if (contents.size() > MAX_FRAME_LENGTH) {
+        std::cout << "\"" << filename << "\" is too large to send to the compile server\n";
+        return 1;
+    }
+
+    CompileOptions options = parseOptions(argc, argv, 2);
+    bool runs = options.interp || options.vm || options.run;
+
+    std::string socketPath = serverSocketPath();
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (server < 0 || connect(server, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        std::cout << "No compile server listening on \"" << socketPath
+            << "\", start one with \"compile -server\"\n";
+        return 1;
+    }
+
+    // linked here afterwards, the way compile does it
+    if (options.native && !options.run) removeProgram(BUILD_DIR);
+
+    // flags are forwarded untouched so the server parses them like compile does
+    std::string request;
+    for (int i = 2; i < argc; i++) appendFrame(request, F_ARG, argv[i]);
+    appendFrame(request, F_NAME, filename);
+    appendFrame(request, F_SOURCE, contents);
+    if (!writeAll(server, request)) {
+        std::cout << "Lost connection to the compile server\n";
+        return 1;
+    }
+
+    // a program run by -interp, -vm or -run reads this client's input, not the
+    // server's, so it is passed on as it arrives, and an empty frame ends it
+    bool reading = runs;
+    Frame frame;
+    while (true) {
+        struct pollfd fds[2] = { { server, POLLIN, 0 }, { reading ? STDIN_FILENO : -1, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents != 0) {
+            char buffer[4096];
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            std::string input;
+            appendFrame(input, F_INPUT, n > 0 ? std::string(buffer, n) : "");
+            if (n <= 0) reading = false;
+            if (!writeAll(server, input)) reading = false;
+        }
+        if (fds[0].revents == 0) continue;
+        if (!readFrame(server, frame)) break;
+
+        if (frame.type == F_STDOUT) {
+            // flushed so a prompt shows before the program waits on input
+            std::cout << frame.payload;
+            std::cout.flush();
+        }
+        else if (frame.type == F_OUTPUT) {
+            size_t split = frame.payload.find('\0');
+            std::string name = frame.payload.substr(0, split);
+            if (split == std::string::npos || name.find('/') != std::string::npos) continue;
+            std::ofstream out(BUILD_DIR + name, std::ofstream::out | std::ofstream::trunc);
+            out << frame.payload.substr(split + 1);
+        }
+        else if (frame.type == F_EXIT) {
+            close(server);
+            int status = atoi(frame.payload.c_str());
+            if (status == 0 && options.native && !options.run) status = linkProgram(BUILD_DIR, options);
+            return status;
+        }
+    }
+
+    std::cout << "Lost connection to the compile server\n";
+    return 1;
+}
@@ -0,0 +1,895 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include "codegen.h"
+#include "interp.h"
+#include "isel.h"
+#include "stats.h"
+
+#define INT_ARG_REGISTERS   6 // rdi, rsi, rdx, rcx, r8, r9
+#define FLOAT_ARG_REGISTERS 8 // xmm0 to xmm7
+
+static const int intArgs[INT_ARG_REGISTERS] = {REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9};
+
+// strings and pointers take all of a register, everything else the low 32 bits
+static bool wide(int type) {
+    return type == IR_STRING || type == IR_PTR;
+}
+
+static int moveFor(int type) {
+    return wide(type) ? X86_MOVQ : X86_MOVL;
+}
+
+// where an argument goes under the sysv abi: the next free register of its
+// class, or the next stack slot once those run out
+struct ArgPlace {
+    bool isFloat;
+    int reg;   // -1 when on the stack
+    int stack; // slot number above the return address
+};
+
+static std::vector<ArgPlace> placeArgs(const std::vector<int> &types, int &stackSlots) {
+    std::vector<ArgPlace> places;
+    int ints = 0, floats = 0;
+    stackSlots = 0;
+    for (size_t i = 0; i < types.size(); i++) {
+        ArgPlace place = {types[i] == IR_FLOAT, -1, -1};
+        int &used = place.isFloat ? floats : ints;
+        if (used < (place.isFloat ? FLOAT_ARG_REGISTERS : INT_ARG_REGISTERS)) place.reg = used++;
+        else place.stack = stackSlots++;
+        places.push_back(place);
+    }
+    return places;
+}
+
+// somewhere an instruction can read a value from or a move can write one to
+#define PLACE_REGISTER  0
+#define PLACE_FRAME     1 // at an offset from rbp
+#define PLACE_IMMEDIATE 2
+#define PLACE_MEMORY    3 // an address a tile folded in
+
+struct Place {
+    int kind;
+    int value;          // the register, the offset or the immediate, for memory the base register or -1
+    Operand memory;     // for memory, the operand
+
+    bool operator==(const Place &other) const { return kind == other.kind && value == other.value && memory == other.memory; }
+    bool operator!=(const Place &other) const { return !(*this == other); }
+    bool isRegister() const { return kind == PLACE_REGISTER; }
+    bool isFloat() const { return kind == PLACE_REGISTER && isFloatRegister(value); }
+    bool inMemory() const { return kind == PLACE_FRAME || kind == PLACE_MEMORY; }
+};
+
+static Place inRegister(int reg) {
+    return {PLACE_REGISTER, reg};
+}
+
+static Place atAddress(const Operand &memory) {
+    return {PLACE_MEMORY, memory.reg == REG_RIP ? -1 : memory.reg, memory};
+}
+
+// the place as an instruction's operand
+static Operand operandAt(const Place &place) {
+    if (place.kind == PLACE_IMMEDIATE) return imm(place.value);
+    if (place.kind == PLACE_MEMORY) return place.memory;
+    if (place.kind == PLACE_FRAME) return mem(REG_RBP, place.value);
+    return reg(place.value);
+}
+
+// condition codes for each comparison of ints
+static const int conditions[] = {CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE};
+
+static int inverse(int condition) {
+    return condition ^ 1;
+}
+
+// one copy of a parallel move
+struct Transfer {
+    Place from, to;
+    int type;
+};
+
+// one function after another, a tile at a time, into a sink that writes
+// assembly text or machine code, each value wherever the
+// register allocator put it at the tile being written. tiles read their
+// operands straight from registers, the frame, immediates or the memory a
+// folded load reads where x86 allows it, and otherwise through rax, rcx, rdx,
+// r11 and xmm0, which nothing is allocated to. a folded address loads its
+// index into rcx and, when it must, its base into r11
+class CodeWriter {
+    Module *module;
+    CodeSink &out;
+    bool tiling;
+    bool registers;
+    SelectionStats &selectionStats;
+    RegisterStats &registerStats;
+    std::ostream *problems;             // where a broken allocation is reported, when checking
+    bool valid = true;
+    std::map<std::string, int> strings; // each constant's label number
+
+    Function *function = NULL;
+    Selection *selection = NULL;
+    RegisterAllocation *allocation = NULL;
+    int number = 0;                     // the function's index, keeping its labels apart
+    int position = 0;                   // of the instruction being written
+    std::vector<int> slots;             // frame offset by value id, for values the stack holds somewhere
+    std::vector<int> homes;             // frame offset of each parameter
+    std::map<int, int> areas;           // storage for each alloca, by id
+    std::vector<int> saves;             // where each callee saved register in use is kept
+    int frame = 0;
+    int labels = 0;
+    Block *next = NULL;                 // the block written after the current one
+
+    std::string blockLabel(Block *block);
+    std::string newLabel();
+    std::string nameLabel();
+    int stringLabel(const std::string &text);
+    Place place(Instruction *value, int location);
+    Place operand(Instruction *value);
+    Place result(Instruction *instruction);
+    Place loaded(Instruction *value, int scratch);
+    Place operandOf(Instruction *instruction, size_t i);
+    Place address(Instruction *instruction, size_t i);
+    Place element(Instruction *index);
+    int flags(Instruction *instruction);
+    int condition(Instruction *instruction, size_t i);
+    void move(Place from, Place to, int type);
+    void parallelMove(std::vector<Transfer> transfers);
+    void moves(const std::vector<Move> &moves);
+    void layout();
+    void prologue();
+    void epilogue();
+    void edge(Block *from, Block *to);
+    void jump(Block *from, Block *to);
+    void arithmetic(Instruction *instruction);
+    void compare(Instruction *instruction);
+    void divide(Instruction *instruction);
+    void call(Instruction *instruction, const std::vector<Move> &moves);
+    void instruction(Instruction *instruction);
+    void writeFunction(Function *function);
+    void writeData();
+
+    public:
+        CodeWriter(Module *module, CodeSink &out, bool tiling, bool registers, SelectionStats &selectionStats,
+            RegisterStats &registerStats, std::ostream *problems) :
+            module(module), out(out), tiling(tiling), registers(registers), selectionStats(selectionStats),
+            registerStats(registerStats), problems(problems) {}
+        bool write();
+};
+
+std::string CodeWriter::blockLabel(Block *block) {
+    return ".L" + std::to_string(this->number) + "_" + std::to_string(block->id);
+}
+
+std::string CodeWriter::newLabel() {
+    return ".L" + std::to_string(this->number) + "x" + std::to_string(this->labels++);
+}
+
+// the function's own name, for runtime errors
+std::string CodeWriter::nameLabel() {
+    return ".L" + std::to_string(this->number) + "name";
+}
+
+int CodeWriter::stringLabel(const std::string &text) {
+    std::map<std::string, int>::iterator found = this->strings.find(text);
+    if (found != this->strings.end()) return found->second;
+    int label = this->strings.size();
+    this->strings[text] = label;
+    return label;
+}
+
+Place CodeWriter::place(Instruction *value, int location) {
+    if (location == LOC_CONSTANT) return {PLACE_IMMEDIATE, value->intValue};
+    if (location == LOC_STACK) return {PLACE_FRAME, this->slots[value->id]};
+    return inRegister(location);
+}
+
+Place CodeWriter::operand(Instruction *value) {
+    return this->place(value, this->allocation->locationAt(value, this->position));
+}
+
+Place CodeWriter::result(Instruction *instruction) {
+    return this->place(instruction, this->allocation->locationAt(instruction, this->position + 1));
+}
+
+// the operand in a register, scratch unless it's in one already
+Place CodeWriter::loaded(Instruction *value, int scratch) {
+    Place from = this->operand(value);
+    if (from.isRegister()) return from;
+    this->move(from, inRegister(scratch), value->type);
+    return inRegister(scratch);
+}
+
+// operand i the way the tile takes it, from memory when it folded the load in
+Place CodeWriter::operandOf(Instruction *instruction, size_t i) {
+    if (this->selection->operandAs(instruction, i) == NT_MEM) return this->address(instruction->operands[i], 0);
+    return this->operand(instruction->operands[i]);
+}
+
+// operand i as a memory operand: a global or an alloca's storage by name, a
+// folded index, or the address in its register
+Place CodeWriter::address(Instruction *instruction, size_t i) {
+    Instruction *value = instruction->operands[i];
+    if (this->selection->operandAs(instruction, i) == NT_ADDR) {
+        if (value->op == OP_GLOBAL) return atAddress(ripRelative("glob_" + value->name));
+        if (value->op == OP_ALLOCA) return atAddress(mem(REG_RBP, this->areas[value->id]));
+        return this->element(value);
+    }
+    Place base = this->operand(value);
+    if (!base.isRegister()) {
+        this->move(base, inRegister(REG_R11), IR_PTR);
+        base = inRegister(REG_R11);
+    }
+    return atAddress(mem(base.value, 0));
+}
+
+// the element an index picks out. a constant index, and one a constant is
+// added to, go in the displacement. rip relative addressing takes no index
+// register, so a global indexed by one has its address loaded first
+Place CodeWriter::element(Instruction *index) {
+    CodeSink &out = this->out;
+    Instruction *array = index->operands[0], *at = index->operands[1];
+    int size = irTypeSize(index->elemType);
+    long displacement = 0;
+    if (this->selection->operandAs(index, 1) == NT_INDEX) {
+        displacement = (long)at->operands[1]->intValue * size;
+        at = at->operands[0];
+    }
+    Place position = this->operand(at);
+    bool scaled = position.kind != PLACE_IMMEDIATE;
+    if (scaled) out.instruction(X86_MOVSLQ, operandAt(position), reg(REG_RCX));
+    else displacement += (long)position.value * size;
+
+    int base, as = this->selection->operandAs(index, 0);
+    if (as != NT_REG && array->op == OP_ALLOCA) {
+        displacement += this->areas[array->id];
+        base = REG_RBP;
+    }
+    else if (as == NT_ADDR && !scaled) {
+        Place at = this->address(index, 0);
+        at.memory.value += displacement;
+        return at;
+    }
+    else if (as == NT_ADDR) {
+        out.instruction(X86_LEAQ, this->address(index, 0).memory, reg(REG_R11));
+        base = REG_R11;
+    }
+    else {
+        Place from = this->operand(array);
+        if (!from.isRegister()) this->move(from, inRegister(REG_R11), IR_PTR);
+        base = from.isRegister() ? from.value : REG_R11;
+    }
+    return atAddress(scaled ? mem(base, displacement, REG_RCX, size) : mem(base, displacement));
+}
+
+// any place to any place but an immediate, through rax when both are in the
+// frame. a float can sit in a general register on its way somewhere, a
+// vector only ever in an xmm register or 16 bytes of memory
+void CodeWriter::move(Place from, Place to, int type) {
+    CodeSink &out = this->out;
+    if (from == to) return;
+    int mov = moveFor(type);
+    if (irIsVector(type)) {
+        if (from.isRegister() && to.isRegister()) out.instruction(X86_MOVAPS, operandAt(from), operandAt(to));
+        else if (from.isRegister() || to.isRegister()) out.instruction(X86_MOVUPS, operandAt(from), operandAt(to));
+        else {
+            for (int half = 0; half < 2; half++) {
+                Operand source = operandAt(from), destination = operandAt(to);
+                source.value += 8 * half;
+                destination.value += 8 * half;
+                out.instruction(X86_MOVQ, source, reg(REG_RAX));
+                out.instruction(X86_MOVQ, reg(REG_RAX), destination);
+            }
+        }
+    }
+    else if (to.isFloat()) {
+        if (from.isFloat()) out.instruction(X86_MOVAPS, operandAt(from), operandAt(to));
+        else if (from.inMemory()) out.instruction(X86_MOVSS, operandAt(from), operandAt(to));
+        else {
+            if (from.kind == PLACE_IMMEDIATE) {
+                out.instruction(X86_MOVL, operandAt(from), reg(REG_RAX));
+                from = inRegister(REG_RAX);
+            }
+            out.instruction(X86_MOVD, operandAt(from), operandAt(to));
+        }
+    }
+    else if (from.isFloat()) {
+        if (to.inMemory()) out.instruction(X86_MOVSS, operandAt(from), operandAt(to));
+        else out.instruction(X86_MOVD, operandAt(from), operandAt(to));
+    }
+    else if (from.inMemory() && to.inMemory()) {
+        out.instruction(mov, operandAt(from), reg(REG_RAX));
+        out.instruction(mov, reg(REG_RAX), operandAt(to));
+    }
+    else out.instruction(mov, operandAt(from), operandAt(to));
+}
+
+// copies made as though all at once: each goes once nothing still to come
+// reads its destination, and a cycle is broken by parking one source in r11,
+// or xmm0 for floats in registers and for vectors
+void CodeWriter::parallelMove(std::vector<Transfer> transfers) {
+    for (size_t i = 0; i < transfers.size(); i++) {
+        if (transfers[i].from == transfers[i].to) transfers.erase(transfers.begin() + i--);
+    }
+    while (!transfers.empty()) {
+        bool moved = false;
+        for (size_t i = 0; i < transfers.size() && !moved; i++) {
+            bool read = false;
+            for (size_t j = 0; j < transfers.size() && !read; j++) read = j != i && transfers[j].from == transfers[i].to;
+            if (read) continue;
+            this->move(transfers[i].from, transfers[i].to, transfers[i].type);
+            transfers.erase(transfers.begin() + i);
+            moved = true;
+        }
+        if (moved) continue;
+        Place parked = inRegister(transfers[0].from.isFloat() || irIsVector(transfers[0].type) ? REG_XMM0 : REG_R11);
+        Place source = transfers[0].from;
+        this->move(source, parked, transfers[0].type);
+        for (size_t i = 0; i < transfers.size(); i++) {
+            if (transfers[i].from == source) transfers[i].from = parked;
+        }
+    }
+}
+
+void CodeWriter::moves(const std::vector<Move> &moves) {
+    if (moves.empty()) return;
+    std::vector<Transfer> transfers;
+    for (size_t i = 0; i < moves.size(); i++) {
+        transfers.push_back({this->place(moves[i].from, moves[i].fromLocation), this->place(moves[i].to, moves[i].toLocation), moves[i].to->type});
+    }
+    this->parallelMove(transfers);
+}
+
+// a slot for every value the stack holds at some point, 16 bytes for a
+// vector and 8 for anything else, storage for each alloca, a home for each
+// register parameter and room to keep each callee saved register, below the
+// saved rbp
+void CodeWriter::layout() {
+    Function *function = this->function;
+    RegisterAllocation *allocation = this->allocation;
+    int used = 0;
+    this->slots.assign(function->nextValueId, 0);
+    this->areas.clear();
+    for (size_t i = 0; i < allocation->order.size(); i++) {
+        std::list<Instruction*> &instructions = allocation->order[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (allocation->needsSlot[instruction->id]) this->slots[instruction->id] = -(used += irIsVector(instruction->type) ? 16 : 8);
+            if (instruction->op == OP_ALLOCA) {
+                int bytes = instruction->intValue * irTypeSize(instruction->elemType);
+                this->areas[instruction->id] = -(used += (bytes + 7) / 8 * 8);
+            }
+        }
+    }
+
+    int stackSlots;
+    std::vector<ArgPlace> places = placeArgs(function->paramTypes, stackSlots);
+    this->homes.clear();
+    for (size_t i = 0; i < places.size(); i++) {
+        if (places[i].reg >= 0) this->homes.push_back(-(used += 8));
+        else this->homes.push_back(16 + 8 * places[i].stack);
+    }
+    this->saves.clear();
+    for (size_t i = 0; i < allocation->calleeSaved.size(); i++) this->saves.push_back(-(used += 8));
+    // calls need rsp on a 16 byte boundary, which it is just after pushing rbp
+    this->frame = (used + 15) / 16 * 16;
+}
+
+// keeps the callee saved registers the allocator gave out, counts the call
+// against the same depth limit the interpreter has, then moves register
+// parameters to their homes
+void CodeWriter::prologue() {
+    CodeSink &out = this->out;
+    out.instruction(X86_PUSHQ, reg(REG_RBP));
+    out.instruction(X86_MOVQ, reg(REG_RSP), reg(REG_RBP));
+    if (this->frame > 0) out.instruction(X86_SUBQ, imm(this->frame), reg(REG_RSP));
+    for (size_t i = 0; i < this->saves.size(); i++) {
+        out.instruction(X86_MOVQ, reg(this->allocation->calleeSaved[i]), mem(REG_RBP, this->saves[i]));
+    }
+    out.instruction(X86_MOVL, ripRelative("rt_depth"), reg(REG_RAX));
+    out.instruction(X86_CMPL, imm(INTERP_MAX_DEPTH), reg(REG_RAX));
+    out.instruction(X86_J + CC_AE, label(this->nameLabel() + "overflow"));
+    out.instruction(X86_INCL, reg(REG_RAX));
+    out.instruction(X86_MOVL, reg(REG_RAX), ripRelative("rt_depth"));
+
+    int stackSlots;
+    std::vector<ArgPlace> places = placeArgs(this->function->paramTypes, stackSlots);
+    for (size_t i = 0; i < places.size(); i++) {
+        if (places[i].reg < 0) continue;
+        Place reg = inRegister(places[i].isFloat ? REG_XMM0 + places[i].reg : intArgs[places[i].reg]);
+        this->move(reg, {PLACE_FRAME, this->homes[i]}, this->function->paramTypes[i]);
+    }
+}
+
+// everything a return or a tail call does before leaving, short of the jump
+void CodeWriter::epilogue() {
+    CodeSink &out = this->out;
+    for (size_t i = 0; i < this->saves.size(); i++) {
+        out.instruction(X86_MOVQ, mem(REG_RBP, this->saves[i]), reg(this->allocation->calleeSaved[i]));
+    }
+    out.instruction(X86_DECL, ripRelative("rt_depth"));
+    out.instruction(X86_LEAVE);
+}
+
+void CodeWriter::edge(Block *from, Block *to) {
+    this->moves(this->allocation->edgeMoves(from, to));
+}
+
+void CodeWriter::jump(Block *from, Block *to) {
+    this->edge(from, to);
+    if (to != this->next) this->out.instruction(X86_JMP, label(this->blockLabel(to)));
+}
+
+// the result register when it's free to build the result in, otherwise rax
+// or xmm0. subtraction and division can't take the second operand's
+// register, nor anything a folded load's address needs. a packed instruction
+// only reads memory aligned to 16 bytes, which a slot isn't, so a vector
+// from the frame is read into xmm1 first
+void CodeWriter::arithmetic(Instruction *instruction) {
+    static const int ints[] = {X86_ADDL, X86_SUBL, X86_IMULL};
+    static const int floatOps[] = {X86_ADDSS, X86_SUBSS, X86_MULSS, X86_DIVSS};
+    static const int packedOps[] = {X86_ADDPS, X86_SUBPS, X86_MULPS, X86_DIVPS};
+    bool vectors = irIsVector(instruction->type);
+    bool floats = instruction->type == IR_FLOAT || vectors;
+    int op = instruction->op;
+    Place a = this->operandOf(instruction, 0), b = this->operandOf(instruction, 1), d = this->result(instruction);
+    Instruction *second = instruction->operands[1];
+    bool commutes = op == OP_ADD || op == OP_MUL || op == OP_AND || op == OP_OR;
+    if (a.kind == PLACE_MEMORY || (commutes && d.isRegister() && b == d)) {
+        std::swap(a, b);
+        second = instruction->operands[0];
+    }
+    if (vectors && !b.isRegister()) b = this->loaded(second, REG_XMM0 + 1);
+    bool free = d.isRegister() && b != d && !(b.kind == PLACE_MEMORY && b.value == d.value);
+    Place x = free ? d : inRegister(floats ? REG_XMM0 : REG_RAX);
+    this->move(a, x, instruction->type);
+    int name = floats ? floatOps[op - OP_ADD] : op == OP_AND ? X86_ANDL : op == OP_OR ? X86_ORL : ints[op - OP_ADD];
+    if (instruction->type == IR_VFLOAT) name = packedOps[op - OP_ADD];
+    else if (instruction->type == IR_VINT) name = op == OP_ADD ? X86_PADDD : X86_PSUBD;
+    this->out.instruction(name, operandAt(b), operandAt(x));
+    this->move(x, d, instruction->type);
+}
+
+// sets the flags for a comparison, or for a not of a bool the tile takes as a
+// condition, giving the condition code that holds when it's true. a > b and
+// a >= b on floats are above and above or equal, the others turn round, and
+// an unordered comparison is neither
+int CodeWriter::flags(Instruction *instruction) {
+    CodeSink &out = this->out;
+    int op = instruction->op;
+    if (op == OP_NOT) return inverse(this->condition(instruction, 0));
+    if (instruction->operands[0]->type == IR_FLOAT) {
+        bool turned = op == OP_LT || op == OP_LE;
+        Place left = this->operandOf(instruction, turned ? 1 : 0);
+        if (!left.isFloat()) {
+            this->move(left, inRegister(REG_XMM0), IR_FLOAT);
+            left = inRegister(REG_XMM0);
+        }
+        Place right = this->operandOf(instruction, turned ? 0 : 1);
+        out.instruction(X86_UCOMISS, operandAt(right), operandAt(left));
+        return op == OP_EQ ? CC_E : op == OP_NE ? CC_NE : op == OP_LT || op == OP_GT ? CC_A : CC_AE;
+    }
+    Place left = this->operandOf(instruction, 0), right = this->operandOf(instruction, 1);
+    bool direct = left.kind == PLACE_MEMORY && (right.isRegister() || right.kind == PLACE_IMMEDIATE);
+    if (!left.isRegister() && !direct) {
+        this->move(left, inRegister(REG_RAX), IR_INT);
+        left = inRegister(REG_RAX);
+    }
+    out.instruction(X86_CMPL, operandAt(right), operandAt(left));
+    return conditions[op - OP_EQ];
+}
+
+// the flags for operand i taken as a condition, folded in or tested
+int CodeWriter::condition(Instruction *instruction, size_t i) {
+    CodeSink &out = this->out;
+    if (this->selection->operandAs(instruction, i) == NT_FLAGS) return this->flags(instruction->operands[i]);
+    Place value = this->operand(instruction->operands[i]);
+    if (value.kind == PLACE_IMMEDIATE) value = this->loaded(instruction->operands[i], REG_RAX);
+    if (value.isRegister()) out.instruction(X86_TESTL, operandAt(value), operandAt(value));
+    else out.instruction(X86_CMPL, imm(0), operandAt(value));
+    return CC_NE;
+}
+
+// bool results are 0 or 1. an unordered float comparison is false, and
+// makes ne true
+void CodeWriter::compare(Instruction *instruction) {
+    CodeSink &out = this->out;
+    Instruction *a = instruction->operands[0], *b = instruction->operands[1];
+    if (a->type == IR_FLOAT && (instruction->op == OP_EQ || instruction->op == OP_NE)) {
+        Place left = this->loaded(a, REG_XMM0);
+        out.instruction(X86_UCOMISS, operandAt(this->operand(b)), operandAt(left));
+        bool equal = instruction->op == OP_EQ;
+        out.instruction(X86_SET + (equal ? CC_E : CC_NE), reg(REG_RAX));
+        out.instruction(X86_SET + (equal ? CC_NP : CC_P), reg(REG_RCX));
+        out.instruction(equal ? X86_ANDB : X86_ORB, reg(REG_RCX), reg(REG_RAX));
+    }
+    else out.instruction(X86_SET + this->flags(instruction), reg(REG_RAX));
+    Place d = this->result(instruction);
+    out.instruction(X86_MOVZBL, reg(REG_RAX), reg(d.isRegister() ? d.value : REG_RAX));
+    if (!d.isRegister()) this->move(inRegister(REG_RAX), d, IR_BOOL);
+}
+
+// idiv faults on zero and on INT_MIN / -1, so zero stops the program the
+// way the interpreter does and -1 negates, wrapping
+void CodeWriter::divide(Instruction *instruction) {
+    CodeSink &out = this->out;
+    if (irLaneType(instruction->type) == IR_FLOAT) {
+        this->arithmetic(instruction);
+        return;
+    }
+    std::string nonzero = this->newLabel(), negate = this->newLabel(), done = this->newLabel();
+    this->move(this->operand(instruction->operands[1]), inRegister(REG_RCX), IR_INT);
+    this->move(this->operand(instruction->operands[0]), inRegister(REG_RAX), IR_INT);
+    out.instruction(X86_TESTL, reg(REG_RCX), reg(REG_RCX));
+    out.instruction(X86_J + CC_NE, label(nonzero));
+    out.instruction(X86_LEAQ, ripRelative(this->nameLabel()), reg(REG_RDI));
+    out.instruction(X86_CALL, symbol("rt_divide"));
+    out.label(nonzero);
+    out.instruction(X86_CMPL, imm(-1), reg(REG_RCX));
+    out.instruction(X86_J + CC_E, label(negate));
+    out.instruction(X86_CLTD);
+    out.instruction(X86_IDIVL, reg(REG_RCX));
+    out.instruction(X86_JMP, label(done));
+    out.label(negate);
+    out.instruction(X86_NEGL, reg(REG_RAX));
+    out.label(done);
+    this->move(inRegister(REG_RAX), this->result(instruction), IR_INT);
+}
+
+// a tail call to one of the program's functions whose arguments all fit in
+// registers leaves this frame and jumps, so its callee returns straight to
+// ours. it doesn't count as a call deeper either. the allocator keeps nothing
+// in a caller saved register across it. an argument read here can share its
+// register with a piece the allocator starts here, so the arguments are found
+// where they were just before and go in one parallel move with its moves
+void CodeWriter::call(Instruction *instruction, const std::vector<Move> &moves) {
+    CodeSink &out = this->out;
+    Function *callee = this->module->find(instruction->name);
+    bool runtime = callee != NULL && callee->external;
+    std::string name = (runtime ? "rt_" : "prog_") + instruction->name;
+    std::vector<int> types;
+    for (size_t i = 0; i < instruction->operands.size(); i++) types.push_back(instruction->operands[i]->type);
+    int stackSlots;
+    std::vector<ArgPlace> places = placeArgs(types, stackSlots);
+    bool tail = instruction->tail && !runtime && stackSlots == 0;
+
+    // stack arguments go last to first, keeping rsp on a 16 byte boundary
+    int pushed = stackSlots + stackSlots % 2;
+    if (stackSlots % 2 != 0) out.instruction(X86_SUBQ, imm(8), reg(REG_RSP));
+    for (int i = (int)places.size() - 1; i >= 0; i--) {
+        if (places[i].reg >= 0) continue;
+        Place arg = this->place(instruction->operands[i], this->allocation->locationAt(instruction->operands[i], this->position - 1));
+        if (arg.isFloat()) {
+            out.instruction(X86_SUBQ, imm(8), reg(REG_RSP));
+            out.instruction(X86_MOVSS, operandAt(arg), mem(REG_RSP, 0));
+        }
+        else out.instruction(X86_PUSHQ, operandAt(arg));
+    }
+    std::vector<Transfer> transfers;
+    for (size_t i = 0; i < moves.size(); i++) {
+        transfers.push_back({this->place(moves[i].from, moves[i].fromLocation), this->place(moves[i].to, moves[i].toLocation), moves[i].to->type});
+    }
+    for (size_t i = 0; i < places.size(); i++) {
+        if (places[i].reg < 0) continue;
+        Place reg = inRegister(places[i].isFloat ? REG_XMM0 + places[i].reg : intArgs[places[i].reg]);
+        Instruction *arg = instruction->operands[i];
+        transfers.push_back({this->place(arg, this->allocation->locationAt(arg, this->position - 1)), reg, types[i]});
+    }
+    this->parallelMove(transfers);
+
+    if (tail) {
+        this->epilogue();
+        out.instruction(X86_JMP, symbol(name));
+        return;
+    }
+    out.instruction(X86_CALL, symbol(name));
+    if (pushed > 0) out.instruction(X86_ADDQ, imm(8 * pushed), reg(REG_RSP));
+    if (instruction->type == IR_VOID) return;
+    this->move(inRegister(instruction->type == IR_FLOAT ? REG_XMM0 : REG_RAX), this->result(instruction), instruction->type);
+}
+
+void CodeWriter::instruction(Instruction *instruction) {
+    CodeSink &out = this->out;
+    Instruction *a = instruction->operands.size() > 0 ? instruction->operands[0] : NULL;
+    Instruction *b = instruction->operands.size() > 1 ? instruction->operands[1] : NULL;
+    bool floats = a != NULL && a->type == IR_FLOAT;
+    switch (instruction->op) {
+        case OP_CONST:
+            if (instruction->type == IR_STRING) {
+                Place d = this->result(instruction);
+                Place x = d.isRegister() ? d : inRegister(REG_RAX);
+                out.instruction(X86_LEAQ, ripRelative(".LS" + std::to_string(this->stringLabel(instruction->name))), operandAt(x));
+                this->move(x, d, IR_STRING);
+            }
+            else if (instruction->type == IR_FLOAT) {
+                int bits;
+                memcpy(&bits, &instruction->floatValue, sizeof(bits));
+                this->move({PLACE_IMMEDIATE, bits}, this->result(instruction), IR_FLOAT);
+            }
+            // ints and bools are immediates wherever they're used
+            break;
+        case OP_PARAM:
+            this->move({PLACE_FRAME, this->homes[instruction->intValue]}, this->result(instruction), instruction->type);
+            break;
+        case OP_PHI:
+            // taken on the edges
+            break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR:
+            this->arithmetic(instruction);
+            break;
+        case OP_DIV:
+            this->divide(instruction);
+            break;
+        case OP_NEG: case OP_NOT: {
+            if (this->selection->derived(instruction) == NT_FLAGS) {
+                // the not of a comparison, set from the opposite condition
+                this->compare(instruction);
+                break;
+            }
+            Place d = this->result(instruction);
+            Place x = d.isRegister() && !floats ? d : inRegister(REG_RAX);
+            this->move(this->operand(a), x, a->type);
+            if (instruction->op == OP_NEG && floats) out.instruction(X86_XORL, imm(0x80000000), reg(REG_RAX));
+            else if (instruction->op == OP_NEG) out.instruction(X86_NEGL, operandAt(x));
+            else if (instruction->type == IR_BOOL) out.instruction(X86_XORL, imm(1), operandAt(x));
+            else out.instruction(X86_NOTL, operandAt(x));
+            this->move(x, d, instruction->type);
+            break;
+        }
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+            this->compare(instruction);
+            break;
+        case OP_ITOF: {
+            Place d = this->result(instruction);
+            Place x = d.isFloat() ? d : inRegister(REG_XMM0);
+            Place from = this->operand(a);
+            if (from.kind == PLACE_IMMEDIATE) from = this->loaded(a, REG_RAX);
+            out.instruction(X86_CVTSI2SSL, operandAt(from), operandAt(x));
+            this->move(x, d, IR_FLOAT);
+            break;
+        }
+        case OP_BTOI: case OP_ITOB: {
+            Place from = this->operand(a);
+            if (from.isRegister()) out.instruction(X86_TESTL, operandAt(from), operandAt(from));
+            else {
+                if (from.kind == PLACE_IMMEDIATE) from = this->loaded(a, REG_RAX);
+                out.instruction(X86_CMPL, imm(0), operandAt(from));
+            }
+            out.instruction(X86_SET + CC_NE, reg(REG_RAX));
+            Place d = this->result(instruction);
+            out.instruction(X86_MOVZBL, reg(REG_RAX), reg(d.isRegister() ? d.value : REG_RAX));
+            if (!d.isRegister()) this->move(inRegister(REG_RAX), d, instruction->type);
+            break;
+        }
+        case OP_ALLOCA: {
+            Operand area = mem(REG_RBP, this->areas[instruction->id]);
+            int bytes = instruction->intValue * irTypeSize(instruction->elemType);
+            if (bytes > 0) {
+                // rdi may hold a value
+                out.instruction(X86_MOVQ, reg(REG_RDI), reg(REG_R11));
+                out.instruction(X86_LEAQ, area, reg(REG_RDI));
+                out.instruction(X86_XORL, reg(REG_RAX), reg(REG_RAX));
+                out.instruction(X86_MOVL, imm(bytes), reg(REG_RCX));
+                out.instruction(X86_REP_STOSB);
+                out.instruction(X86_MOVQ, reg(REG_R11), reg(REG_RDI));
+            }
+            if (!this->selection->hasLocation(instruction)) break;
+            Place d = this->result(instruction);
+            Place x = d.isRegister() ? d : inRegister(REG_RAX);
+            out.instruction(X86_LEAQ, area, operandAt(x));
+            this->move(x, d, IR_PTR);
+            break;
+        }
+        case OP_GLOBAL: {
+            Place d = this->result(instruction);
+            Place x = d.isRegister() ? d : inRegister(REG_RAX);
+            out.instruction(X86_LEAQ, ripRelative("glob_" + instruction->name), operandAt(x));
+            this->move(x, d, IR_PTR);
+            break;
+        }
+        case OP_INDEX: {
+            Place element = this->element(instruction);
+            Place d = this->result(instruction);
+            Place x = d.isRegister() ? d : inRegister(REG_RAX);
+            out.instruction(X86_LEAQ, element.memory, operandAt(x));
+            this->move(x, d, IR_PTR);
+            break;
+        }
+        case OP_LOAD: {
+            Operand address = this->address(instruction, 0).memory;
+            Place d = this->result(instruction);
+            int type = instruction->type;
+            if (irIsVector(type)) {
+                Place x = d.isRegister() ? d : inRegister(REG_XMM0);
+                out.instruction(X86_MOVUPS, address, operandAt(x));
+                this->move(x, d, type);
+            }
+            else if (type == IR_FLOAT && d.isFloat()) out.instruction(X86_MOVSS, address, operandAt(d));
+            else {
+                Place x = d.isRegister() ? d : inRegister(REG_RAX);
+                out.instruction(type == IR_BOOL ? X86_MOVZBL : moveFor(type), address, operandAt(x));
+                this->move(x, d, type == IR_FLOAT ? IR_INT : type);
+            }
+            break;
+        }
+        case OP_STORE: {
+            Operand address = this->address(instruction, 0).memory;
+            int as = this->selection->operandAs(instruction, 1);
+            if (as == NT_UPDATE0 || as == NT_UPDATE1) {
+                // the operation made on memory in place
+                static const int updates[] = {X86_ADDL, X86_SUBL, -1, -1, -1, X86_ANDL, X86_ORL};
+                Place source = this->operandOf(b, as == NT_UPDATE0 ? 1 : 0);
+                if (source.kind == PLACE_FRAME) source = this->loaded(b->operands[as == NT_UPDATE0 ? 1 : 0], REG_RAX);
+                out.instruction(updates[b->op - OP_ADD], operandAt(source), address);
+                break;
+            }
+            Place value = this->operand(b);
+            if (value.kind == PLACE_FRAME) value = this->loaded(b, irIsVector(b->type) ? REG_XMM0 : REG_RAX);
+            if (irIsVector(b->type)) out.instruction(X86_MOVUPS, operandAt(value), address);
+            else if (value.isFloat()) out.instruction(X86_MOVSS, operandAt(value), address);
+            else out.instruction(b->type == IR_BOOL ? X86_MOVB : moveFor(b->type), operandAt(value), address);
+            break;
+        }
+        case OP_SPLAT: {
+            // the value in the low lane, then interleaved with itself twice
+            Place d = this->result(instruction);
+            Place x = d.isRegister() ? d : inRegister(REG_XMM0);
+            this->move(this->operand(a), x, a->type);
+            out.instruction(X86_UNPCKLPS, operandAt(x), operandAt(x));
+            out.instruction(X86_UNPCKLPS, operandAt(x), operandAt(x));
+            this->move(x, d, instruction->type);
+            break;
+        }
+        case OP_LANE: {
+            // shifted down into the low lane, where a scalar is read from
+            Place x = this->loaded(a, REG_XMM0);
+            if (instruction->intValue > 0) {
+                this->move(x, inRegister(REG_XMM0), a->type);
+                x = inRegister(REG_XMM0);
+                out.instruction(X86_PSRLDQ, imm(4 * instruction->intValue), operandAt(x));
+            }
+            this->move(x, this->result(instruction), instruction->type);
+            break;
+        }
+        case OP_CHECK: {
+            std::string fine = this->newLabel();
+            Place index = this->operand(a);
+            if (index.kind == PLACE_IMMEDIATE) index = this->loaded(a, REG_RAX);
+            out.instruction(X86_CMPL, imm(instruction->intValue), operandAt(index));
+            out.instruction(X86_J + CC_B, label(fine));
+            this->move(index, inRegister(REG_RDI), IR_INT);
+            out.instruction(X86_MOVL, imm(instruction->intValue), reg(REG_RSI));
+            out.instruction(X86_LEAQ, ripRelative(this->nameLabel()), reg(REG_RDX));
+            out.instruction(X86_CALL, symbol("rt_check"));
+            out.label(fine);
+            break;
+        }
+        case OP_CALL:
+            // with its moves, in writeFunction
+            break;
+        case OP_BR:
+            this->jump(instruction->block, instruction->targets[0]);
+            break;
+        case OP_CONDBR: {
+            Block *block = instruction->block, *yes = instruction->targets[0], *no = instruction->targets[1];
+            int condition = this->condition(instruction, 0);
+            // an edge with copies to make goes through a stub of its own
+            bool yesCopies = !this->allocation->edgeMoves(block, yes).empty();
+            bool noCopies = !this->allocation->edgeMoves(block, no).empty();
+            if (!noCopies) {
+                out.instruction(X86_J + inverse(condition), label(this->blockLabel(no)));
+                this->jump(block, yes);
+            }
+            else if (!yesCopies) {
+                out.instruction(X86_J + condition, label(this->blockLabel(yes)));
+                this->jump(block, no);
+            }
+            else {
+                std::string otherwise = this->newLabel();
+                out.instruction(X86_J + inverse(condition), label(otherwise));
+                this->edge(block, yes);
+                out.instruction(X86_JMP, label(this->blockLabel(yes)));
+                out.label(otherwise);
+                this->jump(block, no);
+            }
+            break;
+        }
+        case OP_RET:
+            if (a != NULL) this->move(this->operand(a), inRegister(a->type == IR_FLOAT ? REG_XMM0 : REG_RAX), a->type);
+            this->epilogue();
+            out.instruction(X86_RET);
+            break;
+    }
+}
+
+void CodeWriter::writeFunction(Function *function) {
+    CodeSink &out = this->out;
+    this->function = function;
+    this->labels = 0;
+    {
+        PhaseScope timing("isel", "codegen");
+        this->selection = new Selection(function, this->tiling, this->selectionStats);
+    }
+    {
+        PhaseScope timing("regalloc", "codegen");
+        this->allocation = allocateRegisters(function, *this->selection, this->registers, this->registerStats);
+    }
+    if (this->problems != NULL && !this->allocation->check(*this->problems)) this->valid = false;
+    this->layout();
+
+    std::string name = "prog_" + function->name;
+    out.function(name);
+    this->prologue();
+    std::vector<Block*> &order = this->allocation->order;
+    std::vector<Move> none;
+    for (size_t i = 0; i < order.size(); i++) {
+        Block *block = order[i];
+        this->next = i + 1 < order.size() ? order[i + 1] : NULL;
+        out.label(this->blockLabel(block));
+        std::list<Instruction*> &instructions = block->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            this->position = this->allocation->positions[(*it)->id];
+            std::map<int, std::vector<Move> >::iterator split = this->allocation->moves.find(this->position);
+            const std::vector<Move> &moves = split != this->allocation->moves.end() && (*it)->op != OP_PHI ? split->second : none;
+            if ((*it)->op == OP_CALL) this->call(*it, moves);
+            else {
+                this->moves(moves);
+                if (this->selection->written(*it)) this->instruction(*it);
+            }
+        }
+    }
+    out.label(this->nameLabel() + "overflow");
+    out.instruction(X86_LEAQ, ripRelative(this->nameLabel()), reg(REG_RDI));
+    out.instruction(X86_CALL, symbol("rt_overflow"));
+    out.endFunction(name);
+    delete this->allocation;
+    this->allocation = NULL;
+    delete this->selection;
+    this->selection = NULL;
+}
+
+// globals, the function names runtime errors give, and string constants
+void CodeWriter::writeData() {
+    CodeSink &out = this->out;
+    out.section(SECTION_BSS);
+    for (size_t i = 0; i < this->module->globals.size(); i++) {
+        Global &global = this->module->globals[i];
+        out.align(8);
+        out.label("glob_" + global.name);
+        out.zero(std::max(1, global.length * irTypeSize(global.elemType)));
+    }
+
+    out.section(SECTION_RODATA);
+    int number = 0;
+    for (size_t i = 0; i < this->module->functions.size(); i++) {
+        if (this->module->functions[i]->external) continue;
+        out.label(".L" + std::to_string(number++) + "name");
+        out.string(this->module->functions[i]->name);
+    }
+    std::vector<const std::string*> texts(this->strings.size());
+    for (std::map<std::string, int>::iterator it = this->strings.begin(); it != this->strings.end(); it++) texts[it->second] = &it->first;
+    for (size_t i = 0; i < texts.size(); i++) {
+        out.label(".LS" + std::to_string(i));
+        out.string(*texts[i]);
+    }
+}
+
+bool CodeWriter::write() {
+    this->out.section(SECTION_TEXT);
+    this->number = 0;
+    for (size_t i = 0; i < this->module->functions.size(); i++) {
+        if (this->module->functions[i]->external) continue;
+        this->writeFunction(this->module->functions[i]);
+        this->number++;
+    }
+    this->writeData();
+    return this->valid;
+}
+
+bool generateCode(Module *module, CodeSink &out, bool tiling, bool registers, SelectionStats &selectionStats,
+    RegisterStats &registerStats, std::ostream *problems) {
+    CodeWriter writer(module, out, tiling, registers, selectionStats, registerStats, problems);
+    return writer.write();
+}
@@ -0,0 +1,21 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <ostream>
+#include "ir.h"
+#include "isel.h"
+#include "regalloc.h"
+#include "x86.h"
+
+// writes module's x86-64 code for the sysv abi to out, which makes assembly
+// text or machine code of it. the program's own functions are prog_<name>,
+// the runtime routines rt_<name> and globals glob_<name>, so runtime.c can
+// supply main and the routines. with tiling false each instruction is
+// expanded on its own, and with registers false every value is kept in the
+// frame. what the selector and the allocator did is added to their stats.
+// given problems, each function's allocation is checked and false returned
+// if one is broken
+bool generateCode(Module *module, CodeSink &out, bool tiling, bool registers, SelectionStats &selectionStats,
+    RegisterStats &registerStats, std::ostream *problems = NULL);
+
+#endif
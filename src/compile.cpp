@@ -1,9 +1,17 @@
 //  recursive descent compiler by Andrew Miller
 
-#include "parser.h"
+#include "driver.h"
+#include "link.h"
+#include "protocol.h"
 #include "scanner.h"
+#include "server.h"
 
 int main(int argc, char **argv) {
+    // "compile -server [socket]" keeps a warm compiler running for compile-client
+    if (argc >= 2 && strcmp(argv[1], "-server") == 0) {
+        return runServer(argc >= 3 ? argv[2] : serverSocketPath());
+    }
+
     // Check arg count
     if (argc < 2) {
         std::cout << "Parser requires filename argument\n";
@@ -20,39 +28,16 @@ int main(int argc, char **argv) {
     // 'debug = false' flag causes fatal errors to terminate program
     // this prevents cascades of errors from confusing a user
     // when set to true, the program is carried out to produce parsetree.txt for a diagnosis
-    bool debug = false;
-    if (argc == 3) { // check for debug flag
-        if (strcmp(argv[2], "-debug") == 0) debug = true; 
-    }
+    CompileOptions options = parseOptions(argc, argv, 2);
 
-    // initialize scanner
     std::ifstream inputFile(filename);
-    std::string contents((std::istreambuf_iterator<char>(inputFile)), 
+    std::string contents((std::istreambuf_iterator<char>(inputFile)),
         std::istreambuf_iterator<char>());
-    std::cout << "Scan initialization...\n";
-    scan.init(filename, contents, debug);
-
-    // scan for tokens and add them to the scanner's list
-    int nextWord = 0;
-    std::cout << "Scanning in progress...\n";
-    while(nextWord != T_EOF) {
-        nextWord = scan.getNextToken();
-    }
-    scan.writeWordList();
-    std::cout << "Wrote list of words to \"compiler/build/wordlist.txt\"\n";
-
-    std::cout << "Consulting parser...\n";
-    std::list<Word> words = scan.getWordList();
-    std::cout << "Got word list...\n";
-    SymbolTable table = scan.getSymbolTable();
-    std::cout << "Got symbol table...\n";
-    if (debug) table.print("");
-    std::cout << "Starting parse...\n";
-    Parser parser = Parser(words, table, debug);
-    parser.parse();
-    std::cout << "Parse Complete...\n";
-    std::cout << "Printing parsetree.txt...\n";
-    parser.printTree("../build/parsetree.txt");
 
-    return 0;
-}
\ No newline at end of file
+    DirectorySink sink(BUILD_DIR);
+    // so a compile that stops before writing its output leaves no older program behind
+    if (options.native && !options.run) removeProgram(BUILD_DIR);
+    int status = compileSource(filename, contents, options, sink);
+    if (status == 0 && options.native && !options.run) status = linkProgram(BUILD_DIR, options);
+    return status;
+}
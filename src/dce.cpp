@@ -0,0 +1,149 @@
+//  recursive descent compiler by Andrew Miller
+
+#include "passes.h"
+
+// aggressive dead code elimination: nothing is live until something that
+// matters needs it. what matters is returning, storing, checking an index,
+// and calling anything but a pure runtime routine. a live instruction makes
+// its operands live, and the branches that decide whether its block runs,
+// so a branch only survives when something live depends on the way it goes
+class DeadCode {
+    Function *function;
+    const Cfg &cfg;
+    const PostDominatorTree &postdominators;
+    std::vector<std::vector<int> > controllers; // blocks whose branch decides whether each block runs
+    std::vector<bool> live;                     // by value id
+    std::vector<bool> liveBlocks;
+    std::vector<Instruction*> work;
+
+    void controlDependence();
+    void mark(Instruction *instruction);
+    void markBlock(int block);
+    bool isRoot(Instruction *instruction);
+
+    public:
+        DeadCode(Function *function, const PostDominatorTree &postdominators);
+        void solve();
+        int sweep();
+};
+
+DeadCode::DeadCode(Function *function, const PostDominatorTree &postdominators)
+    : function(function), cfg(postdominators.cfg), postdominators(postdominators) {
+    this->live.assign(function->nextValueId, false);
+    this->liveBlocks.assign(this->cfg.size(), false);
+}
+
+// a block depends on a branch when one edge out of the branch's block always
+// leads to it and another needn't: the blocks from an edge's target up the
+// postdominator tree to the branch block's own postdominator
+void DeadCode::controlDependence() {
+    this->controllers.resize(this->cfg.size());
+    for (int i = 0; i < this->cfg.size(); i++) {
+        if (this->cfg.succs[i].size() < 2) continue;
+        int stop = this->postdominators.ipdom[i];
+        for (size_t j = 0; j < this->cfg.succs[i].size(); j++) {
+            int runner = this->cfg.succs[i][j];
+            while (runner >= 0 && runner != stop && runner != this->postdominators.exit) {
+                std::vector<int> &of = this->controllers[runner];
+                if (of.empty() || of.back() != i) of.push_back(i);
+                runner = this->postdominators.ipdom[runner];
+            }
+        }
+    }
+}
+
+bool DeadCode::isRoot(Instruction *instruction) {
+    switch (instruction->op) {
+        case OP_RET: case OP_STORE: case OP_CHECK:
+            return true;
+        case OP_CALL: {
+            Function *callee = this->function->module == NULL ? NULL : this->function->module->find(instruction->name);
+            return callee == NULL || !callee->pure;
+        }
+    }
+    return false;
+}
+
+void DeadCode::mark(Instruction *instruction) {
+    if (this->live[instruction->id]) return;
+    this->live[instruction->id] = true;
+    this->work.push_back(instruction);
+}
+
+void DeadCode::markBlock(int block) {
+    if (this->liveBlocks[block]) return;
+    this->liveBlocks[block] = true;
+    for (size_t i = 0; i < this->controllers[block].size(); i++) {
+        this->mark(this->cfg.blocks[this->controllers[block][i]]->terminator());
+    }
+}
+
+void DeadCode::solve() {
+    this->controlDependence();
+    for (int i = 0; i < this->cfg.size(); i++) {
+        Block *block = this->cfg.blocks[i];
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            if (this->isRoot(*it)) this->mark(*it);
+        }
+        // loops stay, even ones with nothing live in them, since there's no
+        // telling whether they end. so do branches that can't reach a ret
+        for (size_t j = 0; j < this->cfg.succs[i].size(); j++) {
+            if (this->cfg.succs[i][j] <= i) this->mark(block->terminator());
+        }
+        if (!this->postdominators.reachesExit(i)) this->mark(block->terminator());
+    }
+
+    while (!this->work.empty()) {
+        Instruction *instruction = this->work.back();
+        this->work.pop_back();
+        int block = this->cfg.indexOf(instruction->block);
+        this->markBlock(block);
+        for (size_t i = 0; i < instruction->operands.size(); i++) this->mark(instruction->operands[i]);
+        // which value a phi takes is up to the branches into its block
+        if (instruction->op == OP_PHI) {
+            for (size_t i = 0; i < this->cfg.preds[block].size(); i++) {
+                this->mark(this->cfg.blocks[this->cfg.preds[block][i]]->terminator());
+            }
+        }
+    }
+}
+
+// drops every dead instruction, and sends each dead branch straight to its
+// block's postdominator. nothing live can be on the way there, not even a
+// phi in the postdominator, which would have made the branch live
+int DeadCode::sweep() {
+    bool pruned = false;
+    for (int i = 0; i < this->cfg.size(); i++) {
+        Block *block = this->cfg.blocks[i];
+        Instruction *last = block->terminator();
+        if (last->op != OP_CONDBR || this->live[last->id] || this->postdominators.ipdom[i] == this->postdominators.exit) continue;
+        Block *target = this->cfg.blocks[this->postdominators.ipdom[i]];
+        for (size_t j = 0; j < last->targets.size(); j++) last->targets[j]->removePred(block);
+        block->erase(last);
+        this->function->branch(block, target);
+        pruned = true;
+    }
+
+    std::vector<Instruction*> dead;
+    for (int i = 0; i < this->cfg.size(); i++) {
+        Block *block = this->cfg.blocks[i];
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            if (!(*it)->isTerminator() && !this->live[(*it)->id]) dead.push_back(*it);
+        }
+    }
+    // dead values are only used by dead instructions, which let go first
+    for (size_t i = 0; i < dead.size(); i++) dead[i]->dropOperands();
+    for (size_t i = 0; i < dead.size(); i++) dead[i]->block->erase(dead[i]);
+
+    if (pruned) {
+        this->function->removeUnreachableBlocks();
+        return CHANGED_CFG;
+    }
+    return dead.empty() ? CHANGED_NONE : CHANGED_INSTRUCTIONS;
+}
+
+int eliminateDeadCode(Function *function, AnalysisCache &analyses) {
+    DeadCode deadCode(function, analyses.getPostDominators());
+    deadCode.solve();
+    return deadCode.sweep();
+}
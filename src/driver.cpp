@@ -0,0 +1,417 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <sstream>
+#include <sys/stat.h>
+#include "cache.h"
+#include "capture.h"
+#include "bytecode.h"
+#include "codegen.h"
+#include "driver.h"
+#include "elfobject.h"
+#include "incremental.h"
+#include "interp.h"
+#include "jit.h"
+#include "lower.h"
+#include "parser.h"
+#include "passmanager.h"
+#include "scanner.h"
+#include "stats.h"
+#include "trace.h"
+#include "verify.h"
+#include "vm.h"
+
+void DirectorySink::write(std::string name, std::string contents) {
+    std::ofstream out;
+    out.open(this->dir + name, std::ofstream::out | std::ofstream::trunc);
+    out << contents;
+    out.close();
+}
+
+// passes outputs along to another sink while keeping a copy for the cache
+class RecordingSink : public OutputSink {
+    OutputSink &target;
+
+    public:
+        std::list<std::pair<std::string, std::string>> recorded;
+        RecordingSink(OutputSink &sink) : target(sink) {}
+        void write(std::string name, std::string contents) {
+            this->recorded.push_back(std::make_pair(name, contents));
+            this->target.write(name, contents);
+        }
+};
+
+// times every output write as the write phase
+class TimedSink : public OutputSink {
+    OutputSink &target;
+
+    public:
+        TimedSink(OutputSink &sink) : target(sink) {}
+        void write(std::string name, std::string contents) {
+            PhaseScope timing("write");
+            ALLOC_SUBSYSTEM(ALLOC_OUTPUT);
+            this->target.write(name, contents);
+        }
+};
+
+std::string CompileOptions::outputKey() {
+    std::string key = this->debug ? "debug" : "";
+    if (this->ir) key += key.empty() ? "ir" : ",ir";
+    // the passes a level runs, so a compile cached before the pipeline changed isn't reused
+    if (this->optimize > 0) key += (key.empty() ? "O" : ",O") + std::to_string(this->optimize) + "=" + pipelines[this->optimize];
+    if (this->passes != "") key += (key.empty() ? "passes=" : ",passes=") + this->passes;
+    if (this->fastMath) key += key.empty() ? "fastmath" : ",fastmath";
+    if (this->native) key += key.empty() ? "native" : ",native";
+    if (this->native && !this->registers) key += ",noregalloc";
+    if (this->native && !this->tiling) key += ",noisel";
+    if (this->native && !this->vectorize) key += ",novectorize";
+    if (this->native && this->assembly) key += ",assembly";
+    return key;
+}
+
+static void printCacheStats(CompileCache &cache) {
+    CacheCounters mine = cache.getCounters();
+    CacheCounters total = cache.totalCounters();
+    std::cout << "Cache: " << mine.hits << " hit(s), " << mine.misses << " miss(es) this compile; "
+        << total.hits << " hit(s), " << total.misses << " miss(es), " << total.stores
+        << " store(s), " << total.evictions << " eviction(s) in total\n";
+}
+
+static int runPhases(char *filename, std::string contents, CompileOptions options, OutputSink &sink, CompileCache *cache);
+static int writeIr(Parser &parser, CompileOptions &options, OutputSink &sink);
+static int compileCached(char *filename, std::string contents, CompileOptions options, OutputSink &sink);
+
+static double compileStarted = 0.0; // so -run can report how long it took from the start to the program's end
+
+// runs one compile, then reports its statistics and trace when asked for
+// stats.json and trace.json describe this run only, so they never go into the cache
+int compileSource(char *filename, std::string contents, CompileOptions options, OutputSink &sink) {
+    compileStarted = wallClockMs();
+    stats.enabled = options.stats;
+    stats.perf = options.perf;
+    if (options.perf && !perfCounters().open()) {
+        std::cout << "Performance counters unavailable, " << perfCounters().unavailableReason << "\n";
+    }
+    stats.reset();
+    stats.fact("file", jsonString(filename));
+    traceEnabled = options.trace;
+    traceReset();
+
+    TimedSink timed(sink);
+    int status;
+    {
+        TraceSpan tracing("compile", "phase");
+        status = compileCached(filename, contents, options, timed);
+    }
+
+    if (options.trace && status == 0) {
+        sink.write("trace.json", traceJson());
+        std::cout << "Wrote compiler trace to \"compiler/build/trace.json\"\n";
+    }
+
+    if (options.stats && status == 0) {
+        sink.write("stats.json", stats.toJson());
+        std::cout << "Wrote compiler statistics to \"compiler/build/stats.json\"\n";
+    }
+    return status;
+}
+
+// consults the compile cache before running the phases, and fills it after
+// a run reads its input as it goes, so it can't be replayed from the cache
+static int compileCached(char *filename, std::string contents, CompileOptions options, OutputSink &sink) {
+    if (!options.useCache || options.interp || options.vm || options.run) {
+        stats.fact("cache", jsonString("off"));
+        return runPhases(filename, contents, options, sink, NULL);
+    }
+
+    CompileCache cache;
+    std::string key = CompileCache::makeKey(options.outputKey(), contents);
+    CacheEntry entry;
+    bool hit;
+    {
+        PhaseScope timing("cache lookup");
+        ALLOC_SUBSYSTEM(ALLOC_CACHE);
+        hit = cache.lookup(key, entry);
+    }
+    stats.fact("cache", jsonString(hit ? "hit" : "miss"));
+
+    // a hit replays the printed output and files without scanning or parsing
+    if (hit) {
+        std::cout << "Using cached compile " << key.substr(0, 12) << "...\n";
+        std::cout << entry.printed;
+        for (auto const &output : entry.outputs) sink.write(output.first, output.second);
+        if (options.cacheStats) printCacheStats(cache);
+        return 0;
+    }
+
+    // only compiles that run to the end are stored, fatal errors exit before
+    std::streambuf *console = std::cout.rdbuf();
+    CaptureBuf capture(console);
+    RecordingSink recorder(sink);
+    std::cout.rdbuf(&capture);
+    int status = runPhases(filename, contents, options, recorder, &cache);
+    std::cout.rdbuf(console);
+    if (status == 0) {
+        PhaseScope timing("cache store");
+        ALLOC_SUBSYSTEM(ALLOC_CACHE);
+        entry.printed = capture.captured;
+        entry.outputs = recorder.recorded;
+        cache.store(key, entry);
+    }
+    if (options.cacheStats) printCacheStats(cache);
+    return status;
+}
+
+// scans and parses contents, handing each finished output to the sink
+// with a cache, unchanged top level procedures are reused rather than reparsed
+static int runPhases(char *filename, std::string contents, CompileOptions options, OutputSink &sink, CompileCache *cache) {
+    bool debug = options.debug;
+
+    // initialize scanner
+    std::cout << "Scan initialization...\n";
+    std::list<Word> words;
+    {
+        PhaseScope timing("scan");
+        scan.init(filename, contents, debug);
+
+        // scan for tokens and add them to the scanner's list
+        int nextWord = 0;
+        std::cout << "Scanning in progress...\n";
+        while(nextWord != T_EOF) {
+            nextWord = scan.getNextToken();
+        }
+        words = scan.getWordList();
+        stats.tokens = words.size();
+    }
+    std::ostringstream wordsOut;
+    scan.writeWordList(wordsOut);
+    sink.write("wordlist.txt", wordsOut.str());
+    std::cout << "Wrote list of words to \"compiler/build/wordlist.txt\"\n";
+
+    std::cout << "Consulting parser...\n";
+    std::cout << "Got word list...\n";
+    SymbolTable table = scan.getSymbolTable();
+    std::cout << "Got symbol table...\n";
+    if (debug) table.print("");
+    std::cout << "Starting parse...\n";
+    Parser parser = Parser(words, table, debug);
+    ProcedureReuse reuse(cache);
+    if (cache != NULL && !debug) {
+        PhaseScope timing("fingerprint");
+        ALLOC_SUBSYSTEM(ALLOC_CACHE);
+        reuse.analyze(words);
+        parser.setProcedureReuse(&reuse);
+    }
+    {
+        PhaseScope timing("parse");
+        parser.parse();
+    }
+    std::cout << "Parse Complete...\n";
+    if (reuse.procedureCount() > 0) {
+        stats.fact("proceduresReused", std::to_string(reuse.reused));
+        std::cout << "Reused " << reuse.reused << " of " << reuse.procedureCount()
+            << " procedures from earlier compiles...\n";
+    }
+    std::cout << "Printing parsetree.txt...\n";
+    std::ostringstream treeOut;
+    {
+        PhaseScope timing("print tree");
+        ALLOC_SUBSYSTEM(ALLOC_OUTPUT);
+        parser.printTree(treeOut);
+    }
+    sink.write("parsetree.txt", treeOut.str());
+
+    if (options.ir) return writeIr(parser, options, sink);
+    return 0;
+}
+
+// lowers the parsed program to ssa, checks it, runs the -O pipeline over it
+// and writes it out as ir.txt, then with -native writes it as an object or
+// assembly, with -run runs that in place, with -interp runs it and with -vm
+// runs it as bytecode
+static int writeIr(Parser &parser, CompileOptions &options, OutputSink &sink) {
+    if (parser.errorCount() > 0) {
+        std::cout << "Skipping IR, the parse reported errors...\n";
+        return 0;
+    }
+
+    PassManager passManager;
+    std::string unknown;
+    if (!passManager.setPipeline(options.passes != "" ? options.passes : pipelines[options.optimize], unknown)) {
+        std::cout << "Unknown pass \"" << unknown << "\"\n";
+        return 1;
+    }
+
+    std::cout << "Lowering to IR...\n";
+    Module *module;
+    {
+        PhaseScope timing("lower");
+        module = lowerProgram(parser.getTree(), options.debug);
+    }
+    if (module == NULL) return 1;
+
+    std::ostringstream problems;
+    bool valid;
+    {
+        PhaseScope timing("verify");
+        valid = verifyModule(module, problems);
+    }
+
+    // passes may assume well formed input, so broken ir is written as lowered
+    if (valid && !passManager.empty()) {
+        std::cout << "Optimizing IR...\n";
+        passManager.verifyEach = options.debug;
+        passManager.fastMath = options.fastMath;
+        // vectors only exist in machine code, so a program the ir is run as stays scalar
+        passManager.vectors = options.native && options.vectorize && !options.interp && !options.vm;
+        {
+            PhaseScope timing("optimize");
+            ALLOC_SUBSYSTEM(ALLOC_IR);
+            valid = passManager.run(module, problems);
+        }
+        if (valid) {
+            PhaseScope timing("verify");
+            valid = verifyModule(module, problems);
+        }
+        stats.fact("optimization", passManager.toJson());
+    }
+
+    std::ostringstream irOut;
+    module->print(irOut);
+    sink.write("ir.txt", irOut.str());
+    std::cout << "Wrote IR to \"compiler/build/ir.txt\"\n";
+
+    if (!valid) {
+        delete module;
+        std::cout << problems.str() << "IR failed verification\n";
+        return 1;
+    }
+
+    std::string object;
+    if (options.native) {
+        SelectionStats selectionStats;
+        RegisterStats registerStats;
+        EncodeStats encodeStats;
+        MachineCode code(encodeStats);
+        std::ostringstream asmOut;
+        AssemblyText text(asmOut);
+        bool allocated;
+        {
+            PhaseScope timing("codegen");
+            ALLOC_SUBSYSTEM(ALLOC_OUTPUT);
+            CodeSink &out = options.assembly ? (CodeSink&)text : (CodeSink&)code;
+            allocated = generateCode(module, out, options.tiling, options.registers, selectionStats, registerStats,
+                options.debug ? &problems : NULL);
+        }
+        std::string undefined;
+        if (options.assembly) {
+            text.finish();
+            sink.write("program.s", asmOut.str());
+        }
+        else {
+            PhaseScope timing("encode");
+            ALLOC_SUBSYSTEM(ALLOC_OUTPUT);
+            if (code.finish(undefined)) object = writeObject(code);
+        }
+        if (!undefined.empty()) {
+            delete module;
+            std::cout << "Jump to undefined label " << undefined << "\n";
+            return 1;
+        }
+        if (!options.assembly && !options.run) sink.write("program.o", object);
+        if (!allocated) {
+            delete module;
+            std::cout << problems.str() << "Register allocation failed verification\n";
+            return 1;
+        }
+        std::cout << "Selected instructions in " << selectionStats.ms << " ms: " << selectionStats.tiles << " tile(s), "
+            << selectionStats.folded << " instruction(s) folded in, " << selectionStats.addresses << " address(es), "
+            << selectionStats.memoryOperands << " memory operand(s), " << selectionStats.fusedBranches << " fused branch(es) and "
+            << selectionStats.updates << " update(s) in place\n";
+        std::cout << "Allocated registers in " << registerStats.ms << " ms: " << registerStats.values << " value(s) in "
+            << registerStats.intervals << " interval(s), " << registerStats.spilled << " spilled, " << registerStats.stores
+            << " store(s) and " << registerStats.reloads << " reload(s), " << registerStats.coalesced << " of "
+            << registerStats.phiMoves << " phi move(s) coalesced\n";
+        if (options.assembly) std::cout << "Wrote assembly to \"compiler/build/program.s\"\n";
+        else {
+            std::cout << "Encoded " << encodeStats.instructions << " instruction(s) in " << encodeStats.bytes << " byte(s), "
+                << encodeStats.shortBranches << " of " << encodeStats.branches << " branch(es) short, with "
+                << encodeStats.relocations << " relocation(s)\n";
+            if (!options.run) std::cout << "Wrote object to \"compiler/build/program.o\"\n";
+            stats.fact("encode", encodeStats.toJson());
+        }
+        stats.fact("isel", selectionStats.toJson());
+        stats.fact("regalloc", registerStats.toJson());
+    }
+
+    int status = 0;
+    if (options.run) {
+        JitProgram program;
+        bool loaded;
+        {
+            PhaseScope timing("load");
+            loaded = program.load(object);
+        }
+        if (!loaded) {
+            delete module;
+            std::cout << "Loading failed: " << program.error << "\n";
+            return 1;
+        }
+        std::cout << "Loaded " << program.codeSize << " byte(s) of code and " << program.dataSize << " of data in "
+            << program.loadMs << " ms\n";
+        std::cout << "Running @main...\n";
+        {
+            PhaseScope timing("run");
+            if (!program.run()) status = 1;
+        }
+        std::cout << "Ran @main in " << program.ms << " ms, " << wallClockMs() - compileStarted
+            << " ms after the compile started\n";
+        stats.fact("run", program.toJson());
+    }
+    if (options.interp) {
+        std::cout << "Interpreting @main...\n";
+        Interpreter interpreter(module, std::cin, std::cout);
+        {
+            PhaseScope timing("interpret");
+            if (!interpreter.run()) status = 1;
+        }
+        if (status != 0) std::cout << "Runtime error: " << interpreter.error << "\n";
+        std::cout << "Ran " << interpreter.instructions << " instruction(s) and " << interpreter.calls
+            << " call(s) in " << interpreter.ms << " ms\n";
+        for (auto const &callee : interpreter.callsTo) std::cout << "    @" << callee.first << ": " << callee.second << " call(s)\n";
+        stats.fact("interpret", interpreter.toJson());
+    }
+    if (options.vm) {
+        BytecodeStats bytecodeStats;
+        BcModule *bytecode;
+        {
+            PhaseScope timing("bytecode");
+            ALLOC_SUBSYSTEM(ALLOC_OUTPUT);
+            bytecode = compileBytecode(module, bytecodeStats);
+        }
+        std::ostringstream listing;
+        disassemble(bytecode, listing);
+        sink.write("bytecode.txt", listing.str());
+        std::cout << "Compiled " << bytecodeStats.functions << " function(s) to " << bytecodeStats.instructions
+            << " bytecode instruction(s) in " << bytecodeStats.ms << " ms: " << bytecodeStats.superinstructions
+            << " superinstruction(s), " << bytecodeStats.moves << " phi move(s)\n";
+        std::cout << "Wrote bytecode to \"compiler/build/bytecode.txt\"\n";
+        stats.fact("bytecode", bytecodeStats.toJson());
+
+        std::cout << "Running @main in the VM...\n";
+        VirtualMachine machine(bytecode, std::cin, std::cout);
+        bool ran;
+        {
+            PhaseScope timing("vm");
+            ran = machine.run();
+        }
+        if (!ran) {
+            std::cout << "Runtime error: " << machine.error << "\n";
+            status = 1;
+        }
+        std::cout << "Ran " << machine.calls << " call(s) in " << machine.ms << " ms\n";
+        stats.fact("vm", machine.toJson());
+        delete bytecode;
+    }
+    delete module;
+    return status;
+}
@@ -0,0 +1,62 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <list>
+#include <string>
+
+// bump whenever a change alters what the compiler writes out
+#define COMPILER_VERSION "1.7"
+
+// every output file lands here, relative to where compile is run from
+#define BUILD_DIR "../build/"
+
+// flags accepted after the filename by both compile and compile-client
+struct CompileOptions {
+    bool debug = false;
+    bool useCache = true;    // -nocache skips the on-disk compile cache
+    bool cacheStats = false; // -cachestats prints the cache hit/miss counters
+    bool stats = false;      // -stats writes phase times and counters to stats.json
+    bool trace = false;      // -trace writes a chrome trace of the compile to trace.json
+    bool perf = false;       // -perf adds hardware counters per phase to stats.json, implies -stats
+    bool ir = false;         // -ir lowers the checked program to ssa and writes it to ir.txt
+    bool interp = false;     // -interp runs the optimized ir's main after writing it, implies -ir
+    bool vm = false;         // -vm compiles the optimized ir to bytecode, writes it to bytecode.txt and runs it, implies -ir
+    int optimize = 0;        // -O0, -O1 or -O2 picks the passes run over the ir
+    std::string passes = ""; // -passes=a,b,c runs exactly those passes instead
+    bool fastMath = false;   // -ffast-math lets passes reassociate float arithmetic
+    bool native = false;     // -native writes an x86-64 object to program.o, linked into program, implies -ir
+    bool assembly = false;   // -S has -native write assembly to program.s instead, for cc to assemble
+    bool standalone = false; // -static links program itself, with a runtime needing nothing but the kernel
+    bool run = false;        // -run loads the machine code into the compiler and runs it there, implies -native
+    bool registers = true;   // -fno-regalloc keeps every value of the native code in the frame
+    bool tiling = true;      // -fno-isel expands each ir instruction on its own instead of tiling trees of them
+    bool vectorize = true;   // -fno-vectorize keeps the native code's loops scalar
+
+    // the options that change what a compile produces, for cache keys
+    std::string outputKey();
+};
+
+// destination for the files a compile produces
+class OutputSink {
+    public:
+        virtual void write(std::string name, std::string contents) = 0;
+        virtual ~OutputSink() = default;
+};
+
+// writes outputs straight into a directory, the normal command line behavior
+class DirectorySink : public OutputSink {
+    std::string dir;
+
+    public:
+        DirectorySink(std::string path) { dir = path; }
+        void write(std::string name, std::string contents);
+};
+
+// reads the flags following the filename, starting at argv[first]
+CompileOptions parseOptions(int argc, char **argv, int first);
+
+// scans and parses contents, handing each finished output to the sink
+// progress and diagnostics go to std::cout, fatal errors still exit
+int compileSource(char *filename, std::string contents, CompileOptions options, OutputSink &sink);
+
+#endif
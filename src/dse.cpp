@@ -0,0 +1,159 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <climits>
+#include "passes.h"
+
+#define WHOLE LONG_MIN // the place of a scalar, or of an array element at an index that isn't constant
+
+// dead store elimination: a store is dead when nothing can read the place
+// it writes before another store surely overwrites it or the function
+// returns. places are live going backward from the loads and calls that
+// may read them, and from the ret for whatever the caller can still see
+class DeadStores {
+    Function *function;
+    const Cfg &cfg;
+    MemoryRoots roots;
+    std::map<std::pair<long, long>, int> places; // by base and constant index or WHOLE
+    std::vector<int> rootOfPlace;
+    std::vector<Bitset> ofRoot;                  // every place in each root
+
+    long baseOf(Instruction *address, int root);
+    int placeOf(Instruction *address, bool &surely);
+    void addReads(Bitset &into, Instruction *instruction);
+
+    public:
+        DeadStores(Function *function, const Cfg &cfg);
+        int run();
+};
+
+DeadStores::DeadStores(Function *function, const Cfg &cfg) : function(function), cfg(cfg), roots(function) {
+    // a place for everything some store writes, nothing else can be dead
+    for (int i = 0; i < cfg.size(); i++) {
+        std::list<Instruction*> &instructions = cfg.blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op != OP_STORE) continue;
+            Instruction *address = (*it)->operands[0];
+            int root = this->roots.rootOf(address);
+            if (root == ROOT_UNKNOWN) continue;
+            std::pair<long, long> place(this->baseOf(address, root), WHOLE);
+            if (address->op == OP_INDEX && address->operands[1]->isConstant()) place.second = address->operands[1]->intValue;
+            if (this->places.count(place) > 0) continue;
+            this->places[place] = this->rootOfPlace.size();
+            this->rootOfPlace.push_back(root);
+        }
+    }
+    this->ofRoot.assign(this->roots.count, Bitset(this->rootOfPlace.size()));
+    for (size_t i = 0; i < this->rootOfPlace.size(); i++) this->ofRoot[this->rootOfPlace[i]].set(i);
+}
+
+// each global and alloca is one array, pointer parameters are one each
+long DeadStores::baseOf(Instruction *address, int root) {
+    while (address->op == OP_INDEX) address = address->operands[0];
+    return address->op == OP_PARAM ? -2 - (long)address->intValue : root;
+}
+
+// -1 for a place nothing can name. surely is whether a store there writes
+// all of the place, which one to an element at a variable index doesn't
+int DeadStores::placeOf(Instruction *address, bool &surely) {
+    int root = this->roots.rootOf(address);
+    surely = false;
+    if (root == ROOT_UNKNOWN) return -1;
+    std::pair<long, long> place(this->baseOf(address, root), WHOLE);
+    if (address->op == OP_INDEX && address->operands[1]->isConstant()) place.second = address->operands[1]->intValue;
+    surely = address->op != OP_INDEX || place.second != WHOLE;
+    std::map<std::pair<long, long>, int>::iterator found = this->places.find(place);
+    return found == this->places.end() ? -1 : found->second;
+}
+
+// the places a load or call may read
+void DeadStores::addReads(Bitset &into, Instruction *instruction) {
+    Bitset touched(this->roots.count);
+    if (instruction->op == OP_CALL) {
+        this->roots.addCallEffects(touched, instruction);
+    }
+    else {
+        Instruction *address = instruction->operands[0];
+        int root = this->roots.rootOf(address);
+        this->roots.addAliases(touched, root);
+
+        // an element at a constant index reads only itself and the stores
+        // whose index isn't known, where the root is a single array
+        if (root != ROOT_UNKNOWN && root != ROOT_PARAMS && address->op == OP_INDEX && address->operands[1]->isConstant()) {
+            touched.reset(root);
+            long base = this->baseOf(address, root);
+            std::map<std::pair<long, long>, int>::iterator found = this->places.find(std::make_pair(base, (long)address->operands[1]->intValue));
+            if (found != this->places.end()) into.set(found->second);
+            found = this->places.find(std::make_pair(base, WHOLE));
+            if (found != this->places.end()) into.set(found->second);
+        }
+    }
+    for (int root = touched.findNext(0); root >= 0; root = touched.findNext(root + 1)) into.unionWith(this->ofRoot[root]);
+}
+
+int DeadStores::run() {
+    int count = this->rootOfPlace.size();
+    if (count == 0) return CHANGED_NONE;
+
+    // in = gen | (out & ~kill) walking each block bottom up
+    DataflowProblem problem;
+    problem.forward = false;
+    problem.bits = count;
+    problem.gen.assign(this->cfg.size(), Bitset(count));
+    problem.kill.assign(this->cfg.size(), Bitset(count));
+    problem.boundary.resize(count);
+    // what main leaves in memory dies with the program, a procedure's
+    // caller can still read globals and whatever its pointers reach
+    if (this->function->name != "main") {
+        Bitset visible(this->roots.count);
+        this->roots.addAliases(visible, ROOT_PARAMS);
+        for (int root = visible.findNext(0); root >= 0; root = visible.findNext(root + 1)) problem.boundary.unionWith(this->ofRoot[root]);
+    }
+
+    for (int i = 0; i < this->cfg.size(); i++) {
+        std::list<Instruction*> &instructions = this->cfg.blocks[i]->instructions;
+        for (std::list<Instruction*>::reverse_iterator it = instructions.rbegin(); it != instructions.rend(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->op == OP_STORE) {
+                bool surely;
+                int place = this->placeOf(instruction->operands[0], surely);
+                if (place < 0 || !surely) continue;
+                problem.kill[i].set(place);
+                problem.gen[i].reset(place);
+            }
+            else if (instruction->op == OP_LOAD || instruction->op == OP_CALL) {
+                this->addReads(problem.gen[i], instruction);
+            }
+        }
+    }
+
+    DataflowSolution solution;
+    solveDataflow(this->cfg, problem, solution);
+
+    int removed = 0;
+    for (int i = 0; i < this->cfg.size(); i++) {
+        Block *block = this->cfg.blocks[i];
+        Bitset live = solution.out[i];
+        std::vector<Instruction*> dead;
+        for (std::list<Instruction*>::reverse_iterator it = block->instructions.rbegin(); it != block->instructions.rend(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->op == OP_STORE) {
+                bool surely;
+                int place = this->placeOf(instruction->operands[0], surely);
+                if (place < 0) continue;
+                if (!live.test(place)) dead.push_back(instruction);
+                else if (surely) live.reset(place);
+            }
+            else if (instruction->op == OP_LOAD || instruction->op == OP_CALL) {
+                this->addReads(live, instruction);
+            }
+        }
+        for (size_t j = 0; j < dead.size(); j++) block->erase(dead[j]);
+        removed += dead.size();
+    }
+    return removed > 0 ? CHANGED_INSTRUCTIONS : CHANGED_NONE;
+}
+
+int eliminateDeadStores(Function *function, AnalysisCache &analyses) {
+    DeadStores deadStores(function, analyses.getCfg());
+    return deadStores.run();
+}
@@ -0,0 +1,429 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstring>
+#include <elf.h>
+#include "elfobject.h"
+
+// where each of the code's sections goes in the object
+#define OBJECT_TEXT     1
+#define OBJECT_RELA     2
+#define OBJECT_RODATA   3
+#define OBJECT_BSS      4
+#define OBJECT_STACK    5
+#define OBJECT_SYMTAB   6
+#define OBJECT_STRTAB   7
+#define OBJECT_SHSTRTAB 8
+#define OBJECT_SECTIONS 9
+
+static const int objectSection[SECTION_COUNT] = {OBJECT_TEXT, OBJECT_RODATA, OBJECT_BSS};
+
+static long alignUp(long value, long align) {
+    return align > 1 ? (value + align - 1) / align * align : value;
+}
+
+template <typename T> static void append(std::string &out, const T &value) {
+    out.append((const char*)&value, sizeof(T));
+}
+
+// adds a name to a string table, returning where it starts
+static int addName(std::string &table, const std::string &name) {
+    int at = table.size();
+    table += name;
+    table += '\0';
+    return at;
+}
+
+std::string writeObject(MachineCode &code) {
+    // the symbol table: the null symbol, one for each section the relocations
+    // can point into, the code's own locals, then its globals
+    std::string strtab(1, '\0');
+    std::vector<Elf64_Sym> symbols(1 + SECTION_COUNT);
+    memset(&symbols[0], 0, sizeof(Elf64_Sym) * symbols.size());
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        symbols[1 + i].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        symbols[1 + i].st_shndx = objectSection[i];
+    }
+    std::map<std::string, int> indices;
+    for (int global = 0; global < 2; global++) {
+        for (size_t i = 0; i < code.symbolTable.size(); i++) {
+            CodeSymbol &symbol = code.symbolTable[i];
+            bool isGlobal = symbol.global || symbol.section < 0;
+            if (isGlobal != (global == 1)) continue;
+            Elf64_Sym entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.st_name = addName(strtab, symbol.name);
+            entry.st_info = ELF64_ST_INFO(isGlobal ? STB_GLOBAL : STB_LOCAL, symbol.function ? STT_FUNC : STT_NOTYPE);
+            entry.st_shndx = symbol.section < 0 ? SHN_UNDEF : objectSection[symbol.section];
+            entry.st_value = symbol.offset;
+            entry.st_size = symbol.size;
+            indices[symbol.name] = symbols.size();
+            symbols.push_back(entry);
+        }
+    }
+    int firstGlobal = symbols.size();
+    for (size_t i = 1 + SECTION_COUNT; i < symbols.size(); i++) {
+        if (ELF64_ST_BIND(symbols[i].st_info) != STB_GLOBAL) continue;
+        firstGlobal = i;
+        break;
+    }
+
+    std::string rela;
+    for (size_t i = 0; i < code.relocations.size(); i++) {
+        Relocation &relocation = code.relocations[i];
+        Elf64_Rela entry;
+        int symbol = relocation.symbol.empty() ? 1 + relocation.target : indices[relocation.symbol];
+        entry.r_offset = relocation.offset;
+        entry.r_info = ELF64_R_INFO(symbol, relocation.type);
+        entry.r_addend = relocation.addend;
+        append(rela, entry);
+    }
+    std::string symtab;
+    for (size_t i = 0; i < symbols.size(); i++) append(symtab, symbols[i]);
+
+    std::string shstrtab(1, '\0');
+    Elf64_Shdr headers[OBJECT_SECTIONS];
+    memset(headers, 0, sizeof(headers));
+    const char *names[OBJECT_SECTIONS] = {"", ".text", ".rela.text", ".rodata", ".bss", ".note.GNU-stack", ".symtab", ".strtab", ".shstrtab"};
+    const std::string *contents[OBJECT_SECTIONS] = {NULL, &code.sections[SECTION_TEXT], &rela, &code.sections[SECTION_RODATA],
+        NULL, NULL, &symtab, &strtab, &shstrtab};
+    for (int i = 1; i < OBJECT_SECTIONS; i++) headers[i].sh_name = addName(shstrtab, names[i]);
+    headers[OBJECT_TEXT].sh_type = SHT_PROGBITS;
+    headers[OBJECT_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    headers[OBJECT_TEXT].sh_addralign = 16;
+    headers[OBJECT_RELA].sh_type = SHT_RELA;
+    headers[OBJECT_RELA].sh_flags = SHF_INFO_LINK;
+    headers[OBJECT_RELA].sh_link = OBJECT_SYMTAB;
+    headers[OBJECT_RELA].sh_info = OBJECT_TEXT;
+    headers[OBJECT_RELA].sh_entsize = sizeof(Elf64_Rela);
+    headers[OBJECT_RELA].sh_addralign = 8;
+    headers[OBJECT_RODATA].sh_type = SHT_PROGBITS;
+    headers[OBJECT_RODATA].sh_flags = SHF_ALLOC;
+    headers[OBJECT_RODATA].sh_addralign = 1;
+    headers[OBJECT_BSS].sh_type = SHT_NOBITS;
+    headers[OBJECT_BSS].sh_flags = SHF_ALLOC | SHF_WRITE;
+    headers[OBJECT_BSS].sh_addralign = 8;
+    headers[OBJECT_BSS].sh_size = code.sizes[SECTION_BSS];
+    headers[OBJECT_STACK].sh_type = SHT_PROGBITS;
+    headers[OBJECT_STACK].sh_addralign = 1;
+    headers[OBJECT_SYMTAB].sh_type = SHT_SYMTAB;
+    headers[OBJECT_SYMTAB].sh_link = OBJECT_STRTAB;
+    headers[OBJECT_SYMTAB].sh_info = firstGlobal;
+    headers[OBJECT_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    headers[OBJECT_SYMTAB].sh_addralign = 8;
+    headers[OBJECT_STRTAB].sh_type = SHT_STRTAB;
+    headers[OBJECT_STRTAB].sh_addralign = 1;
+    headers[OBJECT_SHSTRTAB].sh_type = SHT_STRTAB;
+    headers[OBJECT_SHSTRTAB].sh_addralign = 1;
+
+    // the sections' contents follow the file header, the headers come last
+    std::string body;
+    long at = sizeof(Elf64_Ehdr);
+    for (int i = 1; i < OBJECT_SECTIONS; i++) {
+        long start = alignUp(at, headers[i].sh_addralign);
+        body.append(start - at, '\0');
+        headers[i].sh_offset = start;
+        if (contents[i] != NULL) {
+            headers[i].sh_size = contents[i]->size();
+            body += *contents[i];
+        }
+        at = start + (contents[i] != NULL ? contents[i]->size() : 0);
+    }
+    long sectionHeaders = alignUp(at, 8);
+    body.append(sectionHeaders - at, '\0');
+
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = sectionHeaders;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = OBJECT_SECTIONS;
+    header.e_shstrndx = OBJECT_SHSTRTAB;
+
+    std::string object;
+    append(object, header);
+    object += body;
+    for (int i = 0; i < OBJECT_SECTIONS; i++) append(object, headers[i]);
+    return object;
+}
+
+// a section header of an object already checked to hold them all
+static const Elf64_Shdr *sectionHeader(const std::string &bytes, int index) {
+    const Elf64_Ehdr *header = (const Elf64_Ehdr*)bytes.data();
+    return (const Elf64_Shdr*)(bytes.data() + header->e_shoff + index * sizeof(Elf64_Shdr));
+}
+
+static bool inside(const std::string &bytes, unsigned long offset, unsigned long size) {
+    return offset <= bytes.size() && size <= bytes.size() - offset;
+}
+
+bool Linker::add(const std::string &bytes, std::string &error) {
+    int number = this->objects.size();
+    const Elf64_Ehdr *header = (const Elf64_Ehdr*)bytes.data();
+    if (bytes.size() < sizeof(Elf64_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+            || header->e_ident[EI_CLASS] != ELFCLASS64 || header->e_type != ET_REL || header->e_machine != EM_X86_64) {
+        error = "not an x86-64 relocatable object";
+        return false;
+    }
+    if (header->e_shentsize != sizeof(Elf64_Shdr) || !inside(bytes, header->e_shoff, header->e_shnum * sizeof(Elf64_Shdr))) {
+        error = "truncated section headers";
+        return false;
+    }
+    this->objects.push_back(ObjectFile());
+    ObjectFile &object = this->objects.back();
+    object.bytes = bytes;
+    const Elf64_Shdr *shstrtab = sectionHeader(bytes, header->e_shstrndx);
+
+    // the sections that are loaded, unwind tables and notes aside
+    object.sections.assign(header->e_shnum, -1);
+    const Elf64_Shdr *symtab = NULL;
+    for (int i = 1; i < header->e_shnum; i++) {
+        const Elf64_Shdr *section = sectionHeader(bytes, i);
+        if (section->sh_type == SHT_SYMTAB) symtab = section;
+        if (!(section->sh_flags & SHF_ALLOC)) continue;
+        std::string name = bytes.c_str() + shstrtab->sh_offset + section->sh_name;
+        if (name.compare(0, 9, ".eh_frame") == 0 || name.compare(0, 5, ".note") == 0) continue;
+        if (section->sh_type != SHT_PROGBITS && section->sh_type != SHT_NOBITS) {
+            error = "can't link section " + name;
+            return false;
+        }
+        if (section->sh_type == SHT_PROGBITS && !inside(bytes, section->sh_offset, section->sh_size)) {
+            error = "truncated section " + name;
+            return false;
+        }
+        object.sections[i] = this->sections.size();
+        Section placed = {number, i, !(section->sh_flags & SHF_WRITE), section->sh_type != SHT_NOBITS,
+            section->sh_addralign > 1 ? (long)section->sh_addralign : 1, (long)section->sh_size};
+        this->sections.push_back(placed);
+    }
+    if (symtab == NULL) {
+        error = "no symbol table";
+        return false;
+    }
+
+    const char *strings = bytes.c_str() + sectionHeader(bytes, symtab->sh_link)->sh_offset;
+    const Elf64_Sym *entries = (const Elf64_Sym*)(bytes.data() + symtab->sh_offset);
+    int count = symtab->sh_size / sizeof(Elf64_Sym);
+    for (int i = 0; i < count; i++) {
+        const Elf64_Sym &entry = entries[i];
+        Symbol symbol = {strings + entry.st_name, -1, (long)entry.st_value, ELF64_ST_BIND(entry.st_info) != STB_LOCAL};
+        if (entry.st_shndx == SHN_ABS) symbol.section = -2;
+        else if (entry.st_shndx == SHN_COMMON) {
+            error = "can't link common symbol " + symbol.name;
+            return false;
+        }
+        else if (entry.st_shndx != SHN_UNDEF && entry.st_shndx < object.sections.size()) symbol.section = object.sections[entry.st_shndx];
+        object.symbols.push_back(symbol);
+        if (!symbol.global || entry.st_shndx == SHN_UNDEF) continue;
+        std::map<std::string, Symbol>::iterator defined = this->globals.find(symbol.name);
+        if (defined != this->globals.end() && ELF64_ST_BIND(entry.st_info) == STB_WEAK) continue;
+        if (defined != this->globals.end() && defined->second.global) {
+            error = "multiple definition of " + symbol.name;
+            return false;
+        }
+        // a weak definition is kept, but a strong one may still replace it
+        symbol.global = ELF64_ST_BIND(entry.st_info) != STB_WEAK;
+        this->globals[symbol.name] = symbol;
+    }
+    return true;
+}
+
+void Linker::layout() {
+    // code first, then read only data, then what's written, bss last
+    long at = 0;
+    for (int pass = 0; pass < 4; pass++) {
+        if (pass == 2) {
+            this->codeSize = at;
+            at = 0;
+        }
+        if (pass == 3) this->fileDataSize = at;
+        for (size_t i = 0; i < this->sections.size(); i++) {
+            Section &section = this->sections[i];
+            const Elf64_Shdr *header = sectionHeader(this->objects[section.object].bytes, section.index);
+            bool executable = header->sh_flags & SHF_EXECINSTR;
+            int kind = section.code ? (executable ? 0 : 1) : (section.bits ? 2 : 3);
+            if (kind != pass) continue;
+            section.offset = alignUp(at, section.align);
+            at = section.offset + section.size;
+        }
+    }
+    this->dataSize = at;
+}
+
+// a symbol's address with the segments where they are, looking globals up
+// across every object, then among the externals
+bool Linker::symbolAddress(const ObjectFile &object, int index, long codeAddress, long dataAddress,
+        const std::map<std::string, long> &externals, long &address, std::string &error) {
+    Symbol symbol = object.symbols[index];
+    if (symbol.global && symbol.section == -1) {
+        std::map<std::string, Symbol>::iterator defined = this->globals.find(symbol.name);
+        if (defined != this->globals.end()) symbol = defined->second;
+        else {
+            std::map<std::string, long>::const_iterator external = externals.find(symbol.name);
+            if (external == externals.end()) {
+                error = "undefined reference to " + symbol.name;
+                return false;
+            }
+            address = external->second;
+            return true;
+        }
+    }
+    if (symbol.section == -2) address = symbol.value;
+    else if (symbol.section >= 0) {
+        const Section &section = this->sections[symbol.section];
+        address = (section.code ? codeAddress : dataAddress) + section.offset + symbol.value;
+    }
+    else {
+        error = "undefined reference to " + (symbol.name.empty() ? std::string("a section not linked") : symbol.name);
+        return false;
+    }
+    return true;
+}
+
+bool Linker::relocate(long codeAddress, long dataAddress, const std::map<std::string, long> &externals,
+        std::string &code, std::string &data, std::string &error) {
+    code.assign(this->codeSize, '\0');
+    data.assign(this->fileDataSize, '\0');
+    for (size_t i = 0; i < this->sections.size(); i++) {
+        Section &section = this->sections[i];
+        if (!section.bits) continue;
+        const std::string &bytes = this->objects[section.object].bytes;
+        const Elf64_Shdr *header = sectionHeader(bytes, section.index);
+        (section.code ? code : data).replace(section.offset, section.size, bytes, header->sh_offset, section.size);
+    }
+
+    for (size_t o = 0; o < this->objects.size(); o++) {
+        ObjectFile &object = this->objects[o];
+        const Elf64_Ehdr *header = (const Elf64_Ehdr*)object.bytes.data();
+        for (int s = 1; s < header->e_shnum; s++) {
+            const Elf64_Shdr *rela = sectionHeader(object.bytes, s);
+            if (rela->sh_type != SHT_RELA || rela->sh_info >= object.sections.size() || object.sections[rela->sh_info] < 0) continue;
+            if (!inside(object.bytes, rela->sh_offset, rela->sh_size)) {
+                error = "truncated relocations";
+                return false;
+            }
+            Section &target = this->sections[object.sections[rela->sh_info]];
+            std::string &segment = target.code ? code : data;
+            long base = target.code ? codeAddress : dataAddress;
+            const Elf64_Rela *entries = (const Elf64_Rela*)(object.bytes.data() + rela->sh_offset);
+            int count = rela->sh_size / sizeof(Elf64_Rela);
+            for (int i = 0; i < count; i++) {
+                const Elf64_Rela &entry = entries[i];
+                int index = ELF64_R_SYM(entry.r_info);
+                int type = ELF64_R_TYPE(entry.r_info);
+                long at = target.offset + entry.r_offset;
+                long address = 0;
+                if (index >= (int)object.symbols.size()
+                        || !this->symbolAddress(object, index, codeAddress, dataAddress, externals, address, error)) {
+                    if (error.empty()) error = "bad relocation symbol";
+                    return false;
+                }
+                long value = address + entry.r_addend;
+                int size = 4;
+                if (type == R_X86_64_PC32 || type == R_X86_64_PLT32) value -= base + at;
+                else if (type == R_X86_64_64) size = 8;
+                else if (type != R_X86_64_32 && type != R_X86_64_32S) {
+                    error = "can't apply relocation type " + std::to_string(type);
+                    return false;
+                }
+                bool fits = type == R_X86_64_32 ? value >= 0 && value <= 0xffffffffL : value == (long)(int)value;
+                if (size == 4 && !fits) {
+                    error = "relocation against " + object.symbols[index].name + " out of range";
+                    return false;
+                }
+                if (at < 0 || at + size > (long)segment.size()) {
+                    error = "relocation outside its section";
+                    return false;
+                }
+                for (int k = 0; k < size; k++) segment[at + k] = (char)((value >> (8 * k)) & 0xff);
+            }
+        }
+    }
+    return true;
+}
+
+long Linker::address(const std::string &name, long codeAddress, long dataAddress) {
+    std::map<std::string, Symbol>::iterator defined = this->globals.find(name);
+    if (defined == this->globals.end() || defined->second.section < 0) return -1;
+    const Section &section = this->sections[defined->second.section];
+    return (section.code ? codeAddress : dataAddress) + section.offset + defined->second.value;
+}
+
+bool linkExecutable(const std::vector<std::string> &objects, std::string &executable, std::string &error) {
+    Linker linker;
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (!linker.add(objects[i], error)) return false;
+    }
+    linker.layout();
+
+    // the file header and program headers load with the code, which follows
+    // them, and the data starts on a page of its own so each segment's
+    // offset in the file is its address less the base, page for page
+    int segments = linker.dataSize > 0 ? 3 : 2;
+    long headers = alignUp(sizeof(Elf64_Ehdr) + segments * sizeof(Elf64_Phdr), 64);
+    long codeAddress = EXECUTABLE_BASE + headers;
+    long dataOffset = alignUp(headers + linker.codeSize, PAGE_SIZE);
+    long dataAddress = EXECUTABLE_BASE + dataOffset;
+    std::string code, data;
+    std::map<std::string, long> externals;
+    if (!linker.relocate(codeAddress, dataAddress, externals, code, data, error)) return false;
+    long entry = linker.address("_start", codeAddress, dataAddress);
+    if (entry < 0) {
+        error = "no _start to enter at";
+        return false;
+    }
+
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_EXEC;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_entry = entry;
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = segments;
+
+    Elf64_Phdr program[3];
+    memset(program, 0, sizeof(program));
+    program[0].p_type = PT_LOAD;
+    program[0].p_flags = PF_R | PF_X;
+    program[0].p_vaddr = program[0].p_paddr = EXECUTABLE_BASE;
+    program[0].p_filesz = program[0].p_memsz = headers + linker.codeSize;
+    program[0].p_align = PAGE_SIZE;
+    program[1].p_type = PT_GNU_STACK;
+    program[1].p_flags = PF_R | PF_W;
+    program[1].p_align = 16;
+    if (segments == 3) {
+        program[2].p_type = PT_LOAD;
+        program[2].p_flags = PF_R | PF_W;
+        program[2].p_offset = dataOffset;
+        program[2].p_vaddr = program[2].p_paddr = dataAddress;
+        program[2].p_filesz = linker.fileDataSize;
+        program[2].p_memsz = linker.dataSize;
+        program[2].p_align = PAGE_SIZE;
+    }
+
+    executable.clear();
+    append(executable, header);
+    for (int i = 0; i < segments; i++) append(executable, program[i]);
+    executable.resize(headers, '\0');
+    executable += code;
+    if (segments == 3) {
+        executable.resize(dataOffset, '\0');
+        executable += data;
+    }
+    return true;
+}
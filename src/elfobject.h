@@ -0,0 +1,68 @@
+#ifndef ELFOBJECT_H
+#define ELFOBJECT_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "x86.h"
+
+// where a -static executable's first segment loads, the usual spot for x86-64
+#define EXECUTABLE_BASE 0x400000
+#define PAGE_SIZE       4096
+
+// finished machine code as a relocatable elf64 object, for cc to link
+std::string writeObject(MachineCode &code);
+
+// relocatable objects combined into one image: every allocated section that
+// can't be written goes in the code segment and everything writable in the
+// data segment after it, then each relocation is applied once both segments
+// have their addresses. a symbol no object defines is taken from externals
+class Linker {
+    struct Section {
+        int object;
+        int index;       // in its object
+        bool code;       // in the code segment, otherwise data
+        bool bits;       // false for bss
+        long align, size;
+        long offset = 0; // within its segment
+    };
+    struct Symbol {
+        std::string name;
+        int section;     // the index into sections, -1 undefined, -2 absolute
+        long value;
+        bool global;
+    };
+    struct ObjectFile {
+        std::string bytes;
+        std::vector<int> sections;  // by section index, the index into sections or -1
+        std::vector<Symbol> symbols;
+    };
+
+    std::vector<ObjectFile> objects;
+    std::vector<Section> sections;
+    std::map<std::string, Symbol> globals;
+
+    bool symbolAddress(const ObjectFile &object, int index, long codeAddress, long dataAddress,
+        const std::map<std::string, long> &externals, long &address, std::string &error);
+
+    public:
+        long codeSize = 0;
+        long dataSize = 0; // with the bss at its end
+        long fileDataSize = 0;
+
+        // reads an object in, false with the reason when it isn't one this can link
+        bool add(const std::string &bytes, std::string &error);
+        // places every section, giving the segments their sizes
+        void layout();
+        // applies the relocations with the segments at those addresses
+        bool relocate(long codeAddress, long dataAddress, const std::map<std::string, long> &externals,
+            std::string &code, std::string &data, std::string &error);
+        // where a global ended up, -1 for one that isn't defined
+        long address(const std::string &name, long codeAddress, long dataAddress);
+};
+
+// links objects into a static executable entered at _start, needing nothing
+// but the kernel, false with the reason on failure
+bool linkExecutable(const std::vector<std::string> &objects, std::string &executable, std::string &error);
+
+#endif
@@ -0,0 +1,16 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <iostream>
+#include "generator.h"
+
+// writes a synthetic program to stdout, see generator.h for the knobs
+int main(int argc, char **argv) {
+    GeneratorOptions options;
+    if (!parseGeneratorOptions(argc, argv, 1, options)) {
+        std::cout << "usage: gen [-name N] [-procs N] [-statements N] [-depth N] [-expr N]"
+            " [-idents N] [-array N] [-seed N]\n";
+        return 1;
+    }
+    std::cout << generateProgram(options);
+    return 0;
+}
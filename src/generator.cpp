@@ -0,0 +1,256 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include "generator.h"
+
+// emits one program, keeping track of what the current body may touch
+class ProgramGenerator {
+    GeneratorOptions options;
+    unsigned long long state;
+    std::ostringstream out;
+    int indent = 0;
+
+    std::vector<std::string> variables; // integers the body can read and assign
+    std::vector<std::string> counters;  // loop counters of the loops we're inside
+    std::vector<std::string> arrays;
+    std::vector<int> paramCounts;       // every procedure declared so far
+    int callee = -1;                    // the one procedure this body may call
+    bool called = false;
+
+    // xorshift, so a seed means the same program everywhere
+    unsigned int next() {
+        this->state ^= this->state << 13;
+        this->state ^= this->state >> 7;
+        this->state ^= this->state << 17;
+        return (unsigned int)(this->state >> 16);
+    }
+
+    int below(int n) { return n <= 1 ? 0 : (int)(this->next() % n); }
+    bool chance(int percent) { return this->below(100) < percent; }
+
+    template <typename T> const T &pick(const std::vector<T> &from) { return from[this->below(from.size())]; }
+
+    void line(const std::string &text) {
+        this->out << std::string(this->indent * 4, ' ') << text << "\n";
+    }
+
+    std::string index() {
+        if (!this->counters.empty() && this->chance(50)) return this->pick(this->counters);
+        return std::to_string(this->below(this->options.arraySize));
+    }
+
+    std::string operand(bool allowCall) {
+        int roll = this->below(100);
+        if (roll < 45 && !this->variables.empty()) return this->pick(this->variables);
+        if (roll < 55 && !this->counters.empty()) return this->pick(this->counters);
+        if (roll < 70 && !this->arrays.empty()) return this->pick(this->arrays) + "[" + this->index() + "]";
+
+        // at most one call per body and none inside loops, so running a
+        // generated program costs time linear in its size
+        if (roll < 80 && allowCall && this->callee >= 0 && !this->called && this->counters.empty()) {
+            this->called = true;
+            std::string call = "proc" + std::to_string(this->callee) + "(";
+            for (int i = 0; i < this->paramCounts[this->callee]; i++) {
+                if (i > 0) call += ", ";
+                call += this->expression(1 + this->below(2), false);
+            }
+            return call + ")";
+        }
+        if (roll < 85) return "(" + this->expression(2, false) + ")";
+        if (roll < 90) return "-" + std::to_string(this->below(50));
+        return std::to_string(this->below(100));
+    }
+
+    // integer typed: relations bind tighter than + here, so none appear inside,
+    // and & | are left out since the parser doesn't accept them yet
+    std::string expression(int length, bool allowCall) {
+        static const char *operators[] = {" + ", " - ", " * ", " + ", " - "};
+        std::string text = this->operand(allowCall);
+        for (int i = 1; i < length; i++) {
+            text += operators[this->below(5)];
+            text += this->operand(allowCall);
+        }
+        return text;
+    }
+
+    std::string condition() {
+        static const char *relations[] = {" < ", " <= ", " > ", " >= ", " == ", " != "};
+        std::string lhs = this->variables.empty() ? "0" : this->pick(this->variables);
+        return lhs + relations[this->below(6)] + std::to_string(this->below(100));
+    }
+
+    std::string target() {
+        if (!this->arrays.empty() && this->chance(25)) return this->pick(this->arrays) + "[" + this->index() + "]";
+        return this->pick(this->variables);
+    }
+
+    // spends count statements, nesting if/for down to the depth limit
+    void statements(int count, int depth) {
+        while (count > 0) {
+            int inner = 1 + this->below(count / 2 + 1);
+            if (depth < this->options.depth && count >= 3 && this->chance(25)) {
+                if (this->chance(50)) this->ifStatement(inner, depth);
+                else this->loopStatement(inner, depth);
+                count -= inner + 1;
+            }
+            else {
+                this->line(this->target() + " := " + this->expression(this->options.expressionLength, true) + ";");
+                count--;
+            }
+        }
+    }
+
+    void ifStatement(int count, int depth) {
+        this->line("if (" + this->condition() + ") then");
+        this->indent++;
+        int thenCount = (count + 1) / 2;
+        this->statements(thenCount, depth + 1);
+        this->indent--;
+        if (count - thenCount > 0) {
+            this->line("else");
+            this->indent++;
+            this->statements(count - thenCount, depth + 1);
+            this->indent--;
+        }
+        this->line("end if;");
+    }
+
+    void loopStatement(int count, int depth) {
+        std::string counter = "i" + std::to_string(depth);
+        int trips = 1 + this->below(this->options.arraySize < 10 ? this->options.arraySize : 10);
+        this->line("for (" + counter + " := 0; " + counter + " < " + std::to_string(trips) + ")");
+        this->indent++;
+        this->counters.push_back(counter);
+        this->statements(count, depth + 1);
+        this->counters.pop_back();
+        this->line(counter + " := " + counter + " + 1;");
+        this->indent--;
+        this->line("end for;");
+    }
+
+    // declares the body's integers, counters and array, then gives each a value
+    void locals(std::string prefix, int count, bool global) {
+        std::string declare = global ? "global variable " : "variable ";
+        for (int i = 0; i < count; i++) {
+            this->variables.push_back(prefix + std::to_string(i));
+            this->line(declare + this->variables.back() + " : integer;");
+        }
+        for (int i = 0; i < this->options.depth || i == 0; i++) {
+            this->line("variable i" + std::to_string(i) + " : integer;");
+        }
+        this->arrays.push_back(prefix + "arr");
+        this->line(declare + this->arrays.back() + " : integer[" + std::to_string(this->options.arraySize) + "];");
+    }
+
+    void initialize(int firstVariable) {
+        for (size_t i = firstVariable; i < this->variables.size(); i++) {
+            this->line(this->variables[i] + " := " + std::to_string(this->below(100)) + ";");
+        }
+        std::string array = this->arrays.back();
+        this->line("for (i0 := 0; i0 < " + std::to_string(this->options.arraySize) + ")");
+        this->line("    " + array + "[i0] := i0;");
+        this->line("    i0 := i0 + 1;");
+        this->line("end for;");
+    }
+
+    void procedure(int number, std::vector<std::string> globals) {
+        int params = 1 + this->below(3);
+        std::string header = "procedure proc" + std::to_string(number) + " : integer(";
+        this->variables = globals;
+        for (int i = 0; i < params; i++) {
+            this->variables.push_back("a" + std::to_string(i));
+            header += std::string(i > 0 ? ", " : "") + "variable a" + std::to_string(i) + " : integer";
+        }
+        this->line(header + ")");
+
+        this->indent++;
+        size_t firstLocal = this->variables.size();
+        this->locals("v", this->options.identifiers, false);
+        this->arrays.insert(this->arrays.begin(), "garr");
+        this->indent--;
+
+        this->line("begin");
+        this->indent++;
+        this->initialize(firstLocal);
+        this->callee = number - 1;
+        this->called = false;
+        this->statements(this->options.statements, 0);
+        this->line("return " + this->expression(this->options.expressionLength, true) + ";");
+        this->indent--;
+        this->line("end procedure;");
+        this->line("");
+
+        this->paramCounts.push_back(params);
+        this->arrays.clear();
+    }
+
+    public:
+        ProgramGenerator(GeneratorOptions generatorOptions) {
+            this->options = generatorOptions;
+            if (this->options.arraySize < 1) this->options.arraySize = 1;
+            if (this->options.identifiers < 1) this->options.identifiers = 1;
+            if (this->options.expressionLength < 1) this->options.expressionLength = 1;
+            this->state = 0x9e3779b97f4a7c15ULL ^ ((unsigned long long)this->options.seed << 1);
+        }
+
+        std::string program() {
+            this->line("program " + this->options.name + " is");
+            this->line("");
+            this->indent++;
+            this->locals("g", this->options.identifiers, true);
+            this->line("variable result : integer;");
+            this->line("variable out : bool;");
+            this->indent--;
+            this->line("");
+
+            std::vector<std::string> globals = this->variables;
+            this->variables.clear();
+            this->arrays.clear();
+            for (int i = 0; i < this->options.procedures; i++) this->procedure(i, globals);
+
+            this->variables = globals;
+            this->variables.push_back("result");
+            this->arrays.push_back("garr");
+            this->line("begin");
+            this->indent++;
+            this->initialize(0);
+            for (int i = 0; i < this->options.procedures; i++) {
+                std::string call = "result := proc" + std::to_string(i) + "(";
+                for (int j = 0; j < this->paramCounts[i]; j++) call += (j > 0 ? ", " : "") + std::to_string(this->below(100));
+                this->line(call + ");");
+                this->line("out := putInteger(result);");
+            }
+            this->callee = -1;
+            this->statements(this->options.statements, 0);
+            this->line("out := putInteger(" + this->variables[0] + ");");
+            this->indent--;
+            this->line("end program.");
+            return this->out.str();
+        }
+};
+
+std::string generateProgram(GeneratorOptions options) {
+    ProgramGenerator generator(options);
+    return generator.program();
+}
+
+bool parseGeneratorOptions(int argc, char **argv, int first, GeneratorOptions &options) {
+    for (int i = first; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        const char *flag = argv[i];
+        const char *value = argv[++i];
+        if (strcmp(flag, "-name") == 0) options.name = value;
+        else if (strcmp(flag, "-procs") == 0) options.procedures = atoi(value);
+        else if (strcmp(flag, "-statements") == 0) options.statements = atoi(value);
+        else if (strcmp(flag, "-depth") == 0) options.depth = atoi(value);
+        else if (strcmp(flag, "-expr") == 0) options.expressionLength = atoi(value);
+        else if (strcmp(flag, "-idents") == 0) options.identifiers = atoi(value);
+        else if (strcmp(flag, "-array") == 0) options.arraySize = atoi(value);
+        else if (strcmp(flag, "-seed") == 0) options.seed = strtoul(value, NULL, 10);
+        else return false;
+    }
+    return true;
+}
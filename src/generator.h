@@ -0,0 +1,27 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <string>
+
+// knobs for a synthetic program, each one a dimension the compiler scales in
+struct GeneratorOptions {
+    int procedures = 8;        // top level procedures
+    int statements = 40;       // statements per body, nested ones included
+    int depth = 3;             // deepest if/for nesting
+    int expressionLength = 4;  // operands per expression
+    int identifiers = 8;       // integer variables per scope
+    int arraySize = 16;        // elements in every array
+    unsigned int seed = 1;
+    std::string name = "Generated";
+};
+
+// a valid, terminating program in the language, the same for the same options
+// everything is integer typed; loops count up to a literal, array indexes are
+// in bounds and procedures only call the ones declared before them
+std::string generateProgram(GeneratorOptions options);
+
+// reads "-procs 8 -statements 40 ..." style flags starting at argv[first]
+// returns false on an unknown flag or a missing value
+bool parseGeneratorOptions(int argc, char **argv, int first, GeneratorOptions &options);
+
+#endif
@@ -0,0 +1,306 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include "passes.h"
+
+// what an instruction computes, two instructions with equal keys compute the
+// same value. loads also carry the generation of the memory they read
+struct ValueKey {
+    int op, type, elemType;
+    int left, right;   // operand ids, -1 when absent
+    int intValue;
+    unsigned int floatBits;
+    std::string name;
+    long generation;
+    long element;      // generation of the array element a load reads, -1 for the whole
+
+    bool operator==(const ValueKey &other) const {
+        return op == other.op && type == other.type && elemType == other.elemType && left == other.left
+            && right == other.right && intValue == other.intValue && floatBits == other.floatBits
+            && generation == other.generation && element == other.element && name == other.name;
+    }
+};
+
+struct ValueKeyHash {
+    size_t operator()(const ValueKey &key) const {
+        size_t hash = key.op;
+        hash = hash * 31 + key.type;
+        hash = hash * 31 + key.left;
+        hash = hash * 31 + key.right;
+        hash = hash * 31 + key.intValue;
+        hash = hash * 31 + key.floatBits;
+        hash = hash * 31 + key.generation;
+        hash = hash * 31 + key.element;
+        return hash ^ std::hash<std::string>()(key.name);
+    }
+};
+
+// where memory stands, as generations that change with every write that
+// may reach it. a root's elements at constant indexes are tracked apart, so
+// writing a[1] leaves a load of a[0] alone
+struct MemoryState {
+    std::vector<long> whole;  // by root, changes when it may all have been written
+    std::vector<long> any;    // by root, changes with any write to it
+    std::map<std::pair<int, int>, long> elements; // by root and index
+};
+
+class ValueNumbering {
+    Function *function;
+    DominatorTree &dominators;
+    const Cfg &cfg;
+
+    MemoryRoots roots;
+    std::vector<Bitset> clobbers; // roots each block may write, by cfg index
+
+    std::unordered_map<ValueKey, Instruction*, ValueKeyHash> available;
+    std::vector<ValueKey> added;  // undo log, popped on leaving a subtree
+    MemoryState memory;
+    long nextGeneration = 1;
+    int removed = 0;
+
+    void summarize();
+    void enter(int block);
+    bool keyFor(Instruction *instruction, ValueKey &key);
+    bool loadKey(Instruction *address, int type, ValueKey &key);
+    void forget(const Bitset &written);
+    void remember(ValueKey &key, Instruction *value);
+    void number(Instruction *instruction);
+
+    public:
+        ValueNumbering(Function *function, DominatorTree &dominators);
+        int run();
+};
+
+ValueNumbering::ValueNumbering(Function *function, DominatorTree &dominators)
+    : function(function), dominators(dominators), cfg(dominators.cfg), roots(function) {
+    this->memory.whole.assign(this->roots.count, 0);
+    this->memory.any.assign(this->roots.count, 0);
+}
+
+// an element of an array at a constant index, directly off the array's address
+static bool constantElement(Instruction *address, int &index) {
+    if (address->op != OP_INDEX || !address->operands[1]->isConstant() || address->operands[0]->op == OP_INDEX) return false;
+    index = address->operands[1]->intValue;
+    return true;
+}
+
+void ValueNumbering::forget(const Bitset &written) {
+    for (int root = written.findNext(0); root >= 0; root = written.findNext(root + 1)) {
+        this->memory.whole[root] = this->memory.any[root] = this->nextGeneration++;
+    }
+}
+
+// which roots each block writes
+void ValueNumbering::summarize() {
+    this->clobbers.assign(this->cfg.size(), Bitset(this->roots.count));
+    for (int i = 0; i < this->cfg.size(); i++) {
+        std::list<Instruction*> &instructions = this->cfg.blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op == OP_STORE) this->roots.addAliases(this->clobbers[i], this->roots.rootOf((*it)->operands[0]));
+            else if ((*it)->op == OP_CALL) this->roots.addCallEffects(this->clobbers[i], *it);
+        }
+    }
+}
+
+// memory as the dominator left it, less whatever the blocks between the two
+// may write. those are the blocks reaching this one back to its dominator
+void ValueNumbering::enter(int block) {
+    int dominator = this->dominators.idom[block];
+    const std::vector<int> &preds = this->cfg.preds[block];
+    if (block == 0 || (preds.size() == 1 && preds[0] == dominator)) return;
+
+    Bitset written(this->roots.count);
+    std::vector<bool> seen(this->cfg.size(), false);
+    std::vector<int> work(preds.begin(), preds.end());
+    while (!work.empty()) {
+        int at = work.back();
+        work.pop_back();
+        if (at == dominator || seen[at]) continue;
+        seen[at] = true;
+        written.unionWith(this->clobbers[at]);
+        work.insert(work.end(), this->cfg.preds[at].begin(), this->cfg.preds[at].end());
+    }
+    this->forget(written);
+}
+
+// false for instructions that can't be numbered: side effects, phis, allocas
+// and loads from memory nothing can place. a check can't fail once the same
+// check has passed, so checks are numbered too
+bool ValueNumbering::keyFor(Instruction *instruction, ValueKey &key) {
+    switch (instruction->op) {
+        case OP_STORE: case OP_CALL: case OP_BR: case OP_CONDBR: case OP_RET:
+        case OP_PHI: case OP_ALLOCA:
+            return false;
+    }
+    key.op = instruction->op;
+    key.type = instruction->type;
+    key.elemType = instruction->elemType;
+    key.left = instruction->operands.size() > 0 ? instruction->operands[0]->id : -1;
+    key.right = instruction->operands.size() > 1 ? instruction->operands[1]->id : -1;
+    key.intValue = instruction->intValue;
+    memcpy(&key.floatBits, &instruction->floatValue, sizeof(float));
+    key.name = instruction->name;
+    key.generation = 0;
+    key.element = -1;
+
+    // operand order doesn't matter to these, so put them in one order
+    switch (instruction->op) {
+        case OP_ADD: case OP_MUL: case OP_AND: case OP_OR: case OP_EQ: case OP_NE:
+            if (key.left > key.right) std::swap(key.left, key.right);
+    }
+
+    if (instruction->op == OP_LOAD) return this->loadKey(instruction->operands[0], instruction->type, key);
+    return true;
+}
+
+// the key of a load of type from address, as the memory it reads stands now
+bool ValueNumbering::loadKey(Instruction *address, int type, ValueKey &key) {
+    int root = this->roots.rootOf(address);
+    if (root == ROOT_UNKNOWN) return false;
+    key.op = OP_LOAD;
+    key.type = type;
+    key.elemType = IR_VOID;
+    key.left = address->id;
+    key.right = -1;
+    key.intValue = 0;
+    key.floatBits = 0;
+    key.name.clear();
+
+    // an element at a constant index only changes with writes to it or to
+    // the whole array, anything else with any write to its root
+    int index;
+    if (constantElement(address, index)) {
+        std::map<std::pair<int, int>, long>::iterator found = this->memory.elements.find(std::make_pair(root, index));
+        key.generation = this->memory.whole[root];
+        key.element = found == this->memory.elements.end() ? 0 : found->second;
+    }
+    else {
+        key.generation = this->memory.any[root];
+        key.element = -1;
+    }
+    return true;
+}
+
+void ValueNumbering::remember(ValueKey &key, Instruction *value) {
+    if (this->available.count(key) > 0) return;
+    this->available[key] = value;
+    this->added.push_back(key);
+}
+
+void ValueNumbering::number(Instruction *instruction) {
+    if (instruction->op == OP_STORE || instruction->op == OP_CALL) {
+        Bitset written(this->roots.count);
+        int root = ROOT_UNKNOWN, index;
+        if (instruction->op == OP_STORE) {
+            root = this->roots.rootOf(instruction->operands[0]);
+            this->roots.addAliases(written, root);
+        }
+        else this->roots.addCallEffects(written, instruction);
+
+        // a store to one element leaves the rest of its array as it was
+        if (root != ROOT_UNKNOWN && constantElement(instruction->operands[0], index)) {
+            written.reset(root);
+            this->memory.elements[std::make_pair(root, index)] = this->nextGeneration++;
+            this->memory.any[root] = this->nextGeneration++;
+        }
+        this->forget(written);
+
+        // what was just stored is what the next load from there reads
+        ValueKey key;
+        if (instruction->op == OP_STORE && this->loadKey(instruction->operands[0], instruction->elemType, key)) {
+            this->remember(key, instruction->operands[1]);
+        }
+        return;
+    }
+
+    ValueKey key;
+    if (!this->keyFor(instruction, key)) return;
+    std::unordered_map<ValueKey, Instruction*, ValueKeyHash>::iterator found = this->available.find(key);
+    if (found == this->available.end()) {
+        this->remember(key, instruction);
+        return;
+    }
+    instruction->replaceAllUsesWith(found->second);
+    instruction->block->erase(instruction);
+    this->removed++;
+}
+
+// phis in one block with the same incoming values are the same value, and a
+// phi whose values are all one value (or itself) is that value
+static int mergePhis(Block *block) {
+    int removed = 0;
+    std::vector<Instruction*> phis = block->phis();
+    for (size_t i = 0; i < phis.size(); i++) {
+        Instruction *phi = phis[i];
+        Instruction *same = NULL;
+        bool trivial = true;
+        for (size_t j = 0; j < phi->operands.size(); j++) {
+            if (phi->operands[j] == phi || phi->operands[j] == same) continue;
+            if (same != NULL) trivial = false;
+            same = phi->operands[j];
+        }
+        Instruction *replacement = trivial ? same : NULL;
+        for (size_t j = 0; j < i && replacement == NULL; j++) {
+            if (phis[j] != NULL && phis[j]->type == phi->type && phis[j]->operands == phi->operands) replacement = phis[j];
+        }
+        if (replacement == NULL) continue;
+        phi->replaceAllUsesWith(replacement);
+        block->erase(phi);
+        phis[i] = NULL;
+        removed++;
+    }
+    return removed;
+}
+
+int ValueNumbering::run() {
+    if (this->cfg.size() == 0) return CHANGED_NONE;
+    this->summarize();
+
+    // preorder over the dominator tree, everything available in a block is
+    // available in the blocks it dominates and nowhere else
+    struct Frame {
+        int block;
+        size_t child;
+        size_t mark;
+        MemoryState memory;
+    };
+    std::vector<Frame> stack;
+    stack.push_back(Frame{0, 0, 0, MemoryState()});
+    bool entered = false;
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        if (!entered) {
+            frame.mark = this->added.size();
+            this->enter(frame.block);
+            Block *block = this->cfg.blocks[frame.block];
+            this->removed += mergePhis(block);
+            std::vector<Instruction*> instructions(block->instructions.begin(), block->instructions.end());
+            for (size_t i = 0; i < instructions.size(); i++) this->number(instructions[i]);
+            frame.memory = this->memory;
+        }
+
+        const std::vector<int> &children = this->dominators.children[frame.block];
+        if (frame.child < children.size()) {
+            int child = children[frame.child++];
+            this->memory = frame.memory;
+            stack.push_back(Frame{child, 0, 0, MemoryState()});
+            entered = false;
+            continue;
+        }
+
+        while (this->added.size() > frame.mark) {
+            this->available.erase(this->added.back());
+            this->added.pop_back();
+        }
+        stack.pop_back();
+        entered = true;
+    }
+    return this->removed > 0 ? CHANGED_INSTRUCTIONS : CHANGED_NONE;
+}
+
+int numberValues(Function *function, AnalysisCache &analyses) {
+    ValueNumbering numbering(function, analyses.getDominators());
+    return numbering.run();
+}
@@ -0,0 +1,258 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstring>
+#include <unordered_set>
+#include "alloctrack.h"
+#include "driver.h"
+#include "incremental.h"
+#include "sha256.h"
+#include "symboltable.h"
+
+// appends fixed width little endian ints and length prefixed strings
+static void putInt(std::string &out, int value) {
+    for (int i = 0; i < 4; i++) out += (char)(((unsigned int)value >> (8 * i)) & 0xff);
+}
+
+static void putString(std::string &out, const std::string &value) {
+    putInt(out, value.size());
+    out += value;
+}
+
+// reads back what putInt/putString wrote, failing softly on short input
+struct BlobReader {
+    const std::string &blob;
+    size_t offset = 0;
+    bool ok = true;
+
+    BlobReader(const std::string &data) : blob(data) {}
+
+    int getInt() {
+        if (offset + 4 > blob.size()) {
+            ok = false;
+            return 0;
+        }
+        unsigned int value = 0;
+        for (int i = 0; i < 4; i++) value |= (unsigned int)(unsigned char)blob[offset + i] << (8 * i);
+        offset += 4;
+        return (int)value;
+    }
+
+    std::string getString() {
+        int length = getInt();
+        if (!ok || length < 0 || offset + length > blob.size()) {
+            ok = false;
+            return "";
+        }
+        std::string value = blob.substr(offset, length);
+        offset += length;
+        return value;
+    }
+};
+
+// words keep their column but store their line relative to the procedure,
+// synthetic words (line 0) stay at zero
+static void putWord(std::string &out, const Word &word, int baseLine) {
+    putString(out, word.tokenString);
+    putInt(out, word.tokenType);
+    putInt(out, word.line == 0 ? 0 : 1);
+    putInt(out, word.line - baseLine);
+    putInt(out, word.col);
+    putInt(out, word.intValue);
+    int floatBits;
+    memcpy(&floatBits, &word.floatValue, sizeof(floatBits));
+    putInt(out, floatBits);
+    putInt(out, word.boolValue | (word.negated << 1) | (word.isProcIdentifier << 2));
+    putString(out, word.strValue);
+    putInt(out, word.length);
+    putInt(out, word.dataType);
+
+    putInt(out, word.arrayInt.size());
+    for (int value : word.arrayInt) putInt(out, value);
+    putInt(out, word.arrayFloat.size());
+    for (float value : word.arrayFloat) {
+        memcpy(&floatBits, &value, sizeof(floatBits));
+        putInt(out, floatBits);
+    }
+    putInt(out, word.arrayString.size());
+    for (const std::string &value : word.arrayString) putString(out, value);
+    putInt(out, word.arrayBool.size());
+    for (bool value : word.arrayBool) putInt(out, value);
+    putInt(out, word.procParamTypes.size());
+    for (int value : word.procParamTypes) putInt(out, value);
+}
+
+static Word getWord(BlobReader &in, int baseLine) {
+    Word word;
+    word.tokenString = in.getString();
+    word.tokenType = in.getInt();
+    bool positioned = in.getInt();
+    int line = in.getInt();
+    word.line = positioned ? line + baseLine : 0;
+    word.col = in.getInt();
+    word.intValue = in.getInt();
+    int floatBits = in.getInt();
+    memcpy(&word.floatValue, &floatBits, sizeof(floatBits));
+    int flags = in.getInt();
+    word.boolValue = flags & 1;
+    word.negated = flags & 2;
+    word.isProcIdentifier = flags & 4;
+    word.strValue = in.getString();
+    word.length = in.getInt();
+    word.dataType = in.getInt();
+
+    int count = in.getInt();
+    for (int i = 0; i < count && in.ok; i++) word.arrayInt.push_back(in.getInt());
+    count = in.getInt();
+    for (int i = 0; i < count && in.ok; i++) {
+        float value;
+        floatBits = in.getInt();
+        memcpy(&value, &floatBits, sizeof(value));
+        word.arrayFloat.push_back(value);
+    }
+    count = in.getInt();
+    for (int i = 0; i < count && in.ok; i++) word.arrayString.push_back(in.getString());
+    count = in.getInt();
+    for (int i = 0; i < count && in.ok; i++) word.arrayBool.push_back(in.getInt());
+    count = in.getInt();
+    for (int i = 0; i < count && in.ok; i++) word.procParamTypes.push_back(in.getInt());
+    return word;
+}
+
+// preorder: expression id, terminal word, child count, then the children
+static void putNode(std::string &out, Node *node, int baseLine) {
+    putInt(out, node->getExprId());
+    putWord(out, node->getTerminal(), baseLine);
+    std::list<Node*> children = node->getChildren();
+    putInt(out, children.size());
+    for (Node *child : children) putNode(out, child, baseLine);
+}
+
+static Node *getNode(BlobReader &in, int baseLine) {
+    Node *node = new Node(in.getInt());
+    node->setTerminal(getWord(in, baseLine));
+    int count = in.getInt();
+    for (int i = 0; i < count && in.ok; i++) node->addChild(getNode(in, baseLine));
+    return node;
+}
+
+// the parts of a word that can change how a procedure is analyzed
+static void putToken(std::string &out, const Word &word, int baseLine) {
+    putInt(out, word.tokenType);
+    putString(out, word.tokenString);
+    putInt(out, word.isProcIdentifier);
+    putInt(out, word.line - baseLine);
+    putInt(out, word.col);
+}
+
+// a declaration that lands in the GLOBAL scope, as a run of words
+struct GlobalDeclaration {
+    std::string name;
+    size_t first, last; // word indexes, inclusive
+};
+
+// finds the top level procedures and fingerprints them
+void ProcedureReuse::analyze(const std::list<Word> &wordList) {
+    ALLOC_SUBSYSTEM(ALLOC_CACHE);
+    std::vector<const Word*> words;
+    for (const Word &word : wordList) words.push_back(&word);
+    size_t count = words.size();
+
+    std::vector<GlobalDeclaration> globals;
+    std::vector<std::pair<size_t, size_t>> ranges; // each top level procedure, inclusive
+    int depth = 0;
+    size_t start = 0;
+    bool programBegun = false;
+
+    for (size_t i = 0; i < count; i++) {
+        int type = words[i]->tokenType;
+        bool globalFlag = (i > 0 && words[i - 1]->tokenType == T_GLOBAL);
+
+        // declarations reaching the global scope: anything top level, or marked global
+        if ((type == T_VARIABLE || type == T_PROC) && (globalFlag || (depth == 0 && !programBegun))
+            && (i == 0 || words[i - 1]->tokenType != T_END) && i + 1 < count) {
+            GlobalDeclaration declaration;
+            declaration.name = words[i + 1]->tokenString;
+            declaration.first = i;
+            int stop = (type == T_VARIABLE) ? T_SEMICOLON : T_RPAREN;
+            size_t last = i;
+            while (last + 1 < count && words[last + 1]->tokenType != stop) last++;
+            declaration.last = (type == T_PROC && last + 1 < count) ? last + 1 : last;
+            globals.push_back(declaration);
+        }
+
+        if (type == T_PROC && (i == 0 || words[i - 1]->tokenType != T_END)) {
+            if (depth == 0 && !programBegun) start = i;
+            depth++;
+        }
+        else if (type == T_END && i + 1 < count && words[i + 1]->tokenType == T_PROC) {
+            i++;
+            depth--;
+            if (depth == 0 && !programBegun) ranges.push_back(std::make_pair(start, i));
+        }
+        else if (type == T_BEGIN && depth == 0) {
+            programBegun = true;
+        }
+    }
+
+    for (auto const &range : ranges) {
+        size_t first = range.first, last = range.second;
+        if (first + 1 > last) continue;
+
+        ProcSpan span;
+        span.name = words[first + 1]->tokenString;
+        span.firstLine = words[first]->line;
+
+        size_t paren = first;
+        while (paren < last && words[paren]->tokenType != T_RPAREN) paren++;
+        span.headerWords = paren - first + 1;
+        span.bodyWords = last - paren;
+
+        // the procedure's own words, and the names it mentions
+        std::string material = "procedure " COMPILER_VERSION;
+        std::unordered_set<std::string> mentioned;
+        for (size_t i = first; i <= last; i++) {
+            putToken(material, *words[i], span.firstLine);
+            if (words[i]->tokenType == T_IDENTIFIER) mentioned.insert(words[i]->tokenString);
+        }
+
+        // every global declaration it could resolve a mentioned name to
+        for (const GlobalDeclaration &declaration : globals) {
+            if (declaration.first > last || mentioned.count(declaration.name) == 0) continue;
+            material += '\0';
+            for (size_t i = declaration.first; i <= declaration.last; i++) {
+                putInt(material, words[i]->tokenType);
+                putString(material, words[i]->tokenString);
+            }
+        }
+
+        span.fingerprint = sha256Hex(material);
+        this->spans.push_back(span);
+    }
+}
+
+ProcSpan *ProcedureReuse::nextProcedure() {
+    if (this->nextSpan >= this->spans.size()) return NULL;
+    return &this->spans[this->nextSpan++];
+}
+
+Node *ProcedureReuse::load(ProcSpan &span) {
+    ALLOC_SUBSYSTEM(ALLOC_CACHE);
+    std::string blob;
+    if (!this->cache->loadBlob(span.fingerprint, blob)) return NULL;
+
+    BlobReader in(blob);
+    Node *body = getNode(in, span.firstLine);
+    if (!in.ok || body->getExprId() != E_PROCBODY) {
+        delete body;
+        return NULL;
+    }
+    this->reused++;
+    return body;
+}
+
+void ProcedureReuse::store(ProcSpan &span, Node *body) {
+    ALLOC_SUBSYSTEM(ALLOC_CACHE);
+    std::string blob;
+    putNode(blob, body, span.firstLine);
+    this->cache->storeBlob(span.fingerprint, blob);
+}
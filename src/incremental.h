@@ -0,0 +1,47 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "parser.h"
+#include "word.h"
+
+// a top level procedure declaration as found by the pre-pass over the words
+struct ProcSpan {
+    std::string name;
+    int firstLine = 0;      // line of the PROCEDURE token, body positions are relative to it
+    int headerWords = 0;    // PROCEDURE through the closing paren of the params
+    int bodyWords = 0;      // everything after that through END PROCEDURE
+    std::string fingerprint;
+};
+
+// reuses the analyzed bodies of unchanged top level procedures
+// a procedure's fingerprint covers its own words (with positions relative
+// to its first line) plus every global declaration and procedure header
+// named inside it, so editing a global or a called procedure's signature
+// also invalidates each procedure that depends on it
+class ProcedureReuse {
+    CompileCache *cache;
+    std::vector<ProcSpan> spans;
+    size_t nextSpan = 0;
+
+    public:
+        int reused = 0;
+
+        ProcedureReuse(CompileCache *store) { cache = store; }
+
+        // finds the top level procedures and fingerprints them
+        void analyze(const std::list<Word> &words);
+        int procedureCount() { return spans.size(); }
+
+        // the span for the top level procedure the parser is starting
+        ProcSpan *nextProcedure();
+
+        // previously analyzed body for the span, or NULL
+        Node *load(ProcSpan &span);
+        void store(ProcSpan &span, Node *body);
+};
+
+#endif
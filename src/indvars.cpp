@@ -0,0 +1,168 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <map>
+#include "passes.h"
+
+// a basic induction variable: a phi in the header taking start from the
+// preheader and phi plus a constant step from the latch
+struct InductionVariable {
+    Instruction *phi;
+    Instruction *start;
+    Instruction *next;
+    int step;
+};
+
+// an induction variable times a loop invariant factor, kept as one more
+// induction variable stepping by step * factor
+struct ScaledVariable {
+    Instruction *phi;
+    Instruction *next;
+};
+
+// induction variable simplification: loops whose header a preheader and one
+// latch lead to get their basic induction variables found. two that start
+// at the same value and step alike are one, and a multiplication of one by
+// something invariant becomes a variable of its own that the latch adds to
+class InductionVariables {
+    Function *function;
+    const LoopForest &loops;
+    const Cfg &cfg;
+
+    Instruction *constant(Block *block, int value);
+    Instruction *product(Block *block, Instruction *left, Instruction *right);
+    bool basic(Instruction *phi, int preheader, int latch, InductionVariable &variable);
+    bool simplify(const Loop *loop);
+
+    public:
+        InductionVariables(Function *function, const LoopForest &loops) : function(function), loops(loops), cfg(loops.cfg) {}
+        bool run();
+};
+
+// made just ahead of block's branch
+Instruction *InductionVariables::constant(Block *block, int value) {
+    Instruction *made = this->function->create(OP_CONST, IR_INT);
+    made->intValue = value;
+    return block->insertBefore(block->terminator(), made);
+}
+
+// left * right ahead of block's branch, folded when both are constant
+Instruction *InductionVariables::product(Block *block, Instruction *left, Instruction *right) {
+    if (left->isConstant() && right->isConstant()) {
+        return this->constant(block, (int)((unsigned int)left->intValue * (unsigned int)right->intValue));
+    }
+    Instruction *made = this->function->create(OP_MUL, IR_INT);
+    made->addOperand(left);
+    made->addOperand(right);
+    return block->insertBefore(block->terminator(), made);
+}
+
+bool InductionVariables::basic(Instruction *phi, int preheader, int latch, InductionVariable &variable) {
+    if (phi->type != IR_INT) return false;
+    variable.phi = phi;
+    variable.start = phi->operands[preheader];
+    variable.next = phi->operands[latch];
+    Instruction *next = variable.next;
+    if (next->op != OP_ADD && next->op != OP_SUB) return false;
+    if (next->operands[0] == phi && next->operands[1]->isConstant()) {
+        variable.step = next->op == OP_ADD ? next->operands[1]->intValue : (int)(0u - (unsigned int)next->operands[1]->intValue);
+        return true;
+    }
+    if (next->op == OP_ADD && next->operands[1] == phi && next->operands[0]->isConstant()) {
+        variable.step = next->operands[0]->intValue;
+        return true;
+    }
+    return false;
+}
+
+bool InductionVariables::simplify(const Loop *loop) {
+    Block *header = this->cfg.blocks[loop->header];
+    if (header->preds.size() != 2 || loop->latches.size() != 1) return false;
+    int latch = header->preds[0] == this->cfg.blocks[loop->latches[0]] ? 0 : 1;
+    int preheader = 1 - latch;
+    Block *before = header->preds[preheader];
+    int outside = this->cfg.indexOf(before);
+    if (outside < 0 || this->loops.contains(loop, outside) || before->succs().size() != 1) return false;
+
+    bool changed = false;
+    std::vector<InductionVariable> variables;
+    std::vector<Instruction*> phis = header->phis();
+    for (size_t i = 0; i < phis.size(); i++) {
+        InductionVariable variable;
+        if (!this->basic(phis[i], preheader, latch, variable)) continue;
+        // the same start and step is the same sequence
+        bool merged = false;
+        for (size_t j = 0; j < variables.size() && !merged; j++) {
+            InductionVariable &earlier = variables[j];
+            bool sameStart = earlier.start == variable.start
+                || (earlier.start->isConstant() && variable.start->isConstant() && earlier.start->intValue == variable.start->intValue);
+            if (!sameStart || earlier.step != variable.step) continue;
+            variable.phi->replaceAllUsesWith(earlier.phi);
+            header->erase(variable.phi);
+            merged = changed = true;
+        }
+        if (!merged) variables.push_back(variable);
+    }
+
+    std::map<std::pair<Instruction*, Instruction*>, ScaledVariable> scaled; // by phi and factor
+    for (size_t i = 0; i < loop->blocks.size(); i++) {
+        Block *block = this->cfg.blocks[loop->blocks[i]];
+        std::vector<Instruction*> multiplies;
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            if ((*it)->op == OP_MUL && (*it)->type == IR_INT) multiplies.push_back(*it);
+        }
+        for (size_t j = 0; j < multiplies.size(); j++) {
+            Instruction *multiply = multiplies[j];
+            for (int side = 0; side < 2; side++) {
+                Instruction *factor = multiply->operands[1 - side];
+                int factorBlock = this->cfg.indexOf(factor->block);
+                if (factorBlock >= 0 && this->loops.contains(loop, factorBlock)) continue;
+                InductionVariable *variable = NULL;
+                bool atNext = false;
+                for (size_t k = 0; k < variables.size() && variable == NULL; k++) {
+                    if (multiply->operands[side] == variables[k].phi) variable = &variables[k];
+                    else if (multiply->operands[side] == variables[k].next) {
+                        variable = &variables[k];
+                        atNext = true;
+                    }
+                }
+                if (variable == NULL) continue;
+
+                std::pair<Instruction*, Instruction*> key(variable->phi, factor);
+                if (scaled.count(key) == 0) {
+                    ScaledVariable made;
+                    made.phi = this->function->create(OP_PHI, IR_INT);
+                    Instruction *start = this->product(before, variable->start, factor);
+                    Instruction *step = this->product(before, this->constant(before, variable->step), factor);
+                    made.next = this->function->create(OP_ADD, IR_INT);
+                    made.next->addOperand(made.phi);
+                    made.next->addOperand(step);
+                    // right after the basic variable's own step, which it then keeps pace with
+                    std::list<Instruction*> &instructions = variable->next->block->instructions;
+                    std::list<Instruction*>::iterator after = std::find(instructions.begin(), instructions.end(), variable->next);
+                    variable->next->block->insertBefore(*++after, made.next);
+                    made.phi->addOperand(preheader == 0 ? start : made.next);
+                    made.phi->addOperand(preheader == 0 ? made.next : start);
+                    header->insertAfterPhis(made.phi);
+                    scaled[key] = made;
+                }
+                multiply->replaceAllUsesWith(atNext ? scaled[key].next : scaled[key].phi);
+                block->erase(multiply);
+                changed = true;
+                break;
+            }
+        }
+    }
+    return changed;
+}
+
+bool InductionVariables::run() {
+    bool changed = false;
+    for (size_t i = 0; i < this->loops.loops.size(); i++) changed = this->simplify(this->loops.loops[i]) || changed;
+    return changed;
+}
+
+int simplifyInductionVariables(Function *function, AnalysisCache &analyses) {
+    InductionVariables variables(function, analyses.getLoops());
+    return variables.run() ? CHANGED_INSTRUCTIONS : CHANGED_NONE;
+}
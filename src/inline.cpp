@@ -0,0 +1,196 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include "passes.h"
+
+// the cost model, in instructions
+#define INLINE_THRESHOLD    40   // what a call site may add to its caller
+#define INLINE_LOOP_BONUS   40   // more for each loop around the call, up to three
+#define INLINE_CONSTANT_ARG 4    // what a constant argument is guessed to fold away
+#define INLINE_ONLY_CALL    400  // allowed for a function called from nowhere else
+#define INLINE_CALLER_LIMIT 5000 // callers stop growing here
+
+// instructions a copy of the callee adds, counting the stores that zero its
+// allocas at every call
+static int inlineSize(Function *callee) {
+    int size = 0;
+    for (size_t i = 0; i < callee->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = callee->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op == OP_PARAM) continue;
+            size += (*it)->op == OP_ALLOCA ? 2 * (*it)->intValue : 1;
+        }
+    }
+    return size;
+}
+
+// whether any path through the function returns, one that never does has no
+// value to stand in for the call
+static bool returns(Function *callee) {
+    for (size_t i = 0; i < callee->blocks.size(); i++) {
+        Instruction *last = callee->blocks[i]->terminator();
+        if (last != NULL && last->op == OP_RET) return true;
+    }
+    return false;
+}
+
+// size less what inlining saves: the call and ret, passing each argument,
+// and whatever constant arguments let fold
+static bool worthInlining(Instruction *call, Function *callee, int loopDepth, const CallGraph &callGraph) {
+    int cost = inlineSize(callee) - 2 - (int)call->operands.size();
+    for (size_t i = 0; i < call->operands.size(); i++) {
+        if (call->operands[i]->isConstant()) cost -= INLINE_CONSTANT_ARG;
+    }
+    int threshold = INLINE_THRESHOLD + INLINE_LOOP_BONUS * std::min(loopDepth, 3);
+    if (callGraph.callSites[callGraph.indexOf(callee)] == 1) threshold = std::max(threshold, INLINE_ONLY_CALL);
+    return cost <= threshold;
+}
+
+// replaces the call with a copy of the callee's body. the call's block is
+// split after the call, the copy's rets branch to the second half, and a
+// phi there takes what they return. parameters become the arguments, so a
+// nested procedure's pointers to its outer locals become those locals
+static void inlineCall(Function *function, Instruction *call, Function *callee) {
+    Block *block = call->block;
+    Block *entry = function->entry();
+    size_t firstNew = function->blocks.size();
+
+    Block *after = function->addBlock();
+    std::list<Instruction*>::iterator position = std::find(block->instructions.begin(), block->instructions.end(), call);
+    std::vector<Instruction*> moving(++position, block->instructions.end());
+    for (size_t i = 0; i < moving.size(); i++) {
+        block->unlink(moving[i]);
+        after->append(moving[i]);
+    }
+    std::vector<Block*> succs = after->succs();
+    for (size_t i = 0; i < succs.size(); i++) succs[i]->replacePred(block, after);
+
+    std::vector<Block*> blocks(callee->nextBlockId, NULL);
+    std::vector<Instruction*> values(callee->nextValueId, NULL);
+    std::vector<Instruction*> allocas;
+    for (size_t i = 0; i < callee->blocks.size(); i++) blocks[callee->blocks[i]->id] = function->addBlock();
+
+    // every instruction first, since phis can use values defined further on
+    std::vector<std::pair<Instruction*, Instruction*> > copies;
+    std::vector<Instruction*> returned;
+    for (size_t i = 0; i < callee->blocks.size(); i++) {
+        Block *original = callee->blocks[i];
+        Block *copy = blocks[original->id];
+        for (size_t j = 0; j < original->preds.size(); j++) copy->preds.push_back(blocks[original->preds[j]->id]);
+        for (std::list<Instruction*>::iterator it = original->instructions.begin(); it != original->instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->op == OP_PARAM) {
+                values[instruction->id] = call->operands[instruction->intValue];
+                continue;
+            }
+            if (instruction->op == OP_RET) {
+                if (!instruction->operands.empty()) returned.push_back(instruction->operands[0]);
+                after->preds.push_back(copy);
+                Instruction *br = function->create(OP_BR, IR_VOID);
+                br->targets.push_back(after);
+                copy->append(br);
+                continue;
+            }
+            Instruction *clone = function->create(instruction->op, instruction->type);
+            clone->intValue = instruction->intValue;
+            clone->floatValue = instruction->floatValue;
+            clone->name = instruction->name;
+            clone->elemType = instruction->elemType;
+            for (size_t k = 0; k < instruction->targets.size(); k++) clone->targets.push_back(blocks[instruction->targets[k]->id]);
+            values[instruction->id] = clone;
+            copies.push_back(std::make_pair(instruction, clone));
+            // allocas only go in the entry, and are zeroed where the call was
+            if (instruction->op == OP_ALLOCA) {
+                entry->insertAfterPhis(clone);
+                allocas.push_back(clone);
+            }
+            else copy->append(clone);
+        }
+    }
+    for (size_t i = 0; i < copies.size(); i++) {
+        Instruction *instruction = copies[i].first;
+        for (size_t j = 0; j < instruction->operands.size(); j++) copies[i].second->addOperand(values[instruction->operands[j]->id]);
+    }
+
+    if (call->type != IR_VOID) {
+        Instruction *result = values[returned[0]->id];
+        if (returned.size() > 1) {
+            result = function->create(OP_PHI, call->type);
+            for (size_t i = 0; i < returned.size(); i++) result->addOperand(values[returned[i]->id]);
+            after->insertAfterPhis(result);
+        }
+        call->replaceAllUsesWith(result);
+    }
+    block->erase(call);
+
+    for (size_t i = 0; i < allocas.size(); i++) {
+        Instruction *alloca = allocas[i];
+        for (int j = 0; j < alloca->intValue; j++) {
+            Instruction *address = alloca;
+            if (alloca->intValue > 1) {
+                Instruction *index = function->create(OP_CONST, IR_INT);
+                index->intValue = j;
+                block->append(index);
+                address = function->create(OP_INDEX, IR_PTR);
+                address->elemType = alloca->elemType;
+                address->addOperand(alloca);
+                address->addOperand(index);
+                block->append(address);
+            }
+            // a fresh constant is already zero, false or the empty string
+            Instruction *zero = block->append(function->create(OP_CONST, alloca->elemType));
+            Instruction *store = function->create(OP_STORE, IR_VOID);
+            store->elemType = alloca->elemType;
+            store->addOperand(address);
+            store->addOperand(zero);
+            block->append(store);
+        }
+    }
+    function->branch(block, blocks[callee->entry()->id]);
+
+    // the copy and the second half go right after the call's block
+    std::vector<Block*> added(function->blocks.begin() + firstNew, function->blocks.end());
+    function->blocks.resize(firstNew);
+    std::vector<Block*>::iterator at = std::find(function->blocks.begin(), function->blocks.end(), block);
+    added.push_back(added[0]);
+    added.erase(added.begin());
+    function->blocks.insert(at + 1, added.begin(), added.end());
+}
+
+int inlineCalls(Function *function, AnalysisCache &analyses) {
+    if (analyses.callGraph == NULL) return CHANGED_NONE;
+    const CallGraph &callGraph = *analyses.callGraph;
+    int caller = callGraph.indexOf(function);
+    if (caller < 0) return CHANGED_NONE;
+
+    // the calls there were to begin with, the ones copied in were already
+    // weighed when their callee was optimized
+    std::vector<std::pair<Instruction*, int> > calls;
+    LoopForest &loops = analyses.getLoops();
+    for (int i = 0; i < loops.cfg.size(); i++) {
+        std::list<Instruction*> &instructions = loops.cfg.blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op == OP_CALL) calls.push_back(std::make_pair(*it, loops.depth(i)));
+        }
+    }
+
+    int size = function->instructionCount();
+    bool inlined = false;
+    for (size_t i = 0; i < calls.size(); i++) {
+        Instruction *call = calls[i].first;
+        Function *callee = function->module->find(call->name);
+        int index = callGraph.indexOf(callee);
+        if (callee == NULL || callee->external || index < 0 || callee->entry() == NULL) continue;
+        // recursion would never finish unrolling, and a loop back to the entry
+        // would leave its phis without a value for the call's block
+        if (callGraph.recursive[index] || callGraph.component[index] == callGraph.component[caller]) continue;
+        if (!callee->entry()->preds.empty() || !returns(callee)) continue;
+        if (!worthInlining(call, callee, calls[i].second, callGraph)) continue;
+        int added = inlineSize(callee);
+        if (size + added > INLINE_CALLER_LIMIT) continue;
+        inlineCall(function, call, callee);
+        size += added;
+        inlined = true;
+    }
+    return inlined ? CHANGED_CFG : CHANGED_NONE;
+}
@@ -0,0 +1,201 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "interp.h"
+#include "stats.h"
+
+Interpreter::Interpreter(Module *module, std::istream &in, std::ostream &out) : module(module), in(in), out(out) {
+    for (size_t i = 0; i < module->globals.size(); i++) {
+        this->globals[module->globals[i].name].resize(module->globals[i].length);
+    }
+}
+
+bool Interpreter::run() {
+    double start = wallClockMs();
+    Function *main = this->module->find("main");
+    std::vector<InterpValue> none;
+    if (main == NULL) this->error = "no @main to run";
+    else this->enter(main, none);
+
+    while (!this->frames.empty() && this->error.empty()) {
+        InterpFrame &frame = this->frames.back();
+        Instruction *instruction = *frame.next++;
+        this->instructions++;
+        std::vector<InterpValue> &values = frame.values;
+        InterpValue &value = values[instruction->id];
+        InterpValue *a = instruction->operands.size() > 0 ? &values[instruction->operands[0]->id] : NULL;
+        InterpValue *b = instruction->operands.size() > 1 ? &values[instruction->operands[1]->id] : NULL;
+        bool floats = a != NULL && instruction->operands[0]->type == IR_FLOAT;
+        unsigned int x = a != NULL ? (unsigned int)a->intValue : 0, y = b != NULL ? (unsigned int)b->intValue : 0;
+        switch (instruction->op) {
+            case OP_CONST:
+                value.intValue = instruction->intValue;
+                value.floatValue = instruction->floatValue;
+                value.stringValue = instruction->type == IR_STRING ? instruction->name.c_str() : NULL;
+                break;
+            case OP_PARAM: value = frame.args[instruction->intValue]; break;
+            case OP_ADD: if (floats) value.floatValue = a->floatValue + b->floatValue; else value.intValue = (int)(x + y); break;
+            case OP_SUB: if (floats) value.floatValue = a->floatValue - b->floatValue; else value.intValue = (int)(x - y); break;
+            case OP_MUL: if (floats) value.floatValue = a->floatValue * b->floatValue; else value.intValue = (int)(x * y); break;
+            case OP_DIV:
+                if (floats) value.floatValue = a->floatValue / b->floatValue;
+                else if (b->intValue == 0) this->fail(frame.function, "division by zero");
+                else if (b->intValue == -1) value.intValue = (int)(0u - x); // INT_MIN / -1 wraps
+                else value.intValue = a->intValue / b->intValue;
+                break;
+            case OP_NEG: if (floats) value.floatValue = -a->floatValue; else value.intValue = (int)(0u - x); break;
+            case OP_AND: value.intValue = a->intValue & b->intValue; break;
+            case OP_OR: value.intValue = a->intValue | b->intValue; break;
+            case OP_NOT: value.intValue = instruction->type == IR_BOOL ? !a->intValue : ~a->intValue; break;
+            case OP_EQ: value.intValue = floats ? a->floatValue == b->floatValue : a->intValue == b->intValue; break;
+            case OP_NE: value.intValue = floats ? a->floatValue != b->floatValue : a->intValue != b->intValue; break;
+            case OP_LT: value.intValue = floats ? a->floatValue < b->floatValue : a->intValue < b->intValue; break;
+            case OP_LE: value.intValue = floats ? a->floatValue <= b->floatValue : a->intValue <= b->intValue; break;
+            case OP_GT: value.intValue = floats ? a->floatValue > b->floatValue : a->intValue > b->intValue; break;
+            case OP_GE: value.intValue = floats ? a->floatValue >= b->floatValue : a->intValue >= b->intValue; break;
+            case OP_ITOF: value.floatValue = (float)a->intValue; break;
+            case OP_BTOI: value.intValue = a->intValue != 0; break;
+            case OP_ITOB: value.intValue = a->intValue != 0; break;
+            case OP_ALLOCA:
+                frame.memory.push_back(std::vector<InterpValue>(instruction->intValue));
+                value.address = frame.memory.back().data();
+                value.end = value.address + instruction->intValue;
+                break;
+            case OP_GLOBAL: {
+                std::vector<InterpValue> &global = this->globals[instruction->name];
+                value.address = global.data();
+                value.end = value.address + global.size();
+                break;
+            }
+            case OP_INDEX:
+                if (b->intValue < 0 || b->intValue >= a->end - a->address) {
+                    this->fail(frame.function, "index " + std::to_string(b->intValue) + " out of range for an array of " + std::to_string(a->end - a->address));
+                    break;
+                }
+                value.address = a->address + b->intValue;
+                value.end = a->end;
+                break;
+            case OP_CHECK:
+                if (a->intValue < 0 || a->intValue >= instruction->intValue) {
+                    this->fail(frame.function, "index " + std::to_string(a->intValue) + " out of range for an array of " + std::to_string(instruction->intValue));
+                }
+                break;
+            case OP_LOAD: value = *a->address; break;
+            case OP_STORE: *a->address = *b; break;
+            case OP_CALL: {
+                std::vector<InterpValue> passed;
+                for (size_t i = 0; i < instruction->operands.size(); i++) passed.push_back(values[instruction->operands[i]->id]);
+                Function *callee = this->module->find(instruction->name);
+                if (callee == NULL) this->fail(frame.function, "call to unknown @" + instruction->name);
+                else if (callee->external) {
+                    this->calls++;
+                    this->callsTo[callee->name]++;
+                    value = this->runtime(callee, passed);
+                }
+                // frame isn't safe to use once another is pushed
+                else this->enter(callee, passed);
+                break;
+            }
+            case OP_BR: this->jump(frame, frame.block, instruction->targets[0]); break;
+            case OP_CONDBR: this->jump(frame, frame.block, instruction->targets[a->intValue ? 0 : 1]); break;
+            case OP_RET: {
+                InterpValue result = a != NULL ? *a : InterpValue();
+                this->frames.pop_back();
+                // the caller's next instruction is the one after its call
+                if (!this->frames.empty()) {
+                    InterpFrame &caller = this->frames.back();
+                    std::list<Instruction*>::iterator call = caller.next;
+                    caller.values[(*--call)->id] = result;
+                }
+                break;
+            }
+        }
+    }
+    this->frames.clear();
+    this->out.flush();
+    this->ms = wallClockMs() - start;
+    return this->error.empty();
+}
+
+void Interpreter::enter(Function *function, std::vector<InterpValue> &args) {
+    this->calls++;
+    this->callsTo[function->name]++;
+    if (this->frames.size() >= INTERP_MAX_DEPTH) {
+        this->fail(function, "stack overflow");
+        return;
+    }
+    if (function->entry() == NULL) {
+        this->fail(function, "call to @" + function->name + " which has no body");
+        return;
+    }
+    this->frames.push_back(InterpFrame());
+    InterpFrame &frame = this->frames.back();
+    frame.function = function;
+    frame.values.resize(function->nextValueId);
+    frame.args = args;
+    frame.block = function->entry();
+    frame.next = frame.block->instructions.begin();
+}
+
+// phis take their values together, as of the edge just taken
+void Interpreter::jump(InterpFrame &frame, Block *from, Block *to) {
+    int pred = to->predIndex(from);
+    std::vector<InterpValue> incoming;
+    std::list<Instruction*>::iterator it = to->instructions.begin();
+    for (; it != to->instructions.end() && (*it)->op == OP_PHI; it++) incoming.push_back(frame.values[(*it)->operands[pred]->id]);
+    it = to->instructions.begin();
+    for (size_t i = 0; i < incoming.size(); i++, it++) frame.values[(*it)->id] = incoming[i];
+    this->instructions += incoming.size();
+    frame.block = to;
+    frame.next = it;
+}
+
+void Interpreter::fail(Function *function, std::string message) {
+    if (this->error.empty()) this->error = message + " in @" + function->name;
+}
+
+// reading takes one whitespace separated word, and anything unreadable as the
+// type asked for reads as its zero
+InterpValue Interpreter::runtime(Function *function, std::vector<InterpValue> &args) {
+    InterpValue result;
+    const std::string &name = function->name;
+    // puts always succeed
+    if (name.compare(0, 3, "PUT") == 0) result.intValue = 1;
+    if (name == "PUTINTEGER") this->out << args[0].intValue << "\n";
+    else if (name == "PUTFLOAT") this->out << args[0].floatValue << "\n";
+    else if (name == "PUTBOOL") this->out << (args[0].intValue ? "true" : "false") << "\n";
+    else if (name == "PUTSTRING") this->out << (args[0].stringValue == NULL ? "" : args[0].stringValue) << "\n";
+    else if (name == "SQRT") result.floatValue = sqrtf((float)args[0].intValue);
+    else if (name == "strcmp") {
+        int order = strcmp(args[0].stringValue == NULL ? "" : args[0].stringValue, args[1].stringValue == NULL ? "" : args[1].stringValue);
+        result.intValue = order < 0 ? -1 : order > 0;
+    }
+    else if (name.compare(0, 3, "GET") == 0) {
+        std::string word;
+        this->in >> word;
+        if (name == "GETINTEGER") result.intValue = atoi(word.c_str());
+        else if (name == "GETFLOAT") result.floatValue = atof(word.c_str());
+        else if (name == "GETBOOL") result.intValue = word == "true" || atoi(word.c_str()) != 0;
+        else {
+            this->strings.push_back(word);
+            result.stringValue = this->strings.back().c_str();
+        }
+    }
+    else this->fail(function, "unknown runtime routine");
+    return result;
+}
+
+std::string Interpreter::toJson() {
+    std::ostringstream json;
+    json << "{\"instructions\": " << this->instructions << ", \"calls\": " << this->calls << ", \"ms\": " << this->ms << ", \"callsTo\": {";
+    for (std::map<std::string, long>::iterator it = this->callsTo.begin(); it != this->callsTo.end(); it++) {
+        json << (it == this->callsTo.begin() ? "" : ", ") << jsonString(it->first) << ": " << it->second;
+    }
+    json << "}";
+    if (!this->error.empty()) json << ", \"error\": " << jsonString(this->error);
+    json << "}";
+    return json.str();
+}
@@ -0,0 +1,67 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <deque>
+#include <istream>
+#include <list>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ir.h"
+
+#define INTERP_MAX_DEPTH 10000 // calls deep before a run stops as a stack overflow
+
+// a value as the interpreter holds it: ints and bools in intValue, strings as
+// their characters, and addresses as the element pointed at together with the
+// end of its array, so an index past the end is caught
+struct InterpValue {
+    int intValue = 0;
+    float floatValue = 0.0;
+    const char *stringValue = NULL; // NULL reads as ""
+    InterpValue *address = NULL;
+    InterpValue *end = NULL;
+};
+
+// a procedure call in progress: its values by id, its allocas, and where it
+// is. a list keeps the allocas from moving as more are made
+struct InterpFrame {
+    Function *function;
+    std::vector<InterpValue> values;
+    std::list<std::vector<InterpValue> > memory;
+    std::vector<InterpValue> args;
+    Block *block = NULL;
+    std::list<Instruction*>::iterator next; // the instruction to run next in block
+};
+
+// runs a module's @main straight from the ir, standing in for a backend so
+// the effect of the passes can be measured. the runtime reads in and writes
+// the program's output to out, one value per line
+class Interpreter {
+    Module *module;
+    std::istream &in;
+    std::ostream &out;
+    std::map<std::string, std::vector<InterpValue> > globals;
+    std::list<std::string> strings; // read by GETSTRING, kept for the whole run
+    std::deque<InterpFrame> frames; // innermost last, kept here rather than on the real stack
+
+    void enter(Function *function, std::vector<InterpValue> &args);
+    void jump(InterpFrame &frame, Block *from, Block *to);
+    InterpValue runtime(Function *function, std::vector<InterpValue> &args);
+    void fail(Function *function, std::string message);
+
+    public:
+        long instructions = 0;               // executed, phis included
+        long calls = 0;                      // to procedures and the runtime
+        std::map<std::string, long> callsTo; // by callee
+        double ms = 0.0;
+        std::string error;                   // what stopped the run, empty when main returned
+
+        Interpreter(Module *module, std::istream &in, std::ostream &out);
+
+        // false when a runtime error stopped the run
+        bool run();
+        std::string toJson();
+};
+
+#endif
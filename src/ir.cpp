@@ -0,0 +1,497 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_set>
+#include "ir.h"
+
+static const char *typeNames[] = {"void", "int", "float", "bool", "string", "ptr", "vint", "vfloat"};
+
+static const char *opNames[OP_COUNT] = {
+    "", "const", "param", "add", "sub", "mul", "div", "neg", "and", "or", "not",
+    "eq", "ne", "lt", "le", "gt", "ge", "itof", "btoi", "itob", "phi",
+    "alloca", "global", "index", "load", "store", "call", "br", "condbr", "ret", "check", "splat", "lane"
+};
+
+const char *irTypeName(int type) {
+    if (type < IR_VOID || type > IR_VFLOAT) return "?";
+    return typeNames[type];
+}
+
+const char *irOpName(int op) {
+    if (op <= 0 || op >= OP_COUNT) return "?";
+    return opNames[op];
+}
+
+int irTypeSize(int type) {
+    switch (type) {
+        case IR_INT: case IR_FLOAT: return 4;
+        case IR_BOOL: return 1;
+        case IR_STRING: case IR_PTR: return 8;
+        case IR_VINT: case IR_VFLOAT: return 4 * IR_LANES;
+        default: return 0;
+    }
+}
+
+int irLaneType(int type) {
+    return type == IR_VINT ? IR_INT : type == IR_VFLOAT ? IR_FLOAT : type;
+}
+
+int irVectorType(int type) {
+    return type == IR_INT ? IR_VINT : type == IR_FLOAT ? IR_VFLOAT : IR_VOID;
+}
+
+bool irIsVector(int type) {
+    return type == IR_VINT || type == IR_VFLOAT;
+}
+
+// drops one entry for user from value's users
+static void removeUse(Instruction *value, Instruction *user) {
+    std::vector<Instruction*>::iterator found = std::find(value->users.begin(), value->users.end(), user);
+    if (found != value->users.end()) value->users.erase(found);
+}
+
+void Instruction::addOperand(Instruction *value) {
+    this->operands.push_back(value);
+    value->users.push_back(this);
+}
+
+void Instruction::setOperand(size_t index, Instruction *value) {
+    removeUse(this->operands[index], this);
+    this->operands[index] = value;
+    value->users.push_back(this);
+}
+
+void Instruction::removeOperand(size_t index) {
+    removeUse(this->operands[index], this);
+    this->operands.erase(this->operands.begin() + index);
+}
+
+void Instruction::dropOperands() {
+    for (size_t i = 0; i < this->operands.size(); i++) removeUse(this->operands[i], this);
+    this->operands.clear();
+}
+
+void Instruction::replaceAllUsesWith(Instruction *value) {
+    if (value == this) return;
+    std::vector<Instruction*> users = this->users;
+    for (size_t i = 0; i < users.size(); i++) {
+        Instruction *user = users[i];
+        for (size_t j = 0; j < user->operands.size(); j++) {
+            if (user->operands[j] == this) {
+                user->operands[j] = value;
+                value->users.push_back(user);
+            }
+        }
+    }
+    this->users.clear();
+}
+
+Block::~Block() {
+    for (std::list<Instruction*>::iterator it = this->instructions.begin(); it != this->instructions.end(); it++) {
+        delete *it;
+    }
+}
+
+Instruction *Block::terminator() {
+    if (this->instructions.empty() || !this->instructions.back()->isTerminator()) return NULL;
+    return this->instructions.back();
+}
+
+std::vector<Block*> Block::succs() {
+    Instruction *last = this->terminator();
+    if (last == NULL) return std::vector<Block*>();
+    return last->targets;
+}
+
+Instruction *Block::append(Instruction *instruction) {
+    instruction->block = this;
+    this->instructions.push_back(instruction);
+    return instruction;
+}
+
+Instruction *Block::insertBefore(Instruction *position, Instruction *instruction) {
+    if (position == NULL) return this->append(instruction);
+    instruction->block = this;
+    std::list<Instruction*>::iterator it = std::find(this->instructions.begin(), this->instructions.end(), position);
+    this->instructions.insert(it, instruction);
+    return instruction;
+}
+
+Instruction *Block::insertAfterPhis(Instruction *instruction) {
+    instruction->block = this;
+    std::list<Instruction*>::iterator it = this->instructions.begin();
+    while (it != this->instructions.end() && (*it)->op == OP_PHI) it++;
+    this->instructions.insert(it, instruction);
+    return instruction;
+}
+
+void Block::erase(Instruction *instruction) {
+    instruction->dropOperands();
+    this->unlink(instruction);
+    delete instruction;
+}
+
+void Block::unlink(Instruction *instruction) {
+    this->instructions.remove(instruction);
+    instruction->block = NULL;
+}
+
+int Block::predIndex(Block *pred) {
+    for (size_t i = 0; i < this->preds.size(); i++) {
+        if (this->preds[i] == pred) return i;
+    }
+    return -1;
+}
+
+void Block::removePred(Block *pred) {
+    int index = this->predIndex(pred);
+    if (index < 0) return;
+    this->preds.erase(this->preds.begin() + index);
+    std::vector<Instruction*> phis = this->phis();
+    for (size_t i = 0; i < phis.size(); i++) phis[i]->removeOperand(index);
+}
+
+void Block::replacePred(Block *oldPred, Block *newPred) {
+    for (size_t i = 0; i < this->preds.size(); i++) {
+        if (this->preds[i] == oldPred) this->preds[i] = newPred;
+    }
+}
+
+std::vector<Instruction*> Block::phis() {
+    std::vector<Instruction*> found;
+    for (std::list<Instruction*>::iterator it = this->instructions.begin(); it != this->instructions.end(); it++) {
+        if ((*it)->op != OP_PHI) break;
+        found.push_back(*it);
+    }
+    return found;
+}
+
+Function::~Function() {
+    // operands point across blocks, so every use goes before any instruction
+    for (size_t i = 0; i < this->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = this->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            (*it)->operands.clear();
+            (*it)->users.clear();
+        }
+    }
+    for (size_t i = 0; i < this->blocks.size(); i++) delete this->blocks[i];
+}
+
+Block *Function::addBlock() {
+    Block *block = new Block();
+    block->id = this->nextBlockId++;
+    block->function = this;
+    this->blocks.push_back(block);
+    return block;
+}
+
+Instruction *Function::create(int op, int type) {
+    Instruction *instruction = new Instruction(op, type);
+    instruction->id = this->nextValueId++;
+    return instruction;
+}
+
+Instruction *Function::branch(Block *from, Block *to) {
+    Instruction *br = this->create(OP_BR, IR_VOID);
+    br->targets.push_back(to);
+    to->preds.push_back(from);
+    return from->append(br);
+}
+
+Instruction *Function::condBranch(Block *from, Instruction *condition, Block *ifTrue, Block *ifFalse) {
+    Instruction *br = this->create(OP_CONDBR, IR_VOID);
+    br->addOperand(condition);
+    br->targets.push_back(ifTrue);
+    br->targets.push_back(ifFalse);
+    ifTrue->preds.push_back(from);
+    ifFalse->preds.push_back(from);
+    return from->append(br);
+}
+
+void Function::removeBlock(Block *block) {
+    std::vector<Block*> succs = block->succs();
+    for (size_t i = 0; i < succs.size(); i++) succs[i]->removePred(block);
+    for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+        (*it)->dropOperands();
+    }
+    this->blocks.erase(std::find(this->blocks.begin(), this->blocks.end(), block));
+    delete block;
+}
+
+bool Function::removeUnreachableBlocks() {
+    if (this->blocks.empty()) return false;
+
+    std::unordered_set<Block*> reached;
+    std::vector<Block*> work(1, this->entry());
+    reached.insert(this->entry());
+    while (!work.empty()) {
+        Block *block = work.back();
+        work.pop_back();
+        std::vector<Block*> succs = block->succs();
+        for (size_t i = 0; i < succs.size(); i++) {
+            if (reached.insert(succs[i]).second) work.push_back(succs[i]);
+        }
+    }
+    if (reached.size() == this->blocks.size()) return false;
+
+    std::vector<Block*> dead;
+    for (size_t i = 0; i < this->blocks.size(); i++) {
+        if (reached.count(this->blocks[i]) == 0) dead.push_back(this->blocks[i]);
+    }
+
+    // unhook every dead block first, they can use each other's values. only
+    // the blocks staying lose edges, a dead one's phis may already be gone
+    for (size_t i = 0; i < dead.size(); i++) {
+        std::vector<Block*> succs = dead[i]->succs();
+        for (size_t j = 0; j < succs.size(); j++) {
+            if (reached.count(succs[j]) > 0) succs[j]->removePred(dead[i]);
+        }
+        std::list<Instruction*> &instructions = dead[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            (*it)->dropOperands();
+        }
+    }
+    for (size_t i = 0; i < dead.size(); i++) {
+        std::list<Instruction*> &instructions = dead[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            (*it)->users.clear();
+        }
+        this->blocks.erase(std::find(this->blocks.begin(), this->blocks.end(), dead[i]));
+        delete dead[i];
+    }
+
+    // phis that lost all but one incoming value are just that value
+    for (size_t i = 0; i < this->blocks.size(); i++) {
+        std::vector<Instruction*> phis = this->blocks[i]->phis();
+        for (size_t j = 0; j < phis.size(); j++) {
+            Instruction *phi = phis[j];
+            Instruction *same = NULL;
+            bool trivial = true;
+            for (size_t k = 0; k < phi->operands.size(); k++) {
+                Instruction *value = phi->operands[k];
+                if (value == phi || value == same) continue;
+                if (same != NULL) trivial = false;
+                same = value;
+            }
+            if (!trivial || same == NULL) continue;
+            phi->replaceAllUsesWith(same);
+            this->blocks[i]->erase(phi);
+        }
+    }
+    return true;
+}
+
+// values count up from %0 in order, instructions without one are numbered after them
+void Function::renumber() {
+    int value = 0;
+    for (size_t i = 0; i < this->blocks.size(); i++) {
+        this->blocks[i]->id = i;
+        std::list<Instruction*> &instructions = this->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->type != IR_VOID) (*it)->id = value++;
+        }
+    }
+    for (size_t i = 0; i < this->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = this->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->type == IR_VOID) (*it)->id = value++;
+        }
+    }
+    this->nextBlockId = this->blocks.size();
+    this->nextValueId = value;
+}
+
+int Function::instructionCount() {
+    int count = 0;
+    for (size_t i = 0; i < this->blocks.size(); i++) count += this->blocks[i]->instructions.size();
+    return count;
+}
+
+Module::~Module() {
+    for (size_t i = 0; i < this->functions.size(); i++) delete this->functions[i];
+}
+
+Function *Module::find(std::string name) {
+    for (size_t i = 0; i < this->functions.size(); i++) {
+        if (this->functions[i]->name == name) return this->functions[i];
+    }
+    return NULL;
+}
+
+Global *Module::findGlobal(std::string name) {
+    for (size_t i = 0; i < this->globals.size(); i++) {
+        if (this->globals[i].name == name) return &this->globals[i];
+    }
+    return NULL;
+}
+
+Function *Module::addFunction(std::string name, int returnType) {
+    Function *function = new Function();
+    function->name = name;
+    function->returnType = returnType;
+    function->module = this;
+    this->functions.push_back(function);
+    return function;
+}
+
+static std::string quoted(const std::string &text) {
+    std::string out = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (c == '\n') out += "\\n";
+        else if (c == '\t') out += "\\t";
+        else out += c;
+    }
+    return out + "\"";
+}
+
+static std::string value(Instruction *instruction) {
+    return "%" + std::to_string(instruction->id);
+}
+
+static std::string block(Block *target) {
+    return "b" + std::to_string(target->id);
+}
+
+static std::string constant(Instruction *instruction) {
+    switch (instruction->type) {
+        case IR_BOOL: return instruction->intValue ? "true" : "false";
+        case IR_STRING: return quoted(instruction->name);
+        case IR_FLOAT: {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.9g", instruction->floatValue);
+            std::string text = buffer;
+            if (text.find_first_of(".en") == std::string::npos) text += ".0";
+            return text;
+        }
+        default: return std::to_string(instruction->intValue);
+    }
+}
+
+static void printInstruction(std::ostream &out, Instruction *instruction) {
+    out << "    ";
+    if (instruction->type != IR_VOID) out << value(instruction) << " = ";
+    if (instruction->tail) out << "tail ";
+    out << irOpName(instruction->op);
+
+    switch (instruction->op) {
+        case OP_CONST:
+            out << " " << irTypeName(instruction->type) << " " << constant(instruction);
+            break;
+        case OP_PARAM:
+            out << " " << irTypeName(instruction->type) << " " << instruction->intValue;
+            break;
+        case OP_ALLOCA:
+            out << " " << irTypeName(instruction->elemType);
+            if (instruction->intValue != 1) out << ", " << instruction->intValue;
+            break;
+        case OP_GLOBAL:
+            out << " @" << instruction->name;
+            break;
+        case OP_CHECK:
+            out << " " << value(instruction->operands[0]) << ", " << instruction->intValue;
+            break;
+        case OP_LANE:
+            out << " " << irTypeName(instruction->type) << " " << value(instruction->operands[0]) << ", " << instruction->intValue;
+            break;
+        case OP_INDEX:
+        case OP_LOAD:
+            out << " " << irTypeName(instruction->elemType);
+            for (size_t i = 0; i < instruction->operands.size(); i++) {
+                out << (i == 0 ? " " : ", ") << value(instruction->operands[i]);
+            }
+            break;
+        case OP_PHI:
+            out << " " << irTypeName(instruction->type);
+            for (size_t i = 0; i < instruction->operands.size(); i++) {
+                out << (i == 0 ? " " : ", ") << "[" << value(instruction->operands[i]) << ", ";
+                if (instruction->block != NULL && i < instruction->block->preds.size()) {
+                    out << block(instruction->block->preds[i]);
+                }
+                else out << "?";
+                out << "]";
+            }
+            break;
+        case OP_CALL:
+            out << " " << irTypeName(instruction->type) << " @" << instruction->name << "(";
+            for (size_t i = 0; i < instruction->operands.size(); i++) {
+                out << (i == 0 ? "" : ", ") << value(instruction->operands[i]);
+            }
+            out << ")";
+            break;
+        case OP_BR:
+        case OP_CONDBR:
+        case OP_RET:
+        case OP_STORE:
+            for (size_t i = 0; i < instruction->operands.size(); i++) {
+                out << (i == 0 ? " " : ", ") << value(instruction->operands[i]);
+            }
+            for (size_t i = 0; i < instruction->targets.size(); i++) {
+                out << (i == 0 && instruction->operands.empty() ? " " : ", ") << block(instruction->targets[i]);
+            }
+            break;
+        default:
+            out << " " << irTypeName(instruction->type);
+            for (size_t i = 0; i < instruction->operands.size(); i++) {
+                out << (i == 0 ? " " : ", ") << value(instruction->operands[i]);
+            }
+    }
+    out << "\n";
+}
+
+static void printSignature(std::ostream &out, Function *function) {
+    out << "@" << function->name << "(";
+    for (size_t i = 0; i < function->paramTypes.size(); i++) {
+        if (i > 0) out << ", ";
+        out << irTypeName(function->paramTypes[i]);
+        if (i < function->paramNames.size()) out << " " << function->paramNames[i];
+    }
+    out << ") : " << irTypeName(function->returnType);
+}
+
+void Module::print(std::ostream &out) {
+    for (size_t i = 0; i < this->globals.size(); i++) {
+        Global &global = this->globals[i];
+        out << "global @" << global.name << " : " << irTypeName(global.elemType);
+        if (global.length != 1) out << "[" << global.length << "]";
+        out << "\n";
+    }
+    if (!this->globals.empty()) out << "\n";
+
+    for (size_t i = 0; i < this->functions.size(); i++) {
+        Function *function = this->functions[i];
+        if (!function->external) continue;
+        out << "declare ";
+        printSignature(out, function);
+        out << "\n";
+    }
+
+    for (size_t i = 0; i < this->functions.size(); i++) {
+        Function *function = this->functions[i];
+        if (function->external) continue;
+        function->renumber();
+
+        out << "\nfunction ";
+        printSignature(out, function);
+        out << " {\n";
+        for (size_t j = 0; j < function->blocks.size(); j++) {
+            Block *current = function->blocks[j];
+            out << block(current) << ":";
+            if (!current->preds.empty()) {
+                out << std::string(block(current).size() < 8 ? 8 - block(current).size() : 1, ' ') << "; preds";
+                for (size_t k = 0; k < current->preds.size(); k++) {
+                    out << (k == 0 ? " " : ", ") << block(current->preds[k]);
+                }
+            }
+            out << "\n";
+            std::list<Instruction*> &instructions = current->instructions;
+            for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+                printInstruction(out, *it);
+            }
+        }
+        out << "}\n";
+    }
+}
@@ -0,0 +1,183 @@
+#ifndef IR_H
+#define IR_H
+
+#include <list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// value types
+#define IR_VOID   0
+#define IR_INT    1 // 32 bit two's complement, wraps on overflow
+#define IR_FLOAT  2 // 32 bit ieee
+#define IR_BOOL   3
+#define IR_STRING 4 // pointer to an immutable nul terminated string, null reads as ""
+#define IR_PTR    5 // address of a variable or an array element
+#define IR_VINT   6 // IR_LANES ints side by side, only ever made for native code
+#define IR_VFLOAT 7 // IR_LANES floats the same way
+
+// elements in a vector, as many 32 bit values as an sse register holds
+#define IR_LANES  4
+
+// opcodes
+#define OP_CONST  1  // intValue/floatValue/name hold the constant
+#define OP_PARAM  2  // intValue is the parameter's position
+#define OP_ADD    3  // int or float
+#define OP_SUB    4
+#define OP_MUL    5
+#define OP_DIV    6  // int division truncates, dividing by zero is a runtime error
+#define OP_NEG    7
+#define OP_AND    8  // bitwise on int, logical on bool
+#define OP_OR     9
+#define OP_NOT    10
+#define OP_EQ     11 // comparisons of two int, float or bool operands, give bool
+#define OP_NE     12
+#define OP_LT     13
+#define OP_LE     14
+#define OP_GT     15
+#define OP_GE     16
+#define OP_ITOF   17 // int to float
+#define OP_BTOI   18 // bool to int, 0 or 1
+#define OP_ITOB   19 // int to bool, nonzero is true
+#define OP_PHI    20 // one operand per predecessor, in the block's preds order
+#define OP_ALLOCA 21 // zeroed stack storage for intValue elements of elemType
+#define OP_GLOBAL 22 // address of the global called name
+#define OP_INDEX  23 // address of element operand 1 of the elemType array at operand 0
+#define OP_LOAD   24
+#define OP_STORE  25 // operand 0 is the address, operand 1 the value
+#define OP_CALL   26 // calls the function called name with the operands
+#define OP_BR     27
+#define OP_CONDBR 28 // operand 0 picks targets[0] when true, targets[1] when false
+#define OP_RET    29 // no operand for void functions
+#define OP_CHECK  30 // stops the program unless 0 <= operand 0 < intValue, the length of the array it indexes
+#define OP_SPLAT  31 // a vector with operand 0 in every lane
+#define OP_LANE   32 // lane intValue of the vector operand 0
+#define OP_COUNT  33
+
+class Block;
+class Function;
+class Module;
+
+// an instruction, and the ssa value it defines when its type isn't void
+class Instruction {
+    public:
+        int id = 0;        // %id in dumps, unique within the function
+        int op;
+        int type;          // type of the value defined
+        Block *block = NULL;
+        std::vector<Instruction*> operands;
+        std::vector<Instruction*> users; // one entry per use, so a value used twice appears twice
+        std::vector<Block*> targets;     // successors of a branch
+
+        int intValue = 0;        // int/bool constants, param position, alloca length
+        float floatValue = 0.0;  // float constants
+        std::string name;        // string constants, callee, global
+        int elemType = IR_VOID;  // what an alloca, index or load/store address holds
+        bool tail = false;       // a call whose result is returned straight away, so its frame can replace the caller's
+
+        Instruction(int opcode, int valueType) { op = opcode; type = valueType; }
+
+        void addOperand(Instruction *value);
+        void setOperand(size_t index, Instruction *value);
+        void removeOperand(size_t index);
+        void dropOperands();
+        void replaceAllUsesWith(Instruction *value);
+
+        bool isTerminator() { return op == OP_BR || op == OP_CONDBR || op == OP_RET; }
+        // stores, calls, checks and terminators, everything that can't be deleted just for being unused
+        bool hasSideEffects() { return op == OP_STORE || op == OP_CALL || op == OP_CHECK || isTerminator(); }
+        bool isConstant() { return op == OP_CONST; }
+};
+
+class Block {
+    public:
+        int id = 0; // b<id> in dumps
+        Function *function = NULL;
+        std::list<Instruction*> instructions;
+        std::vector<Block*> preds;
+
+        ~Block();
+
+        Instruction *terminator();
+        std::vector<Block*> succs();
+
+        Instruction *append(Instruction *instruction);
+        // ahead of position, or at the end when position is NULL
+        Instruction *insertBefore(Instruction *position, Instruction *instruction);
+        // after the phis, the first place an ordinary instruction can go
+        Instruction *insertAfterPhis(Instruction *instruction);
+        // unlinks and deletes an instruction, which must have no users left
+        void erase(Instruction *instruction);
+        // unlinks without deleting, for moving an instruction elsewhere
+        void unlink(Instruction *instruction);
+
+        int predIndex(Block *pred);
+        // drops the edge from pred along with its phi operands
+        void removePred(Block *pred);
+        void replacePred(Block *oldPred, Block *newPred);
+        std::vector<Instruction*> phis();
+};
+
+class Function {
+    public:
+        std::string name;
+        int returnType = IR_VOID;
+        std::vector<int> paramTypes;
+        std::vector<std::string> paramNames; // for dumps, hidden captures start with '&'
+        std::vector<Block*> blocks;          // blocks[0] is the entry
+        bool external = false;               // a runtime routine, declared but without a body
+        bool pure = false;                   // a runtime routine whose only effect is its result
+        Module *module = NULL;
+        int nextValueId = 0, nextBlockId = 0;
+
+        ~Function();
+
+        Block *entry() { return blocks.empty() ? NULL : blocks[0]; }
+        Block *addBlock();
+        Instruction *create(int op, int type);
+
+        // terminates from with a branch and records the edge(s)
+        Instruction *branch(Block *from, Block *to);
+        Instruction *condBranch(Block *from, Instruction *condition, Block *ifTrue, Block *ifFalse);
+
+        // removes a block no other block branches to any more
+        void removeBlock(Block *block);
+        // drops blocks the entry can't reach, folding phis left with one value
+        bool removeUnreachableBlocks();
+        // dense ids in block order, for dumps
+        void renumber();
+        int instructionCount();
+};
+
+// module level storage
+struct Global {
+    std::string name;
+    int elemType;
+    int length; // 1 for scalars
+};
+
+class Module {
+    public:
+        std::vector<Global> globals;
+        std::vector<Function*> functions;
+
+        ~Module();
+
+        Function *find(std::string name);
+        Global *findGlobal(std::string name);
+        Function *addFunction(std::string name, int returnType);
+
+        void print(std::ostream &out);
+};
+
+// names for dumps and error messages
+const char *irTypeName(int type);
+const char *irOpName(int op);
+int irTypeSize(int type); // bytes in memory, strings and pointers are 8, vectors 16
+// what each lane of a vector type holds, any other type itself
+int irLaneType(int type);
+// the vector of an int or float, IR_VOID for anything else
+int irVectorType(int type);
+bool irIsVector(int type);
+
+#endif
@@ -0,0 +1,364 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <sstream>
+#include "isel.h"
+#include "regalloc.h"
+#include "stats.h"
+
+#define NO_COST 0x3fffffff
+
+#define ARITHMETIC(op) \
+    {NT_REG, op, {NT_REG, NT_REG}, 1}, \
+    {NT_REG, op, {NT_REG, NT_IMM}, 1}, \
+    {NT_REG, op, {NT_REG, NT_MEM}, 1}
+#define COMMUTATIVE(op) ARITHMETIC(op), {NT_REG, op, {NT_MEM, NT_REG}, 1}
+#define UPDATE(op) \
+    {NT_UPDATE0, op, {NT_MEM, NT_REG}, 0}, \
+    {NT_UPDATE0, op, {NT_MEM, NT_IMM}, 0}
+#define COMMUTATIVE_UPDATE(op) UPDATE(op), {NT_UPDATE1, op, {NT_REG, NT_MEM}, 0}, {NT_UPDATE1, op, {NT_IMM, NT_MEM}, 0}
+#define COMPARE(op) \
+    {NT_FLAGS, op, {NT_REG, NT_REG}, 1}, \
+    {NT_FLAGS, op, {NT_REG, NT_IMM}, 1}, \
+    {NT_FLAGS, op, {NT_REG, NT_MEM}, 1}, \
+    {NT_FLAGS, op, {NT_MEM, NT_REG}, 1}, \
+    {NT_FLAGS, op, {NT_MEM, NT_IMM}, 1}, \
+    {NT_REG, op, {NT_REG, NT_REG}, 4}
+
+// the grammar. folding an operand in saves the instruction that would have
+// computed it and the register that would have held it, so the cheapest
+// cover is the one with the fewest instructions. of two rules costing the
+// same the first is kept, so a chain from a register comes before the
+// others: a value used more than once computes it once for all of them
+static const Rule patterns[] = {
+    // chain rules
+    {NT_REG,   0, {NT_IMM, -1},   1}, // movl $imm, where an operand must be in a register
+    {NT_REG,   0, {NT_ADDR, -1},  1}, // leaq
+    {NT_REG,   0, {NT_MEM, -1},   1}, // movl, movss
+    {NT_REG,   0, {NT_FLAGS, -1}, 2}, // setcc, movzbl
+    {NT_ADDR,  0, {NT_REG, -1},   0}, // (reg)
+    {NT_BASE,  0, {NT_REG, -1},   0},
+    {NT_BASE,  0, {NT_ADDR, -1},  1}, // leaq into r11
+    {NT_INDEX, 0, {NT_REG, -1},   1}, // movslq into rcx
+    {NT_FLAGS, 0, {NT_REG, -1},   1}, // testl
+
+    // values rebuilt wherever they're used
+    {NT_IMM,  OP_CONST,  {-1, -1}, 0},
+    {NT_REG,  OP_CONST,  {-1, -1}, 1}, // floats and strings
+    {NT_ADDR, OP_GLOBAL, {-1, -1}, 0}, // glob_name(%rip)
+    {NT_ADDR, OP_ALLOCA, {-1, -1}, 0}, // offset(%rbp)
+    {NT_BASE, OP_ALLOCA, {-1, -1}, 0},
+    {NT_STMT, OP_ALLOCA, {-1, -1}, 1}, // zeroing it
+
+    // memory
+    {NT_ADDR,  OP_INDEX, {NT_ADDR, NT_IMM},   0},
+    {NT_ADDR,  OP_INDEX, {NT_BASE, NT_INDEX}, 0},
+    {NT_INDEX, OP_ADD,   {NT_REG, NT_IMM},    1},
+    {NT_MEM,   OP_LOAD,  {NT_ADDR, -1},       0},
+    {NT_REG,   OP_LOAD,  {NT_ADDR, -1},       1}, // bools, strings and pointers
+    {NT_STMT,  OP_STORE, {NT_ADDR, NT_REG},     1},
+    {NT_STMT,  OP_STORE, {NT_ADDR, NT_IMM},     1},
+    {NT_STMT,  OP_STORE, {NT_ADDR, NT_UPDATE0}, 1},
+    {NT_STMT,  OP_STORE, {NT_ADDR, NT_UPDATE1}, 1},
+    COMMUTATIVE_UPDATE(OP_ADD),
+    UPDATE(OP_SUB),
+    COMMUTATIVE_UPDATE(OP_AND),
+    COMMUTATIVE_UPDATE(OP_OR),
+
+    // arithmetic
+    COMMUTATIVE(OP_ADD),
+    ARITHMETIC(OP_SUB),
+    COMMUTATIVE(OP_MUL),
+    COMMUTATIVE(OP_AND),
+    COMMUTATIVE(OP_OR),
+    {NT_REG, OP_DIV,  {-1, -1}, 1},
+    {NT_REG, OP_NEG,  {-1, -1}, 1},
+    {NT_REG, OP_NOT,  {-1, -1}, 1},
+    {NT_REG, OP_ITOF, {-1, -1}, 1},
+    {NT_REG, OP_BTOI, {-1, -1}, 3},
+    {NT_REG, OP_ITOB, {-1, -1}, 3},
+
+    // comparisons and branches
+    COMPARE(OP_EQ),
+    COMPARE(OP_NE),
+    COMPARE(OP_LT),
+    COMPARE(OP_LE),
+    COMPARE(OP_GT),
+    COMPARE(OP_GE),
+    {NT_FLAGS, OP_NOT,    {NT_FLAGS, -1}, 0}, // the condition turned round
+    {NT_STMT,  OP_CONDBR, {NT_FLAGS, -1}, 1},
+    {NT_STMT,  OP_BR,     {-1, -1},       1},
+    {NT_STMT,  OP_RET,    {-1, -1},       1},
+    {NT_STMT,  OP_CHECK,  {-1, -1},       2},
+
+    // the rest
+    {NT_REG,  OP_SPLAT, {-1, -1}, 3}, // movd or movss, then unpcklps twice
+    {NT_REG,  OP_LANE,  {-1, -1}, 2}, // psrldq, movd or movss
+    {NT_REG,  OP_PARAM, {-1, -1}, 1},
+    {NT_REG,  OP_PHI,   {-1, -1}, 0},
+    {NT_REG,  OP_CALL,  {-1, -1}, 1},
+    {NT_STMT, OP_CALL,  {-1, -1}, 1},
+};
+
+#define PATTERNS ((int)(sizeof(patterns) / sizeof(patterns[0])))
+
+// the patterns by the op they match, and the chain rules
+static std::vector<int> byOp[OP_COUNT];
+static std::vector<int> chains;
+static int leafCosts[NT_COUNT]; // what a value read from its location derives
+
+static void indexPatterns() {
+    if (!chains.empty()) return;
+    for (int i = 0; i < PATTERNS; i++) {
+        if (patterns[i].op == 0) chains.push_back(i);
+        else byOp[patterns[i].op].push_back(i);
+    }
+    for (int nt = 0; nt < NT_COUNT; nt++) leafCosts[nt] = NO_COST;
+    leafCosts[NT_REG] = 0;
+    for (size_t i = 0; i < chains.size(); i++) {
+        const Rule &chain = patterns[chains[i]];
+        if (chain.kids[0] == NT_REG) leafCosts[chain.result] = chain.cost;
+    }
+}
+
+static int kidOf(const Rule &rule, size_t i) {
+    return i < 2 && rule.kids[i] >= 0 ? rule.kids[i] : NT_REG;
+}
+
+// constants, globals and allocas, which any tile can take in
+static bool rebuilt(Instruction *value) {
+    return isImmediate(value) || value->op == OP_GLOBAL || value->op == OP_ALLOCA;
+}
+
+bool sameAddress(Instruction *a, Instruction *b) {
+    if (a == b) return true;
+    if (a->op != b->op) return false;
+    if (a->op == OP_GLOBAL) return a->name == b->name;
+    if (a->op != OP_INDEX || a->elemType != b->elemType || !sameAddress(a->operands[0], b->operands[0])) return false;
+    Instruction *i = a->operands[1], *j = b->operands[1];
+    return i == j || (isImmediate(i) && isImmediate(j) && i->intValue == j->intValue);
+}
+
+// what the table can't say: the types a rule works on, and that an update
+// stores back to the address it loaded from
+static bool applies(const Rule &rule, Instruction *instruction) {
+    int type = instruction->type;
+    switch (instruction->op) {
+        case OP_CONST:
+            return (rule.result == NT_IMM) == isImmediate(instruction);
+        case OP_LOAD:
+            // a bool is a byte, too narrow for an instruction's 32 bit operand
+            return rule.result != NT_MEM || type == IR_INT || type == IR_FLOAT;
+        case OP_ADD: case OP_SUB: case OP_AND: case OP_OR:
+            return rule.result == NT_REG || type == IR_INT;
+        case OP_NOT:
+            return rule.result != NT_FLAGS || type == IR_BOOL;
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+            // ucomiss compares with a register, and equality of floats takes
+            // two flags, so it can't be branched on with one jump
+            if (rule.result != NT_FLAGS || instruction->operands[0]->type != IR_FLOAT) return true;
+            return rule.kids[0] != NT_MEM && instruction->op != OP_EQ && instruction->op != OP_NE;
+        case OP_STORE: {
+            if (rule.kids[1] != NT_UPDATE0 && rule.kids[1] != NT_UPDATE1) return true;
+            Instruction *update = instruction->operands[1];
+            if (update->operands.size() != 2) return false;
+            Instruction *loaded = update->operands[rule.kids[1] == NT_UPDATE0 ? 0 : 1];
+            return loaded->op == OP_LOAD && sameAddress(instruction->operands[0], loaded->operands[0]);
+        }
+    }
+    return true;
+}
+
+std::string SelectionStats::toJson() {
+    std::ostringstream json;
+    json << "{\"tiles\": " << this->tiles << ", \"folded\": " << this->folded << ", \"addresses\": " << this->addresses
+        << ", \"memoryOperands\": " << this->memoryOperands << ", \"fusedBranches\": " << this->fusedBranches
+        << ", \"updates\": " << this->updates << ", \"ms\": " << this->ms << "}";
+    return json.str();
+}
+
+Selection::Selection(Function *function, bool tiling, SelectionStats &stats) : function(function), tiling(tiling) {
+    double start = wallClockMs();
+    int values = function->nextValueId;
+    std::vector<Block*> &blocks = function->blocks;
+    this->as.assign(values, -1);
+    this->base.assign(values, -1);
+    this->wanted.assign(values, false);
+    this->writes.assign(values, 0);
+    if (tiling) {
+        indexPatterns();
+        this->costs.assign(values * NT_COUNT, NO_COST);
+        this->rules.assign(values * NT_COUNT, -1);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            int count = 0;
+            std::list<Instruction*> &instructions = blocks[i]->instructions;
+            for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+                this->writes[(*it)->id] = count;
+                if ((*it)->op == OP_STORE || (*it)->op == OP_CALL || (*it)->op == OP_ALLOCA) count++;
+            }
+        }
+        // what can be used anywhere first, then each block's trees from the leaves up
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t i = 0; i < blocks.size(); i++) {
+                std::list<Instruction*> &instructions = blocks[i]->instructions;
+                for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+                    if (rebuilt(*it) == (pass == 0)) this->label(*it);
+                }
+            }
+        }
+        // users come after what they use, so a tile has taken its operands in
+        // by the time the walk back reaches them, and whatever it didn't is a root
+        for (size_t i = 0; i < blocks.size(); i++) {
+            std::list<Instruction*> &instructions = blocks[i]->instructions;
+            for (std::list<Instruction*>::reverse_iterator it = instructions.rbegin(); it != instructions.rend(); it++) {
+                Instruction *instruction = *it;
+                if (rebuilt(instruction)) continue;
+                if (this->as[instruction->id] < 0) {
+                    this->as[instruction->id] = instruction->type == IR_VOID ? NT_STMT : NT_REG;
+                    this->reduce(instruction, this->as[instruction->id]);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        std::list<Instruction*> &instructions = blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *instruction = *it;
+            int &as = this->as[instruction->id];
+            if (isImmediate(instruction)) as = NT_IMM;
+            else if (!tiling) as = instruction->type == IR_VOID ? NT_STMT : NT_REG;
+            else if (instruction->op == OP_GLOBAL) as = this->wanted[instruction->id] ? NT_REG : instruction->users.empty() ? -1 : NT_ADDR;
+            else if (instruction->op == OP_ALLOCA) as = this->wanted[instruction->id] ? NT_REG : NT_STMT;
+        }
+    }
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        std::list<Instruction*> &instructions = blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (this->written(instruction)) {
+                stats.tiles++;
+                if (instruction->op == OP_CONDBR && this->operandAs(instruction, 0) == NT_FLAGS) stats.fusedBranches++;
+                continue;
+            }
+            if (rebuilt(instruction) || this->as[instruction->id] < 0) continue;
+            stats.folded++;
+            switch (this->as[instruction->id]) {
+                case NT_ADDR: stats.addresses++; break;
+                case NT_MEM: stats.memoryOperands++; break;
+                case NT_UPDATE0: case NT_UPDATE1: stats.updates++; break;
+            }
+        }
+    }
+    stats.ms += wallClockMs() - start;
+}
+
+bool Selection::written(Instruction *instruction) {
+    int as = this->as[instruction->id];
+    return as == NT_REG || as == NT_STMT;
+}
+
+int Selection::derived(Instruction *instruction) {
+    int rule = this->base[instruction->id];
+    return rule < 0 ? -1 : patterns[rule].result;
+}
+
+bool Selection::hasLocation(Instruction *value) {
+    return this->as[value->id] == NT_REG && value->type != IR_VOID;
+}
+
+// a load can't be taken past anything that might write what it reads, and
+// everything else keeps to the same rule so a tree's loads stay put
+bool Selection::foldable(Instruction *kid, Instruction *parent) {
+    if (!this->tiling) return false;
+    if (rebuilt(kid)) return true;
+    return kid->users.size() == 1 && kid->block == parent->block && this->writes[kid->id] == this->writes[parent->id]
+        && kid->op != OP_PHI && !kid->hasSideEffects();
+}
+
+// a value computed by a tile of its own only derives what it can from its location
+int Selection::kidCost(Instruction *parent, size_t i, int nt) {
+    Instruction *kid = parent->operands[i];
+    if (!this->foldable(kid, parent)) return leafCosts[nt];
+    return this->costs[kid->id * NT_COUNT + nt];
+}
+
+void Selection::label(Instruction *instruction) {
+    int *cost = &this->costs[instruction->id * NT_COUNT];
+    int *rule = &this->rules[instruction->id * NT_COUNT];
+    std::vector<int> &candidates = byOp[instruction->op];
+    for (size_t r = 0; r < candidates.size(); r++) {
+        const Rule &pattern = patterns[candidates[r]];
+        if (!applies(pattern, instruction)) continue;
+        int total = pattern.cost;
+        for (size_t i = 0; i < instruction->operands.size() && total < NO_COST; i++) {
+            total += this->kidCost(instruction, i, kidOf(pattern, i));
+        }
+        if (total >= cost[pattern.result]) continue;
+        cost[pattern.result] = total;
+        rule[pattern.result] = candidates[r];
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t r = 0; r < chains.size(); r++) {
+            const Rule &chain = patterns[chains[r]];
+            int from = cost[chain.kids[0]];
+            if (from >= NO_COST || from + chain.cost >= cost[chain.result]) continue;
+            cost[chain.result] = from + chain.cost;
+            rule[chain.result] = chains[r];
+            changed = true;
+        }
+    }
+}
+
+// the instruction's part of its tile, derived as nt
+void Selection::reduce(Instruction *instruction, int nt) {
+    int rule = this->rules[instruction->id * NT_COUNT + nt];
+    while (rule >= 0 && patterns[rule].op == 0) rule = this->rules[instruction->id * NT_COUNT + patterns[rule].kids[0]];
+    this->base[instruction->id] = rule;
+    if (rule < 0) return;
+    for (size_t i = 0; i < instruction->operands.size(); i++) {
+        Instruction *kid = instruction->operands[i];
+        if (this->foldable(kid, instruction)) this->reduceKid(kid, kidOf(patterns[rule], i));
+    }
+}
+
+// a kid wanted in a register is the root of a tile of its own
+void Selection::reduceKid(Instruction *kid, int nt) {
+    int rule = nt == NT_REG ? -1 : this->rules[kid->id * NT_COUNT + nt];
+    while (rule >= 0 && patterns[rule].op == 0) {
+        nt = patterns[rule].kids[0];
+        rule = nt == NT_REG ? -1 : this->rules[kid->id * NT_COUNT + nt];
+    }
+    if (rule < 0) {
+        if (rebuilt(kid)) this->wanted[kid->id] = true;
+        return;
+    }
+    if (rebuilt(kid)) return;
+    this->as[kid->id] = nt;
+    this->reduce(kid, nt);
+}
+
+int Selection::operandAs(Instruction *parent, size_t i) {
+    int rule = this->tiling ? this->base[parent->id] : -1;
+    Instruction *kid = parent->operands[i];
+    if (rule < 0 || !this->foldable(kid, parent)) return NT_REG;
+    int nt = kidOf(patterns[rule], i);
+    while (nt != NT_REG) {
+        int derived = this->rules[kid->id * NT_COUNT + nt];
+        if (derived < 0) return NT_REG;
+        if (patterns[derived].op != 0) return nt;
+        nt = patterns[derived].kids[0];
+    }
+    return NT_REG;
+}
+
+void Selection::leaves(Instruction *root, std::vector<Instruction*> &into) {
+    for (size_t i = 0; i < root->operands.size(); i++) {
+        Instruction *kid = root->operands[i];
+        if (this->operandAs(root, i) == NT_REG) {
+            if (this->hasLocation(kid)) into.push_back(kid);
+        }
+        else if (!rebuilt(kid)) this->leaves(kid, into);
+    }
+}
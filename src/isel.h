@@ -0,0 +1,95 @@
+#ifndef ISEL_H
+#define ISEL_H
+
+#include <string>
+#include <vector>
+#include "ir.h"
+
+// nonterminals of the x86-64 tree grammar, what a tile leaves the value at
+// its root as for the tile above it
+#define NT_REG     0 // in whatever location the allocator gives it
+#define NT_IMM     1 // an int or bool constant, as an immediate
+#define NT_ADDR    2 // an address, as a memory operand's base, index and displacement
+#define NT_BASE    3 // an address an index register can be added to, unlike a rip relative one
+#define NT_INDEX   4 // an array index sign extended into rcx, with a displacement
+#define NT_MEM     5 // a value loaded from an address, as a memory operand
+#define NT_FLAGS   6 // a comparison left in the flags, for a branch
+#define NT_UPDATE0 7 // an operation on its loaded first operand, stored back where it came from
+#define NT_UPDATE1 8 // the same with the loaded value second
+#define NT_STMT    9 // an instruction written for its effect
+#define NT_COUNT   10
+
+// one pattern: op over operands deriving kids gives result, or with op 0 a
+// chain rule giving result from kids[0] on the same instruction. operands
+// past the kids given are read as NT_REG. the cost is instructions written
+struct Rule {
+    int result;
+    int op;
+    int kids[2];
+    int cost;
+};
+
+// counted over a module, reported under -stats as isel
+struct SelectionStats {
+    int tiles = 0;          // instructions written in their own place
+    int folded = 0;         // instructions written as part of the tile above them
+    int addresses = 0;      // of those, array elements addressed by the memory operand
+    int memoryOperands = 0; // loads read straight from memory by the instruction using them
+    int fusedBranches = 0;  // comparisons branched on without a bool
+    int updates = 0;        // operations made on memory in place
+    double ms = 0.0;
+
+    std::string toJson();
+};
+
+// instruction selection by bottom up rewriting, after the burs labellers: each
+// instruction is labelled with the cheapest way to derive every nonterminal
+// from the tree below it, then each tree is reduced from its root by the rules
+// that gave its goal that cost. a tree ends at a value used more than once or
+// in another block, and at one whose tile would move a load past a store or a
+// call, except that constants, globals and allocas are rebuilt wherever
+// they're wanted. with tiling false every instruction is its own tile reading
+// its operands from their locations, the macro expansion the tiles are
+// measured against
+class Selection {
+    std::vector<int> costs;   // by value id * NT_COUNT + nonterminal, the cheapest derivation
+    std::vector<int> rules;   // the rule giving each of those, -1 for none
+    std::vector<int> base;    // by value id, the rule matching the instruction in its tile
+    std::vector<int> writes;  // by value id, the stores, calls and allocas before it in its block
+    std::vector<bool> wanted; // by value id, a constant, global or alloca some tile reads from its location
+
+    int kidCost(Instruction *parent, size_t i, int nt);
+    void label(Instruction *instruction);
+    void reduce(Instruction *instruction, int nt);
+    void reduceKid(Instruction *kid, int nt);
+
+    public:
+        Function *function;
+        bool tiling;
+        // by value id: NT_REG or NT_STMT for an instruction written in its own
+        // place, the nonterminal a folded one is derived as, -1 for one never used
+        std::vector<int> as;
+
+        Selection(Function *function, bool tiling, SelectionStats &stats);
+
+        // written in its own place, the root of a tile
+        bool written(Instruction *instruction);
+        // the nonterminal the rule matching instruction in its tile derives,
+        // -1 without tiling
+        int derived(Instruction *instruction);
+        // given a location by the allocator
+        bool hasLocation(Instruction *value);
+        // whether the tile at parent can take kid in, as the parent's only user
+        // or as a value rebuilt anywhere
+        bool foldable(Instruction *kid, Instruction *parent);
+        // what operand i of parent is taken as: NT_REG when it's read from its
+        // location or is an immediate, otherwise the nonterminal it's folded in as
+        int operandAs(Instruction *parent, size_t i);
+        // adds the values the tile at root reads from their locations
+        void leaves(Instruction *root, std::vector<Instruction*> &into);
+};
+
+// two addresses that are the same whenever both are computed
+bool sameAddress(Instruction *a, Instruction *b);
+
+#endif
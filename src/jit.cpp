@@ -0,0 +1,125 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstdlib>
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "elfobject.h"
+#include "jit.h"
+#include "stats.h"
+
+// runtime.c as built into the compiler
+extern "C" {
+    extern int rt_depth;
+    int rt_run(void (*entry)(void));
+    void rt_check(int index, int length, const char *function);
+    void rt_divide(const char *function);
+    void rt_overflow(const char *function);
+    int rt_GETINTEGER(void);
+    float rt_GETFLOAT(void);
+    int rt_GETBOOL(void);
+    char *rt_GETSTRING(void);
+    int rt_PUTINTEGER(int value);
+    int rt_PUTFLOAT(float value);
+    int rt_PUTBOOL(int value);
+    int rt_PUTSTRING(const char *value);
+    float rt_SQRT(int value);
+    int rt_strcmp(const char *a, const char *b);
+}
+
+// what the program's undefined symbols are bound to
+static std::map<std::string, long> runtimeSymbols() {
+    std::map<std::string, long> symbols;
+    symbols["rt_depth"] = (long)&rt_depth;
+    symbols["rt_check"] = (long)&rt_check;
+    symbols["rt_divide"] = (long)&rt_divide;
+    symbols["rt_overflow"] = (long)&rt_overflow;
+    symbols["rt_GETINTEGER"] = (long)&rt_GETINTEGER;
+    symbols["rt_GETFLOAT"] = (long)&rt_GETFLOAT;
+    symbols["rt_GETBOOL"] = (long)&rt_GETBOOL;
+    symbols["rt_GETSTRING"] = (long)&rt_GETSTRING;
+    symbols["rt_PUTINTEGER"] = (long)&rt_PUTINTEGER;
+    symbols["rt_PUTFLOAT"] = (long)&rt_PUTFLOAT;
+    symbols["rt_PUTBOOL"] = (long)&rt_PUTBOOL;
+    symbols["rt_PUTSTRING"] = (long)&rt_PUTSTRING;
+    symbols["rt_SQRT"] = (long)&rt_SQRT;
+    symbols["rt_strcmp"] = (long)&rt_strcmp;
+    return symbols;
+}
+
+static long alignUp(long value, long align) {
+    return (value + align - 1) / align * align;
+}
+
+// size bytes of fresh writable memory within JIT_REACH of near, trying
+// below the compiler first, where the heap doesn't grow into it
+static char *mapNear(long near, long size) {
+    long page = sysconf(_SC_PAGESIZE);
+    static const long offsets[] = {-(1L << 28), -(1L << 29), 1L << 28, 1L << 29, -(3L << 28), 3L << 28};
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        long hint = (near + offsets[i]) / page * page;
+        void *mapped = mmap((void*)hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) continue;
+        long distance = labs((long)mapped - near);
+        if (distance + size < JIT_REACH) return (char*)mapped;
+        munmap(mapped, size);
+    }
+    return NULL;
+}
+
+JitProgram::~JitProgram() {
+    if (this->image != NULL) munmap(this->image, this->size);
+}
+
+bool JitProgram::load(const std::string &object) {
+    double start = wallClockMs();
+    Linker linker;
+    if (!linker.add(object, this->error)) return false;
+    linker.layout();
+    this->codeSize = linker.codeSize;
+    this->dataSize = linker.dataSize;
+
+    // the code and data get pages of their own, so only the code is made executable
+    long page = sysconf(_SC_PAGESIZE);
+    long codePages = alignUp(linker.codeSize, page);
+    this->size = codePages + alignUp(linker.dataSize, page);
+    if (this->size == 0) this->size = page;
+    this->image = mapNear((long)&rt_run, this->size);
+    if (this->image == NULL) {
+        this->error = "no memory near the runtime to load into";
+        return false;
+    }
+
+    long codeAddress = (long)this->image;
+    long dataAddress = codeAddress + codePages;
+    std::string code, data;
+    if (!linker.relocate(codeAddress, dataAddress, runtimeSymbols(), code, data, this->error)) return false;
+    long main = linker.address("prog_main", codeAddress, dataAddress);
+    if (main < 0) {
+        this->error = "no prog_main to call";
+        return false;
+    }
+    code.copy(this->image, code.size());
+    data.copy(this->image + codePages, data.size());
+    if (codePages > 0 && mprotect(this->image, codePages, PROT_READ | PROT_EXEC) != 0) {
+        this->error = "couldn't make the code executable";
+        return false;
+    }
+    this->entry = (void (*)(void))main;
+    this->loadMs = wallClockMs() - start;
+    return true;
+}
+
+bool JitProgram::run() {
+    double start = wallClockMs();
+    int status = rt_run(this->entry);
+    this->ms = wallClockMs() - start;
+    return status == 0;
+}
+
+std::string JitProgram::toJson() {
+    std::ostringstream json;
+    json << "{\"code\": " << this->codeSize << ", \"data\": " << this->dataSize << ", \"loadMs\": " << this->loadMs
+        << ", \"ms\": " << this->ms << "}";
+    return json.str();
+}
@@ -0,0 +1,36 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <string>
+
+// how far the image may be mapped from the compiler's own code, well inside
+// the reach of the program's rel32 calls into the runtime
+#define JIT_REACH (1L << 30)
+
+// an object linked straight into this process's memory and run there, for
+// -run. the image is mapped near the compiler, so the program's calls and
+// rip relative references reach the copy of runtime.c built into it. it is
+// written while its pages are only writable, then its code is made
+// executable and read only
+class JitProgram {
+    char *image = NULL;
+    long size = 0;
+    void (*entry)(void) = NULL;
+
+    public:
+        long codeSize = 0;
+        long dataSize = 0;
+        double loadMs = 0.0;
+        double ms = 0.0;       // the run's
+        std::string error;     // why the object couldn't be loaded
+
+        ~JitProgram();
+
+        // links the object into executable memory, false with the reason
+        bool load(const std::string &object);
+        // calls the program's main, false when a runtime error stopped it
+        bool run();
+        std::string toJson();
+};
+
+#endif
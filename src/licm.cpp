@@ -0,0 +1,430 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include "passes.h"
+
+// sends the edges from preds into target through a new block placed ahead of
+// it, with phis there for target's phis when more than one edge moves
+static Block *splitPreds(Function *function, Block *target, const std::vector<Block*> &preds) {
+    Block *split = function->addBlock();
+    function->blocks.pop_back();
+    function->blocks.insert(std::find(function->blocks.begin(), function->blocks.end(), target), split);
+
+    std::vector<bool> moves(target->preds.size(), false);
+    for (size_t i = 0; i < target->preds.size(); i++) {
+        moves[i] = std::find(preds.begin(), preds.end(), target->preds[i]) != preds.end();
+    }
+    std::vector<Instruction*> phis = target->phis();
+    for (size_t i = 0; i < phis.size(); i++) {
+        std::vector<Instruction*> kept, moved;
+        for (size_t j = 0; j < moves.size(); j++) (moves[j] ? moved : kept).push_back(phis[i]->operands[j]);
+        Instruction *incoming = moved[0];
+        if (moved.size() > 1) {
+            incoming = split->append(function->create(OP_PHI, phis[i]->type));
+            for (size_t j = 0; j < moved.size(); j++) incoming->addOperand(moved[j]);
+        }
+        phis[i]->dropOperands();
+        for (size_t j = 0; j < kept.size(); j++) phis[i]->addOperand(kept[j]);
+        phis[i]->addOperand(incoming);
+    }
+    std::vector<Block*> kept;
+    for (size_t i = 0; i < moves.size(); i++) {
+        if (moves[i]) split->preds.push_back(target->preds[i]);
+        else kept.push_back(target->preds[i]);
+    }
+    target->preds = kept;
+    for (size_t i = 0; i < preds.size(); i++) {
+        std::vector<Block*> &targets = preds[i]->terminator()->targets;
+        std::replace(targets.begin(), targets.end(), target, split);
+    }
+    function->branch(split, target); // which makes split target's last pred
+    return split;
+}
+
+// loop invariant code motion. every loop gets a preheader, the one block
+// outside it that branches to the header, and exits only the loop leads to.
+// then, innermost first, whatever gives the same value every time round is
+// hoisted into the preheader, and each variable or constant element the loop
+// alone reads and writes is kept in a value through the loop, loaded before
+// it and stored back on the way out
+class LoopInvariants {
+    Function *function;
+    AnalysisCache &analyses;
+    MemoryRoots *roots = NULL;
+    const Cfg *cfg = NULL;
+    const DominatorTree *dominators = NULL;
+
+    bool canonicalize();
+    bool inLoop(const Bitset &blocks, Instruction *value);
+    bool invariant(const Bitset &blocks, Instruction *instruction);
+    bool safeToHoist(Instruction *instruction, const Loop *loop, const std::vector<int> &exiting, const Bitset &written);
+    int placeOf(Instruction *address, int &element);
+    bool hoist(const Loop *loop, Block *preheader);
+    bool promote(const Loop *loop, Block *preheader);
+
+    public:
+        LoopInvariants(Function *function, AnalysisCache &analyses) : function(function), analyses(analyses) {}
+        ~LoopInvariants() { delete roots; }
+        int run();
+};
+
+// preheaders and exits only reached from inside, which is all a change to
+// the blocks here ever is
+bool LoopInvariants::canonicalize() {
+    LoopForest &loops = this->analyses.getLoops();
+    const Cfg &cfg = loops.cfg;
+    std::vector<std::pair<Block*, std::vector<Block*> > > splits;
+    for (size_t i = 0; i < loops.loops.size(); i++) {
+        const Loop *loop = loops.loops[i];
+        Block *header = cfg.blocks[loop->header];
+        std::vector<Block*> outside;
+        for (size_t j = 0; j < header->preds.size(); j++) {
+            int pred = cfg.indexOf(header->preds[j]);
+            if ((pred < 0 || !loops.contains(loop, pred)) && std::find(outside.begin(), outside.end(), header->preds[j]) == outside.end()) {
+                outside.push_back(header->preds[j]);
+            }
+        }
+        if (outside.size() != 1 || outside[0]->succs().size() != 1) splits.push_back(std::make_pair(header, outside));
+
+        std::vector<int> exits = loops.exits(loop);
+        for (size_t j = 0; j < exits.size(); j++) {
+            Block *exit = cfg.blocks[exits[j]];
+            std::vector<Block*> inside;
+            bool shared = false;
+            for (size_t k = 0; k < exit->preds.size(); k++) {
+                int pred = cfg.indexOf(exit->preds[k]);
+                if (pred >= 0 && loops.contains(loop, pred)) {
+                    if (std::find(inside.begin(), inside.end(), exit->preds[k]) == inside.end()) inside.push_back(exit->preds[k]);
+                }
+                else shared = true;
+            }
+            if (shared) splits.push_back(std::make_pair(exit, inside));
+        }
+    }
+    // an exit shared by two loops may come up twice, the second split finds
+    // its preds already moved and has nothing left to do
+    bool changed = false;
+    for (size_t i = 0; i < splits.size(); i++) {
+        std::vector<Block*> preds;
+        for (size_t j = 0; j < splits[i].second.size(); j++) {
+            Block *pred = splits[i].second[j];
+            if (std::find(splits[i].first->preds.begin(), splits[i].first->preds.end(), pred) != splits[i].first->preds.end()) preds.push_back(pred);
+        }
+        if (preds.empty() || preds.size() == splits[i].first->preds.size()) continue;
+        splitPreds(this->function, splits[i].first, preds);
+        changed = true;
+    }
+    if (changed) this->analyses.invalidate(CHANGED_CFG);
+    return changed;
+}
+
+bool LoopInvariants::inLoop(const Bitset &blocks, Instruction *value) {
+    int block = this->cfg->indexOf(value->block);
+    return block >= 0 && blocks.test(block);
+}
+
+bool LoopInvariants::invariant(const Bitset &blocks, Instruction *instruction) {
+    for (size_t i = 0; i < instruction->operands.size(); i++) {
+        if (this->inLoop(blocks, instruction->operands[i])) return false;
+    }
+    return true;
+}
+
+// the root and constant element of a global or alloca that address names
+// exactly, -1 when it isn't such a place
+int LoopInvariants::placeOf(Instruction *address, int &element) {
+    Instruction *base = address;
+    element = 0;
+    if (address->op == OP_INDEX) {
+        if (!address->operands[1]->isConstant()) return -1;
+        base = address->operands[0];
+        element = address->operands[1]->intValue;
+    }
+    int length;
+    if (base->op == OP_ALLOCA) length = base->intValue;
+    else if (base->op == OP_GLOBAL) {
+        Global *global = this->function->module->findGlobal(base->name);
+        if (global == NULL) return -1;
+        length = global->length;
+    }
+    else return -1;
+    if (element < 0 || element >= length || (base == address && length != 1)) return -1;
+    return this->roots->rootOf(base);
+}
+
+// what can run ahead of the loop without doing anything the loop wouldn't
+// have: no division that might be by zero, no index that might be out of
+// range unless the loop was going to take it anyway, and no load of
+// memory the loop writes
+bool LoopInvariants::safeToHoist(Instruction *instruction, const Loop *loop, const std::vector<int> &exiting, const Bitset &written) {
+    switch (instruction->op) {
+        case OP_CONST: case OP_GLOBAL:
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_NEG: case OP_AND: case OP_OR: case OP_NOT:
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+        case OP_ITOF: case OP_BTOI: case OP_ITOB:
+            return true;
+        case OP_DIV:
+            return instruction->type == IR_FLOAT || (instruction->operands[1]->isConstant() && instruction->operands[1]->intValue != 0);
+        case OP_INDEX: {
+            int element;
+            if (this->placeOf(instruction, element) >= 0) return true;
+            // taken every time round, the first time round included
+            int block = this->cfg->indexOf(instruction->block);
+            for (size_t i = 0; i < exiting.size(); i++) {
+                if (!this->dominators->dominates(block, exiting[i])) return false;
+            }
+            return !exiting.empty() || block == loop->header;
+        }
+        case OP_LOAD: {
+            Bitset touched(this->roots->count);
+            this->roots->addAliases(touched, this->roots->rootOf(instruction->operands[0]));
+            return !touched.intersects(written);
+        }
+        case OP_CHECK: {
+            // only from the header, which runs whenever the loop is entered,
+            // and ahead of anything else there that could be seen first
+            Block *block = instruction->block;
+            if (block != this->cfg->blocks[loop->header]) return false;
+            for (std::list<Instruction*>::iterator it = block->instructions.begin(); *it != instruction; it++) {
+                if ((*it)->block == block && (*it)->hasSideEffects()) return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LoopInvariants::hoist(const Loop *loop, Block *preheader) {
+    Bitset blocks(this->cfg->size());
+    for (size_t i = 0; i < loop->blocks.size(); i++) blocks.set(loop->blocks[i]);
+
+    Bitset written(this->roots->count);
+    std::vector<int> exiting;
+    for (size_t i = 0; i < loop->blocks.size(); i++) {
+        const std::vector<int> &succs = this->cfg->succs[loop->blocks[i]];
+        for (size_t j = 0; j < succs.size(); j++) {
+            if (!blocks.test(succs[j])) {
+                exiting.push_back(loop->blocks[i]);
+                break;
+            }
+        }
+        std::list<Instruction*> &instructions = this->cfg->blocks[loop->blocks[i]]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op == OP_STORE) this->roots->addAliases(written, this->roots->rootOf((*it)->operands[0]));
+            else if ((*it)->op == OP_CALL) this->roots->addCallEffects(written, *it);
+        }
+    }
+
+    // in reverse postorder, so an operand is hoisted before what uses it
+    std::vector<int> order(loop->blocks.begin(), loop->blocks.end());
+    std::sort(order.begin(), order.end());
+    Instruction *last = preheader->terminator();
+    bool hoisted = false;
+    for (size_t i = 0; i < order.size(); i++) {
+        Block *block = this->cfg->blocks[order[i]];
+        std::vector<Instruction*> moving;
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (!this->invariant(blocks, instruction) || !this->safeToHoist(instruction, loop, exiting, written)) continue;
+            moving.push_back(instruction);
+            // later instructions in the block see it as hoisted already
+            instruction->block = preheader;
+        }
+        for (size_t j = 0; j < moving.size(); j++) {
+            moving[j]->block = block;
+            block->unlink(moving[j]);
+            preheader->insertBefore(last, moving[j]);
+        }
+        hoisted = hoisted || !moving.empty();
+    }
+    return hoisted;
+}
+
+// a place the loop reads and writes through its own address, that nothing
+// else in the loop may touch
+struct PromotedPlace {
+    Instruction *address = NULL; // one outside the loop
+    int elemType = IR_VOID;
+    bool stored = false;
+    Instruction *initial = NULL;
+};
+
+bool LoopInvariants::promote(const Loop *loop, Block *preheader) {
+    Bitset blocks(this->cfg->size());
+    for (size_t i = 0; i < loop->blocks.size(); i++) blocks.set(loop->blocks[i]);
+
+    // any other way into a root rules out all its places
+    Bitset blocked(this->roots->count);
+    std::map<std::pair<int, int>, PromotedPlace> candidates;
+    std::vector<std::pair<Instruction*, std::pair<int, int> > > accesses;
+    for (size_t i = 0; i < loop->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = this->cfg->blocks[loop->blocks[i]]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->op == OP_CALL) {
+                this->roots->addCallEffects(blocked, instruction);
+                continue;
+            }
+            if (instruction->op != OP_LOAD && instruction->op != OP_STORE) continue;
+            Instruction *address = instruction->operands[0];
+            int element;
+            int root = this->placeOf(address, element);
+            if (root < 0 || this->inLoop(blocks, address)) {
+                this->roots->addAliases(blocked, this->roots->rootOf(address));
+                continue;
+            }
+            PromotedPlace &place = candidates[std::make_pair(root, element)];
+            place.address = address;
+            place.elemType = instruction->elemType;
+            place.stored = place.stored || instruction->op == OP_STORE;
+            accesses.push_back(std::make_pair(instruction, std::make_pair(root, element)));
+        }
+    }
+
+    std::vector<PromotedPlace> places;
+    std::map<std::pair<int, int>, int> numbers;
+    for (std::map<std::pair<int, int>, PromotedPlace>::iterator it = candidates.begin(); it != candidates.end(); it++) {
+        if (blocked.test(it->first.first)) continue;
+        numbers[it->first] = places.size();
+        places.push_back(it->second);
+    }
+    if (places.empty()) return false;
+    std::unordered_map<int, int> placeOfAccess; // by id, which unlike an address is never used again
+    for (size_t i = 0; i < accesses.size(); i++) {
+        std::map<std::pair<int, int>, int>::iterator number = numbers.find(accesses[i].second);
+        if (number != numbers.end()) placeOfAccess[accesses[i].first->id] = number->second;
+    }
+    for (size_t i = 0; i < places.size(); i++) {
+        Instruction *initial = this->function->create(OP_LOAD, places[i].elemType);
+        initial->elemType = places[i].elemType;
+        initial->addOperand(places[i].address);
+        places[i].initial = preheader->insertBefore(preheader->terminator(), initial);
+    }
+
+    // each place's value at the top and bottom of each block, a phi where
+    // loop edges meet if the loop stores it and otherwise what the one
+    // predecessor left
+    std::vector<int> order(loop->blocks.begin(), loop->blocks.end());
+    std::sort(order.begin(), order.end());
+    std::unordered_map<Block*, int> position;
+    for (size_t i = 0; i < order.size(); i++) position[this->cfg->blocks[order[i]]] = i;
+    std::vector<std::vector<Instruction*> > bottom(order.size());
+    std::vector<Instruction*> phis;
+    for (size_t i = 0; i < order.size(); i++) {
+        Block *block = this->cfg->blocks[order[i]];
+        std::vector<Instruction*> &current = bottom[i];
+        if (order[i] == loop->header) {
+            for (size_t j = 0; j < places.size(); j++) current.push_back(places[j].initial);
+        }
+        else if (block->preds.size() == 1) current = bottom[position[block->preds[0]]];
+        else current.assign(places.size(), NULL);
+        if (block->preds.size() > 1) {
+            for (size_t j = 0; j < places.size(); j++) {
+                if (!places[j].stored) current[j] = places[j].initial;
+                else phis.push_back(current[j] = block->insertAfterPhis(this->function->create(OP_PHI, places[j].elemType)));
+            }
+        }
+        std::vector<Instruction*> gone;
+        for (std::list<Instruction*>::iterator at = block->instructions.begin(); at != block->instructions.end(); at++) {
+            std::unordered_map<int, int>::iterator access = placeOfAccess.find((*at)->id);
+            if (access == placeOfAccess.end()) continue;
+            if ((*at)->op == OP_LOAD) (*at)->replaceAllUsesWith(current[access->second]);
+            else current[access->second] = (*at)->operands[1];
+            gone.push_back(*at);
+        }
+        for (size_t j = 0; j < gone.size(); j++) block->erase(gone[j]);
+    }
+    // the phis went in for places in order, so the nth phi of a block is
+    // for its nth stored place
+    for (size_t i = 0; i < phis.size(); ) {
+        Block *block = phis[i]->block;
+        for (size_t j = 0; j < places.size(); j++) {
+            if (!places[j].stored) continue;
+            for (size_t k = 0; k < block->preds.size(); k++) {
+                phis[i]->addOperand(block->preds[k] == preheader ? places[j].initial : bottom[position[block->preds[k]]][j]);
+            }
+            i++;
+        }
+    }
+
+    std::vector<Block*> exits;
+    for (size_t i = 0; i < order.size(); i++) {
+        const std::vector<int> &succs = this->cfg->succs[order[i]];
+        for (size_t j = 0; j < succs.size(); j++) {
+            Block *exit = this->cfg->blocks[succs[j]];
+            if (!blocks.test(succs[j]) && std::find(exits.begin(), exits.end(), exit) == exits.end()) exits.push_back(exit);
+        }
+    }
+    for (size_t i = 0; i < exits.size(); i++) {
+        Block *exit = exits[i];
+        for (size_t j = 0; j < places.size(); j++) {
+            if (!places[j].stored) continue;
+            Instruction *value = bottom[position[exit->preds[0]]][j];
+            if (exit->preds.size() > 1) {
+                value = exit->insertAfterPhis(this->function->create(OP_PHI, places[j].elemType));
+                for (size_t k = 0; k < exit->preds.size(); k++) value->addOperand(bottom[position[exit->preds[k]]][j]);
+                phis.push_back(value);
+            }
+            Instruction *store = this->function->create(OP_STORE, IR_VOID);
+            store->elemType = places[j].elemType;
+            store->addOperand(places[j].address);
+            store->addOperand(value);
+            exit->insertAfterPhis(store);
+        }
+    }
+
+    // phis that only ever see one value, the loop never having stored
+    // on some path, give way to it
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t i = 0; i < phis.size(); i++) {
+            if (phis[i] == NULL) continue;
+            Instruction *same = NULL;
+            bool trivial = true;
+            for (size_t j = 0; j < phis[i]->operands.size() && trivial; j++) {
+                Instruction *operand = phis[i]->operands[j];
+                if (operand == phis[i] || operand == same) continue;
+                trivial = same == NULL;
+                same = operand;
+            }
+            if (!trivial || same == NULL) continue;
+            phis[i]->replaceAllUsesWith(same);
+            phis[i]->block->erase(phis[i]);
+            phis[i] = NULL;
+            changed = true;
+        }
+    }
+    return true;
+}
+
+int LoopInvariants::run() {
+    bool reshaped = this->canonicalize();
+    LoopForest &loops = this->analyses.getLoops();
+    if (loops.loops.empty()) return reshaped ? CHANGED_CFG : CHANGED_NONE;
+    this->cfg = &loops.cfg;
+    this->dominators = &this->analyses.getDominators();
+    this->roots = new MemoryRoots(this->function);
+
+    bool changed = false;
+    for (size_t i = 0; i < loops.loops.size(); i++) {
+        const Loop *loop = loops.loops[i];
+        Block *header = this->cfg->blocks[loop->header];
+        Block *preheader = NULL;
+        for (size_t j = 0; j < header->preds.size(); j++) {
+            int pred = this->cfg->indexOf(header->preds[j]);
+            if (pred >= 0 && !loops.contains(loop, pred)) preheader = header->preds[j];
+        }
+        if (preheader == NULL) continue;
+        changed = this->hoist(loop, preheader) || changed;
+        changed = this->promote(loop, preheader) || changed;
+    }
+    if (reshaped) return CHANGED_CFG;
+    return changed ? CHANGED_INSTRUCTIONS : CHANGED_NONE;
+}
+
+int hoistLoopInvariants(Function *function, AnalysisCache &analyses) {
+    LoopInvariants invariants(function, analyses);
+    return invariants.run();
+}
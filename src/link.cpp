@@ -0,0 +1,66 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <vector>
+#include "elfobject.h"
+#include "link.h"
+#include "protocol.h"
+
+void removeProgram(std::string dir) {
+    remove((dir + "program.s").c_str());
+    remove((dir + "program.o").c_str());
+    remove((dir + "program").c_str());
+}
+
+// the object and standalone.o into a static executable, no toolchain needed
+static int linkStatic(std::string dir) {
+    std::vector<std::string> objects(2);
+    if (!readFile(dir + "program.o", objects[0])) {
+        std::cout << "Skipping link, no object was written...\n";
+        return 0;
+    }
+    if (!readFile(dir + "standalone.o", objects[1])) {
+        std::cout << "Linking failed: no standalone runtime at \"" << dir << "standalone.o\"\n";
+        return 1;
+    }
+    std::string executable, error;
+    if (!linkExecutable(objects, executable, error)) {
+        std::cout << "Linking failed: " << error << "\n";
+        return 1;
+    }
+    std::ofstream out(dir + "program", std::ofstream::binary | std::ofstream::trunc);
+    out << executable;
+    out.close();
+    chmod((dir + "program").c_str(), 0755);
+    return 0;
+}
+
+int linkProgram(std::string dir, CompileOptions options) {
+    std::string input = dir + (options.assembly ? "program.s" : "program.o");
+    std::ifstream written(input);
+    if (!written.good()) {
+        std::cout << "Skipping link, no " << (options.assembly ? "assembly" : "object") << " was written...\n";
+        return 0;
+    }
+    double start = monotonicMs();
+    if (options.standalone && !options.assembly) {
+        int status = linkStatic(dir);
+        if (status != 0) return status;
+    }
+    else {
+        // assembly for -static goes through cc, with the c library's static archive
+        std::string command = "cc " + std::string(options.standalone ? "-static " : "") + "-o " + dir + "program " + input + " "
+            + dir + "runtime.o -lm";
+        int status = system(command.c_str());
+        if (status != 0) {
+            std::cout << "Linking failed: " << command << "\n";
+            return 1;
+        }
+    }
+    std::cout << "Linked \"compiler/build/program\" in " << monotonicMs() - start << " ms\n";
+    return 0;
+}
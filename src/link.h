@@ -0,0 +1,17 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <string>
+#include "driver.h"
+
+// removes dir's program and what it is built from, so a compile that stops
+// before writing its output leaves no older program behind
+void removeProgram(std::string dir);
+
+// links dir's program.o, or with -S assembles program.s, with the runtime
+// built beside it into dir's program, returning the toolchain's status. with
+// -static the link happens here, against standalone.o. compile and
+// compile-client both link this way
+int linkProgram(std::string dir, CompileOptions options);
+
+#endif
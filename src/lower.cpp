@@ -0,0 +1,1038 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include "alloctrack.h"
+#include "lower.h"
+
+struct Procedure;
+
+// a declared variable, scalars have length 0
+struct Variable {
+    std::string name;
+    int type;
+    int length = 0;
+    bool global = false;
+    bool captured = false; // some nested procedure uses it, so it has to live in memory
+    Procedure *owner = NULL;
+    int order;             // declaration order, keeps captures in a stable order
+    Word word;
+};
+
+// a declared procedure, or a builtin from the runtime
+struct Procedure {
+    std::string name;
+    std::string symbol; // function name in the ir
+    Procedure *parent = NULL;
+    int returnType = IR_VOID;
+    std::vector<Variable*> params;
+    std::vector<Variable*> locals;
+    Node *body = NULL;
+    bool builtin = false;
+    std::set<Variable*> uses;     // outer locals it reads or writes itself
+    std::set<Procedure*> calls;
+    std::vector<Variable*> captures; // outer locals it needs, its own and its callees'
+    Word word;
+};
+
+// what an identifier resolves to
+struct Symbol {
+    Variable *variable = NULL;
+    Procedure *procedure = NULL;
+};
+
+static int irType(int dataType) {
+    switch (dataType) {
+        case T_INTEGER: return IR_INT;
+        case T_FLOAT: return IR_FLOAT;
+        case T_BOOL: return IR_BOOL;
+        case T_STRING: return IR_STRING;
+        default: return IR_VOID;
+    }
+}
+
+static bool isTerminal(Node *node, int tokenType) {
+    return node->getExprId() == 0 && node->readTerminal().tokenType == tokenType;
+}
+
+// first word with a position under node, for messages
+static const Word &firstWord(Node *node) {
+    if (node->getExprId() == 0 || node->getChildCount() == 0) return node->readTerminal();
+    for (int i = 0; i < node->getChildCount(); i++) {
+        const Word &word = firstWord((*node)[i]);
+        if (word.line > 0) return word;
+    }
+    return node->readTerminal();
+}
+
+// the NAME of an expression that is nothing but an unindexed name, else NULL
+static Node *bareName(Node *expression) {
+    Node *node = expression;
+    int expected[] = {E_EXPR, E_MATHOP, E_REL, E_TERM};
+    for (int i = 0; i < 4; i++) {
+        if (node->getExprId() != expected[i] || node->getChildCount() != 2) return NULL;
+        if ((*node)[1]->getChildCount() != 0) return NULL;
+        node = (*node)[0];
+    }
+    if (node->getExprId() != E_FACTOR || node->getChildCount() != 1) return NULL;
+    node = (*node)[0];
+    if (node->getExprId() != E_NAME || node->getChildCount() != 1) return NULL;
+    return node;
+}
+
+class Lowering {
+    bool debug;
+    int errors = 0;
+    Module *module;
+
+    // resolution, done once for the whole program
+    std::vector<std::unordered_map<std::string, Symbol>> scopes;
+    std::vector<Procedure*> procedures; // declaration order, main last
+    std::vector<Variable*> variables;
+    std::unordered_map<Node*, Variable*> variableOf;   // id terminals of names and destinations
+    std::unordered_map<Node*, Procedure*> procedureOf; // id terminals of calls
+    Procedure *main;
+
+    // the function being built
+    Procedure *procedure;
+    Function *function;
+    Block *current;
+    int prologue; // allocas and global addresses at the top of the entry block
+    std::unordered_map<Variable*, Instruction*> addresses;
+    Instruction *elementIndex = NULL; // set while an array is assigned element by element
+    int elementLength = 0;
+
+    // ssa construction after braun et al., "simple and efficient construction of ssa form"
+    std::unordered_map<Variable*, std::unordered_map<Block*, Instruction*>> currentDef;
+    std::unordered_set<Block*> sealed;
+    std::unordered_map<Block*, std::vector<std::pair<Variable*, Instruction*>>> incompletePhis;
+    std::unordered_map<Instruction*, Instruction*> replaced; // trivial phis and what took their place
+    std::vector<Instruction*> removedPhis;                   // freed once the function is done
+
+    void error(const Word &where, std::string message);
+
+    // resolution
+    void declareBody(Node *body, Procedure *owner);
+    Variable *declareVariable(Node *declaration, bool global, Procedure *owner);
+    void declareProcedure(Node *declaration, bool global, Procedure *owner);
+    void declareBuiltin(std::string name, int returnType, int paramType);
+    Symbol lookup(Node *id);
+    void resolve(Node *node, Procedure *owner);
+    void findCaptures();
+
+    // emission
+    void lowerProcedure(Procedure *lowered);
+    Instruction *emit(int op, int type, Instruction *a = NULL, Instruction *b = NULL);
+    Instruction *constant(int type, int intValue = 0, float floatValue = 0.0, std::string text = "");
+    Instruction *zero(int type) { return this->constant(type); }
+    void addToPrologue(Instruction *instruction);
+    Instruction *addressOf(Variable *variable);
+    Instruction *element(Variable *variable, Instruction *index);
+    Instruction *checkedElement(Variable *variable, Instruction *index);
+    Function *functionFor(Procedure *callee);
+    Function *runtime(std::string name, int returnType, int param1, int param2);
+    bool inSsa(Variable *variable);
+    Block *deadBlock();
+
+    Instruction *convert(Instruction *value, int type, const Word &where);
+    Instruction *toFloat(Instruction *value, const Word &where);
+    Instruction *toBool(Instruction *value, const Word &where);
+    Instruction *binary(const Word &op, Instruction *lhs, Instruction *rhs);
+
+    void statements(std::list<Node*> &children, std::list<Node*>::iterator from, int stopToken);
+    void statement(Node *statement);
+    void assignment(Node *assignment);
+    void arrayAssignment(Variable *variable, Node *expression, const Word &where);
+    void ifStatement(Node *statement);
+    void loopStatement(Node *statement);
+    void returnStatement(Node *statement);
+    Instruction *condition(Node *expression);
+    Instruction *value(Node *node);
+    Instruction *factor(Node *factor);
+    Instruction *name(Node *name);
+    Instruction *call(Node *call);
+
+    // ssa construction
+    void writeVariable(Variable *variable, Block *block, Instruction *value);
+    Instruction *readVariable(Variable *variable, Block *block);
+    Instruction *readVariableRecursive(Variable *variable, Block *block);
+    Instruction *addPhiOperands(Variable *variable, Instruction *phi);
+    Instruction *tryRemoveTrivialPhi(Instruction *phi);
+    Instruction *resolved(Instruction *value);
+    void seal(Block *block);
+
+    public:
+        Lowering(bool debugMode) { debug = debugMode; }
+        ~Lowering();
+        Module *run(Node *tree);
+};
+
+Lowering::~Lowering() {
+    for (size_t i = 0; i < this->procedures.size(); i++) delete this->procedures[i];
+    for (size_t i = 0; i < this->variables.size(); i++) delete this->variables[i];
+}
+
+void Lowering::error(const Word &where, std::string message) {
+    std::cout << "(" << where.line << "," << where.col << ") Error: " << message << "\n";
+    this->errors++;
+    if (this->debug == false) std::exit(1);
+}
+
+// ****************************************************
+// resolution
+
+// mirrors the parser's scopes: program level names and "global" ones go in
+// the outermost scope, everything else in the innermost procedure's
+void Lowering::declareBody(Node *body, Procedure *owner) {
+    std::list<Node*> children = body->getChildren();
+    for (Node *child : children) {
+        if (child->getExprId() == E_DECLARE) {
+            bool global = child->getChildCount() == 2;
+            Node *declared = (*child)[child->getChildCount() - 1];
+            if (declared->getExprId() == E_VARDEC) {
+                Variable *variable = this->declareVariable(declared, global || owner == this->main, owner);
+                if (!variable->global) owner->locals.push_back(variable);
+            }
+            else this->declareProcedure(declared, global, owner);
+        }
+        else if (child->getExprId() == E_STMT) this->resolve(child, owner);
+    }
+}
+
+Variable *Lowering::declareVariable(Node *declaration, bool global, Procedure *owner) {
+    Variable *variable = new Variable();
+    Word word = declaration->readTerminal();
+    variable->name = word.tokenString;
+    variable->word = word;
+    variable->type = irType(word.dataType);
+    if (declaration->getChildCount() > 4) variable->length = (*declaration)[5]->readTerminal().intValue;
+    variable->global = global;
+    variable->owner = global ? NULL : owner;
+    variable->order = this->variables.size();
+    this->variables.push_back(variable);
+
+    if (variable->length < 0 || (declaration->getChildCount() > 4 && variable->length == 0)) {
+        this->error(word, "array " + variable->name + " needs a positive length");
+        variable->length = 1;
+    }
+    if (global) {
+        Global storage = {variable->name, variable->type, variable->length > 0 ? variable->length : 1};
+        this->module->globals.push_back(storage);
+    }
+
+    Symbol symbol;
+    symbol.variable = variable;
+    (global ? this->scopes.front() : this->scopes.back())[variable->name] = symbol;
+    return variable;
+}
+
+void Lowering::declareProcedure(Node *declaration, bool global, Procedure *owner) {
+    Node *header = (*declaration)[0];
+    Procedure *procedure = new Procedure();
+    procedure->word = (*header)[1]->readTerminal();
+    procedure->name = procedure->word.tokenString;
+    procedure->symbol = owner == this->main ? procedure->name : owner->symbol + "." + procedure->name;
+    procedure->parent = owner;
+    procedure->returnType = irType((*header)[3]->readTerminal().tokenType);
+    procedure->body = (*declaration)[1];
+
+    Symbol symbol;
+    symbol.procedure = procedure;
+    (global ? this->scopes.front() : this->scopes.back())[procedure->name] = symbol;
+
+    // parameters and the body share the procedure's own scope
+    this->scopes.push_back(std::unordered_map<std::string, Symbol>());
+    std::list<Node*> params = (*header)[5]->getChildren();
+    for (Node *param : params) {
+        if (param->getExprId() != E_PARAM) continue;
+        procedure->params.push_back(this->declareVariable((*param)[0], false, procedure));
+    }
+    this->declareBody(procedure->body, procedure);
+    this->scopes.pop_back();
+
+    this->procedures.push_back(procedure);
+}
+
+void Lowering::declareBuiltin(std::string name, int returnType, int paramType) {
+    Procedure *builtin = new Procedure();
+    builtin->name = builtin->symbol = name;
+    builtin->returnType = returnType;
+    builtin->builtin = true;
+    if (paramType != IR_VOID) {
+        Variable *param = new Variable();
+        param->name = "VALUE";
+        param->type = paramType;
+        param->owner = builtin;
+        param->order = this->variables.size();
+        this->variables.push_back(param);
+        builtin->params.push_back(param);
+    }
+    this->procedures.push_back(builtin);
+
+    Symbol symbol;
+    symbol.procedure = builtin;
+    this->scopes.front()[name] = symbol;
+}
+
+Symbol Lowering::lookup(Node *id) {
+    std::string name = id->readTerminal().tokenString;
+    for (size_t i = this->scopes.size(); i-- > 0;) {
+        std::unordered_map<std::string, Symbol>::iterator found = this->scopes[i].find(name);
+        if (found != this->scopes[i].end()) return found->second;
+    }
+    return Symbol();
+}
+
+// records what every name in a statement refers to, and which outer locals
+// and procedures the statement's procedure reaches
+void Lowering::resolve(Node *node, Procedure *owner) {
+    int id = node->getExprId();
+    if (id == E_NAME || id == E_DEST) {
+        Node *identifier = (*node)[0];
+        Symbol symbol = this->lookup(identifier);
+        if (symbol.variable == NULL) this->error(identifier->readTerminal(), identifier->readTerminal().tokenString + " isn't a variable");
+        else {
+            this->variableOf[identifier] = symbol.variable;
+            if (!symbol.variable->global && symbol.variable->owner != owner) owner->uses.insert(symbol.variable);
+        }
+    }
+    else if (id == E_PROCCALL) {
+        Node *identifier = (*node)[0];
+        Symbol symbol = this->lookup(identifier);
+        if (symbol.procedure == NULL) this->error(identifier->readTerminal(), identifier->readTerminal().tokenString + " isn't a procedure");
+        else {
+            this->procedureOf[identifier] = symbol.procedure;
+            if (!symbol.procedure->builtin) owner->calls.insert(symbol.procedure);
+        }
+    }
+
+    for (int i = 0; i < node->getChildCount(); i++) this->resolve((*node)[i], owner);
+}
+
+// a procedure needs every outer local it uses, plus those its callees need
+// that it doesn't own itself, iterated until nothing more is added
+void Lowering::findCaptures() {
+    std::map<Procedure*, std::set<Variable*>> needs;
+    for (Procedure *procedure : this->procedures) needs[procedure] = procedure->uses;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Procedure *procedure : this->procedures) {
+            for (Procedure *callee : procedure->calls) {
+                for (Variable *variable : needs[callee]) {
+                    if (variable->owner == procedure) continue;
+                    if (needs[procedure].insert(variable).second) changed = true;
+                }
+            }
+        }
+    }
+
+    for (Procedure *procedure : this->procedures) {
+        for (Variable *variable : needs[procedure]) {
+            // only a procedure nested inside the owner can be handed its address
+            Procedure *enclosing = procedure->parent;
+            while (enclosing != NULL && enclosing != variable->owner) enclosing = enclosing->parent;
+            if (enclosing == NULL) {
+                this->error(procedure->word, procedure->name + " reaches " + variable->name + ", a local of "
+                    + variable->owner->name + ", from outside " + variable->owner->name);
+                continue;
+            }
+            variable->captured = true;
+            procedure->captures.push_back(variable);
+        }
+        std::sort(procedure->captures.begin(), procedure->captures.end(),
+            [](Variable *a, Variable *b) { return a->order < b->order; });
+    }
+}
+
+// ****************************************************
+// emission helpers
+
+Instruction *Lowering::resolved(Instruction *value) {
+    if (this->replaced.empty()) return value;
+    std::unordered_map<Instruction*, Instruction*>::iterator found = this->replaced.find(value);
+    while (found != this->replaced.end()) {
+        value = found->second;
+        found = this->replaced.find(value);
+    }
+    return value;
+}
+
+Instruction *Lowering::emit(int op, int type, Instruction *a, Instruction *b) {
+    Instruction *instruction = this->function->create(op, type);
+    if (a != NULL) instruction->addOperand(this->resolved(a));
+    if (b != NULL) instruction->addOperand(this->resolved(b));
+    return this->current->append(instruction);
+}
+
+Instruction *Lowering::constant(int type, int intValue, float floatValue, std::string text) {
+    Instruction *instruction = this->emit(OP_CONST, type);
+    instruction->intValue = intValue;
+    instruction->floatValue = floatValue;
+    instruction->name = text;
+    return instruction;
+}
+
+void Lowering::addToPrologue(Instruction *instruction) {
+    Block *entry = this->function->entry();
+    instruction->block = entry;
+    entry->instructions.insert(std::next(entry->instructions.begin(), this->prologue++), instruction);
+}
+
+Instruction *Lowering::addressOf(Variable *variable) {
+    std::unordered_map<Variable*, Instruction*>::iterator found = this->addresses.find(variable);
+    if (found != this->addresses.end()) return found->second;
+
+    Instruction *address = this->function->create(OP_GLOBAL, IR_PTR);
+    address->name = variable->name;
+    this->addToPrologue(address);
+    this->addresses[variable] = address;
+    return address;
+}
+
+Instruction *Lowering::element(Variable *variable, Instruction *index) {
+    Instruction *address = this->emit(OP_INDEX, IR_PTR, this->addressOf(variable), index);
+    address->elemType = variable->type;
+    return address;
+}
+
+// an index the program wrote, which the parser could only check when it was
+// a literal, so anything else is checked when it runs
+Instruction *Lowering::checkedElement(Variable *variable, Instruction *index) {
+    if (!index->isConstant()) {
+        Instruction *check = this->emit(OP_CHECK, IR_VOID, index);
+        check->intValue = variable->length;
+    }
+    return this->element(variable, index);
+}
+
+Function *Lowering::functionFor(Procedure *callee) {
+    if (!callee->builtin) return this->module->find(callee->symbol);
+    int param = callee->params.empty() ? IR_VOID : callee->params[0]->type;
+    return this->runtime(callee->symbol, callee->returnType, param, IR_VOID);
+}
+
+// declares a routine the runtime provides, the first time it's called
+Function *Lowering::runtime(std::string name, int returnType, int param1, int param2) {
+    Function *declared = this->module->find(name);
+    if (declared != NULL) return declared;
+    declared = this->module->addFunction(name, returnType);
+    declared->external = true;
+    // reading and printing have effects, these only compute
+    declared->pure = name == "SQRT" || name == "strcmp";
+    if (param1 != IR_VOID) declared->paramTypes.push_back(param1);
+    if (param2 != IR_VOID) declared->paramTypes.push_back(param2);
+    return declared;
+}
+
+bool Lowering::inSsa(Variable *variable) {
+    return !variable->global && !variable->captured && variable->length == 0;
+}
+
+// somewhere for statements after a return to go, dropped once the function is built
+Block *Lowering::deadBlock() {
+    Block *block = this->function->addBlock();
+    this->sealed.insert(block);
+    return block;
+}
+
+// the conversions assignments and arguments allow, as the parser checks them
+Instruction *Lowering::convert(Instruction *value, int type, const Word &where) {
+    if (value->type == type) return value;
+    if (type == IR_FLOAT && value->type == IR_INT) return this->emit(OP_ITOF, IR_FLOAT, value);
+    if (type == IR_INT && value->type == IR_BOOL) return this->emit(OP_BTOI, IR_INT, value);
+    if (type == IR_BOOL && value->type == IR_INT) return this->emit(OP_ITOB, IR_BOOL, value);
+    this->error(where, std::string("can't convert ") + irTypeName(value->type) + " to " + irTypeName(type));
+    return this->zero(type);
+}
+
+Instruction *Lowering::toFloat(Instruction *value, const Word &where) {
+    if (value->type == IR_BOOL) value = this->emit(OP_BTOI, IR_INT, value);
+    return this->convert(value, IR_FLOAT, where);
+}
+
+Instruction *Lowering::toBool(Instruction *value, const Word &where) {
+    return this->convert(value, IR_BOOL, where);
+}
+
+// result types follow the parser's findResultType
+Instruction *Lowering::binary(const Word &op, Instruction *lhs, Instruction *rhs) {
+    switch (op.tokenType) {
+        case T_ADD: case T_SUB: case T_MULT: case T_DIVIDE: {
+            int opcode = op.tokenType == T_ADD ? OP_ADD : op.tokenType == T_SUB ? OP_SUB
+                : op.tokenType == T_MULT ? OP_MUL : OP_DIV;
+            if (lhs->type == IR_STRING || rhs->type == IR_STRING) break;
+            if (lhs->type == IR_INT && rhs->type == IR_INT) return this->emit(opcode, IR_INT, lhs, rhs);
+            return this->emit(opcode, IR_FLOAT, this->toFloat(lhs, op), this->toFloat(rhs, op));
+        }
+        case T_AND: case T_OR: {
+            int opcode = op.tokenType == T_AND ? OP_AND : OP_OR;
+            if (lhs->type == IR_INT && rhs->type == IR_INT) return this->emit(opcode, IR_INT, lhs, rhs);
+            if (lhs->type == IR_STRING || lhs->type == IR_FLOAT || rhs->type == IR_STRING || rhs->type == IR_FLOAT) break;
+            return this->emit(opcode, IR_BOOL, this->toBool(lhs, op), this->toBool(rhs, op));
+        }
+        case T_LESS: case T_LESSEQUIV: case T_MORE: case T_MOREEQUIV: case T_EQUIV: case T_NOTEQUIV: {
+            int opcode = op.tokenType == T_LESS ? OP_LT : op.tokenType == T_LESSEQUIV ? OP_LE
+                : op.tokenType == T_MORE ? OP_GT : op.tokenType == T_MOREEQUIV ? OP_GE
+                : op.tokenType == T_EQUIV ? OP_EQ : OP_NE;
+
+            // strings compare through the runtime, as strcmp's sign against zero
+            if (lhs->type == IR_STRING && rhs->type == IR_STRING) {
+                this->runtime("strcmp", IR_INT, IR_STRING, IR_STRING);
+                Instruction *order = this->emit(OP_CALL, IR_INT, lhs, rhs);
+                order->name = "strcmp";
+                return this->emit(opcode, IR_BOOL, order, this->zero(IR_INT));
+            }
+            if (lhs->type == IR_STRING || rhs->type == IR_STRING) break;
+            if (lhs->type == IR_BOOL && rhs->type == IR_BOOL) return this->emit(opcode, IR_BOOL, lhs, rhs);
+            if (lhs->type == IR_FLOAT || rhs->type == IR_FLOAT) {
+                return this->emit(opcode, IR_BOOL, this->toFloat(lhs, op), this->toFloat(rhs, op));
+            }
+            return this->emit(opcode, IR_BOOL, this->convert(lhs, IR_INT, op), this->convert(rhs, IR_INT, op));
+        }
+    }
+    this->error(op, "\"" + op.tokenString + "\" can't combine " + irTypeName(lhs->type) + " and " + irTypeName(rhs->type));
+    return this->zero(IR_INT);
+}
+
+// ****************************************************
+// procedures
+
+void Lowering::lowerProcedure(Procedure *lowered) {
+    this->procedure = lowered;
+    this->function = this->module->find(lowered->symbol);
+    this->current = this->function->addBlock();
+    this->sealed.insert(this->current);
+    this->prologue = 0;
+
+    std::vector<std::pair<Instruction*, Instruction*>> arrayCopies;
+    int position = 0;
+    for (Variable *param : lowered->params) {
+        Instruction *incoming = this->function->create(OP_PARAM, param->length > 0 ? IR_PTR : param->type);
+        incoming->intValue = position++;
+        this->addToPrologue(incoming);
+
+        if (param->length > 0 || param->captured) {
+            // arrays are passed by value, so the callee copies its own
+            Instruction *storage = this->function->create(OP_ALLOCA, IR_PTR);
+            storage->elemType = param->type;
+            storage->intValue = param->length > 0 ? param->length : 1;
+            this->addToPrologue(storage);
+            this->addresses[param] = storage;
+            if (param->length > 0) arrayCopies.push_back(std::make_pair(storage, incoming));
+            else {
+                Instruction *store = this->emit(OP_STORE, IR_VOID, storage, incoming);
+                store->elemType = param->type;
+            }
+        }
+        else this->writeVariable(param, this->current, incoming);
+    }
+    for (Variable *captured : lowered->captures) {
+        Instruction *incoming = this->function->create(OP_PARAM, IR_PTR);
+        incoming->intValue = position++;
+        this->addToPrologue(incoming);
+        this->addresses[captured] = incoming;
+    }
+
+    // locals start out zeroed, allocas already are
+    for (Variable *local : lowered->locals) {
+        if (this->inSsa(local)) {
+            this->writeVariable(local, this->current, this->zero(local->type));
+            continue;
+        }
+        Instruction *storage = this->function->create(OP_ALLOCA, IR_PTR);
+        storage->elemType = local->type;
+        storage->intValue = local->length > 0 ? local->length : 1;
+        this->addToPrologue(storage);
+        this->addresses[local] = storage;
+    }
+
+    // element by element copies of array arguments, through a counted loop
+    for (size_t i = 0; i < arrayCopies.size(); i++) {
+        Instruction *storage = arrayCopies[i].first, *incoming = arrayCopies[i].second;
+        Block *header = this->function->addBlock(), *body = this->function->addBlock(), *exit = this->function->addBlock();
+        Instruction *start = this->zero(IR_INT);
+        Instruction *length = this->constant(IR_INT, storage->intValue);
+        Instruction *one = this->constant(IR_INT, 1);
+        this->function->branch(this->current, header);
+
+        this->current = header;
+        Instruction *counter = this->function->create(OP_PHI, IR_INT);
+        header->append(counter);
+        this->function->condBranch(header, this->emit(OP_LT, IR_BOOL, counter, length), body, exit);
+
+        this->current = body;
+        Instruction *from = this->emit(OP_INDEX, IR_PTR, incoming, counter);
+        Instruction *to = this->emit(OP_INDEX, IR_PTR, storage, counter);
+        from->elemType = to->elemType = storage->elemType;
+        Instruction *load = this->emit(OP_LOAD, storage->elemType, from);
+        load->elemType = storage->elemType;
+        Instruction *store = this->emit(OP_STORE, IR_VOID, to, load);
+        store->elemType = storage->elemType;
+        Instruction *next = this->emit(OP_ADD, IR_INT, counter, one);
+        this->function->branch(body, header);
+        counter->addOperand(start);
+        counter->addOperand(next);
+
+        this->sealed.insert(header);
+        this->sealed.insert(body);
+        this->sealed.insert(exit);
+        this->current = exit;
+    }
+
+    std::list<Node*> children = lowered->body->getChildren();
+    this->statements(children, children.begin(), T_END);
+
+    // falling off the end returns the zero of the return type
+    if (lowered == this->main) this->emit(OP_RET, IR_VOID);
+    else this->emit(OP_RET, IR_VOID, this->zero(lowered->returnType));
+
+    this->function->removeUnreachableBlocks();
+
+    for (Instruction *phi : this->removedPhis) delete phi;
+    this->removedPhis.clear();
+    this->replaced.clear();
+    this->currentDef.clear();
+    this->sealed.clear();
+    this->incompletePhis.clear();
+    this->addresses.clear();
+}
+
+// ****************************************************
+// statements
+
+// lowers the statements in children from the given one until a stopToken terminal
+void Lowering::statements(std::list<Node*> &children, std::list<Node*>::iterator from, int stopToken) {
+    for (std::list<Node*>::iterator it = from; it != children.end(); it++) {
+        if (isTerminal(*it, stopToken)) return;
+        if ((*it)->getExprId() == E_STMT) this->statement(*it);
+    }
+}
+
+void Lowering::statement(Node *statement) {
+    if (statement->getChildCount() == 0) return;
+    Node *inner = (*statement)[0];
+    switch (inner->getExprId()) {
+        case E_ASGNSTMT: this->assignment(inner); break;
+        case E_IFSTMT: this->ifStatement(inner); break;
+        case E_LPSTMT: this->loopStatement(inner); break;
+        case E_RTRNSTMT: this->returnStatement(inner); break;
+    }
+}
+
+void Lowering::assignment(Node *assignment) {
+    Node *destination = (*assignment)[0];
+    Node *expression = (*assignment)[2];
+    const Word &where = (*destination)[0]->readTerminal();
+    Variable *variable = this->variableOf[(*destination)[0]];
+
+    if (destination->getChildCount() > 1) {
+        if (variable->length == 0) {
+            this->error(where, variable->name + " isn't an array");
+            return;
+        }
+        Instruction *index = this->convert(this->value((*destination)[2]), IR_INT, where);
+        Instruction *stored = this->convert(this->value(expression), variable->type, where);
+        Instruction *store = this->emit(OP_STORE, IR_VOID, this->checkedElement(variable, index), stored);
+        store->elemType = variable->type;
+    }
+    else if (variable->length > 0) this->arrayAssignment(variable, expression, where);
+    else {
+        Instruction *stored = this->convert(this->value(expression), variable->type, where);
+        if (this->inSsa(variable)) this->writeVariable(variable, this->current, stored);
+        else {
+            Instruction *store = this->emit(OP_STORE, IR_VOID, this->addressOf(variable), stored);
+            store->elemType = variable->type;
+        }
+    }
+}
+
+// a whole array assigned at once, as a loop assigning each element with
+// every unindexed array in the expression read at the same position
+void Lowering::arrayAssignment(Variable *variable, Node *expression, const Word &where) {
+    Block *header = this->function->addBlock(), *body = this->function->addBlock(), *exit = this->function->addBlock();
+    Instruction *start = this->zero(IR_INT);
+    Instruction *length = this->constant(IR_INT, variable->length);
+    this->function->branch(this->current, header);
+
+    this->current = header;
+    Instruction *counter = this->function->create(OP_PHI, IR_INT);
+    header->append(counter);
+    this->function->condBranch(header, this->emit(OP_LT, IR_BOOL, counter, length), body, exit);
+    this->seal(body);
+    this->seal(exit);
+
+    this->current = body;
+    this->elementIndex = counter;
+    this->elementLength = variable->length;
+    Instruction *stored = this->convert(this->value(expression), variable->type, where);
+    this->elementIndex = NULL;
+    Instruction *store = this->emit(OP_STORE, IR_VOID, this->element(variable, counter), stored);
+    store->elemType = variable->type;
+    Instruction *next = this->emit(OP_ADD, IR_INT, counter, this->constant(IR_INT, 1));
+    this->function->branch(this->current, header);
+
+    counter->addOperand(start);
+    counter->addOperand(next);
+    this->seal(header);
+    this->current = exit;
+}
+
+Instruction *Lowering::condition(Node *expression) {
+    Instruction *value = this->value(expression);
+    if (value->type == IR_BOOL) return value;
+    if (value->type == IR_INT) return this->emit(OP_ITOB, IR_BOOL, value);
+    this->error(firstWord(expression), std::string("a condition can't be ") + irTypeName(value->type));
+    return this->zero(IR_BOOL);
+}
+
+void Lowering::ifStatement(Node *statement) {
+    Instruction *test = this->condition((*statement)[2]);
+    std::list<Node*> children = statement->getChildren();
+    std::list<Node*>::iterator elseAt = children.begin();
+    while (elseAt != children.end() && !isTerminal(*elseAt, T_ELSE)) elseAt++;
+    bool hasElse = elseAt != children.end();
+
+    Block *thenBlock = this->function->addBlock();
+    Block *elseBlock = hasElse ? this->function->addBlock() : NULL;
+    Block *join = this->function->addBlock();
+    this->function->condBranch(this->current, test, thenBlock, hasElse ? elseBlock : join);
+
+    this->seal(thenBlock);
+    this->current = thenBlock;
+    this->statements(children, std::next(children.begin(), 5), hasElse ? T_ELSE : T_END);
+    this->function->branch(this->current, join);
+
+    if (hasElse) {
+        this->seal(elseBlock);
+        this->current = elseBlock;
+        this->statements(children, std::next(elseAt), T_END);
+        this->function->branch(this->current, join);
+    }
+
+    this->seal(join);
+    this->current = join;
+}
+
+// for (init; test) body end for runs init, then body while test holds
+void Lowering::loopStatement(Node *statement) {
+    this->assignment((*statement)[2]);
+
+    Block *header = this->function->addBlock();
+    this->function->branch(this->current, header);
+    this->current = header;
+    Instruction *test = this->condition((*statement)[4]);
+
+    Block *body = this->function->addBlock(), *exit = this->function->addBlock();
+    this->function->condBranch(this->current, test, body, exit);
+    this->seal(body);
+    this->seal(exit);
+
+    this->current = body;
+    std::list<Node*> children = statement->getChildren();
+    this->statements(children, std::next(children.begin(), 6), T_END);
+    this->function->branch(this->current, header);
+
+    this->seal(header);
+    this->current = exit;
+}
+
+// a return from the program's own body ends the program
+void Lowering::returnStatement(Node *statement) {
+    Instruction *returned = this->value((*statement)[1]);
+    if (this->procedure == this->main) this->emit(OP_RET, IR_VOID);
+    else this->emit(OP_RET, IR_VOID, this->convert(returned, this->procedure->returnType, firstWord(statement)));
+    this->current = this->deadBlock();
+}
+
+// ****************************************************
+// expressions
+
+// expression, mathop, relation and term all chain a left operand through
+// their prime nodes, evaluated left to right
+Instruction *Lowering::value(Node *node) {
+    switch (node->getExprId()) {
+        case E_FACTOR:
+            return this->factor(node);
+        case E_EXPR: case E_MATHOP: case E_REL: case E_TERM: {
+            bool inverted = isTerminal((*node)[0], T_NOT);
+            Instruction *result = this->value((*node)[inverted ? 1 : 0]);
+            if (inverted) {
+                if (result->type != IR_INT && result->type != IR_BOOL) {
+                    this->error((*node)[0]->readTerminal(), std::string("\"NOT\" can't apply to ") + irTypeName(result->type));
+                }
+                else result = this->emit(OP_NOT, result->type, result);
+            }
+
+            Node *prime = (*node)[inverted ? 2 : 1];
+            while (prime->getChildCount() == 3) {
+                Instruction *rhs = this->value((*prime)[1]);
+                result = this->binary((*prime)[0]->readTerminal(), result, rhs);
+                prime = (*prime)[2];
+            }
+            return result;
+        }
+    }
+    this->error(firstWord(node), "malformed expression");
+    return this->zero(IR_INT);
+}
+
+Instruction *Lowering::factor(Node *factor) {
+    Node *first = (*factor)[0];
+    if (isTerminal(first, T_LPAREN)) return this->value((*factor)[1]);
+
+    if (isTerminal(first, T_SUB)) {
+        Node *negated = (*factor)[1];
+        Instruction *operand = NULL;
+        if (negated->getExprId() == E_NAME) operand = this->name(negated);
+        else if (negated->getExprId() == E_PROCCALL) operand = this->call(negated);
+        else {
+            // a negative literal
+            const Word &literal = negated->readTerminal();
+            if (literal.tokenType == T_FLITERAL) return this->constant(IR_FLOAT, 0, -literal.floatValue);
+            return this->constant(IR_INT, -(unsigned)literal.intValue);
+        }
+        if (operand->type != IR_INT && operand->type != IR_FLOAT) {
+            this->error(first->readTerminal(), std::string("\"-\" can't apply to ") + irTypeName(operand->type));
+            return operand;
+        }
+        return this->emit(OP_NEG, operand->type, operand);
+    }
+
+    switch (first->getExprId()) {
+        case E_NAME: return this->name(first);
+        case E_PROCCALL: return this->call(first);
+        case E_EXPR: case E_MATHOP: case E_REL: case E_TERM: case E_FACTOR: return this->value(first);
+    }
+
+    const Word &literal = first->readTerminal();
+    switch (literal.tokenType) {
+        case T_ILITERAL: return this->constant(IR_INT, literal.intValue);
+        case T_FLITERAL: return this->constant(IR_FLOAT, 0, literal.floatValue);
+        case T_SLITERAL: return this->constant(IR_STRING, 0, 0.0, literal.tokenString);
+        case T_TRUE: return this->constant(IR_BOOL, 1);
+        case T_FALSE: return this->constant(IR_BOOL, 0);
+    }
+    this->error(literal, "malformed factor");
+    return this->zero(IR_INT);
+}
+
+Instruction *Lowering::name(Node *name) {
+    const Word &where = (*name)[0]->readTerminal();
+    Variable *variable = this->variableOf[(*name)[0]];
+    Instruction *address;
+
+    if (name->getChildCount() > 1) {
+        if (variable->length == 0) {
+            this->error(where, variable->name + " isn't an array");
+            return this->zero(variable->type);
+        }
+        Instruction *index = this->convert(this->value((*name)[2]), IR_INT, where);
+        address = this->checkedElement(variable, index);
+    }
+    else if (variable->length > 0) {
+        if (this->elementIndex == NULL) {
+            this->error(where, "array " + variable->name + " used where a single value belongs");
+            return this->zero(variable->type);
+        }
+        if (variable->length != this->elementLength) {
+            this->error(where, "array " + variable->name + " has " + std::to_string(variable->length)
+                + " elements, not " + std::to_string(this->elementLength));
+            return this->zero(variable->type);
+        }
+        address = this->element(variable, this->elementIndex);
+    }
+    else if (this->inSsa(variable)) return this->readVariable(variable, this->current);
+    else address = this->addressOf(variable);
+
+    Instruction *load = this->emit(OP_LOAD, variable->type, address);
+    load->elemType = variable->type;
+    return load;
+}
+
+Instruction *Lowering::call(Node *call) {
+    const Word &where = (*call)[0]->readTerminal();
+    Procedure *callee = this->procedureOf[(*call)[0]];
+    Function *target = this->functionFor(callee);
+
+    std::vector<Node*> arguments;
+    std::list<Node*> children = (*call)[2]->getChildren();
+    for (Node *child : children) {
+        if (child->getExprId() == E_EXPR) arguments.push_back(child);
+    }
+    if (arguments.size() != callee->params.size()) {
+        this->error(where, callee->name + " takes " + std::to_string(callee->params.size()) + " argument(s)");
+        return this->zero(callee->returnType);
+    }
+
+    std::vector<Instruction*> values;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        Variable *param = callee->params[i];
+        if (param->length == 0) {
+            values.push_back(this->convert(this->value(arguments[i]), param->type, firstWord(arguments[i])));
+            continue;
+        }
+
+        // arrays go by address, the callee makes its own copy
+        Node *passed = bareName(arguments[i]);
+        Variable *array = passed == NULL ? NULL : this->variableOf[(*passed)[0]];
+        if (array == NULL || array->length != param->length || array->type != param->type) {
+            this->error(firstWord(arguments[i]), callee->name + " takes an array of " + std::to_string(param->length)
+                + " " + irTypeName(param->type) + " as argument " + std::to_string(i + 1));
+            return this->zero(callee->returnType);
+        }
+        values.push_back(this->addressOf(array));
+    }
+    for (Variable *captured : callee->captures) values.push_back(this->addressOf(captured));
+
+    Instruction *result = this->emit(OP_CALL, target->returnType);
+    result->name = target->name;
+    for (Instruction *argument : values) result->addOperand(this->resolved(argument));
+    return result;
+}
+
+// ****************************************************
+// ssa construction
+
+void Lowering::writeVariable(Variable *variable, Block *block, Instruction *value) {
+    this->currentDef[variable][block] = value;
+}
+
+Instruction *Lowering::readVariable(Variable *variable, Block *block) {
+    std::unordered_map<Block*, Instruction*> &defs = this->currentDef[variable];
+    std::unordered_map<Block*, Instruction*>::iterator found = defs.find(block);
+    if (found != defs.end()) return this->resolved(found->second);
+    return this->readVariableRecursive(variable, block);
+}
+
+Instruction *Lowering::readVariableRecursive(Variable *variable, Block *block) {
+    Instruction *value;
+    if (this->sealed.count(block) == 0) {
+        // predecessors are still coming, settle the phi when the block is sealed
+        value = this->function->create(OP_PHI, variable->type);
+        block->instructions.push_front(value);
+        value->block = block;
+        this->incompletePhis[block].push_back(std::make_pair(variable, value));
+    }
+    else if (block->preds.size() == 1) value = this->readVariable(variable, block->preds[0]);
+    else if (block->preds.empty()) {
+        // only unreachable blocks have no predecessors after the entry
+        value = this->function->create(OP_CONST, variable->type);
+        block->insertAfterPhis(value);
+    }
+    else {
+        Instruction *phi = this->function->create(OP_PHI, variable->type);
+        block->instructions.push_front(phi);
+        phi->block = block;
+        this->writeVariable(variable, block, phi); // breaks cycles through loops
+        value = this->addPhiOperands(variable, phi);
+    }
+    this->writeVariable(variable, block, value);
+    return value;
+}
+
+Instruction *Lowering::addPhiOperands(Variable *variable, Instruction *phi) {
+    std::vector<Block*> preds = phi->block->preds;
+    for (Block *pred : preds) phi->addOperand(this->readVariable(variable, pred));
+    return this->tryRemoveTrivialPhi(phi);
+}
+
+// a phi merging only itself and one other value is that value
+Instruction *Lowering::tryRemoveTrivialPhi(Instruction *phi) {
+    Instruction *same = NULL;
+    for (Instruction *operand : phi->operands) {
+        if (operand == same || operand == phi) continue;
+        if (same != NULL) return phi;
+        same = operand;
+    }
+    if (same == NULL) {
+        same = this->function->create(OP_CONST, phi->type);
+        phi->block->insertAfterPhis(same);
+    }
+
+    std::vector<Instruction*> users;
+    for (Instruction *user : phi->users) {
+        if (user != phi) users.push_back(user);
+    }
+    phi->replaceAllUsesWith(same);
+    this->replaced[phi] = same;
+    phi->dropOperands();
+    phi->block->unlink(phi);
+    this->removedPhis.push_back(phi);
+
+    for (Instruction *user : users) {
+        if (user->op == OP_PHI && user->block != NULL) this->tryRemoveTrivialPhi(user);
+    }
+    return this->resolved(same);
+}
+
+void Lowering::seal(Block *block) {
+    std::vector<std::pair<Variable*, Instruction*>> pending = this->incompletePhis[block];
+    this->incompletePhis.erase(block);
+    this->sealed.insert(block);
+    for (size_t i = 0; i < pending.size(); i++) this->addPhiOperands(pending[i].first, pending[i].second);
+}
+
+// ****************************************************
+
+Module *Lowering::run(Node *tree) {
+    this->module = new Module();
+    this->scopes.push_back(std::unordered_map<std::string, Symbol>());
+
+    this->declareBuiltin("GETBOOL", IR_BOOL, IR_VOID);
+    this->declareBuiltin("GETINTEGER", IR_INT, IR_VOID);
+    this->declareBuiltin("GETFLOAT", IR_FLOAT, IR_VOID);
+    this->declareBuiltin("GETSTRING", IR_STRING, IR_VOID);
+    this->declareBuiltin("PUTBOOL", IR_BOOL, IR_BOOL);
+    this->declareBuiltin("PUTINTEGER", IR_BOOL, IR_INT);
+    this->declareBuiltin("PUTFLOAT", IR_BOOL, IR_FLOAT);
+    this->declareBuiltin("PUTSTRING", IR_BOOL, IR_STRING);
+    this->declareBuiltin("SQRT", IR_FLOAT, IR_INT);
+
+    this->main = new Procedure();
+    this->main->name = this->main->symbol = "main";
+    this->main->body = (*tree)[1];
+
+    this->declareBody(this->main->body, this->main);
+    this->procedures.push_back(this->main);
+    this->findCaptures();
+    if (this->errors > 0) {
+        delete this->module;
+        return NULL;
+    }
+
+    // every signature first, so calls can be checked against them
+    for (Procedure *procedure : this->procedures) {
+        if (procedure->builtin) continue;
+        Function *function = this->module->addFunction(procedure->symbol, procedure->returnType);
+        for (Variable *param : procedure->params) {
+            function->paramTypes.push_back(param->length > 0 ? IR_PTR : param->type);
+            function->paramNames.push_back(param->name);
+        }
+        for (Variable *captured : procedure->captures) {
+            function->paramTypes.push_back(IR_PTR);
+            function->paramNames.push_back("&" + captured->name);
+        }
+    }
+    for (Procedure *procedure : this->procedures) {
+        if (!procedure->builtin) this->lowerProcedure(procedure);
+    }
+
+    if (this->errors > 0) {
+        delete this->module;
+        return NULL;
+    }
+    return this->module;
+}
+
+Module *lowerProgram(Node *tree, bool debug) {
+    ALLOC_SUBSYSTEM(ALLOC_IR);
+    Lowering lowering(debug);
+    Module *module = lowering.run(tree);
+    return module;
+}
@@ -0,0 +1,21 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "ir.h"
+#include "parser.h"
+
+// builds the ssa form of a program from the tree the parser checked
+//
+// every procedure becomes a function named by its path through the procedures
+// enclosing it (OUTER.INNER), the program's own statements become @main, and
+// program level and "global" variables become module globals. scalar locals and
+// parameters live in ssa values, arrays and locals a nested procedure uses live
+// in allocas, and a nested procedure gets the address of each outer local it
+// touches as an extra parameter, so no function ever needs a static link
+//
+// problems the parser lets through (arrays of the wrong length, an array where
+// a single value belongs) are reported like the parser's errors: printed, then
+// fatal unless debugging, in which case NULL comes back
+Module *lowerProgram(Node *tree, bool debug);
+
+#endif
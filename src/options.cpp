@@ -0,0 +1,35 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstring>
+#include "driver.h"
+
+// reads the flags following the filename, starting at argv[first]
+CompileOptions parseOptions(int argc, char **argv, int first) {
+    CompileOptions options;
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "-debug") == 0) options.debug = true;
+        else if (strcmp(argv[i], "-nocache") == 0) options.useCache = false;
+        else if (strcmp(argv[i], "-cachestats") == 0) options.cacheStats = true;
+        else if (strcmp(argv[i], "-stats") == 0) options.stats = true;
+        else if (strcmp(argv[i], "-trace") == 0) options.trace = true;
+        else if (strcmp(argv[i], "-perf") == 0) options.perf = options.stats = true;
+        else if (strcmp(argv[i], "-ir") == 0) options.ir = true;
+        else if (strcmp(argv[i], "-interp") == 0) options.interp = options.ir = true;
+        else if (strcmp(argv[i], "-vm") == 0) options.vm = options.ir = true;
+        else if (strcmp(argv[i], "-O0") == 0) options.optimize = 0;
+        else if (strcmp(argv[i], "-O1") == 0) options.optimize = 1;
+        else if (strcmp(argv[i], "-O2") == 0) options.optimize = 2;
+        else if (strncmp(argv[i], "-passes=", 8) == 0) options.passes = argv[i] + 8;
+        else if (strcmp(argv[i], "-ffast-math") == 0) options.fastMath = true;
+        else if (strcmp(argv[i], "-native") == 0) options.native = options.ir = true;
+        else if (strcmp(argv[i], "-fno-regalloc") == 0) options.registers = false;
+        else if (strcmp(argv[i], "-fno-isel") == 0) options.tiling = false;
+        else if (strcmp(argv[i], "-fno-vectorize") == 0) options.vectorize = false;
+        else if (strcmp(argv[i], "-S") == 0) options.assembly = true;
+        else if (strcmp(argv[i], "-static") == 0) options.standalone = true;
+        else if (strcmp(argv[i], "-run") == 0) options.run = options.native = options.ir = true;
+    }
+    // a program run in place needs machine code, and is never linked
+    if (options.run) options.assembly = options.standalone = false;
+    return options;
+}
@@ -1,13 +1,17 @@
 //  recursive descent compiler by Andrew Miller
 
 #include <stdlib.h>
+#include "capture.h"
+#include "incremental.h"
 #include "parser.h"
 #include "scanner.h"
+#include "stats.h"
+#include "trace.h"
 #include "word.h"
 #include "symboltable.h"
 
 // used to recursively print every node in the parse tree
-void Node::printNode(std::ofstream &file, int layer) {
+void Node::printNode(std::ostream &file, int layer) {
     file << "\n";
     for (int i = 0; i < layer; i++) {
         file << "\t";
@@ -34,16 +38,14 @@ Node *Node::operator[](size_t index) const {
     return (*it);
 }
 
-// outputs the tree to path
-void ParserTree::outputTree(std::string path) {
-    std::ofstream treeOut;
-    treeOut.open(path, std::ofstream::out | std::ofstream::trunc);
+// outputs the tree to a stream
+void ParserTree::outputTree(std::ostream &treeOut) {
     (*head).printNode(treeOut, 0);
-    treeOut.close();
 }
 
 // constructs the parser with the wordlist from the scanner and the symbol table generated
 Parser::Parser(std::list<Word> words, SymbolTable table, bool debugMode) {
+    ALLOC_SUBSYSTEM(ALLOC_PARSER);
     this->wordList = words;
     this->symbolTable = table;
     this->tree = ParserTree();
@@ -53,8 +55,8 @@ Parser::Parser(std::list<Word> words, SymbolTable table, bool debugMode) {
     this->scopes.push(Word("GLOBAL", 0, 0, 0));
 }
 
-void Parser::printTree(std::string path) {
-    this->tree.outputTree(path);
+void Parser::printTree(std::ostream &treeOut) {
+    this->tree.outputTree(treeOut);
 }
 
 Word Parser::peek() { 
@@ -92,6 +94,7 @@ void Parser::printLocation(std::string locationDesc) {
 // alerts user of error in the grammar
 void Parser::parsingError(std::string expected) {
     if (this->debug) this->printLocation("Entered parsingError(string)");
+    this->errors++;
 
     Word next = this->peek();
     std::cout << "Error (" << next.line << ", " << next.col << "): "
@@ -103,6 +106,7 @@ void Parser::parsingError(std::string expected) {
 // alerts of error without suggestion
 void Parser::parsingError() {
     if (this->debug) this->printLocation("Entered parsingError()");
+    this->errors++;
 
     Word next = this->peek();
     std::cout << "Error (" << next.line << ", " << next.col << "): "
@@ -113,6 +117,7 @@ void Parser::parsingError() {
 // alerts of out of scope or undeclared identifier usage
 void Parser::identifierNotFoundError() {
     if (this->debug) this->printLocation("Entered identifierNotFoundError()");
+    this->errors++;
     Word next = this->peek();
     std::cout << "Identifier not declared or is being used out of scope "
         << "(" << next.line << "," << next.col << ")\n";
@@ -122,6 +127,7 @@ void Parser::identifierNotFoundError() {
 // alerts of a double declaration within the local scope
 void Parser::doubleDeclarationError(bool globalFlag) {
     if (this->debug) this->printLocation("Entered doubleDeclarationError()");
+    this->errors++;
 
     Word next = this->peek();
     Word topScope = this->scopes.top();
@@ -135,6 +141,7 @@ void Parser::doubleDeclarationError(bool globalFlag) {
 // alerts of a non-int array bound arg
 void Parser::arrayBadBoundsError(Node *name) {
     if (this->debug) this->printLocation("Entered arrayBadBoundsError()");
+    this->errors++;
     Word expression = name->getChildTerminal(2);
     std::cout << "Array bound needs to be an integer. (" << expression.line
         << "," << expression.col << ")\n";
@@ -145,6 +152,7 @@ void Parser::arrayBadBoundsError(Node *name) {
 // invalid use of operator on a certain type
 void Parser::wrongOperatorError(Word op, Word type) {
     if (this->debug) this->printLocation("Entered wrongOperatorError(Word Word)");
+    this->errors++;
     std::cout << "(" << type.line << "," << type.col << ") Invalid use of \"" 
         << op.tokenString << "\" operator with operand of type \"" << type.dataType << "\"\n";
         
@@ -154,6 +162,7 @@ void Parser::wrongOperatorError(Word op, Word type) {
 // invalid use of operator on two certain types
 void Parser::wrongOperatorError(Word op, Word type1, Word type2) {
     if (this->debug) this->printLocation("Entered wrongOperatorError(Word Word Word)");
+    this->errors++;
     std::cout << "Invalid use of \"" << op.tokenString << "\" operator with operands of type \"" 
         << type1.dataType << "\" and \"" << type2.dataType << "\"\n";
         
@@ -163,6 +172,7 @@ void Parser::wrongOperatorError(Word op, Word type1, Word type2) {
 // something should've resolved to a different type
 void Parser::wrongTypeResolutionError(int expected, int received, int line, int col) {
     if (this->debug) this->printLocation("Entered wrongTypeResolutionError()");
+    this->errors++;
     std::string expectedName = "", receivedName = "";
     switch (expected) {
         case T_INTEGER : expectedName = "int";
@@ -198,6 +208,7 @@ Node *Parser::follow(std::string expectedTokenString) {
 // Finds a match for an identifier during declaration
 Node *Parser::followUndeclared(bool globalFlag) {
     if (this->debug) this->printLocation("Entered followUndeclared(bool)");
+    SemanticScope timing;
 
     Word nextWord = this->peek();
     Word topScope = this->scopes.top();
@@ -218,6 +229,7 @@ Node *Parser::followUndeclared(bool globalFlag) {
 // Finds an identifier that already exists in the symbol table
 Node *Parser::followDeclared() {
     if (this->debug) this->printLocation("Entered followDeclare()");
+    SemanticScope timing;
 
     Word nextWord = this->peek();
     Record expected = this->symbolTable.lookup(nextWord.tokenString, this->scopes, this->debug);
@@ -261,6 +273,7 @@ Node *Parser::followLiteral(int literalType) {
 // Make record in the symbol table
 void Parser::createSymbol(Word token, bool globalFlag) {
     if (this->debug) this->printLocation("Entered createSymbol()");
+    SemanticScope timing;
 
     // ensure symbol isn't already in the local scope
     Record expected = this->symbolTable.lookup(token.tokenString, this->scopes.top());
@@ -280,6 +293,7 @@ void Parser::createSymbol(Word token, bool globalFlag) {
 // used for expression, mathop, relation, and term
 int Parser::findPrimeGrammarType(Node *gram, Node *lhs) {
     if (this->debug) this->printLocation("Entered findPrimeGrammarType()");
+    SemanticScope timing;
 
     // master node of these structures has different children
     if (lhs == NULL) {
@@ -314,6 +328,7 @@ int Parser::findPrimeGrammarType(Node *gram, Node *lhs) {
 
 bool Parser::checkValidTypeConversion(Word to, Word from) {
     if (this->debug) this->printLocation("Entered checkValidTypeConversion()");
+    SemanticScope timing;
 
     switch (to.dataType) {
         case T_INTEGER :
@@ -366,6 +381,7 @@ int Parser::findResultType(Word lhs, Word op, Word rhs) {
 // populates parser tree using wordList and left recursion with single lookahead
 // looks for program header, program body, and then a period
 void Parser::parse() {
+    ALLOC_SUBSYSTEM(ALLOC_PARSER);
     if (this->debug) this->printLocation("Entered parse()");
 
     Node *top = this->tree.getHead();
@@ -453,12 +469,50 @@ Node *Parser::declaration() {
 // procedure header and procedure body
 Node *Parser::procDeclaration(bool globalFlag) {
     if (this->debug) this->printLocation("Entered procDeclaration()");
+    TraceSpan tracing("procDeclaration", "procedure");
 
     Node *procedure = new Node(E_PROCDEC);
 
+    // top level procedures can be reused whole from an earlier compile
+    ProcSpan *span = NULL;
+    if (this->reuse != NULL && this->scopes.size() == 1) span = this->reuse->nextProcedure();
+    size_t wordsLeft = this->wordList.size();
+
     // baseline procedure parts (much like parse() but smaller)
     procedure->addChild(this->procHeader(globalFlag));
-    procedure->addChild(this->procBody());
+    tracing.label(this->scopes.top().tokenString);
+
+    // the header is always parsed so the symbol table learns the signature,
+    // if it doesn't line up with the pre-pass then stop trusting the spans
+    if (span != NULL && (wordsLeft - this->wordList.size() != (size_t)span->headerWords
+        || (*procedure)[0]->getChildCount() < 2
+        || (*procedure)[0]->getChildTerminal(1).tokenString != span->name)) {
+        span = NULL;
+        this->reuse = NULL;
+    }
+
+    Node *body = (span != NULL) ? this->reuse->load(*span) : NULL;
+    if (body != NULL) {
+        procedure->addChild(this->reuseProcBody(span, body));
+        return procedure;
+    }
+
+    if (span == NULL) {
+        procedure->addChild(this->procBody());
+        return procedure;
+    }
+
+    // only bodies that analyzed cleanly, without a word printed, are kept
+    wordsLeft = this->wordList.size();
+    std::streambuf *console = std::cout.rdbuf();
+    CaptureBuf capture(console);
+    std::cout.rdbuf(&capture);
+    body = this->procBody();
+    std::cout.rdbuf(console);
+    if (capture.captured.empty() && wordsLeft - this->wordList.size() == (size_t)span->bodyWords) {
+        this->reuse->store(*span, body);
+    }
+    procedure->addChild(body);
 
     return procedure;
 }
@@ -500,6 +554,8 @@ Node *Parser::procHeader(bool globalFlag) {
 // statements with semicolon terminal, "end", "procedure"
 Node *Parser::procBody() {
     if (this->debug) this->printLocation("Entered procBody()");
+    TraceSpan tracing("procBody", "procedure");
+    tracing.label(this->scopes.top().tokenString);
 
     Word nextWord = this->peek();
 
@@ -538,6 +594,44 @@ Node *Parser::procBody() {
 
 }
 
+// stands in for procBody() when an unchanged procedure's analyzed body is reused
+// skips its words and replays the only lasting effect the body has on the
+// symbol table: whatever it declared global
+Node *Parser::reuseProcBody(ProcSpan *span, Node *body) {
+    if (this->debug) this->printLocation("Entered reuseProcBody()");
+    TraceSpan tracing("reuseProcBody", "procedure");
+    tracing.label(span->name);
+
+    for (int i = 0; i < span->bodyWords; i++) this->wordList.pop_front();
+    this->declareReusedGlobals(body);
+
+    Word oldScope = this->scopes.top();
+    this->scopes.pop();
+    this->symbolTable.removeScope(oldScope);
+
+    return body;
+}
+
+// creates the symbols for every "global" declaration inside a reused subtree
+void Parser::declareReusedGlobals(Node *node) {
+    std::list<Node*> children = node->getChildren();
+    if (node->getExprId() == E_DECLARE && children.size() == 2
+        && children.front()->getTerminal().tokenType == T_GLOBAL) {
+        Node *declared = children.back();
+        if (declared->getExprId() == E_VARDEC) {
+            this->createSymbol(declared->getTerminal(), true);
+        }
+        else if (declared->getExprId() == E_PROCDEC) {
+            Node *header = (*declared)[0];
+            Word procWord = header->getChildTerminal(1);
+            procWord.dataType = header->getChildTerminal(3).tokenType;
+            this->createSymbol(procWord, true);
+        }
+    }
+
+    for (Node *child : children) this->declareReusedGlobals(child);
+}
+
 // [parameter and comma terminal and param list] OR 
 // just parameter (no comma)
 Node *Parser::paramList() {
@@ -687,6 +781,7 @@ Node *Parser::procCall() {
     // SA: ensure that argList matches argTypes list from the proc id's Record in the table
     std::list<int> paramTypes = (*procCall)[0]->getTerminal().procParamTypes;
     if (paramTypes != (*procCall)[2]->getTerminal().procParamTypes) {
+        this->errors++;
         std::cout << "(" << procCall->getTerminal().line << "," << procCall->getTerminal().col 
             << ") Error: arg list types do not match proc header.\n";
         std::cout << "paramList: ";
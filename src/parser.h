@@ -5,6 +5,7 @@
 #include <list>
 #include <memory>
 #include <type_traits>
+#include "stats.h"
 #include "symboltable.h"
 #include "word.h"
 
@@ -48,18 +49,19 @@ class Node {
 
     public:
         // constructors
-        Node() = default;
-        Node(int id) { exprId = id; }
-        Node(Word term) { terminal = term; }
+        Node() { hotCounters.nodes++; }
+        Node(int id) { exprId = id; hotCounters.nodes++; }
+        Node(Word term) { terminal = term; hotCounters.nodes++; }
 
         // output
-        void printNode(std::ofstream &file, int layer);
+        void printNode(std::ostream &file, int layer);
 
         // getters
         std::list<Node*> getChildren() { return children; }
         int getExprId() { return exprId; }
         int getChildCount() { return childCount; }
         Word getTerminal() { return terminal; }
+        const Word &readTerminal() const { return terminal; } // no copy, for walking finished trees
         Word getChildTerminal(int index) {
             auto it = std::next(children.begin(), index);
             return (*it)->getTerminal();
@@ -90,15 +92,20 @@ class ParserTree {
     public:
         ParserTree() { head = new Node(1); }
         Node *getHead() { return head; }
-        void outputTree(std::string path);
+        void outputTree(std::ostream &treeOut);
 };
 
+class ProcedureReuse;
+struct ProcSpan;
+
 class Parser {
     std::list<Word> wordList;
     std::stack<Word> scopes;
     ParserTree tree;
     SymbolTable symbolTable;
     bool debug;
+    ProcedureReuse *reuse = NULL; // optional source of unchanged procedure bodies
+    int errors = 0; // errors reported, fatal or not
     
     // analyzing token stream;
     Word peek();
@@ -132,6 +139,8 @@ class Parser {
     Node *procDeclaration(bool globalFlag);
     Node *procHeader(bool globalFlag);
     Node *procBody();
+    Node *reuseProcBody(ProcSpan *span, Node *body);
+    void declareReusedGlobals(Node *node);
     Node *paramList();
     Node *param();
     Node *varDeclaration(bool globalFlag);
@@ -158,7 +167,10 @@ class Parser {
     public:
         Parser(std::list<Word> words, SymbolTable table, bool debugMode);
         void parse(); // represents <program> from the syntax cfg
-        void printTree(std::string path);
+        void setProcedureReuse(ProcedureReuse *procedures) { reuse = procedures; }
+        void printTree(std::ostream &treeOut);
+        Node *getTree() { return tree.getHead(); }
+        int errorCount() { return errors; }
 };
 
 #endif
\ No newline at end of file
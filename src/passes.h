@@ -0,0 +1,67 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include "passmanager.h"
+
+// the optimization passes, each registered by name in passmanager.cpp
+
+// copies the bodies of small procedures into their callers, weighing the
+// callee's size against what the call costs, more generously inside loops and
+// for procedures called from one place only. recursive procedures stay calls
+int inlineCalls(Function *function, AnalysisCache &analyses);
+
+// folds branches on constants, drops unreachable blocks, merges a block into
+// its only predecessor and forwards edges through blocks that only branch
+int simplifyCfg(Function *function, AnalysisCache &analyses);
+
+// sparse conditional constant propagation: folds int, float and bool
+// arithmetic, comparisons and conversions whose operands are constant on every
+// edge that can run, then turns branches that can only go one way into brs
+// and drops the blocks nothing reaches any more
+int propagateConstants(Function *function, AnalysisCache &analyses);
+
+// global value numbering over the dominator tree: an instruction computing
+// what one dominating it already did, arithmetic, a comparison, an array
+// element's address or a load from memory nothing has written since, is
+// replaced by it. a load after a store to the same place takes the stored value
+int numberValues(Function *function, AnalysisCache &analyses);
+
+// gives every loop a preheader and exits reached only from inside it, then
+// hoists what the loop computes the same way every time round, loads of
+// memory it doesn't write included, and keeps variables and constant
+// elements only the loop touches in values, stored back on the way out
+int hoistLoopInvariants(Function *function, AnalysisCache &analyses);
+
+// finds each loop's basic induction variables, merges those that step alike
+// from the same start, and turns a multiplication of one by something
+// invariant into a variable of its own that the latch adds to
+int simplifyInductionVariables(Function *function, AnalysisCache &analyses);
+
+// drops array bounds checks a value range, narrowed by the branches and
+// checks dominating them, shows can't fail, and gives a counted one block
+// loop still checking its variable plus a constant an unchecked copy ahead
+// of it, run only while none of those checks could fail
+int eliminateBoundsChecks(Function *function, AnalysisCache &analyses);
+
+// puts an unrolled copy of each counted one block loop ahead of it, running
+// several bodies a test while enough are left, with accumulators split
+// into partial results. floats only with fastMath. with vectors, a loop
+// whose body is lanewise arithmetic on the elements it indexes does them
+// as vector instructions instead
+int unrollLoops(Function *function, AnalysisCache &analyses);
+
+// drops stores nothing can read before the place is surely written again or
+// the function returns. main's stores to globals die with the program
+int eliminateDeadStores(Function *function, AnalysisCache &analyses);
+
+// turns self calls whose result is returned, as is or after an add, mul,
+// and or or an accumulator can take over, into a loop back to the start.
+// other calls returned as is are marked tail
+int eliminateTailCalls(Function *function, AnalysisCache &analyses);
+
+// aggressive dead code elimination: only rets, stores, checks, calls to
+// anything but pure runtime routines, and what they need are kept. branches nothing live
+// depends on go straight to their postdominator, loops stay
+int eliminateDeadCode(Function *function, AnalysisCache &analyses);
+
+#endif
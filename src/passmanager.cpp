@@ -0,0 +1,199 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <sstream>
+#include "passes.h"
+#include "passmanager.h"
+#include "stats.h"
+#include "verify.h"
+
+const char *analysisNames[ANALYSES] = {"cfg", "dominators", "loops", "liveness", "reaching stores", "postdominators"};
+
+const PassInfo passes[] = {
+    {"inline", inlineCalls},
+    {"simplifycfg", simplifyCfg},
+    {"sccp", propagateConstants},
+    {"gvn", numberValues},
+    {"licm", hoistLoopInvariants},
+    {"indvars", simplifyInductionVariables},
+    {"bounds", eliminateBoundsChecks},
+    {"unroll", unrollLoops},
+    {"dse", eliminateDeadStores},
+    {"dce", eliminateDeadCode},
+    {"tailcall", eliminateTailCalls},
+    {NULL, NULL},
+};
+
+const char *pipelines[OPT_LEVELS] = {
+    "",
+    "sccp,gvn,licm,gvn,bounds,dse,dce,tailcall,simplifycfg",
+    "inline,sccp,gvn,dse,tailcall,licm,indvars,gvn,bounds,unroll,gvn,dse,dce,simplifycfg",
+};
+
+const PassInfo *findPass(std::string name) {
+    for (int i = 0; passes[i].name != NULL; i++) {
+        if (name == passes[i].name) return &passes[i];
+    }
+    return NULL;
+}
+
+Cfg &AnalysisCache::getCfg() {
+    if (this->cfg != NULL) {
+        this->reused[ANALYSIS_CFG]++;
+        return *this->cfg;
+    }
+    PhaseScope timing(analysisNames[ANALYSIS_CFG], "optimize");
+    this->computed[ANALYSIS_CFG]++;
+    this->cfg = new Cfg(this->function);
+    return *this->cfg;
+}
+
+DominatorTree &AnalysisCache::getDominators() {
+    if (this->dominators != NULL) {
+        this->reused[ANALYSIS_DOMINATORS]++;
+        return *this->dominators;
+    }
+    Cfg &cfg = this->getCfg();
+    PhaseScope timing(analysisNames[ANALYSIS_DOMINATORS], "optimize");
+    this->computed[ANALYSIS_DOMINATORS]++;
+    this->dominators = new DominatorTree(cfg);
+    return *this->dominators;
+}
+
+LoopForest &AnalysisCache::getLoops() {
+    if (this->loops != NULL) {
+        this->reused[ANALYSIS_LOOPS]++;
+        return *this->loops;
+    }
+    DominatorTree &dominators = this->getDominators();
+    PhaseScope timing(analysisNames[ANALYSIS_LOOPS], "optimize");
+    this->computed[ANALYSIS_LOOPS]++;
+    this->loops = new LoopForest(dominators.cfg, dominators);
+    return *this->loops;
+}
+
+Liveness &AnalysisCache::getLiveness() {
+    if (this->liveness != NULL) {
+        this->reused[ANALYSIS_LIVENESS]++;
+        return *this->liveness;
+    }
+    Cfg &cfg = this->getCfg();
+    PhaseScope timing(analysisNames[ANALYSIS_LIVENESS], "optimize");
+    this->computed[ANALYSIS_LIVENESS]++;
+    this->liveness = new Liveness(cfg);
+    return *this->liveness;
+}
+
+ReachingStores &AnalysisCache::getReachingStores() {
+    if (this->reaching != NULL) {
+        this->reused[ANALYSIS_REACHING]++;
+        return *this->reaching;
+    }
+    Cfg &cfg = this->getCfg();
+    PhaseScope timing(analysisNames[ANALYSIS_REACHING], "optimize");
+    this->computed[ANALYSIS_REACHING]++;
+    this->reaching = new ReachingStores(cfg);
+    return *this->reaching;
+}
+
+PostDominatorTree &AnalysisCache::getPostDominators() {
+    if (this->postdominators != NULL) {
+        this->reused[ANALYSIS_POSTDOMINATORS]++;
+        return *this->postdominators;
+    }
+    Cfg &cfg = this->getCfg();
+    PhaseScope timing(analysisNames[ANALYSIS_POSTDOMINATORS], "optimize");
+    this->computed[ANALYSIS_POSTDOMINATORS]++;
+    this->postdominators = new PostDominatorTree(cfg);
+    return *this->postdominators;
+}
+
+// the cfg, both dominator trees and loops only read blocks and edges, the
+// dataflow results also name instructions, so they go with any change at all
+void AnalysisCache::invalidate(int changes) {
+    if (changes == CHANGED_NONE) return;
+    delete this->liveness;
+    delete this->reaching;
+    this->liveness = NULL;
+    this->reaching = NULL;
+    if ((changes & CHANGED_CFG) == 0) return;
+
+    delete this->loops;
+    delete this->postdominators;
+    delete this->dominators;
+    delete this->cfg;
+    this->loops = NULL;
+    this->postdominators = NULL;
+    this->dominators = NULL;
+    this->cfg = NULL;
+}
+
+bool PassManager::setPipeline(std::string names, std::string &unknown) {
+    this->pipeline.clear();
+    std::stringstream list(names);
+    std::string name;
+    while (std::getline(list, name, ',')) {
+        if (name.empty()) continue;
+        const PassInfo *pass = findPass(name);
+        if (pass == NULL) {
+            unknown = name;
+            return false;
+        }
+        this->pipeline.push_back(pass);
+    }
+    return true;
+}
+
+bool PassManager::run(Module *module, std::ostream &errors) {
+    this->changed.assign(this->pipeline.size(), 0);
+    CallGraph callGraph(module);
+    for (size_t i = 0; i < callGraph.bottomUp.size(); i++) {
+        Function *function = callGraph.bottomUp[i];
+        if (function->external) continue;
+
+        AnalysisCache analyses(function, &callGraph);
+        analyses.fastMath = this->fastMath;
+        analyses.vectors = this->vectors;
+        this->instructionsBefore += function->instructionCount();
+        for (size_t j = 0; j < this->pipeline.size(); j++) {
+            const PassInfo *pass = this->pipeline[j];
+            int changes;
+            {
+                PhaseScope timing(pass->name, "optimize");
+                changes = pass->run(function, analyses);
+            }
+            if (changes != CHANGED_NONE) {
+                this->changed[j]++;
+                analyses.invalidate(changes);
+            }
+
+            std::ostringstream problems;
+            if (this->verifyEach && !verifyFunction(function, problems)) {
+                errors << problems.str() << "IR broken by " << pass->name << " in @" << function->name << "\n";
+                return false;
+            }
+        }
+        this->instructionsAfter += function->instructionCount();
+        for (int j = 0; j < ANALYSES; j++) {
+            this->computed[j] += analyses.computed[j];
+            this->reused[j] += analyses.reused[j];
+        }
+    }
+    return true;
+}
+
+std::string PassManager::toJson() {
+    std::ostringstream out;
+    out << "{\"instructionsBefore\": " << this->instructionsBefore << ", \"instructionsAfter\": " << this->instructionsAfter;
+    out << ", \"passes\": [";
+    for (size_t i = 0; i < this->pipeline.size(); i++) {
+        out << (i == 0 ? "" : ", ") << "{\"name\": " << jsonString(this->pipeline[i]->name)
+            << ", \"functionsChanged\": " << (i < this->changed.size() ? this->changed[i] : 0) << "}";
+    }
+    out << "], \"analyses\": {";
+    for (int i = 0; i < ANALYSES; i++) {
+        out << (i == 0 ? "" : ", ") << jsonString(analysisNames[i]) << ": {\"computed\": " << this->computed[i]
+            << ", \"reused\": " << this->reused[i] << "}";
+    }
+    out << "}}";
+    return out.str();
+}
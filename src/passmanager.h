@@ -0,0 +1,105 @@
+#ifndef PASSMANAGER_H
+#define PASSMANAGER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "analysis.h"
+#include "ir.h"
+
+// what a pass changed, so the analyses that still hold can be kept
+#define CHANGED_NONE         0
+#define CHANGED_INSTRUCTIONS 1 // instructions added, removed or rewired, blocks and edges untouched
+#define CHANGED_CFG          2 // blocks or edges, which invalidates everything
+
+// the analyses cached for a function
+#define ANALYSIS_CFG            0
+#define ANALYSIS_DOMINATORS     1
+#define ANALYSIS_LOOPS          2
+#define ANALYSIS_LIVENESS       3
+#define ANALYSIS_REACHING       4
+#define ANALYSIS_POSTDOMINATORS 5
+#define ANALYSES                6
+
+#define OPT_LEVELS 3 // -O0 to -O2
+
+extern const char *analysisNames[ANALYSES];
+
+// one function's analyses, each built on first request and kept until a pass
+// reports a change that breaks it. the references handed out are only good
+// until the next invalidate
+class AnalysisCache {
+    Function *function;
+    Cfg *cfg = NULL;
+    DominatorTree *dominators = NULL;
+    LoopForest *loops = NULL;
+    Liveness *liveness = NULL;
+    ReachingStores *reaching = NULL;
+    PostDominatorTree *postdominators = NULL;
+
+    public:
+        const CallGraph *callGraph; // the module's, built before the pipeline ran, NULL outside a pass manager
+        bool fastMath = false;      // float arithmetic may be reassociated, as if it were exact
+        bool vectors = false;       // the ir only goes to native code, so loops may use vector types
+        long computed[ANALYSES] = {};
+        long reused[ANALYSES] = {};
+
+        AnalysisCache(Function *function, const CallGraph *callGraph = NULL) { this->function = function; this->callGraph = callGraph; }
+        ~AnalysisCache() { invalidate(CHANGED_CFG); }
+        AnalysisCache(const AnalysisCache&) = delete;
+        AnalysisCache &operator=(const AnalysisCache&) = delete;
+
+        Cfg &getCfg();
+        DominatorTree &getDominators();
+        LoopForest &getLoops();
+        Liveness &getLiveness();
+        ReachingStores &getReachingStores();
+        PostDominatorTree &getPostDominators();
+
+        void invalidate(int changes);
+};
+
+// a pass rewrites one function, using and keeping the analyses it likes, and
+// returns the CHANGED_ flags for what it did
+typedef int (*FunctionPass)(Function *function, AnalysisCache &analyses);
+
+struct PassInfo {
+    const char *name;
+    FunctionPass run;
+};
+
+// every pass, by name
+extern const PassInfo passes[];
+const PassInfo *findPass(std::string name);
+
+// the comma separated passes each -O level runs
+extern const char *pipelines[OPT_LEVELS];
+
+// runs a pipeline over every function, one function at a time so its
+// analyses stay cached from pass to pass. functions go callees first, so a
+// caller sees the bodies of its callees already optimized. each pass is a
+// phase under "optimize" in -stats, and so is each analysis a pass asked for
+class PassManager {
+    std::vector<const PassInfo*> pipeline;
+
+    public:
+        bool verifyEach = false;  // check the ir after every pass, naming the one that broke it
+        bool fastMath = false;    // handed to every pass through its analyses
+        bool vectors = false;     // the same
+        std::vector<long> changed; // functions each pass changed, by position in the pipeline
+        long instructionsBefore = 0, instructionsAfter = 0;
+        long computed[ANALYSES] = {};
+        long reused[ANALYSES] = {};
+
+        // false, with the name in unknown, when a pass doesn't exist
+        bool setPipeline(std::string names, std::string &unknown);
+        bool empty() { return pipeline.empty(); }
+
+        // false when verification after a pass failed, the problems written to errors
+        bool run(Module *module, std::ostream &errors);
+
+        // the pipeline, what it changed and how often analyses were reused, for -stats
+        std::string toJson();
+};
+
+#endif
@@ -0,0 +1,99 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "perf.h"
+
+const char *PerfCounters::names[PERF_COUNTERS] = {
+    "cycles", "instructions", "branchMisses", "l1dMisses", "llcMisses", "pageFaults"
+};
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct { unsigned int type; unsigned long long config; } events[PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < PERF_COUNTERS; i++) this->fds[i] = -1;
+}
+
+PerfCounters::~PerfCounters() {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (this->fds[i] >= 0) close(this->fds[i]);
+    }
+}
+
+bool PerfCounters::open() {
+    if (this->opened) return this->available();
+    this->opened = true;
+
+    int firstError = 0;
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        this->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (this->fds[i] < 0 && firstError == 0) firstError = errno;
+    }
+
+    if (!this->available()) {
+        this->unavailableReason = std::string("perf_event_open failed: ") + strerror(firstError);
+        if (firstError == EACCES || firstError == EPERM) {
+            this->unavailableReason += " (see /proc/sys/kernel/perf_event_paranoid)";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool PerfCounters::available() {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (this->fds[i] >= 0) return true;
+    }
+    return false;
+}
+
+PerfSample PerfCounters::read() {
+    PerfSample sample;
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (this->fds[i] < 0) continue;
+
+        // value, time enabled, time running
+        unsigned long long data[3];
+        if (::read(this->fds[i], data, sizeof(data)) != sizeof(data)) continue;
+        if (data[2] == 0) sample.values[i] = 0;
+        else if (data[2] < data[1]) sample.values[i] = (long long)((double)data[0] * data[1] / data[2]);
+        else sample.values[i] = data[0];
+    }
+    return sample;
+}
+
+PerfSample perfDelta(const PerfSample &before, const PerfSample &after) {
+    PerfSample delta;
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (before.values[i] >= 0 && after.values[i] >= 0) delta.values[i] = after.values[i] - before.values[i];
+    }
+    return delta;
+}
+
+PerfCounters &perfCounters() {
+    static PerfCounters counters;
+    return counters;
+}
@@ -0,0 +1,46 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <string>
+
+#define PERF_COUNTERS 6
+
+// hardware and software event counts, -1 where the counter couldn't be opened
+struct PerfSample {
+    long long values[PERF_COUNTERS];
+
+    PerfSample() { for (int i = 0; i < PERF_COUNTERS; i++) values[i] = -1; }
+};
+
+// cycles, instructions, branch misses, L1D and LLC misses and page faults
+// for this process through perf_event_open, each counter opened on its own
+// so a machine without some of them (or a container without any) still
+// reports the rest
+class PerfCounters {
+    int fds[PERF_COUNTERS];
+    bool opened = false;
+
+    public:
+        static const char *names[PERF_COUNTERS];
+
+        PerfCounters();
+        ~PerfCounters();
+
+        // opens every counter it can, false when none could be
+        bool open();
+        bool available();
+
+        // why nothing could be opened, for the reports
+        std::string unavailableReason;
+
+        // current counts, scaled up when the kernel multiplexed a counter
+        PerfSample read();
+};
+
+// difference of two samples, keeping -1 for counters that aren't there
+PerfSample perfDelta(const PerfSample &before, const PerfSample &after);
+
+// the counters process wide, opened on first use by -perf
+PerfCounters &perfCounters();
+
+#endif
@@ -0,0 +1,100 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+#include <unistd.h>
+#include "protocol.h"
+
+// resolves the socket path, honoring the COMPILE_SERVER environment variable
+std::string serverSocketPath() {
+    char *path = getenv("COMPILE_SERVER");
+    if (path != NULL && path[0] != '\0') return path;
+    return DEFAULT_SOCKET;
+}
+
+// serializes a frame onto the end of buffer
+void appendFrame(std::string &buffer, char type, std::string payload) {
+    unsigned int length = payload.size();
+    buffer += type;
+    for (int i = 0; i < 4; i++) buffer += (char)((length >> (8 * i)) & 0xff);
+    buffer += payload;
+}
+
+bool writeAll(int fd, std::string buffer) {
+    size_t done = 0;
+    while (done < buffer.size()) {
+        ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+double monotonicMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+bool readFile(std::string path, std::string &contents) {
+    std::ifstream in(path, std::ifstream::binary);
+    if (!in) return false;
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+// reads exactly count bytes, anything short of that is a broken connection
+// with a deadline, waits for each read only as long as is left of it
+static bool readExactly(int fd, char *out, size_t count, double deadline) {
+    size_t done = 0;
+    while (done < count) {
+        if (deadline > 0) {
+            double left = deadline - monotonicMs();
+            if (left <= 0) return false;
+            struct pollfd ready = { fd, POLLIN, 0 };
+            int polled = poll(&ready, 1, (int)left + 1);
+            if (polled < 0 && errno == EINTR) continue;
+            if (polled <= 0) return false;
+        }
+        ssize_t n = read(fd, out + done, count - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+bool readFrame(int fd, Frame &frame, double deadline) {
+    unsigned char header[5];
+    if (!readExactly(fd, (char *)header, 5, deadline)) return false;
+
+    unsigned int length = 0;
+    for (int i = 0; i < 4; i++) length |= (unsigned int)header[i + 1] << (8 * i);
+
+    if (length > MAX_FRAME_LENGTH) return false;
+
+    frame.type = header[0];
+    frame.payload.assign(length, '\0');
+    if (length == 0) return true;
+    return readExactly(fd, &frame.payload[0], length, deadline);
+}
+
+bool nextFrame(const std::string &buffer, size_t &offset, Frame &frame) {
+    if (offset + 5 > buffer.size()) return false;
+
+    unsigned int length = 0;
+    for (int i = 0; i < 4; i++) length |= (unsigned int)(unsigned char)buffer[offset + 1 + i] << (8 * i);
+    if (offset + 5 + length > buffer.size()) return false;
+
+    frame.type = buffer[offset];
+    frame.payload = buffer.substr(offset + 5, length);
+    offset += 5 + length;
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+
+// every message between compile-client and the compile server is a frame:
+// one type byte, a four byte little endian length, then the payload
+#define F_ARG 'A'      // request: one command line flag
+#define F_NAME 'N'     // request: source filename
+#define F_INPUT 'I'    // after a request: standard input for a program the compile runs, empty at its end
+#define F_SOURCE 'S'   // request: source contents, ends the request
+#define F_STDOUT 'O'   // response: something the compile printed, sent as it prints
+#define F_OUTPUT 'F'   // response: output file, name and contents split by '\0'
+#define F_EXIT 'X'     // response: exit status, ends the response
+
+// the largest payload a frame may carry, anything longer is a broken or hostile peer
+#define MAX_FRAME_LENGTH (64 << 20)
+
+// how long the server waits for a whole request before hanging up on the client
+#define REQUEST_TIMEOUT_MS 10000
+
+// socket used when COMPILE_SERVER isn't set in the environment
+#define DEFAULT_SOCKET "/tmp/compile-server.sock"
+
+struct Frame {
+    char type = 0;
+    std::string payload;
+};
+
+// resolves the socket path, honoring the COMPILE_SERVER environment variable
+std::string serverSocketPath();
+
+// serializes a frame onto the end of buffer
+void appendFrame(std::string &buffer, char type, std::string payload);
+
+// blocking whole-buffer io on a file descriptor, false on failure
+bool writeAll(int fd, std::string buffer);
+
+// the whole of a file, false if it can't be opened
+bool readFile(std::string path, std::string &contents);
+
+// false on a broken connection, a payload over MAX_FRAME_LENGTH, or when the
+// frame hasn't fully arrived by deadline (a monotonicMs time, 0 waits forever)
+bool readFrame(int fd, Frame &frame, double deadline = 0);
+
+// milliseconds on a clock that only moves forward, for deadlines and timing
+double monotonicMs();
+
+// walks frames stored back to back in a buffer, false once none remain
+bool nextFrame(const std::string &buffer, size_t &offset, Frame &frame);
+
+#endif
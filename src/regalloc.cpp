@@ -0,0 +1,829 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <queue>
+#include <sstream>
+#include "analysis.h"
+#include "isel.h"
+#include "regalloc.h"
+#include "stats.h"
+
+#define MAX_POSITION   0x7fffffff
+#define LOOP_WEIGHT    10 // a use one loop deeper counts this many times over
+#define MAX_LOOP_DEPTH 6  // deeper loops weigh no more than this
+
+// handed out in this order, so an interval that doesn't cross a call takes a
+// caller saved register and leaves the callee saved ones, which cost a save
+// and a restore, to those that do. rax, rcx, rdx and r11 stay scratch for the
+// instructions, and xmm0 to xmm7 for arguments and scratch
+static const int generalRegisters[] = {REG_RSI, REG_RDI, REG_R8, REG_R9, REG_R10, REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15};
+static const int floatRegisters[] = {REG_XMM0 + 8, REG_XMM0 + 9, REG_XMM0 + 10, REG_XMM0 + 11, REG_XMM0 + 12, REG_XMM0 + 13, REG_XMM0 + 14, REG_XMM0 + 15};
+
+#define GENERAL_REGISTERS ((int)(sizeof(generalRegisters) / sizeof(generalRegisters[0])))
+#define FLOAT_REGISTERS   ((int)(sizeof(floatRegisters) / sizeof(floatRegisters[0])))
+
+bool isImmediate(Instruction *value) {
+    return value->op == OP_CONST && (value->type == IR_INT || value->type == IR_BOOL);
+}
+
+// floats and vectors of either kind go in xmm registers
+static bool usesXmm(int type) {
+    return type == IR_FLOAT || irIsVector(type);
+}
+
+bool isFloatRegister(int reg) {
+    return reg >= REG_XMM0;
+}
+
+bool isCalleeSaved(int reg) {
+    return reg == REG_RBX || (reg >= REG_R12 && reg <= REG_R15);
+}
+
+// what a call leaves in an allocatable register is garbage
+static bool isCallerSaved(int reg) {
+    return isFloatRegister(reg) ? reg >= REG_XMM0 + 8 : reg == REG_RSI || reg == REG_RDI || (reg >= REG_R8 && reg <= REG_R10);
+}
+
+std::string RegisterStats::toJson() {
+    std::ostringstream json;
+    json << "{\"values\": " << this->values << ", \"intervals\": " << this->intervals << ", \"spilled\": " << this->spilled
+        << ", \"stores\": " << this->stores << ", \"reloads\": " << this->reloads << ", \"phiMoves\": " << this->phiMoves
+        << ", \"coalesced\": " << this->coalesced << ", \"calleeSaved\": " << this->calleeSaved << ", \"ms\": " << this->ms << "}";
+    return json.str();
+}
+
+// positions from up to but not including to
+struct Range {
+    int from, to;
+};
+
+// the positions where one value, or a piece of it, is live, with a register
+// or the stack to keep it in. a register's fixed interval marks where calls
+// clobber it
+class Interval {
+    public:
+        Instruction *value;        // NULL for a fixed interval
+        int location = LOC_STACK;  // a register once one is given out
+        std::vector<Range> ranges; // ascending and apart
+        std::vector<int> uses;     // positions read at where a register helps, ascending
+        std::vector<int> reads;    // call arguments and phi operands, which memory serves as well
+        int def = -1;              // where the value is written, in its first piece only
+        int serial = 0;            // keeps the order of equal starts fixed
+        std::vector<double> usesWeight, readsWeight; // what the uses and reads from each on weigh, once asked
+
+        Interval(Instruction *value) : value(value) {}
+
+        int start() { return this->ranges.front().from; }
+        int end() { return this->ranges.back().to; }
+        bool covers(int position);
+        // the first position both cover, MAX_POSITION when there isn't one
+        int intersection(Interval *other);
+        // the first use at or after position, MAX_POSITION when there isn't one
+        int nextUse(int position);
+        // moves everything from position on, which must come after start(), into a new piece
+        Interval *split(int position);
+        // sorts and merges what building left
+        void normalize();
+};
+
+// the first range ending after position
+static std::vector<Range>::iterator rangeAfter(std::vector<Range> &ranges, int position) {
+    return std::upper_bound(ranges.begin(), ranges.end(), position, [](int at, const Range &range) { return at < range.to; });
+}
+
+bool Interval::covers(int position) {
+    std::vector<Range>::iterator range = rangeAfter(this->ranges, position);
+    return range != this->ranges.end() && range->from <= position;
+}
+
+int Interval::intersection(Interval *other) {
+    std::vector<Range>::iterator a = rangeAfter(this->ranges, other->start());
+    std::vector<Range>::iterator b = rangeAfter(other->ranges, this->start());
+    while (a != this->ranges.end() && b != other->ranges.end()) {
+        int from = std::max(a->from, b->from);
+        if (from < std::min(a->to, b->to)) return from;
+        if (a->to < b->to) a++;
+        else b++;
+    }
+    return MAX_POSITION;
+}
+
+int Interval::nextUse(int position) {
+    std::vector<int>::iterator use = std::lower_bound(this->uses.begin(), this->uses.end(), position);
+    return use == this->uses.end() ? MAX_POSITION : *use;
+}
+
+Interval *Interval::split(int position) {
+    Interval *piece = new Interval(this->value);
+    std::vector<Range>::iterator cut = rangeAfter(this->ranges, position);
+    if (cut != this->ranges.end() && cut->from < position) {
+        piece->ranges.push_back({position, cut->to});
+        cut->to = position;
+        cut++;
+    }
+    piece->ranges.insert(piece->ranges.end(), cut, this->ranges.end());
+    this->ranges.erase(cut, this->ranges.end());
+
+    std::vector<int>::iterator use = std::lower_bound(this->uses.begin(), this->uses.end(), position);
+    piece->uses.assign(use, this->uses.end());
+    this->uses.erase(use, this->uses.end());
+    std::vector<int>::iterator read = std::lower_bound(this->reads.begin(), this->reads.end(), position);
+    piece->reads.assign(read, this->reads.end());
+    this->reads.erase(read, this->reads.end());
+    this->usesWeight.clear();
+    this->readsWeight.clear();
+    return piece;
+}
+
+void Interval::normalize() {
+    std::sort(this->ranges.begin(), this->ranges.end(), [](const Range &a, const Range &b) { return a.from < b.from; });
+    std::vector<Range> merged;
+    for (size_t i = 0; i < this->ranges.size(); i++) {
+        if (!merged.empty() && this->ranges[i].from <= merged.back().to) merged.back().to = std::max(merged.back().to, this->ranges[i].to);
+        else merged.push_back(this->ranges[i]);
+    }
+    this->ranges.swap(merged);
+    std::sort(this->uses.begin(), this->uses.end());
+    std::sort(this->reads.begin(), this->reads.end());
+}
+
+RegisterAllocation::RegisterAllocation(Function *function, Selection &selection) : function(function), selection(selection) {
+    this->pieces.resize(function->nextValueId);
+    this->positions.assign(function->nextValueId, -1);
+    this->blockStart.assign(function->nextBlockId, -1);
+    this->blockEnd.assign(function->nextBlockId, -1);
+    this->needsSlot.assign(function->nextValueId, false);
+}
+
+RegisterAllocation::~RegisterAllocation() {
+    for (size_t i = 0; i < this->owned.size(); i++) delete this->owned[i];
+}
+
+// the blocks as written, skipping those the entry can't reach
+void RegisterAllocation::number(const Cfg &cfg) {
+    int position = 0;
+    std::vector<Block*> &blocks = this->function->blocks;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (cfg.indexOf(blocks[i]) < 0) continue;
+        this->order.push_back(blocks[i]);
+        this->blockStart[blocks[i]->id] = position;
+        position += 2;
+        std::list<Instruction*> &instructions = blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if ((*it)->op == OP_PHI) this->positions[(*it)->id] = this->blockStart[blocks[i]->id];
+            else {
+                this->positions[(*it)->id] = position;
+                position += 2;
+            }
+        }
+        this->blockEnd[blocks[i]->id] = position;
+    }
+}
+
+// every value in its slot, which needs none of the analyses
+void RegisterAllocation::inFrame(RegisterStats &stats) {
+    Cfg cfg(this->function);
+    this->number(cfg);
+    for (size_t i = 0; i < this->order.size(); i++) {
+        std::list<Instruction*> &instructions = this->order[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if (!this->selection.hasLocation(*it)) continue;
+            this->needsSlot[(*it)->id] = true;
+            stats.values++;
+            stats.intervals++;
+            stats.spilled++;
+        }
+        std::vector<Block*> succs = this->order[i]->succs();
+        for (size_t j = 0; j < succs.size(); j++) stats.phiMoves += succs[j]->phis().size();
+    }
+}
+
+// the last of pieces starting at or before position, pieces.end() for none
+static std::vector<Interval*>::iterator pieceAt(std::vector<Interval*> &pieces, int position) {
+    std::vector<Interval*>::iterator piece = std::upper_bound(pieces.begin(), pieces.end(), position,
+        [](int at, Interval *interval) { return at < interval->start(); });
+    return piece == pieces.begin() ? pieces.end() : piece - 1;
+}
+
+int RegisterAllocation::locationAt(Instruction *value, int position) {
+    if (isImmediate(value)) return LOC_CONSTANT;
+    std::vector<Interval*> &pieces = this->pieces[value->id];
+    for (int at = position; at >= position - 1; at--) {
+        std::vector<Interval*>::iterator piece = pieceAt(pieces, at);
+        if (piece != pieces.end() && (*piece)->covers(at)) return (*piece)->location;
+    }
+    return pieces.empty() ? LOC_STACK : pieces.front()->location;
+}
+
+std::vector<Move> RegisterAllocation::edgeMoves(Block *from, Block *to) {
+    std::vector<Move> moves;
+    int end = this->blockEnd[from->id] - 1, start = this->blockStart[to->id];
+    std::vector<Instruction*> phis = to->phis();
+    int pred = to->predIndex(from);
+    for (size_t i = 0; i < phis.size(); i++) {
+        Instruction *operand = phis[i]->operands[pred];
+        moves.push_back({operand, this->locationAt(operand, end), phis[i], this->locationAt(phis[i], start)});
+    }
+    std::map<std::pair<int, int>, std::vector<Instruction*> >::iterator live = this->liveAcross.find(std::make_pair(from->id, to->id));
+    if (live == this->liveAcross.end()) return moves;
+    for (size_t i = 0; i < live->second.size(); i++) {
+        Instruction *value = live->second[i];
+        int before = this->locationAt(value, end), after = this->locationAt(value, start);
+        if (before != after) moves.push_back({value, before, value, after});
+    }
+    return moves;
+}
+
+// the state a check walks through: which value each register and each
+// value's slot holds, -1 for none or for disagreeing paths
+static int keyOf(Instruction *value, int location) {
+    return location >= 0 ? location : REG_COUNT + value->id;
+}
+
+bool RegisterAllocation::check(std::ostream &problems) {
+    Function *function = this->function;
+    std::vector<std::vector<int> > in(function->nextBlockId);
+    std::vector<bool> seen(function->nextBlockId, false);
+    if (this->order.empty()) return true;
+    seen[this->order[0]->id] = true;
+    in[this->order[0]->id].assign(REG_COUNT + function->nextValueId, -1);
+    bool changed = true, ok = true;
+    std::vector<Instruction*> reads;
+    while (changed && ok) {
+        changed = false;
+        for (size_t i = 0; i < this->order.size() && ok; i++) {
+            Block *block = this->order[i];
+            if (!seen[block->id]) continue;
+            std::vector<int> state = in[block->id];
+            std::list<Instruction*> &instructions = block->instructions;
+            for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end() && ok; it++) {
+                Instruction *instruction = *it;
+                int position = this->positions[instruction->id];
+                // a call reads its arguments alongside the moves made at it
+                bool call = instruction->op == OP_CALL;
+                for (size_t j = 0; j < instruction->operands.size() && call; j++) {
+                    Instruction *operand = instruction->operands[j];
+                    int location = this->locationAt(operand, position - 1);
+                    if (location == LOC_CONSTANT || state[keyOf(operand, location)] == operand->id) continue;
+                    problems << "@" << function->name << ": %" << instruction->id << " reads %" << operand->id << " from " << location
+                        << " holding %" << state[keyOf(operand, location)] << " at " << position << "\n";
+                    ok = false;
+                }
+                std::map<int, std::vector<Move> >::iterator split = this->moves.find(position);
+                if (split != this->moves.end() && instruction->op != OP_PHI) {
+                    std::vector<int> before = state;
+                    for (size_t j = 0; j < split->second.size(); j++) {
+                        Move &move = split->second[j];
+                        if (before[keyOf(move.from, move.fromLocation)] != move.from->id) {
+                            problems << "@" << function->name << ": split move of %" << move.from->id << " at " << position << " reads the wrong value\n";
+                            ok = false;
+                        }
+                        state[keyOf(move.to, move.toLocation)] = move.from->id;
+                    }
+                }
+                if (instruction->op == OP_PHI || !this->selection.written(instruction)) continue;
+                reads.clear();
+                this->selection.leaves(instruction, reads);
+                for (size_t j = 0; j < reads.size() && !call; j++) {
+                    Instruction *operand = reads[j];
+                    int location = this->locationAt(operand, position);
+                    if (location == LOC_CONSTANT || state[keyOf(operand, location)] == operand->id) continue;
+                    problems << "@" << function->name << ": %" << instruction->id << " reads %" << operand->id << " from " << location
+                        << " holding %" << state[keyOf(operand, location)] << " at " << position << "\n";
+                    ok = false;
+                }
+                if (call) {
+                    for (int reg = 0; reg < REG_COUNT; reg++) {
+                        if (isCallerSaved(reg)) state[reg] = -1;
+                    }
+                }
+                if (this->selection.hasLocation(instruction)) {
+                    int location = this->locationAt(instruction, position + 1);
+                    for (int k = 0; k < REG_COUNT; k++) {
+                        if (state[k] == instruction->id) state[k] = -1;
+                    }
+                    state[keyOf(instruction, LOC_STACK)] = -1;
+                    state[keyOf(instruction, location)] = instruction->id;
+                }
+            }
+            std::vector<Block*> succs = block->succs();
+            for (size_t j = 0; j < succs.size() && ok; j++) {
+                std::vector<Move> moves = this->edgeMoves(block, succs[j]);
+                std::vector<int> after = state;
+                for (size_t k = 0; k < moves.size(); k++) {
+                    Move &move = moves[k];
+                    if (move.fromLocation != LOC_CONSTANT && state[keyOf(move.from, move.fromLocation)] != move.from->id) {
+                        problems << "@" << function->name << ": edge b" << block->id << " to b" << succs[j]->id << " reads %" << move.from->id
+                            << " from " << move.fromLocation << " holding %" << state[keyOf(move.from, move.fromLocation)] << "\n";
+                        ok = false;
+                    }
+                    after[keyOf(move.to, move.toLocation)] = move.to->id;
+                }
+                // values live into the successor must be where it expects them
+                int id = succs[j]->id;
+                if (!seen[id]) {
+                    seen[id] = true;
+                    in[id] = after;
+                    changed = true;
+                    continue;
+                }
+                for (size_t k = 0; k < after.size(); k++) {
+                    if (in[id][k] != after[k] && in[id][k] != -1) {
+                        in[id][k] = -1;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+class LinearScan {
+    RegisterAllocation &allocation;
+    RegisterStats &stats;
+    Cfg cfg;
+    DominatorTree dominators;
+    LoopForest loops;
+    std::vector<std::vector<Instruction*> > reads; // by instruction id, what the tile rooted there reads
+    Liveness liveness;
+    std::vector<int> depths;            // loop depth of each block, in order
+    std::vector<double> weights;        // of each block, in order
+    std::vector<int> shallower;         // the last block before each in a shallower loop, -1 for none
+    std::vector<int> blocks;            // the block holding each even position, halved
+    std::vector<std::vector<Instruction*> > phiUsers; // by value id, the phis taking it on some edge
+    std::vector<Interval*> intervals;   // by value id, the first piece
+    std::vector<Interval*> fixed;       // by register, NULL for those never clobbered
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int> >, std::greater<std::pair<int, int> > > unhandled;
+    std::vector<Interval*> bySerial;
+    std::vector<Interval*> active, inactive;
+
+    Interval *newInterval(Instruction *value);
+    void addRange(Instruction *value, int from, int to);
+    void number();
+    void build();
+    int blockAt(int position);
+    double weightAt(int position);
+    double weightAfter(std::vector<int> &positions, std::vector<double> &weights, int position);
+    double weightFrom(Interval *interval, int position);
+    int splitPosition(int from, int to);
+    Interval *splitAt(Interval *interval, int position);
+    void schedule(Interval *interval);
+    void hints(Interval *interval, std::vector<int> &into);
+    bool allocateFree(Interval *current);
+    void allocateBlocked(Interval *current);
+    void spillFrom(Interval *interval, int position);
+    void resolve();
+
+    public:
+        LinearScan(RegisterAllocation &allocation, RegisterStats &stats);
+
+        void run();
+};
+
+// a global or alloca folded into a tile in one block is live there only
+// where some other tile reads it from its location
+static std::vector<std::vector<Instruction*> > tileReads(Function *function, Selection &selection) {
+    std::vector<std::vector<Instruction*> > reads(function->nextValueId);
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = function->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if (selection.written(*it)) selection.leaves(*it, reads[(*it)->id]);
+        }
+    }
+    return reads;
+}
+
+LinearScan::LinearScan(RegisterAllocation &allocation, RegisterStats &stats) :
+    allocation(allocation), stats(stats), cfg(allocation.function), dominators(cfg), loops(cfg, dominators),
+    reads(tileReads(allocation.function, allocation.selection)), liveness(cfg, &reads) {}
+
+Interval *LinearScan::newInterval(Instruction *value) {
+    Interval *interval = new Interval(value);
+    interval->serial = this->bySerial.size();
+    this->bySerial.push_back(interval);
+    this->allocation.owned.push_back(interval);
+    return interval;
+}
+
+void LinearScan::addRange(Instruction *value, int from, int to) {
+    this->intervals[value->id]->ranges.push_back({from, to});
+}
+
+void LinearScan::number() {
+    RegisterAllocation &allocation = this->allocation;
+    allocation.number(this->cfg);
+
+    // so looking up a position's block and weight and searching for a split
+    // take no time however long the function is
+    int end = allocation.order.empty() ? 0 : allocation.blockEnd[allocation.order.back()->id];
+    this->blocks.resize(end / 2 + 1, allocation.order.size() - 1);
+    for (size_t i = 0; i < allocation.order.size(); i++) {
+        this->depths.push_back(this->loops.depth(this->cfg.indexOf(allocation.order[i])));
+        double weight = 1.0;
+        for (int depth = std::min(this->depths[i], MAX_LOOP_DEPTH); depth > 0; depth--) weight *= LOOP_WEIGHT;
+        this->weights.push_back(weight);
+        int block = i - 1;
+        while (block >= 0 && this->depths[block] >= this->depths[i]) block = this->shallower[block];
+        this->shallower.push_back(block);
+        Block *ordered = allocation.order[i];
+        for (int at = allocation.blockStart[ordered->id]; at < allocation.blockEnd[ordered->id]; at += 2) this->blocks[at / 2] = i;
+    }
+}
+
+// a block at a time from the last, each live out value live to the block's
+// end and each value read in it live from its start, until their definitions
+// cut them short. an operand stays live through the position it's read at,
+// so a piece reloaded for it covers it, except a call's, since the call
+// clobbers each caller saved register there with a fixed range
+void LinearScan::build() {
+    RegisterAllocation &allocation = this->allocation;
+    Function *function = allocation.function;
+    this->intervals.assign(function->nextValueId, NULL);
+    this->phiUsers.resize(function->nextValueId);
+    this->fixed.assign(REG_COUNT, NULL);
+    for (size_t i = 0; i < allocation.order.size(); i++) {
+        std::list<Instruction*> &instructions = allocation.order[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            if (allocation.selection.hasLocation(*it)) this->intervals[(*it)->id] = this->newInterval(*it);
+        }
+    }
+
+    std::vector<int> endAt(function->nextValueId, -1);
+    std::vector<Instruction*> open;
+    for (int i = allocation.order.size() - 1; i >= 0; i--) {
+        Block *block = allocation.order[i];
+        int from = allocation.blockStart[block->id], to = allocation.blockEnd[block->id];
+        const Bitset &out = this->liveness.solution.out[this->cfg.indexOf(block)];
+        for (int bit = out.findNext(0); bit >= 0; bit = out.findNext(bit + 1)) {
+            Instruction *value = this->liveness.values[bit];
+            if (this->intervals[value->id] == NULL) continue;
+            endAt[value->id] = to;
+            open.push_back(value);
+        }
+        std::vector<Block*> succs = block->succs();
+        for (size_t j = 0; j < succs.size(); j++) {
+            std::vector<Instruction*> phis = succs[j]->phis();
+            int pred = succs[j]->predIndex(block);
+            for (size_t k = 0; k < phis.size(); k++) {
+                Interval *operand = this->intervals[phis[k]->operands[pred]->id];
+                if (operand == NULL) continue;
+                operand->reads.push_back(to);
+                this->phiUsers[phis[k]->operands[pred]->id].push_back(phis[k]);
+            }
+        }
+
+        std::list<Instruction*> &instructions = block->instructions;
+        for (std::list<Instruction*>::reverse_iterator it = instructions.rbegin(); it != instructions.rend(); it++) {
+            Instruction *instruction = *it;
+            int position = allocation.positions[instruction->id];
+            Interval *interval = this->intervals[instruction->id];
+            if (interval != NULL) {
+                int def = instruction->op == OP_PHI ? from : position + 1;
+                int end = endAt[instruction->id] >= 0 ? endAt[instruction->id] : def + 1;
+                this->addRange(instruction, def, end);
+                interval->def = def;
+                endAt[instruction->id] = -1;
+            }
+            if (instruction->op == OP_PHI || !allocation.selection.written(instruction)) continue;
+            bool call = instruction->op == OP_CALL;
+            std::vector<Instruction*> &reads = this->reads[instruction->id];
+            for (size_t j = 0; j < reads.size(); j++) {
+                Instruction *operand = reads[j];
+                if (this->intervals[operand->id] == NULL) continue;
+                (call ? this->intervals[operand->id]->reads : this->intervals[operand->id]->uses).push_back(position);
+                if (endAt[operand->id] < 0) {
+                    endAt[operand->id] = call ? position : position + 1;
+                    open.push_back(operand);
+                }
+            }
+            if (instruction->op != OP_CALL) continue;
+            for (int reg = 0; reg < REG_COUNT; reg++) {
+                if (!isCallerSaved(reg)) continue;
+                if (this->fixed[reg] == NULL) {
+                    this->fixed[reg] = new Interval(NULL);
+                    this->fixed[reg]->location = reg;
+                    allocation.owned.push_back(this->fixed[reg]);
+                }
+                this->fixed[reg]->ranges.push_back({position, position + 1});
+            }
+        }
+        for (size_t j = 0; j < open.size(); j++) {
+            if (endAt[open[j]->id] < 0) continue;
+            this->addRange(open[j], from, endAt[open[j]->id]);
+            endAt[open[j]->id] = -1;
+        }
+        open.clear();
+    }
+
+    for (size_t i = 0; i < this->intervals.size(); i++) {
+        if (this->intervals[i] != NULL) this->intervals[i]->normalize();
+    }
+    for (int reg = 0; reg < REG_COUNT; reg++) {
+        if (this->fixed[reg] != NULL) this->fixed[reg]->normalize();
+    }
+}
+
+// the index in order of the block holding position
+int LinearScan::blockAt(int position) {
+    return this->blocks[std::min(std::max(position, 0) / 2, (int)this->blocks.size() - 1)];
+}
+
+// LOOP_WEIGHT to the depth of the loops around position
+double LinearScan::weightAt(int position) {
+    return this->weights[this->blockAt(position)];
+}
+
+// what the reads at positions from position on weigh, summing them back to
+// front the first time
+double LinearScan::weightAfter(std::vector<int> &positions, std::vector<double> &weights, int position) {
+    if (weights.size() != positions.size() + 1) {
+        weights.assign(positions.size() + 1, 0.0);
+        for (int i = positions.size() - 1; i >= 0; i--) weights[i] = weights[i + 1] + this->weightAt(positions[i] - 1);
+    }
+    return weights[std::lower_bound(positions.begin(), positions.end(), position) - positions.begin()];
+}
+
+// what keeping interval in memory from position on would cost, each read and
+// the write weighed by the loops around it. a read on an edge belongs to the
+// block it leaves
+double LinearScan::weightFrom(Interval *interval, int position) {
+    double weight = interval->def >= position ? this->weightAt(interval->def) : 0.0;
+    weight += this->weightAfter(interval->uses, interval->usesWeight, position);
+    return weight + this->weightAfter(interval->reads, interval->readsWeight, position);
+}
+
+// an instruction position from..to to split at, -1 when there isn't one. the
+// latest unless a block starts in between in a shallower loop, since the
+// moves then go on the edges into it rather than round the loop
+int LinearScan::splitPosition(int from, int to) {
+    int best = to & ~1;
+    if (best < from) return -1;
+    for (int i = this->shallower[this->blockAt(best)]; i >= 0; i = this->shallower[i]) {
+        int start = this->allocation.blockStart[this->allocation.order[i]->id];
+        if (start < from) break;
+        best = start;
+    }
+    return best;
+}
+
+Interval *LinearScan::splitAt(Interval *interval, int position) {
+    Interval *piece = interval->split(position);
+    piece->serial = this->bySerial.size();
+    this->bySerial.push_back(piece);
+    this->allocation.owned.push_back(piece);
+    std::vector<Interval*> &pieces = this->allocation.pieces[interval->value->id];
+    pieces.insert(pieceAt(pieces, position) + 1, piece);
+    return piece;
+}
+
+void LinearScan::schedule(Interval *interval) {
+    if (!interval->ranges.empty()) this->unhandled.push(std::make_pair(interval->start(), interval->serial));
+}
+
+// registers that would save a move: the one the piece before had, and for a
+// phi or a phi's operand, the register on the other side of the edge
+void LinearScan::hints(Interval *interval, std::vector<int> &into) {
+    RegisterAllocation &allocation = this->allocation;
+    Instruction *value = interval->value;
+    int start = interval->start();
+    std::vector<Interval*> &pieces = allocation.pieces[value->id];
+    std::vector<Interval*>::iterator before = pieceAt(pieces, start - 1);
+    if (before != pieces.end() && *before != interval && (*before)->end() == start && (*before)->location >= 0) into.push_back((*before)->location);
+    if (value->op == OP_PHI) {
+        for (size_t i = 0; i < value->operands.size(); i++) {
+            int end = allocation.blockEnd[value->block->preds[i]->id];
+            if (end < 0 || isImmediate(value->operands[i])) continue;
+            int location = allocation.locationAt(value->operands[i], end - 1);
+            if (location >= 0) into.push_back(location);
+        }
+    }
+    std::vector<Instruction*> &users = this->phiUsers[value->id];
+    for (size_t i = 0; i < users.size(); i++) {
+        Instruction *user = users[i];
+        int location = allocation.locationAt(user, allocation.blockStart[user->block->id]);
+        if (location >= 0) into.push_back(location);
+    }
+}
+
+// gives current a register nothing else needs before it ends, or failing that
+// the one free longest, splitting current where that runs out
+bool LinearScan::allocateFree(Interval *current) {
+    bool floats = usesXmm(current->value->type);
+    const int *registers = floats ? floatRegisters : generalRegisters;
+    int count = floats ? FLOAT_REGISTERS : GENERAL_REGISTERS;
+    int freeUntil[REG_COUNT];
+    for (int i = 0; i < REG_COUNT; i++) freeUntil[i] = -1;
+    for (int i = 0; i < count; i++) freeUntil[registers[i]] = MAX_POSITION;
+    for (size_t i = 0; i < this->active.size(); i++) freeUntil[this->active[i]->location] = -1;
+    for (size_t i = 0; i < this->inactive.size(); i++) {
+        int location = this->inactive[i]->location;
+        if (freeUntil[location] < 0) continue;
+        freeUntil[location] = std::min(freeUntil[location], this->inactive[i]->intersection(current));
+    }
+
+    int end = current->end(), chosen = -1;
+    std::vector<int> hinted;
+    this->hints(current, hinted);
+    for (size_t i = 0; i < hinted.size() && chosen < 0; i++) {
+        if (freeUntil[hinted[i]] >= end) chosen = hinted[i];
+    }
+    // a callee saved register already saved costs nothing more
+    for (int i = 0; i < count && chosen < 0; i++) {
+        int reg = registers[i];
+        bool used = std::find(this->allocation.calleeSaved.begin(), this->allocation.calleeSaved.end(), reg) != this->allocation.calleeSaved.end();
+        if (freeUntil[reg] >= end && (!isCalleeSaved(reg) || used)) chosen = reg;
+    }
+    for (int i = 0; i < count && chosen < 0; i++) {
+        if (freeUntil[registers[i]] >= end) chosen = registers[i];
+    }
+    if (chosen < 0) {
+        int best = registers[0];
+        for (int i = 1; i < count; i++) {
+            if (freeUntil[registers[i]] > freeUntil[best]) best = registers[i];
+        }
+        int at = this->splitPosition(current->start() + 1, freeUntil[best]);
+        if (at < 0) return false;
+        chosen = best;
+        this->schedule(this->splitAt(current, at));
+    }
+
+    current->location = chosen;
+    if (isCalleeSaved(chosen) && std::find(this->allocation.calleeSaved.begin(), this->allocation.calleeSaved.end(), chosen) == this->allocation.calleeSaved.end()) {
+        this->allocation.calleeSaved.push_back(chosen);
+    }
+    return true;
+}
+
+// every register is taken somewhere current is live. current takes the one
+// whose holders would cost least to move to the stack, if that's less than
+// moving current itself, and they give it up from here to their next use
+void LinearScan::allocateBlocked(Interval *current) {
+    bool floats = usesXmm(current->value->type);
+    const int *registers = floats ? floatRegisters : generalRegisters;
+    int count = floats ? FLOAT_REGISTERS : GENERAL_REGISTERS;
+    int position = current->start();
+    double cost[REG_COUNT];
+    int blocked[REG_COUNT];
+    for (int i = 0; i < REG_COUNT; i++) {
+        cost[i] = 0.0;
+        blocked[i] = MAX_POSITION;
+    }
+    for (size_t i = 0; i < this->active.size(); i++) {
+        Interval *holder = this->active[i];
+        if (holder->value == NULL) blocked[holder->location] = position;
+        else cost[holder->location] += this->weightFrom(holder, position);
+    }
+    for (size_t i = 0; i < this->inactive.size(); i++) {
+        Interval *holder = this->inactive[i];
+        int at = holder->intersection(current);
+        if (at == MAX_POSITION) continue;
+        if (holder->value == NULL) blocked[holder->location] = std::min(blocked[holder->location], at);
+        else cost[holder->location] += this->weightFrom(holder, position);
+    }
+
+    int chosen = -1;
+    for (int i = 0; i < count; i++) {
+        int reg = registers[i];
+        if (this->splitPosition(position + 1, blocked[reg]) < 0) continue;
+        if (chosen < 0 || cost[reg] < cost[chosen]) chosen = reg;
+    }
+
+    if (chosen < 0 || cost[chosen] >= this->weightFrom(current, position)) {
+        current->location = LOC_STACK;
+        int use = current->nextUse(position + 1);
+        if (use != MAX_POSITION) this->schedule(this->splitAt(current, this->splitPosition(position + 1, use)));
+        return;
+    }
+
+    current->location = chosen;
+    if (blocked[chosen] < current->end()) this->schedule(this->splitAt(current, this->splitPosition(position + 1, blocked[chosen])));
+    if (isCalleeSaved(chosen) && std::find(this->allocation.calleeSaved.begin(), this->allocation.calleeSaved.end(), chosen) == this->allocation.calleeSaved.end()) {
+        this->allocation.calleeSaved.push_back(chosen);
+    }
+    for (size_t i = 0; i < this->active.size(); i++) {
+        Interval *holder = this->active[i];
+        if (holder->value == NULL || holder->location != chosen) continue;
+        this->spillFrom(holder, position);
+        this->active.erase(this->active.begin() + i--);
+    }
+    for (size_t i = 0; i < this->inactive.size(); i++) {
+        Interval *holder = this->inactive[i];
+        if (holder->value == NULL || holder->location != chosen || holder->intersection(current) == MAX_POSITION) continue;
+        this->spillFrom(holder, position);
+        this->inactive.erase(this->inactive.begin() + i--);
+    }
+}
+
+// interval keeps its register up to position and the stack after, until
+// the next use brings it back to compete for a register
+void LinearScan::spillFrom(Interval *interval, int position) {
+    int at = position & ~1;
+    Interval *piece = at > interval->start() ? this->splitAt(interval, at) : interval;
+    piece->location = LOC_STACK;
+    int from = std::max(position, piece->start()) + 1;
+    int use = piece->nextUse(from);
+    if (use != MAX_POSITION) this->schedule(this->splitAt(piece, this->splitPosition(from, use)));
+}
+
+// the moves between pieces of a value inside a block. those at a block's
+// start, and a value's changes of place from one block to the next, are
+// left to the edges
+void LinearScan::resolve() {
+    RegisterAllocation &allocation = this->allocation;
+    std::vector<bool> starts(allocation.order.empty() ? 0 : allocation.blockEnd[allocation.order.back()->id] + 1, false);
+    for (size_t i = 0; i < allocation.order.size(); i++) starts[allocation.blockStart[allocation.order[i]->id]] = true;
+
+    for (size_t id = 0; id < allocation.pieces.size(); id++) {
+        std::vector<Interval*> &pieces = allocation.pieces[id];
+        if (pieces.empty()) continue;
+        this->stats.values++;
+        this->stats.intervals += pieces.size();
+        for (size_t i = 0; i < pieces.size(); i++) {
+            if (pieces[i]->location == LOC_STACK) allocation.needsSlot[id] = true;
+        }
+        if (allocation.needsSlot[id]) this->stats.spilled++;
+        for (size_t i = 1; i < pieces.size(); i++) {
+            Interval *before = pieces[i - 1], *after = pieces[i];
+            if (before->end() != after->start() || starts[after->start()] || before->location == after->location) continue;
+            allocation.moves[after->start()].push_back({before->value, before->location, after->value, after->location});
+            if (after->location == LOC_STACK) this->stats.stores++;
+            else if (before->location == LOC_STACK) this->stats.reloads++;
+        }
+    }
+
+    // values live along each edge, counted once here for the stats
+    for (size_t i = 0; i < allocation.order.size(); i++) {
+        Block *block = allocation.order[i];
+        std::vector<Block*> succs = block->succs();
+        for (size_t j = 0; j < succs.size(); j++) {
+            if (allocation.liveAcross.count(std::make_pair(block->id, succs[j]->id))) continue;
+            std::vector<Instruction*> &live = allocation.liveAcross[std::make_pair(block->id, succs[j]->id)];
+            const Bitset &in = this->liveness.solution.in[this->cfg.indexOf(succs[j])];
+            for (int bit = in.findNext(0); bit >= 0; bit = in.findNext(bit + 1)) {
+                if (this->intervals[this->liveness.values[bit]->id] != NULL) live.push_back(this->liveness.values[bit]);
+            }
+            std::vector<Move> moves = allocation.edgeMoves(block, succs[j]);
+            for (size_t k = 0; k < moves.size(); k++) {
+                if (moves[k].from != moves[k].to) {
+                    this->stats.phiMoves++;
+                    if (moves[k].fromLocation >= 0 && moves[k].fromLocation == moves[k].toLocation) this->stats.coalesced++;
+                }
+                else if (moves[k].toLocation == LOC_STACK) this->stats.stores++;
+                else if (moves[k].fromLocation == LOC_STACK) this->stats.reloads++;
+            }
+        }
+    }
+}
+
+void LinearScan::run() {
+    RegisterAllocation &allocation = this->allocation;
+    this->number();
+    this->build();
+    for (size_t i = 0; i < this->intervals.size(); i++) {
+        if (this->intervals[i] == NULL) continue;
+        allocation.pieces[i].push_back(this->intervals[i]);
+        this->schedule(this->intervals[i]);
+    }
+    for (int reg = 0; reg < REG_COUNT; reg++) {
+        if (this->fixed[reg] != NULL) this->inactive.push_back(this->fixed[reg]);
+    }
+
+    while (!this->unhandled.empty()) {
+        Interval *current = this->bySerial[this->unhandled.top().second];
+        this->unhandled.pop();
+        int position = current->start();
+        for (size_t i = 0; i < this->active.size(); i++) {
+            Interval *interval = this->active[i];
+            if (interval->end() <= position) this->active.erase(this->active.begin() + i--);
+            else if (!interval->covers(position)) {
+                this->inactive.push_back(interval);
+                this->active.erase(this->active.begin() + i--);
+            }
+        }
+        for (size_t i = 0; i < this->inactive.size(); i++) {
+            Interval *interval = this->inactive[i];
+            if (interval->end() <= position) this->inactive.erase(this->inactive.begin() + i--);
+            else if (interval->covers(position)) {
+                this->active.push_back(interval);
+                this->inactive.erase(this->inactive.begin() + i--);
+            }
+        }
+        if (!this->allocateFree(current)) this->allocateBlocked(current);
+        if (current->location >= 0) this->active.push_back(current);
+    }
+    this->resolve();
+    this->stats.calleeSaved += allocation.calleeSaved.size();
+}
+
+RegisterAllocation *allocateRegisters(Function *function, Selection &selection, bool registers, RegisterStats &stats) {
+    double start = wallClockMs();
+    RegisterAllocation *allocation = new RegisterAllocation(function, selection);
+    if (registers) {
+        LinearScan scan(*allocation, stats);
+        scan.run();
+    }
+    else allocation->inFrame(stats);
+    stats.ms += wallClockMs() - start;
+    return allocation;
+}
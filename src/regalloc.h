@@ -0,0 +1,116 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "ir.h"
+
+// registers, numbered the way x86-64 encodes them with the xmm registers after
+// the general purpose ones
+#define REG_RAX   0
+#define REG_RCX   1
+#define REG_RDX   2
+#define REG_RBX   3
+#define REG_RSP   4
+#define REG_RBP   5
+#define REG_RSI   6
+#define REG_RDI   7
+#define REG_R8    8
+#define REG_R9    9
+#define REG_R10   10
+#define REG_R11   11
+#define REG_R12   12
+#define REG_R13   13
+#define REG_R14   14
+#define REG_R15   15
+#define REG_XMM0  16
+#define REG_COUNT 32
+
+// where a value is when it isn't in a register
+#define LOC_STACK    -1 // the value's own slot in the frame
+#define LOC_CONSTANT -2 // an int or bool constant, written as an immediate wherever it's used
+
+// copies one value's location into another's: a value moving between its
+// register and its slot, or a phi taking its operand on an edge
+struct Move {
+    Instruction *from;
+    int fromLocation;
+    Instruction *to;
+    int toLocation;
+};
+
+// counted over a module, reported under -stats as regalloc
+struct RegisterStats {
+    int values = 0;     // values that needed a location
+    int intervals = 0;  // pieces those were split into
+    int spilled = 0;    // values with a piece on the stack
+    int stores = 0;     // moves from a register to a slot written
+    int reloads = 0;    // moves from a slot to a register written
+    int phiMoves = 0;   // phi operands taken along an edge
+    int coalesced = 0;  // of those, the ones already in the phi's register
+    int calleeSaved = 0;// callee saved registers used, summed over functions
+    double ms = 0.0;
+
+    std::string toJson();
+};
+
+class Cfg;
+class Interval;
+class Selection;
+
+// where each value of a function lives at each point of its code. positions
+// number the reachable blocks in the order they're written: a block starts at
+// an even position, where its phis are defined, and each other instruction
+// takes two more, reading its operands at the first and writing its result at
+// the second. an instruction folded into the tile above it has no location
+// and reads nothing itself, the root of its tile reading what it would
+class RegisterAllocation {
+    std::vector<std::vector<Interval*> > pieces; // by value id, in order
+    std::vector<Interval*> owned;
+    std::map<std::pair<int, int>, std::vector<Instruction*> > liveAcross; // values live into the second block, by edge
+
+    void number(const Cfg &cfg);
+    void inFrame(RegisterStats &stats);
+
+    public:
+        Function *function;
+        Selection &selection;
+        std::vector<Block*> order;             // the reachable blocks, as written
+        std::vector<int> positions;            // by instruction id
+        std::vector<int> blockStart, blockEnd; // by block id
+        std::vector<bool> needsSlot;           // by value id, when some piece is on the stack
+        std::vector<int> calleeSaved;          // the callee saved registers given out
+        std::map<int, std::vector<Move> > moves; // made ahead of the instruction at a position
+
+        RegisterAllocation(Function *function, Selection &selection);
+        ~RegisterAllocation();
+        RegisterAllocation(const RegisterAllocation&) = delete;
+        RegisterAllocation &operator=(const RegisterAllocation&) = delete;
+
+        // the location value has at position, where a read at an instruction's
+        // position finds a piece ending there too
+        int locationAt(Instruction *value, int position);
+        // what to copy on the edge, as one parallel move
+        std::vector<Move> edgeMoves(Block *from, Block *to);
+        // walks the code checking that each read finds the value it expects
+        bool check(std::ostream &problems);
+
+        friend class LinearScan;
+        friend RegisterAllocation *allocateRegisters(Function *function, Selection &selection, bool registers, RegisterStats &stats);
+};
+
+// linear scan over live intervals, after wimmer and mössenböck. an interval
+// that can't keep a register all its life is split, around calls that
+// clobber it or where another interval needs the register more, weighing
+// each use by how deeply it's nested in loops. phis and their operands prefer
+// each other's registers so the edge needs no move. with registers false every
+// value stays in its slot, as the baseline the allocation is measured against
+RegisterAllocation *allocateRegisters(Function *function, Selection &selection, bool registers, RegisterStats &stats);
+
+// values the allocator gives no location, since an immediate does
+bool isImmediate(Instruction *value);
+bool isFloatRegister(int reg);
+bool isCalleeSaved(int reg);
+
+#endif
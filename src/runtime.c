@@ -0,0 +1,143 @@
+//  recursive descent compiler by Andrew Miller
+
+// what a program compiled with -native links against. main runs the
+// program's statements, and the routines behave like the interpreter's:
+// puts write one value per line, gets read one whitespace separated word,
+// anything unreadable as the type asked for reads as its zero, and a
+// runtime error stops the program with status 1. built with IN_PROCESS it
+// is linked into the compiler for -run, where rt_run calls the program's
+// main in place of main and a runtime error returns to it instead
+#ifndef STANDALONE
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+#ifdef IN_PROCESS
+#include <setjmp.h>
+#endif
+
+#define RT_WORD 64 // bytes a word read starts out with, doubling as needed
+
+int rt_depth = 0; // calls in progress, which the generated code keeps under the interpreter's limit
+
+void prog_main(void);
+
+#ifdef IN_PROCESS
+static jmp_buf stopped; // where a runtime error goes back to rt_run
+#endif
+
+static void fail(const char *message, const char *function) {
+#ifdef IN_PROCESS
+    // with the compiler's output, where -interp puts its errors
+    printf("Runtime error: %s in @%s\n", message, function);
+    fflush(stdout);
+    longjmp(stopped, 1);
+#else
+    fflush(stdout);
+    fprintf(stderr, "Runtime error: %s in @%s\n", message, function);
+    exit(1);
+#endif
+}
+
+void rt_check(int index, int length, const char *function) {
+    char message[96];
+    snprintf(message, sizeof(message), "index %d out of range for an array of %d", index, length);
+    fail(message, function);
+}
+
+void rt_divide(const char *function) {
+    fail("division by zero", function);
+}
+
+void rt_overflow(const char *function) {
+    fail("stack overflow", function);
+}
+
+// the next word on stdin, empty at the end of the input, for the caller to keep or free
+static char *word(void) {
+    size_t size = RT_WORD, length = 0;
+    char *text = malloc(size);
+    int c = getchar();
+    while (c != EOF && isspace(c)) c = getchar();
+    while (c != EOF && !isspace(c)) {
+        if (length + 1 == size) text = realloc(text, size *= 2);
+        text[length++] = c;
+        c = getchar();
+    }
+    if (c != EOF) ungetc(c, stdin);
+    text[length] = '\0';
+    return text;
+}
+
+int rt_GETINTEGER(void) {
+    char *text = word();
+    int value = atoi(text);
+    free(text);
+    return value;
+}
+
+float rt_GETFLOAT(void) {
+    char *text = word();
+    float value = atof(text);
+    free(text);
+    return value;
+}
+
+int rt_GETBOOL(void) {
+    char *text = word();
+    int value = strcmp(text, "true") == 0 || atoi(text) != 0;
+    free(text);
+    return value;
+}
+
+// kept for the whole run
+char *rt_GETSTRING(void) {
+    return word();
+}
+
+int rt_PUTINTEGER(int value) {
+    printf("%d\n", value);
+    return 1;
+}
+
+int rt_PUTFLOAT(float value) {
+    printf("%g\n", value);
+    return 1;
+}
+
+int rt_PUTBOOL(int value) {
+    puts(value ? "true" : "false");
+    return 1;
+}
+
+int rt_PUTSTRING(const char *value) {
+    puts(value == NULL ? "" : value);
+    return 1;
+}
+
+float rt_SQRT(int value) {
+    return sqrtf((float)value);
+}
+
+int rt_strcmp(const char *a, const char *b) {
+    int order = strcmp(a == NULL ? "" : a, b == NULL ? "" : b);
+    return order < 0 ? -1 : order > 0;
+}
+
+#ifdef IN_PROCESS
+// runs a program's main loaded into this process, returning its exit status
+int rt_run(void (*entry)(void)) {
+    rt_depth = 0;
+    if (setjmp(stopped) != 0) return 1;
+    entry();
+    fflush(stdout);
+    return 0;
+}
+#else
+int main(void) {
+    prog_main();
+    return 0;
+}
+#endif
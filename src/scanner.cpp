@@ -1,6 +1,7 @@
 //  recursive descent compiler by Andrew Miller
 
 #include <algorithm>
+#include "alloctrack.h"
 #include "parser.h"
 #include "scanner.h"
 #include "symboltable.h"
@@ -14,7 +15,10 @@ void Scanner::reportWarning(std::string message) {
 }
 
 bool Scanner::init(char *filename, std::string contents, bool debug) {
+    ALLOC_SUBSYSTEM(ALLOC_SCANNER);
     this->lineCounter = 1;
+    this->colCounter = 0;
+    this->streamIndex = 0;
     this->errCounter = 0;
     this->warnCounter = 0;
     this->multilineNest = 0;
@@ -24,6 +28,9 @@ bool Scanner::init(char *filename, std::string contents, bool debug) {
     this->multilineCommentFlag = false;
     std::cout << "Flags initialized.\n";
 
+    // a scanner may be reused, so forget the tokens of any previous file
+    this->wordList.clear();
+
     // populate symbol table with reserved words
     symbolTable = SymbolTable();
     this->procList = {
@@ -51,6 +58,7 @@ bool Scanner::init(char *filename, std::string contents, bool debug) {
 
 // finds the next token in the codestream
 int Scanner::getNextToken() {
+    ALLOC_SUBSYSTEM(ALLOC_SCANNER);
     int current = this->advanceScanner();
 
     // skip spaces and tab characters
@@ -372,26 +380,23 @@ int Scanner::peekScannerDigit() {
     return 0;
 }
 
-// write word list out to txt file, so I can look at it and cry
-void Scanner::writeWordList() {
-    std::ofstream wordsOut;
-    std::list<Word> copyWordList = this->wordList;
-    wordsOut.open("../build/wordlist.txt", std::ofstream::out | std::ofstream::trunc);
-    while (copyWordList.empty() == false) {
-        Word frontWord = copyWordList.front();
-        wordsOut << frontWord.tokenType << "," << frontWord.tokenString << "\n";
-        copyWordList.pop_front();
+// write word list out to a stream, so I can look at it and cry
+void Scanner::writeWordList(std::ostream &wordsOut) {
+    std::list<Word>::iterator it;
+    for (it = this->wordList.begin(); it != this->wordList.end(); ++it) {
+        wordsOut << it->tokenType << "," << it->tokenString << "\n";
     }
-    wordsOut.close();
 }
 
 // getter for wordlist to be passed to parser
 std::list<Word> Scanner::getWordList() {
+    ALLOC_SUBSYSTEM(ALLOC_SCANNER);
     return this->wordList;
 }
 
 // getter for symbol table to be passed to parser
 SymbolTable Scanner::getSymbolTable() {
+    ALLOC_SUBSYSTEM(ALLOC_SYMBOLS);
     return this->symbolTable;
 }
 
@@ -7,6 +7,7 @@
 #include <memory>
 #include <sys/stat.h>
 #include <utility>
+#include "symboltable.h"
 #include "word.h"
 
 // time-efficient check for file existence
@@ -35,7 +36,7 @@ static class Scanner {
     public:
         bool init(char *filename, std::string contents, bool debug);
         int getNextToken();
-        void writeWordList();
+        void writeWordList(std::ostream &wordsOut);
         std::list<Word> getWordList();
         SymbolTable getSymbolTable();
         Record symbolLookup(std::string tokenString);
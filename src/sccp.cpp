@@ -0,0 +1,285 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <climits>
+#include <cstring>
+#include "passes.h"
+
+// lattice states, a value only ever moves down
+#define LATTICE_TOP      0 // nothing known yet, no executable definition seen
+#define LATTICE_CONSTANT 1
+#define LATTICE_BOTTOM   2 // could be more than one value at run time
+
+struct Lattice {
+    int state = LATTICE_TOP;
+    int intValue = 0;  // ints, and bools as 0 or 1
+    float floatValue = 0.0;
+};
+
+static Lattice constantOf(int type, int intValue, float floatValue) {
+    Lattice value;
+    value.state = LATTICE_CONSTANT;
+    if (type == IR_FLOAT) value.floatValue = floatValue;
+    else value.intValue = type == IR_BOOL ? intValue != 0 : intValue;
+    return value;
+}
+
+static Lattice bottom() {
+    Lattice value;
+    value.state = LATTICE_BOTTOM;
+    return value;
+}
+
+// floats compare by bits, so a NaN constant still equals itself
+static bool sameLattice(const Lattice &a, const Lattice &b) {
+    return a.state == b.state && a.intValue == b.intValue && memcmp(&a.floatValue, &b.floatValue, sizeof(float)) == 0;
+}
+
+// wegman and zadeck's sparse conditional constant propagation: values and
+// cfg edges are discovered together, so a value is only ever merged from
+// edges that can actually run, and a branch on a constant only opens one
+class Propagation {
+    Function *function;
+    std::vector<Lattice> values;          // by value id
+    std::vector<bool> executable;         // by block id
+    std::vector<std::vector<bool> > edges; // by block id, then pred index
+    std::vector<Block*> blockWork;
+    std::vector<std::pair<Block*, Block*> > edgeWork;
+    std::vector<Instruction*> valueWork;
+
+    Lattice evaluate(Instruction *instruction);
+    Lattice meetPhi(Instruction *phi);
+    void visit(Instruction *instruction);
+    void markEdge(Block *from, Block *to);
+
+    public:
+        Propagation(Function *function);
+        void solve();
+        int rewrite();
+};
+
+Propagation::Propagation(Function *function) {
+    this->function = function;
+    this->values.resize(function->nextValueId);
+    this->executable.assign(function->nextBlockId, false);
+    this->edges.resize(function->nextBlockId);
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        Block *block = function->blocks[i];
+        this->edges[block->id].assign(block->preds.size(), false);
+    }
+}
+
+static int wrap(long value) {
+    return (int)(unsigned int)value;
+}
+
+Lattice Propagation::evaluate(Instruction *instruction) {
+    int type = instruction->type;
+    switch (instruction->op) {
+        case OP_CONST:
+            if (type == IR_STRING) return bottom();
+            return constantOf(type, instruction->intValue, instruction->floatValue);
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+        case OP_AND: case OP_OR:
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+        case OP_NEG: case OP_NOT: case OP_ITOF: case OP_BTOI: case OP_ITOB:
+            break;
+        default:
+            return bottom();
+    }
+
+    Lattice a = this->values[instruction->operands[0]->id];
+    Lattice b = instruction->operands.size() > 1 ? this->values[instruction->operands[1]->id] : a;
+
+    // an operand that decides the result alone, whatever the other turns out to be
+    if (instruction->op == OP_MUL && type == IR_INT) {
+        if ((a.state == LATTICE_CONSTANT && a.intValue == 0) || (b.state == LATTICE_CONSTANT && b.intValue == 0)) return constantOf(type, 0, 0);
+    }
+    if (instruction->op == OP_AND) {
+        if ((a.state == LATTICE_CONSTANT && a.intValue == 0) || (b.state == LATTICE_CONSTANT && b.intValue == 0)) return constantOf(type, 0, 0);
+    }
+    if (instruction->op == OP_OR) {
+        int all = type == IR_BOOL ? 1 : -1;
+        if ((a.state == LATTICE_CONSTANT && a.intValue == all) || (b.state == LATTICE_CONSTANT && b.intValue == all)) return constantOf(type, all, 0);
+    }
+
+    if (a.state == LATTICE_BOTTOM || b.state == LATTICE_BOTTOM) return bottom();
+    if (a.state == LATTICE_TOP || b.state == LATTICE_TOP) return Lattice();
+
+    // the operands' type, which the result's needn't be for comparisons and conversions
+    int operandType = instruction->operands[0]->type;
+    bool floats = operandType == IR_FLOAT;
+    long x = a.intValue, y = b.intValue;
+    float f = a.floatValue, g = b.floatValue;
+    switch (instruction->op) {
+        case OP_ADD: return floats ? constantOf(type, 0, f + g) : constantOf(type, wrap(x + y), 0);
+        case OP_SUB: return floats ? constantOf(type, 0, f - g) : constantOf(type, wrap(x - y), 0);
+        case OP_MUL: return floats ? constantOf(type, 0, f * g) : constantOf(type, wrap(x * y), 0);
+        case OP_DIV:
+            if (floats) return constantOf(type, 0, f / g);
+            // dividing by zero has to stay to fail at run time, and INT_MIN / -1 traps on most machines
+            if (y == 0 || (x == INT_MIN && y == -1)) return bottom();
+            return constantOf(type, x / y, 0);
+        case OP_NEG: return floats ? constantOf(type, 0, -f) : constantOf(type, wrap(-x), 0);
+        case OP_AND: return constantOf(type, x & y, 0);
+        case OP_OR: return constantOf(type, x | y, 0);
+        case OP_NOT: return constantOf(type, type == IR_BOOL ? !x : ~x, 0);
+        case OP_EQ: return constantOf(type, floats ? f == g : x == y, 0);
+        case OP_NE: return constantOf(type, floats ? f != g : x != y, 0);
+        case OP_LT: return constantOf(type, floats ? f < g : x < y, 0);
+        case OP_LE: return constantOf(type, floats ? f <= g : x <= y, 0);
+        case OP_GT: return constantOf(type, floats ? f > g : x > y, 0);
+        case OP_GE: return constantOf(type, floats ? f >= g : x >= y, 0);
+        case OP_ITOF: return constantOf(type, 0, (float)x);
+        case OP_BTOI: return constantOf(type, x != 0, 0);
+        case OP_ITOB: return constantOf(type, x != 0, 0);
+    }
+    return bottom();
+}
+
+// the meet over the edges known to run, edges not yet seen don't count
+Lattice Propagation::meetPhi(Instruction *phi) {
+    Lattice result;
+    std::vector<bool> &incoming = this->edges[phi->block->id];
+    for (size_t i = 0; i < phi->operands.size(); i++) {
+        if (!incoming[i]) continue;
+        Lattice value = this->values[phi->operands[i]->id];
+        if (value.state == LATTICE_TOP) continue;
+        if (value.state == LATTICE_BOTTOM) return bottom();
+        if (result.state == LATTICE_TOP) result = value;
+        else if (!sameLattice(result, value)) return bottom();
+    }
+    return result;
+}
+
+void Propagation::markEdge(Block *from, Block *to) {
+    std::vector<bool> &incoming = this->edges[to->id];
+    bool opened = false;
+    for (size_t i = 0; i < to->preds.size(); i++) {
+        if (to->preds[i] != from || incoming[i]) continue;
+        incoming[i] = true;
+        opened = true;
+    }
+    if (opened) this->edgeWork.push_back(std::make_pair(from, to));
+}
+
+void Propagation::visit(Instruction *instruction) {
+    if (instruction->op == OP_BR) {
+        this->markEdge(instruction->block, instruction->targets[0]);
+        return;
+    }
+    if (instruction->op == OP_CONDBR) {
+        Lattice condition = this->values[instruction->operands[0]->id];
+        if (condition.state == LATTICE_TOP) return;
+        for (int i = 0; i < 2; i++) {
+            if (condition.state == LATTICE_CONSTANT && condition.intValue != (i == 0)) continue;
+            this->markEdge(instruction->block, instruction->targets[i]);
+        }
+        return;
+    }
+    if (instruction->type == IR_VOID) return;
+
+    Lattice &current = this->values[instruction->id];
+    if (current.state == LATTICE_BOTTOM) return;
+    Lattice next = instruction->op == OP_PHI ? this->meetPhi(instruction) : this->evaluate(instruction);
+    if (sameLattice(current, next)) return;
+    // a value that changes its constant has more than one value
+    if (current.state == LATTICE_CONSTANT && next.state == LATTICE_CONSTANT) next = bottom();
+    if (next.state == LATTICE_TOP) return;
+    current = next;
+    this->valueWork.push_back(instruction);
+}
+
+void Propagation::solve() {
+    Block *entry = this->function->entry();
+    this->executable[entry->id] = true;
+    this->blockWork.push_back(entry);
+
+    while (!this->blockWork.empty() || !this->edgeWork.empty() || !this->valueWork.empty()) {
+        while (!this->blockWork.empty()) {
+            Block *block = this->blockWork.back();
+            this->blockWork.pop_back();
+            for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+                this->visit(*it);
+            }
+        }
+        if (!this->edgeWork.empty()) {
+            Block *to = this->edgeWork.back().second;
+            this->edgeWork.pop_back();
+            // a block seen before only has new incoming values for its phis
+            if (!this->executable[to->id]) {
+                this->executable[to->id] = true;
+                this->blockWork.push_back(to);
+            }
+            else {
+                std::vector<Instruction*> phis = to->phis();
+                for (size_t i = 0; i < phis.size(); i++) this->visit(phis[i]);
+            }
+            continue;
+        }
+        if (!this->valueWork.empty()) {
+            Instruction *value = this->valueWork.back();
+            this->valueWork.pop_back();
+            for (size_t i = 0; i < value->users.size(); i++) {
+                Instruction *user = value->users[i];
+                if (this->executable[user->block->id]) this->visit(user);
+            }
+        }
+    }
+}
+
+// swaps every value found constant for a constant where it was defined, and
+// every branch that can only go one way for a br
+int Propagation::rewrite() {
+    Function *function = this->function;
+    bool folded = false, pruned = false;
+
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        Block *block = function->blocks[i];
+        if (!this->executable[block->id]) continue;
+        std::vector<Instruction*> constants;
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->type == IR_VOID || instruction->isConstant() || instruction->op == OP_CALL) continue;
+            if (this->values[instruction->id].state == LATTICE_CONSTANT) constants.push_back(instruction);
+        }
+        for (size_t j = 0; j < constants.size(); j++) {
+            Instruction *instruction = constants[j];
+            Lattice &value = this->values[instruction->id];
+            Instruction *constant = function->create(OP_CONST, instruction->type);
+            constant->intValue = value.intValue;
+            constant->floatValue = value.floatValue;
+            if (instruction->op == OP_PHI) block->insertAfterPhis(constant);
+            else block->insertBefore(instruction, constant);
+            instruction->replaceAllUsesWith(constant);
+            instruction->block->erase(instruction);
+            folded = true;
+        }
+    }
+
+    // conditions are all constants by now, wherever their blocks came in the order
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        Block *block = function->blocks[i];
+        Instruction *last = block->terminator();
+        if (!this->executable[block->id] || last == NULL || last->op != OP_CONDBR) continue;
+        // both edges to one block are simplifycfg's to merge, their phi values may differ
+        if (!last->operands[0]->isConstant() || last->targets[0] == last->targets[1]) continue;
+        Block *taken = last->targets[last->operands[0]->intValue ? 0 : 1];
+        Block *dropped = last->targets[last->operands[0]->intValue ? 1 : 0];
+        dropped->removePred(block);
+        block->erase(last);
+        Instruction *br = function->create(OP_BR, IR_VOID);
+        br->targets.push_back(taken);
+        block->append(br);
+        pruned = true;
+    }
+
+    if (function->removeUnreachableBlocks()) pruned = true;
+    if (pruned) return CHANGED_CFG;
+    return folded ? CHANGED_INSTRUCTIONS : CHANGED_NONE;
+}
+
+int propagateConstants(Function *function, AnalysisCache &analyses) {
+    Propagation propagation(function);
+    propagation.solve();
+    return propagation.rewrite();
+}
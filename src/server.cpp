@@ -0,0 +1,399 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <list>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "driver.h"
+#include "protocol.h"
+#include "server.h"
+#include "symboltable.h"
+
+// how many finished responses the server keeps around for repeat requests
+#define RESPONSE_CACHE_SIZE 64
+
+// how many requests are compiled (or their programs run) at once
+#define SERVER_MAX_JOBS 16
+
+// bytes of a client's input held for a program before the client is read again
+#define MAX_PENDING_INPUT 65536
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+    stopRequested = 1;
+}
+
+// sends every output of the child compile back to the server as a frame
+class FrameSink : public OutputSink {
+    int fd;
+
+    public:
+        FrameSink(int out) { fd = out; }
+        void write(std::string name, std::string contents) {
+            std::string frame;
+            appendFrame(frame, F_OUTPUT, name + '\0' + contents);
+            writeAll(this->fd, frame);
+        }
+};
+
+// least recently used map from request to the full response it produced
+class ResponseCache {
+    typedef std::pair<std::string, std::string> entry;
+    std::list<entry> order; // front is most recently used
+    std::unordered_map<std::string, std::list<entry>::iterator> index;
+
+    public:
+        bool lookup(std::string key, std::string &response) {
+            auto found = this->index.find(key);
+            if (found == this->index.end()) return false;
+            this->order.splice(this->order.begin(), this->order, found->second);
+            response = found->second->second;
+            return true;
+        }
+
+        void insert(std::string key, std::string response) {
+            if (this->index.count(key) > 0) return;
+            this->order.push_front(entry(key, response));
+            this->index[key] = this->order.begin();
+            if (this->order.size() > RESPONSE_CACHE_SIZE) {
+                this->index.erase(this->order.back().first);
+                this->order.pop_back();
+            }
+        }
+};
+
+// parses a request's flags the way the child will
+static CompileOptions requestOptions(std::vector<std::string> args) {
+    std::vector<char *> argv;
+    for (size_t i = 0; i < args.size(); i++) argv.push_back(&args[i][0]);
+    return parseOptions(argv.size(), argv.data(), 0);
+}
+
+// stats.json, trace.json and perf counters describe one compile, and a run's
+// output depends on its input, so a response carrying them is never kept or replayed
+static bool replayable(CompileOptions options) {
+    return !options.stats && !options.trace && !options.perf && !options.interp && !options.vm && !options.run;
+}
+
+// compiles one request in a forked child, streaming what it prints to the
+// client as it goes and, for a run, the client's input to the program as it
+// reads. returns everything sent, for the cache, or nothing when the client
+// went away and the child was killed
+static std::string compileInChild(int client, std::vector<std::string> args, std::string filename, std::string source, int &status) {
+    CompileOptions options = requestOptions(args);
+    bool runs = options.interp || options.vm || options.run;
+    int inputPipe[2], stdoutPipe[2], outputPipe[2];
+    std::string response;
+    status = 1;
+    if (pipe(inputPipe) < 0 || pipe(stdoutPipe) < 0 || pipe(outputPipe) < 0) {
+        appendFrame(response, F_STDOUT, "Compile server could not create pipes\n");
+        appendFrame(response, F_EXIT, "1");
+        writeAll(client, response);
+        return response;
+    }
+
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        close(client);
+        close(inputPipe[1]);
+        close(stdoutPipe[0]);
+        close(outputPipe[0]);
+        dup2(inputPipe[0], STDIN_FILENO);
+        close(inputPipe[0]);
+        dup2(stdoutPipe[1], STDOUT_FILENO);
+        close(stdoutPipe[1]);
+        // a running program's prompts reach the client a line at a time
+        if (runs) setvbuf(stdout, NULL, _IOLBF, 0);
+
+        FrameSink sink(outputPipe[1]);
+        int status = compileSource(&filename[0], source, options, sink);
+        std::cout.flush();
+        _exit(status);
+    }
+    close(inputPipe[0]);
+    close(stdoutPipe[1]);
+    close(outputPipe[1]);
+
+    // only a run is given input, anything else reads the end of it at once
+    int input = inputPipe[1], printed = stdoutPipe[0], written = outputPipe[0];
+    if (runs && child > 0) fcntl(input, F_SETFL, O_NONBLOCK);
+    else {
+        close(input);
+        input = -1;
+    }
+
+    // pending is input the program hasn't taken yet. the client isn't read
+    // while there is too much of it, so a program that never reads can't
+    // make the handler hold everything the client sends
+    std::string pending, outputs;
+    bool inputEnded = false, gone = false;
+    char buffer[4096];
+    while (printed >= 0 || written >= 0) {
+        struct pollfd fds[4] = {
+            { printed, POLLIN, 0 },
+            { written, POLLIN, 0 },
+            { !gone && pending.size() < MAX_PENDING_INPUT ? client : -1, POLLIN, 0 },
+            { pending.empty() ? -1 : input, POLLOUT, 0 } };
+        if (poll(fds, 4, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[0].revents != 0) {
+            ssize_t n = read(printed, buffer, sizeof(buffer));
+            if (n > 0) {
+                std::string frame;
+                appendFrame(frame, F_STDOUT, std::string(buffer, n));
+                response += frame;
+                writeAll(client, frame);
+            }
+            else if (n == 0 || errno != EINTR) {
+                close(printed);
+                printed = -1;
+            }
+        }
+        if (fds[1].revents != 0) {
+            ssize_t n = read(written, buffer, sizeof(buffer));
+            if (n > 0) outputs.append(buffer, n);
+            else if (n == 0 || errno != EINTR) {
+                close(written);
+                written = -1;
+            }
+        }
+
+        // the client only sends input now, so a frame it can't finish means it has gone
+        if (fds[2].revents != 0) {
+            Frame frame;
+            if (!readFrame(client, frame, monotonicMs() + REQUEST_TIMEOUT_MS)) {
+                gone = true;
+                if (child > 0) kill(child, SIGKILL);
+            }
+            else if (frame.type == F_INPUT && input >= 0) {
+                if (frame.payload.empty()) inputEnded = true;
+                else pending += frame.payload;
+            }
+        }
+        if (fds[3].revents != 0) {
+            ssize_t n = write(input, pending.data(), pending.size());
+            if (n > 0) pending.erase(0, n);
+            else if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                // the program exited without reading the rest
+                pending.clear();
+                inputEnded = true;
+            }
+        }
+        if (input >= 0 && inputEnded && pending.empty()) {
+            close(input);
+            input = -1;
+        }
+    }
+    if (input >= 0) close(input);
+    if (printed >= 0) close(printed);
+    if (written >= 0) close(written);
+
+    int waitStatus = 0;
+    if (child > 0 && waitpid(child, &waitStatus, 0) == child && WIFEXITED(waitStatus)) {
+        status = WEXITSTATUS(waitStatus);
+    }
+    if (gone) {
+        status = 1;
+        return "";
+    }
+
+    std::string rest = outputs;
+    appendFrame(rest, F_EXIT, std::to_string(status));
+    writeAll(client, rest);
+    return response + rest;
+}
+
+// a request being compiled in its own process. the handler streams the
+// response to the client, and sends a copy to results for the cache when it may be replayed
+struct Handler {
+    pid_t pid;
+    int results;
+    std::string filename, key;
+    std::string response;
+    bool replay;
+};
+
+// forks the handler for a request read from client, returns its pid or -1.
+// the handler leads a process group of its own, so the compile it forks goes
+// down with it when the server stops
+static pid_t startHandler(int client, int listener, std::vector<std::string> &args, std::string &filename,
+    std::string &source, bool replay, int &results) {
+    int pipeFds[2];
+    if (pipe(pipeFds) < 0) {
+        std::string response;
+        appendFrame(response, F_STDOUT, "Compile server could not create pipes\n");
+        appendFrame(response, F_EXIT, "1");
+        writeAll(client, response);
+        return -1;
+    }
+
+    std::cout.flush();
+    pid_t handler = fork();
+    if (handler == 0) {
+        setpgid(0, 0);
+        close(listener);
+        close(pipeFds[0]);
+        int status = 1;
+        std::string response = compileInChild(client, args, filename, source, status);
+        if (replay && status == 0 && !response.empty()) writeAll(pipeFds[1], response);
+        _exit(0);
+    }
+    close(pipeFds[1]);
+    if (handler < 0) {
+        close(pipeFds[0]);
+        std::string response;
+        appendFrame(response, F_STDOUT, "Compile server could not start a compile\n");
+        appendFrame(response, F_EXIT, "1");
+        writeAll(client, response);
+        return -1;
+    }
+    setpgid(handler, handler);
+    results = pipeFds[0];
+    return handler;
+}
+
+// reads what the handler has sent so far, false once it has closed results
+static bool collectResult(Handler &handler) {
+    char buffer[65536];
+    ssize_t n = read(handler.results, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) return true;
+    if (n <= 0) return false;
+    handler.response.append(buffer, n);
+    return true;
+}
+
+// reaps a handler that is done and keeps its response if it may be replayed
+static void finishHandler(Handler &handler, ResponseCache &cache) {
+    close(handler.results);
+    waitpid(handler.pid, NULL, 0);
+    if (handler.replay && !handler.response.empty()) cache.insert(handler.key, handler.response);
+    std::cout << "Compiled \"" << handler.filename << "\"\n";
+}
+
+int runServer(std::string socketPath) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (listener < 0 || socketPath.size() >= sizeof(address.sun_path)) {
+        std::cout << "Could not create compile server socket \"" << socketPath << "\"\n";
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        std::cout << "Could not listen on \"" << socketPath << "\": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    // no SA_RESTART, so poll() returns when a stop signal arrives
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = requestStop;
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // warm up everything a child would otherwise build for itself
+    SymbolTable::reservedWords();
+    ResponseCache cache;
+
+    std::cout << "Compile server listening on \"" << socketPath << "\"\n";
+    std::vector<Handler> handlers;
+    while (!stopRequested) {
+        // past SERVER_MAX_JOBS, new clients wait in the listen queue until a handler finishes
+        std::vector<struct pollfd> fds;
+        fds.push_back({ listener, (short)(handlers.size() < SERVER_MAX_JOBS ? POLLIN : 0), 0 });
+        for (size_t i = 0; i < handlers.size(); i++) fds.push_back({ handlers[i].results, POLLIN, 0 });
+        if (poll(fds.data(), fds.size(), -1) < 0) continue;
+
+        // a handler closes its end of results when it's done
+        for (size_t i = handlers.size(); i-- > 0; ) {
+            if (fds[i + 1].revents == 0 || collectResult(handlers[i])) continue;
+            finishHandler(handlers[i], cache);
+            handlers.erase(handlers.begin() + i);
+        }
+        if ((fds[0].revents & POLLIN) == 0) continue;
+
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) continue;
+
+        // requests are read one at a time, so a client that stalls while
+        // sending its request or reading the response is dropped rather than
+        // holding up everyone behind it
+        struct timeval patience = { REQUEST_TIMEOUT_MS / 1000, (REQUEST_TIMEOUT_MS % 1000) * 1000 };
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &patience, sizeof(patience));
+        double deadline = monotonicMs() + REQUEST_TIMEOUT_MS;
+
+        // read the request: flags, then the filename, then the source. a run's
+        // input follows while the program goes, and its handler reads that
+        std::vector<std::string> args;
+        std::string filename, source, key;
+        Frame frame;
+        bool complete = false;
+        while (readFrame(client, frame, deadline)) {
+            if (frame.type == F_ARG) {
+                args.push_back(frame.payload);
+                key += frame.payload + '\0';
+            }
+            else if (frame.type == F_NAME) filename = frame.payload;
+            else if (frame.type == F_SOURCE) {
+                source = frame.payload;
+                complete = true;
+                break;
+            }
+        }
+        if (!complete) {
+            std::cout << "Dropped an incomplete, oversized or stalled request\n";
+            close(client);
+            continue;
+        }
+        key += source;
+
+        std::string response;
+        bool replay = replayable(requestOptions(args));
+        if (replay && cache.lookup(key, response)) {
+            std::cout << "Served \"" << filename << "\" from cache\n";
+            writeAll(client, response);
+            close(client);
+            continue;
+        }
+
+        // the compile, and any program it runs, happens in a handler process,
+        // so however long it takes the server goes on accepting
+        Handler handler;
+        handler.filename = filename;
+        handler.key = key;
+        handler.replay = replay;
+        handler.pid = startHandler(client, listener, args, filename, source, replay, handler.results);
+        close(client);
+        if (handler.pid > 0) handlers.push_back(handler);
+    }
+
+    // whatever is still running has nobody left to collect it
+    for (size_t i = 0; i < handlers.size(); i++) {
+        kill(-handlers[i].pid, SIGKILL);
+        close(handlers[i].results);
+        waitpid(handlers[i].pid, NULL, 0);
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+    std::cout << "Compile server stopped\n";
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+// runs the long-lived compile server on a unix socket until SIGINT/SIGTERM
+// each request is compiled in a forked child of the warm server process, so
+// the tables built at startup are shared and a fatal error only ends that child
+int runServer(std::string socketPath);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstdint>
+#include <string>
+
+// incremental SHA-256 (FIPS 180-4), used to address cached compiles
+class Sha256 {
+    uint32_t state[8];
+    unsigned char block[64];
+    uint64_t totalBytes = 0;
+    size_t blockFill = 0;
+
+    void compress(const unsigned char *chunk);
+
+    public:
+        Sha256();
+        void update(const std::string &data);
+        void update(const char *data, size_t length);
+
+        // finishes the digest and returns it as 64 lowercase hex characters
+        std::string hexDigest();
+};
+
+// one-shot convenience wrapper
+std::string sha256Hex(const std::string &data);
+
+#endif
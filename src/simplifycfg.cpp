@@ -0,0 +1,119 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include "passes.h"
+
+// a condbr on a constant, or with both edges to the same place, becomes a br
+static bool foldBranch(Function *function, Block *block) {
+    Instruction *last = block->terminator();
+    if (last == NULL || last->op != OP_CONDBR) return false;
+
+    Block *taken, *dropped;
+    if (last->targets[0] == last->targets[1]) {
+        // both edges carry the same values into the phis or the choice matters
+        std::vector<Instruction*> phis = last->targets[0]->phis();
+        int first = last->targets[0]->predIndex(block);
+        for (size_t i = 0; i < phis.size(); i++) {
+            for (size_t j = first + 1; j < phis[i]->operands.size(); j++) {
+                if (last->targets[0]->preds[j] == block && phis[i]->operands[j] != phis[i]->operands[first]) return false;
+            }
+        }
+        taken = dropped = last->targets[0];
+    }
+    else if (last->operands[0]->isConstant()) {
+        taken = last->targets[last->operands[0]->intValue ? 0 : 1];
+        dropped = last->targets[last->operands[0]->intValue ? 1 : 0];
+    }
+    else return false;
+
+    dropped->removePred(block);
+    block->erase(last);
+    Instruction *br = function->create(OP_BR, IR_VOID);
+    br->targets.push_back(taken);
+    block->append(br);
+    return true;
+}
+
+// folds succ, whose only predecessor is block, onto the end of block
+static bool mergeIntoPred(Function *function, Block *block) {
+    Instruction *last = block->terminator();
+    if (last == NULL || last->op != OP_BR) return false;
+    Block *succ = last->targets[0];
+    if (succ == block || succ == function->entry() || succ->preds.size() != 1) return false;
+
+    std::vector<Instruction*> phis = succ->phis();
+    for (size_t i = 0; i < phis.size(); i++) {
+        phis[i]->replaceAllUsesWith(phis[i]->operands[0]);
+        succ->erase(phis[i]);
+    }
+    block->erase(last);
+    for (std::list<Instruction*>::iterator it = succ->instructions.begin(); it != succ->instructions.end(); it++) {
+        block->append(*it);
+    }
+    succ->instructions.clear();
+
+    std::vector<Block*> succs = block->succs();
+    for (size_t i = 0; i < succs.size(); i++) succs[i]->replacePred(succ, block);
+    function->blocks.erase(std::find(function->blocks.begin(), function->blocks.end(), succ));
+    delete succ;
+    return true;
+}
+
+// sends the edges into a block holding nothing but a br straight to its
+// target, for every predecessor the target's phis can tell apart
+static bool forwardEdges(Function *function, Block *block) {
+    if (block == function->entry() || block->instructions.size() != 1) return false;
+    Instruction *last = block->terminator();
+    if (last == NULL || last->op != OP_BR || last->targets[0] == block) return false;
+    Block *target = last->targets[0];
+    std::vector<Instruction*> phis = target->phis();
+    int through = target->predIndex(block);
+
+    bool changed = false;
+    std::vector<Block*> preds = block->preds;
+    for (size_t i = 0; i < preds.size(); i++) {
+        Block *pred = preds[i];
+        if (block->predIndex(pred) < 0) continue; // an earlier condbr already moved both edges
+        if (!phis.empty() && target->predIndex(pred) >= 0) continue;
+
+        Instruction *branch = pred->terminator();
+        for (size_t j = 0; j < branch->targets.size(); j++) {
+            if (branch->targets[j] != block) continue;
+            branch->targets[j] = target;
+            block->removePred(pred);
+            target->preds.push_back(pred);
+            for (size_t k = 0; k < phis.size(); k++) phis[k]->addOperand(phis[k]->operands[through]);
+        }
+        changed = true;
+    }
+
+    if (block->preds.empty()) function->removeBlock(block);
+    return changed;
+}
+
+int simplifyCfg(Function *function, AnalysisCache &analyses) {
+    bool changed = false;
+    bool again = true;
+    while (again) {
+        again = false;
+        for (size_t i = 0; i < function->blocks.size(); i++) {
+            if (foldBranch(function, function->blocks[i])) again = true;
+        }
+        if (function->removeUnreachableBlocks()) again = true;
+
+        // merging and forwarding delete blocks, so walk by pointer and restart on change
+        for (size_t i = 0; i < function->blocks.size(); i++) {
+            Block *block = function->blocks[i];
+            if (mergeIntoPred(function, block)) {
+                again = true;
+                i--;
+            }
+            else if (forwardEdges(function, block)) {
+                again = true;
+                break;
+            }
+        }
+        if (again) changed = true;
+    }
+    return changed ? CHANGED_CFG : CHANGED_NONE;
+}
@@ -0,0 +1,558 @@
+//  recursive descent compiler by Andrew Miller
+
+// the runtime for -static programs, which link against nothing but this: the
+// few pieces of the c library runtime.c uses, over raw linux system calls,
+// then runtime.c itself. output matches the library's to the character, %g
+// included, and so does reading numbers, so a program behaves the same
+// however it was linked
+#define STANDALONE
+#include <stdarg.h>
+#include <stddef.h>
+
+#define EOF (-1)
+#define FILE_BUFFER 4096
+#define FORMAT_BUFFER 1200 // the longest %g is 13 characters, %s goes straight out
+#define LIMBS 100          // base 1e9 digits, enough for any double exactly
+#define SMALLEST_BLOCK 4   // log2 of malloc's smallest block
+#define BLOCK_CLASSES 40
+#define ARENA (1 << 20)    // bytes malloc maps at a time, at least
+
+#define SYS_READ 0
+#define SYS_WRITE 1
+#define SYS_MMAP 9
+#define SYS_EXIT_GROUP 231
+
+static long syscall3(long number, long a, long b, long c) {
+    long result;
+    __asm__ volatile ("syscall" : "=a"(result) : "a"(number), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+    return result;
+}
+
+static long syscall6(long number, long a, long b, long c, long d, long e, long f) {
+    long result;
+    register long r10 __asm__("r10") = d;
+    register long r8 __asm__("r8") = e;
+    register long r9 __asm__("r9") = f;
+    __asm__ volatile ("syscall" : "=a"(result) : "a"(number), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+        : "rcx", "r11", "memory");
+    return result;
+}
+
+void *memcpy(void *to, const void *from, size_t size) {
+    char *out = to;
+    const char *in = from;
+    while (size-- > 0) *out++ = *in++;
+    return to;
+}
+
+void *memset(void *to, int value, size_t size) {
+    char *out = to;
+    while (size-- > 0) *out++ = value;
+    return to;
+}
+
+size_t strlen(const char *text) {
+    size_t length = 0;
+    while (text[length] != '\0') length++;
+    return length;
+}
+
+int strcmp(const char *a, const char *b) {
+    while (*a != '\0' && *a == *b) a++, b++;
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+// sqrtss, with -fno-math-errno
+float sqrtf(float value) {
+    return __builtin_sqrtf(value);
+}
+
+int isspace(int c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// stdout is written when its buffer fills and at exit, stderr at once, and
+// stdin is read a buffer at a time
+typedef struct {
+    int fd;
+    int length;   // bytes buffered
+    int position; // of those, the ones stdin has handed out
+    char buffer[FILE_BUFFER];
+} FILE;
+
+static FILE files[3] = {{0}, {1}, {2}};
+#define stdin (&files[0])
+#define stdout (&files[1])
+#define stderr (&files[2])
+
+static void writeAll(int fd, const char *data, long length) {
+    while (length > 0) {
+        long written = syscall3(SYS_WRITE, fd, (long)data, length);
+        if (written <= 0) return;
+        data += written;
+        length -= written;
+    }
+}
+
+int fflush(FILE *file) {
+    if (file->fd == 0) return 0;
+    writeAll(file->fd, file->buffer, file->length);
+    file->length = 0;
+    return 0;
+}
+
+static void put(FILE *file, const char *data, long length) {
+    if (file->fd == 2 || length >= FILE_BUFFER) {
+        fflush(file);
+        writeAll(file->fd, data, length);
+        return;
+    }
+    if (file->length + length > FILE_BUFFER) fflush(file);
+    memcpy(file->buffer + file->length, data, length);
+    file->length += length;
+}
+
+int getchar(void) {
+    FILE *file = stdin;
+    if (file->position == file->length) {
+        long got = syscall3(SYS_READ, 0, (long)file->buffer, FILE_BUFFER);
+        if (got <= 0) return EOF;
+        file->length = got;
+        file->position = 0;
+    }
+    return (unsigned char)file->buffer[file->position++];
+}
+
+// only ever straight after a getchar, so the character is still buffered
+int ungetc(int c, FILE *file) {
+    if (c == EOF || file->position == 0) return EOF;
+    file->buffer[--file->position] = c;
+    return c;
+}
+
+void exit(int status) {
+    fflush(stdout);
+    syscall3(SYS_EXIT_GROUP, status, 0, 0);
+    __builtin_unreachable();
+}
+
+// malloc hands out power of two blocks with their size class just before
+// them, and free keeps each class's blocks on a list for reuse
+typedef struct Block {
+    struct Block *next;
+} Block;
+
+static Block *freeBlocks[BLOCK_CLASSES];
+static char *arena;
+static size_t arenaLeft;
+
+void *malloc(size_t size) {
+    int sizeClass = SMALLEST_BLOCK;
+    while (((size_t)1 << sizeClass) < size + 16) sizeClass++;
+    if (sizeClass >= BLOCK_CLASSES) return NULL;
+    Block *block = freeBlocks[sizeClass];
+    if (block != NULL) {
+        freeBlocks[sizeClass] = block->next;
+        return block;
+    }
+    size_t bytes = (size_t)1 << sizeClass;
+    if (bytes > arenaLeft) {
+        size_t mapped = bytes > ARENA ? bytes : ARENA;
+        long address = syscall6(SYS_MMAP, 0, mapped, 3 /* read, write */, 0x22 /* private, anonymous */, -1, 0);
+        if (address < 0 && address > -4096) return NULL;
+        arena = (char*)address;
+        arenaLeft = mapped;
+    }
+    char *start = arena;
+    arena += bytes;
+    arenaLeft -= bytes;
+    *(long*)start = sizeClass;
+    return start + 16;
+}
+
+void free(void *pointer) {
+    if (pointer == NULL) return;
+    int sizeClass = *(long*)((char*)pointer - 16);
+    Block *block = pointer;
+    block->next = freeBlocks[sizeClass];
+    freeBlocks[sizeClass] = block;
+}
+
+void *realloc(void *pointer, size_t size) {
+    if (pointer == NULL) return malloc(size);
+    size_t capacity = ((size_t)1 << *(long*)((char*)pointer - 16)) - 16;
+    if (size <= capacity) return pointer;
+    void *moved = malloc(size);
+    if (moved == NULL) return NULL;
+    memcpy(moved, pointer, capacity);
+    free(pointer);
+    return moved;
+}
+
+// numbers, base 1e9 digits least significant first, just big enough to
+// write out or read in any double exactly
+typedef struct {
+    int length;
+    unsigned int limbs[LIMBS];
+} Big;
+
+static void bigMultiply(Big *big, unsigned int factor, unsigned int add) {
+    unsigned long carry = add;
+    for (int i = 0; i < big->length; i++) {
+        carry += (unsigned long)big->limbs[i] * factor;
+        big->limbs[i] = carry % 1000000000;
+        carry /= 1000000000;
+    }
+    while (carry != 0 && big->length < LIMBS) {
+        big->limbs[big->length++] = carry % 1000000000;
+        carry /= 1000000000;
+    }
+}
+
+static void bigPower(Big *big, unsigned int base, int times, unsigned int chunk, int perChunk) {
+    for (; times >= perChunk; times -= perChunk) bigMultiply(big, chunk, 0);
+    while (times-- > 0) bigMultiply(big, base, 0);
+}
+
+// the exact decimal digits of a finite positive double, without trailing
+// zeros, and where the point goes, the value being 0.digits times 10^point
+static int exactDigits(double value, char *digits, int *point) {
+    union { double value; unsigned long bits; } split = {value};
+    unsigned long mantissa = split.bits & ((1UL << 52) - 1);
+    int exponent = (split.bits >> 52) & 0x7ff;
+    if (exponent == 0) exponent = 1;
+    else mantissa |= 1UL << 52;
+    exponent -= 1075;
+    while ((mantissa & 1) == 0) mantissa >>= 1, exponent++;
+
+    Big big = {2, {mantissa % 1000000000, mantissa / 1000000000}};
+    if (big.limbs[1] == 0) big.length = 1;
+    if (exponent > 0) bigPower(&big, 2, exponent, 1U << 29, 29);
+    else bigPower(&big, 5, -exponent, 1220703125, 13);
+
+    int length = 0;
+    for (int i = big.length - 1; i >= 0; i--) {
+        char limb[9];
+        unsigned int rest = big.limbs[i];
+        for (int k = 8; k >= 0; k--, rest /= 10) limb[k] = '0' + rest % 10;
+        for (int k = 0; k < 9; k++) {
+            if (length == 0 && limb[k] == '0') continue;
+            digits[length++] = limb[k];
+        }
+    }
+    *point = exponent > 0 ? length : length + exponent;
+    while (digits[length - 1] == '0') length--;
+    return length;
+}
+
+// %g, six significant digits, the exact value rounded half to even
+static int formatFloat(char *out, double value) {
+    int at = 0;
+    union { double value; unsigned long bits; } split = {value};
+    if (split.bits >> 63) out[at++] = '-', value = -value;
+    if (value != value || value == 1.0 / 0.0) {
+        memcpy(out + at, value != value ? "nan" : "inf", 3);
+        return at + 3;
+    }
+    if (value == 0) {
+        out[at++] = '0';
+        return at;
+    }
+
+    char digits[LIMBS * 9];
+    int point;
+    int length = exactDigits(value, digits, &point);
+    if (length > 6) {
+        int up = digits[6] > '5' || (digits[6] == '5' && (length > 7 || (digits[5] - '0') % 2 == 1));
+        length = 6;
+        for (int i = length - 1; up && i >= 0; i--) {
+            up = digits[i] == '9';
+            digits[i] = up ? '0' : digits[i] + 1;
+        }
+        if (up) {
+            digits[0] = '1';
+            length = 1;
+            point++;
+        }
+        while (digits[length - 1] == '0') length--;
+    }
+
+    int exponent = point - 1;
+    if (exponent < -4 || exponent >= 6) {
+        out[at++] = digits[0];
+        if (length > 1) out[at++] = '.';
+        for (int i = 1; i < length; i++) out[at++] = digits[i];
+        out[at++] = 'e';
+        out[at++] = exponent < 0 ? '-' : '+';
+        if (exponent < 0) exponent = -exponent;
+        if (exponent >= 100) out[at++] = '0' + exponent / 100;
+        out[at++] = '0' + exponent / 10 % 10;
+        out[at++] = '0' + exponent % 10;
+        return at;
+    }
+    if (point <= 0) {
+        out[at++] = '0';
+        out[at++] = '.';
+        for (int i = point; i < 0; i++) out[at++] = '0';
+        for (int i = 0; i < length; i++) out[at++] = digits[i];
+        return at;
+    }
+    for (int i = 0; i < point; i++) out[at++] = i < length ? digits[i] : '0';
+    if (length > point) out[at++] = '.';
+    for (int i = point; i < length; i++) out[at++] = digits[i];
+    return at;
+}
+
+// %d, %s, %g and %% are all the runtime asks for
+static int format(char *out, size_t size, const char *text, va_list arguments) {
+    size_t at = 0;
+    for (; *text != '\0'; text++) {
+        char piece[FORMAT_BUFFER];
+        const char *from = piece;
+        int length = 0;
+        if (*text != '%') piece[length++] = *text;
+        else if (*++text == 'd') {
+            long value = va_arg(arguments, int);
+            unsigned long magnitude = value < 0 ? -value : value;
+            char reversed[16];
+            int count = 0;
+            do reversed[count++] = '0' + magnitude % 10; while ((magnitude /= 10) != 0);
+            if (value < 0) piece[length++] = '-';
+            while (count > 0) piece[length++] = reversed[--count];
+        }
+        else if (*text == 's') {
+            from = va_arg(arguments, const char*);
+            length = strlen(from);
+        }
+        else if (*text == 'g') length = formatFloat(piece, va_arg(arguments, double));
+        else piece[length++] = *text;
+        for (int i = 0; i < length; i++, at++) {
+            if (at + 1 < size) out[at] = from[i];
+        }
+    }
+    if (size > 0) out[at < size ? at : size - 1] = '\0';
+    return at;
+}
+
+int snprintf(char *out, size_t size, const char *text, ...) {
+    va_list arguments;
+    va_start(arguments, text);
+    int length = format(out, size, text, arguments);
+    va_end(arguments);
+    return length;
+}
+
+static int vfprintf(FILE *file, const char *text, va_list arguments) {
+    va_list again;
+    va_copy(again, arguments);
+    char buffer[FORMAT_BUFFER];
+    int length = format(buffer, sizeof(buffer), text, arguments);
+    if (length < (int)sizeof(buffer)) put(file, buffer, length);
+    else {
+        char *large = malloc(length + 1);
+        format(large, length + 1, text, again);
+        put(file, large, length);
+        free(large);
+    }
+    va_end(again);
+    return length;
+}
+
+int fprintf(FILE *file, const char *text, ...) {
+    va_list arguments;
+    va_start(arguments, text);
+    int length = vfprintf(file, text, arguments);
+    va_end(arguments);
+    return length;
+}
+
+int printf(const char *text, ...) {
+    va_list arguments;
+    va_start(arguments, text);
+    int length = vfprintf(stdout, text, arguments);
+    va_end(arguments);
+    return length;
+}
+
+int puts(const char *text) {
+    put(stdout, text, strlen(text));
+    put(stdout, "\n", 1);
+    return 1;
+}
+
+// strtol's reading, which atoi is: leading space, a sign, then digits, held
+// at the long limits on overflow before being cut to an int
+int atoi(const char *text) {
+    while (isspace(*text)) text++;
+    int negative = *text == '-';
+    if (*text == '-' || *text == '+') text++;
+    unsigned long value = 0, limit = negative ? 1UL << 63 : (1UL << 63) - 1;
+    for (; *text >= '0' && *text <= '9'; text++) {
+        int digit = *text - '0';
+        value = value > (limit - digit) / 10 ? limit : value * 10 + digit;
+    }
+    return (int)(negative ? -value : value);
+}
+
+// a decimal number of digits times 10^exponent as the nearest double. few
+// enough digits and a small enough power of ten are both exact doubles and
+// one operation rounds them correctly; otherwise the quotient is worked out
+// bit by bit from big integers and rounded half to even by hand
+typedef struct {
+    int length;
+    unsigned int words[LIMBS * 2]; // base 2^32, least significant first
+} Binary;
+
+static void binaryMultiply(Binary *big, unsigned int factor, unsigned int add) {
+    unsigned long carry = add;
+    for (int i = 0; i < big->length; i++) {
+        carry += (unsigned long)big->words[i] * factor;
+        big->words[i] = carry;
+        carry >>= 32;
+    }
+    if (carry != 0) big->words[big->length++] = carry;
+}
+
+static void binaryShift(Binary *big, int bits) {
+    int words = bits / 32;
+    bits %= 32;
+    big->words[big->length] = 0;
+    for (int i = big->length; i >= 0; i--) {
+        unsigned long wide = (unsigned long)big->words[i] << bits;
+        if (i > 0 && bits > 0) wide |= big->words[i - 1] >> (32 - bits);
+        big->words[i + words] = wide;
+    }
+    for (int i = 0; i < words; i++) big->words[i] = 0;
+    big->length += words + 1;
+    while (big->length > 0 && big->words[big->length - 1] == 0) big->length--;
+}
+
+static int binaryCompare(const Binary *a, const Binary *b) {
+    if (a->length != b->length) return a->length < b->length ? -1 : 1;
+    for (int i = a->length - 1; i >= 0; i--) {
+        if (a->words[i] != b->words[i]) return a->words[i] < b->words[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void binarySubtract(Binary *a, const Binary *b) {
+    long borrow = 0;
+    for (int i = 0; i < a->length; i++) {
+        long difference = (long)a->words[i] - (i < b->length ? b->words[i] : 0) - borrow;
+        borrow = difference < 0;
+        a->words[i] = difference + (borrow << 32);
+    }
+    while (a->length > 0 && a->words[a->length - 1] == 0) a->length--;
+}
+
+static int binaryBits(const Binary *big) {
+    if (big->length == 0) return 0;
+    return 32 * (big->length - 1) + 32 - __builtin_clz(big->words[big->length - 1]);
+}
+
+static double decimalToDouble(const char *digits, int count, int exponent) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (count <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = 0;
+        for (int i = 0; i < count; i++) value = value * 10 + (digits[i] - '0');
+        return exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+    }
+    if (count + exponent > 310) return 1.0 / 0.0;
+    if (count + exponent < -330) return 0;
+
+    Binary numerator = {0}, denominator = {1, {1}};
+    for (int i = 0; i < count; i++) binaryMultiply(&numerator, 10, digits[i] - '0');
+    for (int i = exponent; i > 0; i--) binaryMultiply(&numerator, 10, 0);
+    for (int i = exponent; i < 0; i++) binaryMultiply(&denominator, 10, 0);
+    // scaled so the quotient has 54 bits, the 53 a double keeps and one to round on
+    int shift = 53 - (binaryBits(&numerator) - binaryBits(&denominator));
+    if (shift > 0) binaryShift(&numerator, shift);
+    else binaryShift(&denominator, -shift);
+    Binary bound = denominator;
+    binaryShift(&bound, 53);
+    if (binaryCompare(&numerator, &bound) < 0) {
+        binaryShift(&numerator, 1);
+        shift++;
+    }
+    unsigned long quotient = 0;
+    Binary part = denominator;
+    binaryShift(&part, 53);
+    for (int bit = 53; bit >= 0; bit--) {
+        if (binaryCompare(&numerator, &part) >= 0) {
+            binarySubtract(&numerator, &part);
+            quotient |= 1UL << bit;
+        }
+        part = denominator;
+        if (bit > 0) binaryShift(&part, bit - 1);
+    }
+    unsigned long mantissa = quotient >> 1;
+    if ((quotient & 1) && (numerator.length > 0 || (mantissa & 1))) mantissa++;
+    int power = 53 - shift;
+    if (mantissa >> 53) mantissa >>= 1, power++;
+    // the value is mantissa times 2^(power - 52); anything below the normal
+    // range is far below the smallest float, which is all it's read for
+    if (power > 1023) return 1.0 / 0.0;
+    if (power < -1022) return 0;
+    union { unsigned long bits; double value; } join = {((unsigned long)(power + 1023) << 52) | (mantissa & ((1UL << 52) - 1))};
+    return join.value;
+}
+
+// strtod's reading, which atof is: leading space, a sign, then inf, nan or
+// a decimal number with an optional exponent
+double atof(const char *text) {
+    while (isspace(*text)) text++;
+    int negative = *text == '-';
+    if (*text == '-' || *text == '+') text++;
+    double sign = negative ? -1.0 : 1.0;
+    char lower[4] = {0};
+    for (int i = 0; i < 3 && text[i] != '\0'; i++) lower[i] = text[i] | 0x20;
+    if (strcmp(lower, "inf") == 0) return sign / 0.0;
+    if (strcmp(lower, "nan") == 0) return negative ? -__builtin_nan("") : __builtin_nan("");
+
+    char digits[800];
+    int count = 0, exponent = 0, any = 0;
+    for (; *text >= '0' && *text <= '9'; text++, any = 1) {
+        if (count == 0 && *text == '0') continue;
+        if (count < (int)sizeof(digits)) digits[count++] = *text;
+        else exponent++;
+    }
+    if (*text == '.') {
+        for (text++; *text >= '0' && *text <= '9'; text++, any = 1) {
+            if (count == 0 && *text == '0') exponent--;
+            else if (count < (int)sizeof(digits)) digits[count++] = *text, exponent--;
+        }
+    }
+    if (!any) return 0;
+    if (*text == 'e' || *text == 'E') {
+        const char *power = text + 1;
+        int negativePower = *power == '-';
+        if (*power == '-' || *power == '+') power++;
+        if (*power >= '0' && *power <= '9') {
+            int value = 0;
+            for (; *power >= '0' && *power <= '9'; power++) {
+                if (value < 100000) value = value * 10 + (*power - '0');
+            }
+            exponent += negativePower ? -value : value;
+        }
+    }
+    while (count > 0 && digits[count - 1] == '0') count--, exponent++;
+    if (count == 0) return sign * 0.0;
+    return sign * decimalToDouble(digits, count, exponent);
+}
+
+#include "runtime.c"
+
+// the kernel starts the program here with the stack as it left it
+void rt_start(void) {
+    exit(main());
+}
+
+__asm__(
+    ".text\n"
+    ".globl _start\n"
+    "_start:\n"
+    "    xorl %ebp, %ebp\n"
+    "    andq $-16, %rsp\n"
+    "    call rt_start\n"
+    "    hlt\n");
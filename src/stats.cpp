@@ -0,0 +1,191 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+#include "driver.h"
+#include "stats.h"
+
+HotCounters hotCounters;
+CompileStats stats;
+int SemanticScope::depth = 0;
+
+double wallClockMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+double cpuClockMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+void CompileStats::reset() {
+    bool wasEnabled = this->enabled, wasPerf = this->perf;
+    *this = CompileStats();
+    this->enabled = wasEnabled;
+    this->perf = wasPerf;
+    this->startCounters = hotCounters;
+    this->startWall = wallClockMs();
+    this->startCpu = cpuClockMs();
+#ifdef TRACK_ALLOC
+    allocReset();
+#endif
+}
+
+PhaseTime &CompileStats::phase(std::string name, std::string parent) {
+    for (PhaseTime &existing : this->phases) {
+        if (existing.name == name) return existing;
+    }
+    PhaseTime added;
+    added.name = name;
+    added.parent = parent;
+    this->phases.push_back(added);
+    return this->phases.back();
+}
+
+void CompileStats::fact(std::string key, std::string json) {
+    this->facts.push_back(std::make_pair(key, json));
+}
+
+std::string jsonString(std::string value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else out += c;
+    }
+    return out + "\"";
+}
+
+std::string CompileStats::toJson() {
+    HotCounters counters = hotCounters;
+    counters.nodes -= this->startCounters.nodes;
+    counters.lookups -= this->startCounters.lookups;
+    counters.probes -= this->startCounters.probes;
+    counters.scopes -= this->startCounters.scopes;
+    counters.allocations -= this->startCounters.allocations;
+    counters.bytesAllocated -= this->startCounters.bytesAllocated;
+
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\n  \"compilerVersion\": " << jsonString(COMPILER_VERSION) << ",\n";
+    if (this->perf && !perfCounters().available()) {
+        out << "  \"perfCounters\": " << jsonString(perfCounters().unavailableReason) << ",\n";
+    }
+    else if (this->perf) {
+        PerfSample now = perfCounters().read();
+        std::string missing = "";
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            if (now.values[i] < 0) missing += (missing == "" ? "" : ", ") + jsonString(PerfCounters::names[i]);
+        }
+        if (missing != "") out << "  \"perfCountersMissing\": [" << missing << "],\n";
+    }
+    for (auto const &fact : this->facts) out << "  " << jsonString(fact.first) << ": " << fact.second << ",\n";
+    out << "  \"totalWallMs\": " << wallClockMs() - this->startWall << ",\n";
+    out << "  \"totalCpuMs\": " << cpuClockMs() - this->startCpu << ",\n";
+
+    out << "  \"phases\": [";
+    bool first = true;
+    for (PhaseTime &time : this->phases) {
+        out << (first ? "\n" : ",\n") << "    {\"name\": " << jsonString(time.name);
+        if (time.parent != "") out << ", \"parent\": " << jsonString(time.parent);
+        out << ", \"wallMs\": " << time.wallMs << ", \"cpuMs\": " << time.cpuMs
+            << ", \"calls\": " << time.calls;
+        bool firstCounter = true;
+        for (int i = 0; i < PERF_COUNTERS; i++) {
+            if (time.counters.values[i] < 0) continue;
+            out << (firstCounter ? ", \"counters\": {" : ", ") << jsonString(PerfCounters::names[i])
+                << ": " << time.counters.values[i];
+            firstCounter = false;
+        }
+        if (!firstCounter) out << "}";
+#ifdef TRACK_ALLOC
+        if (time.parent == "") {
+            out << ", \"alloc\": {\"count\": " << time.alloc.count << ", \"bytes\": " << time.alloc.bytes
+                << ", \"peakLiveBytes\": " << time.alloc.peakLiveBytes << "}";
+        }
+#endif
+        out << "}";
+        first = false;
+    }
+    out << "\n  ],\n";
+
+#ifdef TRACK_ALLOC
+    out << "  \"peakLiveBytes\": " << allocPeakLiveBytes() << ",\n";
+    out << "  \"subsystems\": [";
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+        AllocCounters subsystem = allocSubsystem(i);
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": " << jsonString(allocSubsystemNames[i])
+            << ", \"count\": " << subsystem.count << ", \"bytes\": " << subsystem.bytes
+            << ", \"liveBytes\": " << subsystem.liveBytes << ", \"peakLiveBytes\": " << subsystem.peakLiveBytes << "}";
+    }
+    out << "\n  ],\n";
+#endif
+
+    double probesPerLookup = counters.lookups > 0 ? (double)counters.probes / counters.lookups : 0.0;
+    out << "  \"counters\": {\n"
+        << "    \"tokens\": " << this->tokens << ",\n"
+        << "    \"nodesAllocated\": " << counters.nodes << ",\n"
+        << "    \"symbolLookups\": " << counters.lookups << ",\n"
+        << "    \"symbolProbes\": " << counters.probes << ",\n"
+        << "    \"probesPerLookup\": " << probesPerLookup << ",\n"
+        << "    \"scopesCreated\": " << counters.scopes << ",\n"
+        << "    \"allocations\": " << counters.allocations << ",\n"
+        << "    \"bytesAllocated\": " << counters.bytesAllocated << "\n"
+        << "  }\n}\n";
+    return out.str();
+}
+
+PhaseScope::PhaseScope(std::string name, std::string parent)
+    : time(stats.phase(name, parent)), span(time.name.c_str(), "phase")
+#ifdef TRACK_ALLOC
+    , charge(&time.alloc)
+#endif
+{
+    if (stats.perf) this->counters = perfCounters().read();
+    this->wall = wallClockMs();
+    this->cpu = cpuClockMs();
+}
+
+PhaseScope::~PhaseScope() {
+    this->time.wallMs += wallClockMs() - this->wall;
+    this->time.cpuMs += cpuClockMs() - this->cpu;
+    this->time.calls++;
+    if (!stats.perf) return;
+
+    PerfSample delta = perfDelta(this->counters, perfCounters().read());
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (delta.values[i] < 0) continue;
+        if (this->time.counters.values[i] < 0) this->time.counters.values[i] = 0;
+        this->time.counters.values[i] += delta.values[i];
+    }
+}
+
+SemanticScope::SemanticScope() {
+    if (!stats.enabled || depth++ > 0) return;
+    this->timing = true;
+    this->wall = wallClockMs();
+    this->cpu = cpuClockMs();
+}
+
+SemanticScope::~SemanticScope() {
+    if (!stats.enabled) return;
+    depth--;
+    if (!this->timing) return;
+    PhaseTime &time = stats.phase("semantic", "parse");
+    time.wallMs += wallClockMs() - this->wall;
+    time.cpuMs += cpuClockMs() - this->cpu;
+    time.calls++;
+}
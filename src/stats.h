@@ -0,0 +1,93 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include "alloctrack.h"
+#include "perf.h"
+#include "trace.h"
+
+// counters bumped on the compiler's hot paths, always on and a single add each
+struct HotCounters {
+    long nodes = 0;           // parse tree nodes constructed
+    long lookups = 0;         // symbol table lookups
+    long probes = 0;          // scope tables searched by those lookups
+    long scopes = 0;          // scopes created
+    long allocations = 0;     // calls to operator new
+    long bytesAllocated = 0;  // bytes requested from operator new
+};
+
+extern HotCounters hotCounters;
+
+// wall and cpu time, in milliseconds, accumulated under one name
+struct PhaseTime {
+    std::string name;
+    std::string parent; // set for phases nested inside another, like semantic in parse
+    double wallMs = 0.0, cpuMs = 0.0;
+    long calls = 0;
+    PerfSample counters; // summed over the calls, only read under -perf
+#ifdef TRACK_ALLOC
+    AllocCounters alloc;
+#endif
+};
+
+// per compile statistics behind -stats, reported as json
+class CompileStats {
+    std::list<PhaseTime> phases; // a list, open PhaseScopes hold references into it
+    std::vector<std::pair<std::string, std::string>> facts; // extra "key": value pairs
+    HotCounters startCounters;
+    double startWall = 0.0, startCpu = 0.0;
+
+    public:
+        bool enabled = false;
+        bool perf = false;    // read the hardware counters around each phase
+        long tokens = 0;
+
+        // clears everything and starts the overall clock
+        void reset();
+        PhaseTime &phase(std::string name, std::string parent = "");
+
+        // records a top level value, already json encoded
+        void fact(std::string key, std::string json);
+
+        std::string toJson();
+};
+
+extern CompileStats stats;
+
+// monotonic wall clock and process cpu clock, in milliseconds
+double wallClockMs();
+double cpuClockMs();
+
+// times the enclosing block into a named phase, and traces it under -trace
+class PhaseScope {
+    PhaseTime &time;
+    TraceSpan span;
+    double wall, cpu;
+    PerfSample counters;
+#ifdef TRACK_ALLOC
+    AllocPhase charge;
+#endif
+
+    public:
+        PhaseScope(std::string name, std::string parent = "");
+        ~PhaseScope();
+};
+
+// times semantic analysis inside the parser, only while -stats is on
+// nested uses (recursive type checking) only count the outermost one
+class SemanticScope {
+    static int depth;
+    double wall = 0.0, cpu = 0.0;
+    bool timing = false;
+
+    public:
+        SemanticScope();
+        ~SemanticScope();
+};
+
+// quotes and escapes a string for json output
+std::string jsonString(std::string value);
+
+#endif
@@ -1,17 +1,22 @@
 #include "symboltable.h"
+#include "alloctrack.h"
+#include "stats.h"
 #include <algorithm>
 #include <utility>
 
 // search for a token name and a pointer to its entry
 // takes the scope stack from the parser and locates records
 Record SymbolTable::lookup(std::string tokenString, std::stack<Word> scopes, bool debug) {
+    ALLOC_SUBSYSTEM(ALLOC_SYMBOLS);
     int scopesCount = scopes.size();
     symbol_book::const_iterator domain;
     symbol_map::const_iterator subject;
     Record found;
+    hotCounters.lookups++;
 
     // search the scope heirarchy starting from most local
     for (int i = 0; i < scopesCount; i++) {
+        hotCounters.probes++;
         if (debug) std::cout << "in SymbolTable::lookup(): searching scope='"
             << scopes.top().tokenString << "'\n";
 
@@ -32,9 +37,12 @@ Record SymbolTable::lookup(std::string tokenString, std::stack<Word> scopes, boo
 // lookup overload for a single scope string instead of a stack of scopes
 // helpful for SymbolTable::insert where only concerned with the local scope
 Record SymbolTable::lookup(std::string tokenString, Word scope) {
+    ALLOC_SUBSYSTEM(ALLOC_SYMBOLS);
     symbol_book::const_iterator domain;
     symbol_map::const_iterator subject;
     Record found;
+    hotCounters.lookups++;
+    hotCounters.probes++;
 
     domain = this->tables.find(scope);
     if (domain == this->tables.end()) return Record(); // scope doesn't exist?
@@ -66,6 +74,7 @@ void SymbolTable::print(std::string localScope) {
 
 // insert name into symbol table at record's scope, if it isn't already there
 void SymbolTable::insert(Record tokenRecord, bool debug) {
+    ALLOC_SUBSYSTEM(ALLOC_SYMBOLS);
     if (debug) std::cout << "Inserting symbol " << tokenRecord.tokenString << " at scope " << tokenRecord.scope.tokenString << "\n";
 
     symbol_book::const_iterator domain = this->tables.find(tokenRecord.scope);
@@ -79,8 +88,10 @@ void SymbolTable::insert(Record tokenRecord, bool debug) {
 
 // create a new scope during parsing (if it doesn't already exist)
 void SymbolTable::createScope(Word scope) {
+    ALLOC_SUBSYSTEM(ALLOC_SYMBOLS);
     symbol_book::const_iterator domain = this->tables.find(scope);
     if (domain == this->tables.end()) { // scope doesn't exist already
+        hotCounters.scopes++;
         symbol_map table = symbol_map();
         this->tables[scope] = table;
     }
@@ -88,6 +99,7 @@ void SymbolTable::createScope(Word scope) {
 
 // remove a new scope during parsing (if it exists)
 void SymbolTable::removeScope(Word scope) {
+    ALLOC_SUBSYSTEM(ALLOC_SYMBOLS);
     symbol_book::const_iterator domain = this->tables.find(scope);
     if (domain == this->tables.end()) return; // scope doesn't exist
     this->tables.erase(domain);
@@ -95,12 +107,13 @@ void SymbolTable::removeScope(Word scope) {
 
 // sets the sequence of parameter data types from a proc header
 void SymbolTable::setArgTypes(std::list<int> argTypes, std::string tokenString, bool debug, Word scope) {
+    ALLOC_SUBSYSTEM(ALLOC_SYMBOLS);
     if (debug) std::cout << "setting arg types to " << tokenString << std::endl;
     this->tables[scope][tokenString].argTypes = argTypes;
 }
 
-// instantiate global scope, and insert reserved words
-SymbolTable::SymbolTable() {
+// builds the global scope holding the reserved words and builtin procs
+static symbol_map buildReservedWords() {
     symbol_map table = symbol_map();
 
     std::string reservedStrings[] = {
@@ -257,6 +270,18 @@ SymbolTable::SymbolTable() {
         table[reservedStrings[i]] = toBeAdded;
     }
 
-    std::pair<Word, symbol_map> entry(Word("GLOBAL", 0, 0, 0), table);
+    return table;
+}
+
+// the reserved words never change, so they are only built once per process
+// and every symbol table after the first starts from a copy
+const symbol_map &SymbolTable::reservedWords() {
+    static const symbol_map reserved = buildReservedWords();
+    return reserved;
+}
+
+// instantiate global scope, and insert reserved words
+SymbolTable::SymbolTable() {
+    std::pair<Word, symbol_map> entry(Word("GLOBAL", 0, 0, 0), reservedWords());
     this->tables.insert(entry);
 }
\ No newline at end of file
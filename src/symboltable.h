@@ -99,6 +99,9 @@ class SymbolTable {
         // insert reserved words into symbol table
         SymbolTable();
 
+        // shared, lazily built table of reserved words
+        static const symbol_map &reservedWords();
+
         // remove all entries and free storage
         inline void free() { tables.clear(); };
 
@@ -0,0 +1,223 @@
+//  recursive descent compiler by Andrew Miller
+
+#include "passes.h"
+
+// a call whose result is returned as is, or combined with a value computed
+// before the call by an operation that can be regrouped, the accumulator
+struct TailSite {
+    Instruction *call;
+    Instruction *combine = NULL; // the add, mul, and or or taking the call's result, if any
+};
+
+// tail recursion elimination: a procedure that returns its own call's result
+// loops back to its start with the arguments as the new parameters instead.
+// when the result is first added to (or multiplied, anded or ored with)
+// something, that goes into an accumulator the other rets then fold in, so
+// n + f(n - 1) runs in constant stack too. calls to other procedures that
+// are returned as is are marked tail, for a backend to make them jumps
+class TailCalls {
+    Function *function;
+    MemoryRoots roots;
+    std::vector<TailSite> sites;
+    int accumulate = 0; // the op the accumulator combines with, 0 when there isn't one
+
+    bool intoFrame(Instruction *call);
+    bool returnedFrom(Instruction *call, Instruction *&combine);
+    Instruction *identity(Block *block);
+    void rewrite();
+
+    public:
+        TailCalls(Function *function);
+        int run();
+};
+
+TailCalls::TailCalls(Function *function) : function(function), roots(function) {}
+
+// whether an argument points into this call's own allocas, which a loop
+// would reuse, or anywhere unknown
+bool TailCalls::intoFrame(Instruction *call) {
+    for (size_t i = 0; i < call->operands.size(); i++) {
+        if (call->operands[i]->type != IR_PTR) continue;
+        int root = this->roots.rootOf(call->operands[i]);
+        if (root == ROOT_UNKNOWN || (root != ROOT_PARAMS && !this->roots.isGlobal(root))) return true;
+    }
+    return false;
+}
+
+// whether the call is followed by nothing but constants, at most one
+// regroupable operation on its result, and a ret of that
+bool TailCalls::returnedFrom(Instruction *call, Instruction *&combine) {
+    Block *block = call->block;
+    Instruction *last = block->terminator();
+    combine = NULL;
+    if (last == NULL || last->op != OP_RET) return false;
+
+    std::list<Instruction*>::iterator it = block->instructions.begin();
+    while (*it != call) it++;
+    for (it++; *it != last; it++) {
+        Instruction *instruction = *it;
+        if (instruction->op == OP_CONST) continue;
+        if (combine != NULL || instruction->operands.size() != 2) return false;
+        bool regroups = instruction->op == OP_ADD || instruction->op == OP_MUL || instruction->op == OP_AND || instruction->op == OP_OR;
+        // float arithmetic rounds differently once regrouped
+        if (!regroups || instruction->type == IR_FLOAT) return false;
+        if ((instruction->operands[0] == call) == (instruction->operands[1] == call)) return false;
+        combine = instruction;
+    }
+    Instruction *returned = combine != NULL ? combine : call;
+    if (call->type == IR_VOID) return last->operands.empty();
+    if (last->operands.empty() || last->operands[0] != returned) return false;
+    if (call->users.size() != 1 || (combine != NULL && combine->users.size() != 1)) return false;
+    return true;
+}
+
+// the value combining with which changes nothing, made ahead of block's branch
+Instruction *TailCalls::identity(Block *block) {
+    Instruction *constant = this->function->create(OP_CONST, this->function->returnType);
+    if (this->accumulate == OP_MUL) constant->intValue = 1;
+    if (this->accumulate == OP_AND) constant->intValue = constant->type == IR_BOOL ? 1 : -1;
+    return block->insertBefore(block->terminator(), constant);
+}
+
+int TailCalls::run() {
+    bool marked = false;
+    for (size_t i = 0; i < this->function->blocks.size(); i++) {
+        std::list<Instruction*> &instructions = this->function->blocks[i]->instructions;
+        for (std::list<Instruction*>::iterator it = instructions.begin(); it != instructions.end(); it++) {
+            Instruction *call = *it;
+            Instruction *combine;
+            if (call->op != OP_CALL || call->tail || !this->returnedFrom(call, combine) || this->intoFrame(call)) continue;
+            if (call->name != this->function->name) {
+                Function *callee = this->function->module->find(call->name);
+                if (combine == NULL && callee != NULL && !callee->external) {
+                    call->tail = true;
+                    marked = true;
+                }
+                continue;
+            }
+            // every accumulating site has to regroup the same way
+            if (combine != NULL && this->accumulate != 0 && combine->op != this->accumulate) continue;
+            TailSite site;
+            site.call = call;
+            if (combine != NULL) {
+                this->accumulate = combine->op;
+                site.combine = combine;
+            }
+            this->sites.push_back(site);
+        }
+    }
+    if (this->sites.empty() || !this->function->entry()->preds.empty()) return marked ? CHANGED_INSTRUCTIONS : CHANGED_NONE;
+    this->rewrite();
+    return CHANGED_CFG;
+}
+
+// the entry keeps the parameters and allocas and falls into a new header,
+// which every site branches back to. a parameter some site passes something
+// else for gets a phi there
+void TailCalls::rewrite() {
+    Block *entry = this->function->entry();
+    Block *header = this->function->addBlock();
+    this->function->blocks.pop_back();
+    this->function->blocks.insert(this->function->blocks.begin() + 1, header);
+
+    std::vector<Instruction*> moving;
+    std::vector<Instruction*> params(this->function->paramTypes.size(), NULL);
+    std::vector<Instruction*> allocas;
+    for (std::list<Instruction*>::iterator it = entry->instructions.begin(); it != entry->instructions.end(); it++) {
+        if ((*it)->op == OP_PARAM) params[(*it)->intValue] = *it;
+        else if ((*it)->op == OP_ALLOCA) allocas.push_back(*it);
+        else moving.push_back(*it);
+    }
+    for (size_t i = 0; i < moving.size(); i++) {
+        entry->unlink(moving[i]);
+        header->append(moving[i]);
+    }
+    std::vector<Block*> succs = header->succs();
+    for (size_t i = 0; i < succs.size(); i++) succs[i]->replacePred(entry, header);
+    this->function->branch(entry, header);
+
+    // phis before their operands exist, so the parameters' uses can move over first
+    std::vector<Instruction*> phis(params.size(), NULL);
+    for (size_t i = 0; i < params.size(); i++) {
+        if (params[i] == NULL) continue;
+        bool changes = false;
+        for (size_t j = 0; j < this->sites.size(); j++) changes = changes || this->sites[j].call->operands[i] != params[i];
+        if (!changes) continue;
+        phis[i] = header->insertAfterPhis(this->function->create(OP_PHI, params[i]->type));
+        params[i]->replaceAllUsesWith(phis[i]);
+        phis[i]->addOperand(params[i]);
+    }
+    Instruction *accumulator = NULL;
+    if (this->accumulate != 0) {
+        accumulator = header->insertAfterPhis(this->function->create(OP_PHI, this->function->returnType));
+        Instruction *identity = this->identity(entry);
+        accumulator->addOperand(identity);
+        // the rets that stay fold in what was put aside on the way down
+        for (size_t i = 0; i < this->function->blocks.size(); i++) {
+            Instruction *last = this->function->blocks[i]->terminator();
+            if (last == NULL || last->op != OP_RET || last->operands.empty()) continue;
+            bool site = false;
+            for (size_t j = 0; j < this->sites.size(); j++) site = site || this->sites[j].call->block == last->block;
+            if (site) continue;
+            // returning the identity leaves just what was put aside
+            Instruction *returned = last->operands[0];
+            if (returned->isConstant() && returned->intValue == identity->intValue) {
+                last->setOperand(0, accumulator);
+                continue;
+            }
+            Instruction *folded = this->function->create(this->accumulate, this->function->returnType);
+            folded->addOperand(accumulator);
+            folded->addOperand(last->operands[0]);
+            last->block->insertBefore(last, folded);
+            last->setOperand(0, folded);
+        }
+    }
+
+    for (size_t i = 0; i < this->sites.size(); i++) {
+        TailSite &site = this->sites[i];
+        Block *block = site.call->block;
+        block->erase(block->terminator());
+        for (size_t j = 0; j < phis.size(); j++) {
+            if (phis[j] != NULL) phis[j]->addOperand(site.call->operands[j]);
+        }
+        if (accumulator != NULL) {
+            // the combine now puts this level's share into the accumulator
+            if (site.combine != NULL) {
+                site.combine->setOperand(site.combine->operands[0] == site.call ? 0 : 1, accumulator);
+                accumulator->addOperand(site.combine);
+            }
+            else accumulator->addOperand(accumulator);
+        }
+        block->erase(site.call);
+
+        // the next time round expects its allocas zeroed, as a call would have
+        for (size_t j = 0; j < allocas.size(); j++) {
+            Instruction *alloca = allocas[j];
+            for (int k = 0; k < alloca->intValue; k++) {
+                Instruction *address = alloca;
+                if (alloca->intValue > 1) {
+                    Instruction *index = block->append(this->function->create(OP_CONST, IR_INT));
+                    index->intValue = k;
+                    address = this->function->create(OP_INDEX, IR_PTR);
+                    address->elemType = alloca->elemType;
+                    address->addOperand(alloca);
+                    address->addOperand(index);
+                    block->append(address);
+                }
+                Instruction *zero = block->append(this->function->create(OP_CONST, alloca->elemType));
+                Instruction *store = this->function->create(OP_STORE, IR_VOID);
+                store->elemType = alloca->elemType;
+                store->addOperand(address);
+                store->addOperand(zero);
+                block->append(store);
+            }
+        }
+        this->function->branch(block, header);
+    }
+}
+
+int eliminateTailCalls(Function *function, AnalysisCache &analyses) {
+    if (function->entry() == NULL) return CHANGED_NONE;
+    TailCalls tailCalls(function);
+    return tailCalls.run();
+}
@@ -0,0 +1,86 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include "stats.h"
+#include "trace.h"
+
+bool traceEnabled = false;
+
+// a thread's events, only ever appended to by that thread
+struct ThreadTrace {
+    int tid;
+    std::string threadName;
+    std::vector<TraceEvent> events;
+};
+
+// buffers are registered once per thread and live until exit,
+// the lock is only taken to register, reset and write out
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<ThreadTrace>> registry;
+static double traceStartMs = 0.0;
+
+static ThreadTrace &threadTrace() {
+    thread_local ThreadTrace *mine = NULL;
+    if (mine == NULL) {
+        std::lock_guard<std::mutex> hold(registryLock);
+        registry.push_back(std::unique_ptr<ThreadTrace>(new ThreadTrace()));
+        mine = registry.back().get();
+        mine->tid = registry.size();
+        mine->threadName = (mine->tid == 1) ? "main" : "thread " + std::to_string(mine->tid);
+    }
+    return *mine;
+}
+
+void traceReset() {
+    std::lock_guard<std::mutex> hold(registryLock);
+    for (auto &buffer : registry) buffer->events.clear();
+    traceStartMs = wallClockMs();
+}
+
+void traceThreadName(std::string name) {
+    if (traceEnabled) threadTrace().threadName = name;
+}
+
+TraceSpan::TraceSpan(const char *spanName, const char *spanCategory) {
+    this->active = traceEnabled;
+    if (!this->active) return;
+    this->name = spanName;
+    this->category = spanCategory;
+    this->start = wallClockMs();
+}
+
+TraceSpan::~TraceSpan() {
+    if (!this->active) return;
+    double end = wallClockMs();
+    TraceEvent event;
+    event.name = this->name;
+    event.category = this->category;
+    event.detail = this->detail;
+    event.startUs = (this->start - traceStartMs) * 1000.0;
+    event.durationUs = (end - this->start) * 1000.0;
+    threadTrace().events.push_back(event);
+}
+
+std::string traceJson() {
+    std::lock_guard<std::mutex> hold(registryLock);
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"compile\"}}";
+    for (auto &buffer : registry) {
+        out << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+            << ", \"args\": {\"name\": " << jsonString(buffer->threadName) << "}}";
+        for (TraceEvent &event : buffer->events) {
+            out << ",\n  {\"name\": " << jsonString(event.name) << ", \"cat\": " << jsonString(event.category)
+                << ", \"ph\": \"X\", \"ts\": " << event.startUs << ", \"dur\": " << event.durationUs
+                << ", \"pid\": 1, \"tid\": " << buffer->tid;
+            if (event.detail != "") out << ", \"args\": {\"name\": " << jsonString(event.detail) << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+
+// one finished span, a chrome trace-event "complete" event
+struct TraceEvent {
+    std::string name;
+    const char *category;
+    std::string detail; // shown as args.name, usually a procedure
+    double startUs, durationUs;
+};
+
+// set once per compile by -trace, every span checks it and nothing else
+extern bool traceEnabled;
+
+// clears every thread's events and restarts the trace clock
+void traceReset();
+
+// names the calling thread's track in the trace viewer
+void traceThreadName(std::string name);
+
+// every thread's events as chrome/perfetto trace-event json
+std::string traceJson();
+
+// records the enclosing block as a span on the calling thread's track
+// each thread appends to its own buffer, so recording takes no lock
+class TraceSpan {
+    const char *name;
+    const char *category;
+    std::string detail;
+    double start = 0.0;
+    bool active;
+
+    public:
+        TraceSpan(const char *spanName, const char *spanCategory = "compile");
+        ~TraceSpan();
+
+        // labels the span, only copied when tracing
+        void label(const std::string &text) { if (active) detail = text; }
+};
+
+#endif
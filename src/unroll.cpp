@@ -0,0 +1,393 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <climits>
+#include <map>
+#include <set>
+#include "passes.h"
+
+#define UNROLL_FACTOR 4    // copies of the body each time round the unrolled loop
+#define UNROLL_MAX_BODY 32 // instructions in a body still worth copying that often
+
+// what value stands for in the copy being made, itself when it's from outside
+static Instruction *mapped(std::map<Instruction*, Instruction*> &values, Instruction *value) {
+    std::map<Instruction*, Instruction*>::iterator found = values.find(value);
+    return found == values.end() ? value : found->second;
+}
+
+// an accumulator the loop folds one value into each time round, and nothing
+// else in the loop looks at
+struct Reduction {
+    Instruction *phi;
+    Instruction *step; // phi op something, what the latch hands back
+    std::vector<Instruction*> partials; // one accumulator per copy of the body
+    std::vector<Instruction*> nexts;
+};
+
+// loop unrolling. a counted loop, a header that only tests phi < limit
+// against something the loop doesn't change and one block of body that
+// steps the phi up by a constant, gets an unrolled copy in front of it. that
+// runs UNROLL_FACTOR bodies for each test while at least that many are left,
+// and the original loop then does what remains. each accumulator gets one
+// partial result per copy, combined on the way out, so the copies don't
+// wait on each other. floats are only split that way with -ffast-math, since
+// it adds them up in another order. when the ir is going to native code and
+// every copy would do the same arithmetic on its own elements, the copies
+// are packed into one vector body of IR_LANES lanes instead
+class LoopUnroller {
+    Function *function;
+    const LoopForest &loops;
+    const Cfg &cfg;
+    bool fastMath;
+    bool vectors;
+    std::map<Block*, std::vector<Block*> > ahead; // the blocks made for each header, to go before it
+
+    bool inLoop(const Loop *loop, Instruction *value);
+    bool counted(const Loop *loop, Instruction *test, Instruction *&variable, Instruction *&limit, int &step, bool &inclusive);
+    bool reduction(const Loop *loop, Instruction *phi, int latch, Reduction &found);
+    Instruction *identity(Block *block, Reduction &reduction);
+    bool lanewise(const Loop *loop, std::set<Instruction*> &packed, Instruction *value);
+    bool packable(const Loop *loop, Block *body, Instruction *variable, Instruction *next, std::vector<Reduction> &reductions);
+    Instruction *spread(Block *preheader, std::map<Instruction*, Instruction*> &splats, Instruction *value);
+    void pack(Block *body, Block *copies, Block *preheader, Instruction *next, std::map<Instruction*, Instruction*> &values, std::vector<Reduction> &reductions);
+    bool unroll(const Loop *loop);
+
+    public:
+        LoopUnroller(Function *function, AnalysisCache &analyses)
+            : function(function), loops(analyses.getLoops()), cfg(loops.cfg), fastMath(analyses.fastMath), vectors(analyses.vectors) {}
+        bool run();
+};
+
+bool LoopUnroller::inLoop(const Loop *loop, Instruction *value) {
+    int block = this->cfg.indexOf(value->block);
+    return block >= 0 && this->loops.contains(loop, block);
+}
+
+// test compares a header phi against a limit from outside, the phi going up
+// by a positive constant step each time round
+bool LoopUnroller::counted(const Loop *loop, Instruction *test, Instruction *&variable, Instruction *&limit, int &step, bool &inclusive) {
+    switch (test->op) {
+        case OP_LT: case OP_LE:
+            variable = test->operands[0];
+            limit = test->operands[1];
+            inclusive = test->op == OP_LE;
+            break;
+        case OP_GT: case OP_GE:
+            variable = test->operands[1];
+            limit = test->operands[0];
+            inclusive = test->op == OP_GE;
+            break;
+        default:
+            return false;
+    }
+    Block *header = this->cfg.blocks[loop->header];
+    if (variable->op != OP_PHI || variable->block != header || variable->type != IR_INT || this->inLoop(loop, limit)) return false;
+    Instruction *next = variable->operands[header->predIndex(this->cfg.blocks[loop->latches[0]])];
+    if (next->op != OP_ADD || !this->inLoop(loop, next)) return false;
+    Instruction *amount = next->operands[0] == variable ? next->operands[1] : next->operands[1] == variable ? next->operands[0] : NULL;
+    if (amount == NULL || !amount->isConstant()) return false;
+    step = amount->intValue;
+    // the last copy's test needs step * (UNROLL_FACTOR - 1) to fit
+    return step > 0 && step <= INT_MAX / (UNROLL_FACTOR - 1);
+}
+
+bool LoopUnroller::reduction(const Loop *loop, Instruction *phi, int latch, Reduction &found) {
+    Instruction *step = phi->operands[latch];
+    if (step->op != OP_ADD && step->op != OP_MUL && step->op != OP_AND && step->op != OP_OR) return false;
+    if (step->type == IR_FLOAT ? !this->fastMath || step->op == OP_AND || step->op == OP_OR : step->type != IR_INT && step->type != IR_BOOL) return false;
+    if (!this->inLoop(loop, step) || step->users.size() != 1) return false;
+    if ((step->operands[0] == phi) == (step->operands[1] == phi)) return false;
+    int inside = 0;
+    for (size_t i = 0; i < phi->users.size(); i++) inside += this->inLoop(loop, phi->users[i]) ? 1 : 0;
+    if (inside != 1) return false;
+    found.phi = phi;
+    found.step = step;
+    return true;
+}
+
+// made just ahead of block's branch
+Instruction *LoopUnroller::identity(Block *block, Reduction &reduction) {
+    Instruction *constant = this->function->create(OP_CONST, reduction.phi->type);
+    if (reduction.step->op == OP_MUL) {
+        constant->intValue = 1;
+        constant->floatValue = 1.0;
+    }
+    if (reduction.step->op == OP_AND) constant->intValue = constant->type == IR_BOOL ? 1 : -1;
+    return block->insertBefore(block->terminator(), constant);
+}
+
+// value can be a lane of a vector: one already packed, a constant, or an
+// int or float from outside the loop, spread over every lane
+bool LoopUnroller::lanewise(const Loop *loop, std::set<Instruction*> &packed, Instruction *value) {
+    if (packed.count(value) > 0) return true;
+    if (irVectorType(value->type) == IR_VOID) return false;
+    return value->isConstant() || !this->inLoop(loop, value);
+}
+
+// the counter goes up by one, only to index arrays of ints or floats with,
+// and everything else is ints or floats added, subtracted, or for floats
+// multiplied and divided, then stored back at the counter or summed into
+// reductions. copies then only ever touch their own element of each array,
+// so doing all the loads of IR_LANES copies before their stores changes
+// nothing, even where two of the arrays are the same one
+bool LoopUnroller::packable(const Loop *loop, Block *body, Instruction *variable, Instruction *next, std::vector<Reduction> &reductions) {
+    std::set<Instruction*> packed, indexes;
+    for (size_t i = 0; i < reductions.size(); i++) {
+        Instruction *step = reductions[i].step;
+        if (step->op == OP_ADD ? irVectorType(step->type) == IR_VOID : step->op != OP_MUL || step->type != IR_FLOAT) return false;
+        packed.insert(reductions[i].phi);
+    }
+    if (next->users.size() != 1) return false;
+
+    for (std::list<Instruction*>::iterator it = body->instructions.begin(); it != body->instructions.end(); it++) {
+        Instruction *instruction = *it;
+        if (instruction->isTerminator() || instruction == next || instruction->isConstant()) continue;
+        switch (instruction->op) {
+            case OP_INDEX:
+                if (instruction->operands[1] != variable || this->inLoop(loop, instruction->operands[0])) return false;
+                if (irVectorType(instruction->elemType) == IR_VOID) return false;
+                for (size_t i = 0; i < instruction->users.size(); i++) {
+                    Instruction *user = instruction->users[i];
+                    if (user->op != OP_LOAD && (user->op != OP_STORE || user->operands[1] == instruction)) return false;
+                }
+                indexes.insert(instruction);
+                continue;
+            case OP_LOAD:
+                if (indexes.count(instruction->operands[0]) == 0) return false;
+                break;
+            case OP_STORE:
+                if (indexes.count(instruction->operands[0]) == 0 || !this->lanewise(loop, packed, instruction->operands[1])) return false;
+                continue;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+                // sse2 has no packed multiply of 32 bit ints, nor any int divide
+                if (instruction->op == OP_MUL || instruction->op == OP_DIV ? instruction->type != IR_FLOAT : irVectorType(instruction->type) == IR_VOID) return false;
+                if (!this->lanewise(loop, packed, instruction->operands[0]) || !this->lanewise(loop, packed, instruction->operands[1])) return false;
+                break;
+            default:
+                return false;
+        }
+        packed.insert(instruction);
+    }
+    return true;
+}
+
+// value in every lane, made once ahead of the loop. constants are copied
+// there, since they may come from the body
+Instruction *LoopUnroller::spread(Block *preheader, std::map<Instruction*, Instruction*> &splats, Instruction *value) {
+    std::map<Instruction*, Instruction*>::iterator found = splats.find(value);
+    if (found != splats.end()) return found->second;
+    Instruction *scalar = value;
+    if (value->isConstant()) {
+        scalar = this->function->create(OP_CONST, value->type);
+        scalar->intValue = value->intValue;
+        scalar->floatValue = value->floatValue;
+        preheader->insertBefore(preheader->terminator(), scalar);
+    }
+    Instruction *splat = this->function->create(OP_SPLAT, irVectorType(value->type));
+    splat->addOperand(scalar);
+    return splats[value] = preheader->insertBefore(preheader->terminator(), splat);
+}
+
+// the body once for IR_LANES elements, the counter stepping over all of
+// them, with vector loads, stores and arithmetic in place of scalar ones
+void LoopUnroller::pack(Block *body, Block *copies, Block *preheader, Instruction *next, std::map<Instruction*, Instruction*> &values, std::vector<Reduction> &reductions) {
+    std::map<Instruction*, Instruction*> splats;
+    for (size_t i = 0; i < reductions.size(); i++) values[reductions[i].phi] = reductions[i].partials[0];
+    for (std::list<Instruction*>::iterator it = body->instructions.begin(); it != body->instructions.end(); it++) {
+        Instruction *instruction = *it;
+        if (instruction->isTerminator() || instruction->isConstant()) continue;
+        Instruction *clone;
+        if (instruction == next) {
+            Instruction *lanes = copies->append(this->function->create(OP_CONST, IR_INT));
+            lanes->intValue = IR_LANES;
+            clone = this->function->create(OP_ADD, IR_INT);
+            for (size_t i = 0; i < 2; i++) clone->addOperand(next->operands[i]->isConstant() ? lanes : mapped(values, next->operands[i]));
+        }
+        else if (instruction->op == OP_INDEX) {
+            clone = this->function->create(OP_INDEX, IR_PTR);
+            clone->elemType = instruction->elemType;
+            clone->addOperand(instruction->operands[0]);
+            clone->addOperand(mapped(values, instruction->operands[1]));
+        }
+        else {
+            clone = this->function->create(instruction->op, instruction->op == OP_STORE ? IR_VOID : irVectorType(instruction->type));
+            if (instruction->op == OP_LOAD || instruction->op == OP_STORE) {
+                clone->elemType = irVectorType(instruction->elemType);
+                clone->addOperand(values[instruction->operands[0]]);
+            }
+            for (size_t i = instruction->op == OP_LOAD || instruction->op == OP_STORE ? 1 : 0; i < instruction->operands.size(); i++) {
+                Instruction *operand = instruction->operands[i];
+                clone->addOperand(values.count(operand) > 0 ? values[operand] : this->spread(preheader, splats, operand));
+            }
+        }
+        values[instruction] = copies->append(clone);
+    }
+    for (size_t i = 0; i < reductions.size(); i++) {
+        reductions[i].partials[0]->addOperand(this->spread(preheader, splats, this->identity(preheader, reductions[i])));
+        reductions[i].nexts.push_back(values[reductions[i].step]);
+    }
+}
+
+bool LoopUnroller::unroll(const Loop *loop) {
+    if (loop->blocks.size() != 2 || loop->latches.size() != 1) return false;
+    Block *header = this->cfg.blocks[loop->header];
+    Block *body = this->cfg.blocks[loop->latches[0]];
+    if (body == header || header->preds.size() != 2 || body->preds.size() != 1) return false;
+    int latch = header->predIndex(body);
+    Block *preheader = header->preds[1 - latch];
+    Instruction *enter = preheader->terminator();
+    if (enter->op != OP_BR || body->instructions.size() > UNROLL_MAX_BODY) return false;
+
+    // nothing in the header but its phis and the test
+    Instruction *branch = header->terminator();
+    if (branch->op != OP_CONDBR || branch->targets[0] != body || branch->targets[1] == body) return false;
+    Instruction *test = branch->operands[0];
+    std::vector<Instruction*> phis = header->phis();
+    if (header->instructions.size() != phis.size() + 2 || test->block != header || test->users.size() != 1) return false;
+    Instruction *variable, *limit;
+    int step;
+    bool inclusive;
+    if (!this->counted(loop, test, variable, limit, step, inclusive)) return false;
+
+    std::vector<Reduction> reductions;
+    std::vector<Instruction*> carried;
+    for (size_t i = 0; i < phis.size(); i++) {
+        Reduction found;
+        if (phis[i] != variable && this->reduction(loop, phis[i], latch, found)) reductions.push_back(found);
+        else carried.push_back(phis[i]);
+    }
+    Instruction *next = variable->operands[latch];
+    bool packed = this->vectors && step == 1 && carried.size() == 1 && this->packable(loop, body, variable, next, reductions);
+    int factor = packed ? IR_LANES : UNROLL_FACTOR;
+
+    Block *top = this->function->addBlock();
+    Block *copies = this->function->addBlock();
+    Block *after = reductions.empty() ? header : this->function->addBlock();
+    this->ahead[header].push_back(top);
+    this->ahead[header].push_back(copies);
+    if (after != header) this->ahead[header].push_back(after);
+
+    // the preheader now enters the unrolled loop, and the original one is
+    // entered from where that leaves off
+    std::map<Instruction*, Instruction*> starts;
+    for (size_t i = 0; i < phis.size(); i++) starts[phis[i]] = phis[i]->operands[1 - latch];
+    header->removePred(preheader);
+    enter->targets[0] = top;
+    top->preds.push_back(preheader);
+
+    std::map<Instruction*, Instruction*> values; // from the body to the copy being made
+    std::vector<Instruction*> tops;
+    for (size_t i = 0; i < carried.size(); i++) {
+        Instruction *phi = top->append(this->function->create(OP_PHI, carried[i]->type));
+        phi->addOperand(starts[carried[i]]);
+        values[carried[i]] = phi;
+        tops.push_back(phi);
+    }
+    for (size_t i = 0; i < reductions.size(); i++) {
+        // packed, the partial results are the lanes of one vector
+        if (packed) reductions[i].partials.push_back(top->append(this->function->create(OP_PHI, irVectorType(reductions[i].phi->type))));
+        for (int j = 0; j < UNROLL_FACTOR && !packed; j++) {
+            Instruction *phi = top->append(this->function->create(OP_PHI, reductions[i].phi->type));
+            phi->addOperand(j == 0 ? starts[reductions[i].phi] : this->identity(preheader, reductions[i]));
+            reductions[i].partials.push_back(phi);
+        }
+    }
+
+    // at least factor left to go: the phi is below the limit and the
+    // distance to it, should it overflow, only sends the loop the slow way
+    Instruction *first = this->function->create(test->op, IR_BOOL);
+    Instruction *distance = this->function->create(OP_SUB, IR_INT);
+    Instruction *reach = this->function->create(OP_CONST, IR_INT);
+    Instruction *enough = this->function->create(inclusive ? OP_GE : OP_GT, IR_BOOL);
+    Instruction *both = this->function->create(OP_AND, IR_BOOL);
+    first->addOperand(mapped(values, test->operands[0]));
+    first->addOperand(mapped(values, test->operands[1]));
+    distance->addOperand(limit);
+    distance->addOperand(values[variable]);
+    reach->intValue = step * (factor - 1);
+    enough->addOperand(distance);
+    enough->addOperand(reach);
+    both->addOperand(first);
+    both->addOperand(enough);
+    top->append(first);
+    top->append(distance);
+    top->append(reach);
+    top->append(enough);
+    top->append(both);
+    this->function->condBranch(top, both, copies, after);
+
+    if (packed) this->pack(body, copies, preheader, next, values, reductions);
+    for (int copy = 0; copy < UNROLL_FACTOR && !packed; copy++) {
+        if (copy > 0) {
+            std::vector<Instruction*> nexts;
+            for (size_t i = 0; i < carried.size(); i++) nexts.push_back(mapped(values, carried[i]->operands[latch]));
+            for (size_t i = 0; i < carried.size(); i++) values[carried[i]] = nexts[i];
+        }
+        for (size_t i = 0; i < reductions.size(); i++) values[reductions[i].phi] = reductions[i].partials[copy];
+        for (std::list<Instruction*>::iterator it = body->instructions.begin(); it != body->instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->isTerminator()) continue;
+            Instruction *clone = this->function->create(instruction->op, instruction->type);
+            clone->intValue = instruction->intValue;
+            clone->floatValue = instruction->floatValue;
+            clone->name = instruction->name;
+            clone->elemType = instruction->elemType;
+            for (size_t i = 0; i < instruction->operands.size(); i++) {
+                clone->addOperand(mapped(values, instruction->operands[i]));
+            }
+            values[instruction] = copies->append(clone);
+        }
+        for (size_t i = 0; i < reductions.size(); i++) reductions[i].nexts.push_back(values[reductions[i].step]);
+    }
+    this->function->branch(copies, top);
+    for (size_t i = 0; i < carried.size(); i++) tops[i]->addOperand(mapped(values, carried[i]->operands[latch]));
+    for (size_t i = 0; i < reductions.size(); i++) {
+        for (size_t j = 0; j < reductions[i].partials.size(); j++) reductions[i].partials[j]->addOperand(reductions[i].nexts[j]);
+    }
+
+    // the partial results become one again before the rest of the loop
+    std::map<Instruction*, Instruction*> leaving;
+    for (size_t i = 0; i < carried.size(); i++) leaving[carried[i]] = tops[i];
+    for (size_t i = 0; i < reductions.size(); i++) {
+        Instruction *combined = packed ? starts[reductions[i].phi] : reductions[i].partials[0];
+        for (int j = packed ? 0 : 1; j < factor; j++) {
+            Instruction *part = reductions[i].partials[packed ? 0 : j];
+            if (packed) {
+                part = this->function->create(OP_LANE, reductions[i].phi->type);
+                part->intValue = j;
+                part->addOperand(reductions[i].partials[0]);
+                after->append(part);
+            }
+            Instruction *fold = this->function->create(reductions[i].step->op, combined->type);
+            fold->addOperand(combined);
+            fold->addOperand(part);
+            combined = after->append(fold);
+        }
+        leaving[reductions[i].phi] = combined;
+    }
+    if (after != header) this->function->branch(after, header);
+    for (size_t i = 0; i < phis.size(); i++) phis[i]->addOperand(leaving[phis[i]]);
+    return true;
+}
+
+bool LoopUnroller::run() {
+    size_t existing = this->function->blocks.size();
+    bool changed = false;
+    for (size_t i = 0; i < this->loops.loops.size(); i++) changed = this->unroll(this->loops.loops[i]) || changed;
+    if (!changed) return false;
+
+    // the new blocks were added last, and go just ahead of their loops
+    std::vector<Block*> blocks;
+    for (size_t i = 0; i < existing; i++) {
+        Block *block = this->function->blocks[i];
+        std::map<Block*, std::vector<Block*> >::iterator made = this->ahead.find(block);
+        if (made != this->ahead.end()) blocks.insert(blocks.end(), made->second.begin(), made->second.end());
+        blocks.push_back(block);
+    }
+    this->function->blocks = blocks;
+    return true;
+}
+
+int unrollLoops(Function *function, AnalysisCache &analyses) {
+    LoopUnroller unroller(function, analyses);
+    return unroller.run() ? CHANGED_CFG : CHANGED_NONE;
+}
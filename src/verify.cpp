@@ -0,0 +1,331 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "analysis.h"
+#include "verify.h"
+
+class Verifier {
+    Function *function;
+    std::ostream &errors;
+    int problems = 0;
+
+    const DominatorTree *dominators = NULL;
+    std::unordered_map<Instruction*, int> position; // within its block
+
+    void report(Block *block, Instruction *instruction, std::string message);
+    bool definedBefore(Instruction *def, Instruction *use, Block *useBlock);
+    void checkTypes(Instruction *instruction);
+
+    public:
+        Verifier(Function *function, std::ostream &errors) : function(function), errors(errors) {}
+        bool run();
+};
+
+void Verifier::report(Block *block, Instruction *instruction, std::string message) {
+    this->problems++;
+    this->errors << "IR Error: @" << this->function->name;
+    if (block != NULL) this->errors << " b" << block->id;
+    if (instruction != NULL) {
+        this->errors << " " << irOpName(instruction->op);
+        if (instruction->type != IR_VOID) this->errors << " %" << instruction->id;
+    }
+    this->errors << ": " << message << "\n";
+}
+
+bool Verifier::definedBefore(Instruction *def, Instruction *use, Block *useBlock) {
+    if (def->block != useBlock) return this->dominators->dominates(def->block, useBlock);
+    return use == NULL || this->position[def] < this->position[use];
+}
+
+// only constants may come between a tail call and the ret of its result
+static bool returnsStraightAway(Instruction *call) {
+    std::list<Instruction*> &instructions = call->block->instructions;
+    std::list<Instruction*>::iterator it = std::find(instructions.begin(), instructions.end(), call);
+    for (it++; it != instructions.end() && (*it)->op == OP_CONST; it++);
+    if (it == instructions.end() || (*it)->op != OP_RET) return false;
+    if (call->type == IR_VOID) return (*it)->operands.empty();
+    return !(*it)->operands.empty() && (*it)->operands[0] == call;
+}
+
+static bool isNumeric(int type) {
+    return type == IR_INT || type == IR_FLOAT;
+}
+
+void Verifier::checkTypes(Instruction *instruction) {
+    Block *block = instruction->block;
+    std::vector<Instruction*> &operands = instruction->operands;
+    size_t expected = 0;
+    bool sameTypes = false;
+
+    switch (instruction->op) {
+        case OP_CONST:
+            if (instruction->type == IR_VOID || instruction->type == IR_PTR || irIsVector(instruction->type)) this->report(block, instruction, "constant of type " + std::string(irTypeName(instruction->type)));
+            break;
+        case OP_PARAM:
+            if (block != this->function->entry()) this->report(block, instruction, "param outside the entry block");
+            if (instruction->intValue < 0 || instruction->intValue >= (int)this->function->paramTypes.size()) {
+                this->report(block, instruction, "no parameter " + std::to_string(instruction->intValue));
+            }
+            else if (this->function->paramTypes[instruction->intValue] != instruction->type) {
+                this->report(block, instruction, "param type differs from the signature");
+            }
+            break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+            expected = 2;
+            sameTypes = true;
+            if (!isNumeric(irLaneType(instruction->type))) this->report(block, instruction, "arithmetic on " + std::string(irTypeName(instruction->type)));
+            break;
+        case OP_NEG:
+            expected = 1;
+            sameTypes = true;
+            if (!isNumeric(instruction->type)) this->report(block, instruction, "negation of " + std::string(irTypeName(instruction->type)));
+            break;
+        case OP_AND: case OP_OR: case OP_NOT:
+            expected = instruction->op == OP_NOT ? 1 : 2;
+            sameTypes = true;
+            if (instruction->type != IR_INT && instruction->type != IR_BOOL) {
+                this->report(block, instruction, "logic on " + std::string(irTypeName(instruction->type)));
+            }
+            break;
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+            expected = 2;
+            if (instruction->type != IR_BOOL) this->report(block, instruction, "comparison doesn't give bool");
+            if (operands.size() == 2) {
+                int type = operands[0]->type;
+                if (type != operands[1]->type) this->report(block, instruction, "compared operands differ in type");
+                if (!isNumeric(type) && type != IR_BOOL) this->report(block, instruction, "comparison of " + std::string(irTypeName(type)));
+            }
+            break;
+        case OP_ITOF: case OP_BTOI: case OP_ITOB: {
+            expected = 1;
+            int from = instruction->op == OP_BTOI ? IR_BOOL : IR_INT;
+            int to = instruction->op == OP_ITOF ? IR_FLOAT : instruction->op == OP_BTOI ? IR_INT : IR_BOOL;
+            if (instruction->type != to) this->report(block, instruction, "conversion gives the wrong type");
+            if (operands.size() == 1 && operands[0]->type != from) this->report(block, instruction, "conversion of the wrong type");
+            break;
+        }
+        case OP_PHI:
+            if (operands.size() != block->preds.size()) {
+                this->report(block, instruction, std::to_string(operands.size()) + " values for " + std::to_string(block->preds.size()) + " predecessors");
+            }
+            for (size_t i = 0; i < operands.size(); i++) {
+                if (operands[i]->type != instruction->type) this->report(block, instruction, "incoming value of the wrong type");
+            }
+            break;
+        case OP_ALLOCA:
+            if (block != this->function->entry()) this->report(block, instruction, "alloca outside the entry block");
+            if (instruction->type != IR_PTR || instruction->intValue < 1 || instruction->elemType == IR_VOID || instruction->elemType == IR_PTR) {
+                this->report(block, instruction, "malformed alloca");
+            }
+            break;
+        case OP_GLOBAL:
+            if (instruction->type != IR_PTR) this->report(block, instruction, "global address isn't a ptr");
+            if (this->function->module == NULL || this->function->module->findGlobal(instruction->name) == NULL) {
+                this->report(block, instruction, "no global @" + instruction->name);
+            }
+            break;
+        case OP_INDEX:
+            expected = 2;
+            if (instruction->type != IR_PTR) this->report(block, instruction, "index doesn't give a ptr");
+            if (operands.size() == 2 && (operands[0]->type != IR_PTR || operands[1]->type != IR_INT)) {
+                this->report(block, instruction, "index needs a ptr and an int");
+            }
+            break;
+        case OP_SPLAT:
+            expected = 1;
+            if (!irIsVector(instruction->type)) this->report(block, instruction, "splat doesn't give a vector");
+            else if (operands.size() == 1 && operands[0]->type != irLaneType(instruction->type)) {
+                this->report(block, instruction, "splat of the wrong type");
+            }
+            break;
+        case OP_LANE:
+            expected = 1;
+            if (instruction->intValue < 0 || instruction->intValue >= IR_LANES) this->report(block, instruction, "no lane " + std::to_string(instruction->intValue));
+            if (operands.size() == 1 && (!irIsVector(operands[0]->type) || irLaneType(operands[0]->type) != instruction->type)) {
+                this->report(block, instruction, "lane of the wrong type");
+            }
+            break;
+        case OP_CHECK:
+            expected = 1;
+            if (instruction->type != IR_VOID || instruction->intValue < 1) this->report(block, instruction, "malformed check");
+            if (operands.size() == 1 && operands[0]->type != IR_INT) this->report(block, instruction, "check of a non int");
+            break;
+        case OP_LOAD:
+            expected = 1;
+            if (operands.size() == 1 && operands[0]->type != IR_PTR) this->report(block, instruction, "load from a non ptr");
+            if (instruction->type != instruction->elemType || instruction->type == IR_VOID || instruction->type == IR_PTR) {
+                this->report(block, instruction, "load of the wrong type");
+            }
+            break;
+        case OP_STORE:
+            expected = 2;
+            if (operands.size() == 2 && operands[0]->type != IR_PTR) this->report(block, instruction, "store to a non ptr");
+            if (operands.size() == 2 && operands[1]->type != instruction->elemType) this->report(block, instruction, "store of the wrong type");
+            break;
+        case OP_CALL: {
+            Function *callee = this->function->module == NULL ? NULL : this->function->module->find(instruction->name);
+            if (callee == NULL) {
+                this->report(block, instruction, "call to unknown @" + instruction->name);
+                break;
+            }
+            if (callee->returnType != instruction->type) this->report(block, instruction, "call result differs from @" + callee->name + "'s return type");
+            if (operands.size() != callee->paramTypes.size()) {
+                this->report(block, instruction, "@" + callee->name + " takes " + std::to_string(callee->paramTypes.size()) + " arguments");
+                break;
+            }
+            for (size_t i = 0; i < operands.size(); i++) {
+                if (operands[i]->type != callee->paramTypes[i]) this->report(block, instruction, "argument " + std::to_string(i) + " of the wrong type");
+            }
+            if (instruction->tail && !returnsStraightAway(instruction)) this->report(block, instruction, "tail call whose result isn't returned straight away");
+            break;
+        }
+        case OP_BR:
+            if (instruction->targets.size() != 1 || !operands.empty()) this->report(block, instruction, "br needs one target");
+            break;
+        case OP_CONDBR:
+            expected = 1;
+            if (instruction->targets.size() != 2) this->report(block, instruction, "condbr needs two targets");
+            if (operands.size() == 1 && operands[0]->type != IR_BOOL) this->report(block, instruction, "condition isn't bool");
+            break;
+        case OP_RET:
+            if (this->function->returnType == IR_VOID) {
+                if (!operands.empty()) this->report(block, instruction, "value returned from a void function");
+            }
+            else if (operands.size() != 1 || operands[0]->type != this->function->returnType) {
+                this->report(block, instruction, "return of the wrong type");
+            }
+            break;
+        default:
+            this->report(block, instruction, "unknown opcode " + std::to_string(instruction->op));
+    }
+
+    if (expected > 0 && operands.size() != expected) {
+        this->report(block, instruction, "expected " + std::to_string(expected) + " operands");
+    }
+    else if (sameTypes) {
+        for (size_t i = 0; i < operands.size(); i++) {
+            if (operands[i]->type != instruction->type) this->report(block, instruction, "operand of the wrong type");
+        }
+    }
+}
+
+bool Verifier::run() {
+    Function *function = this->function;
+    if (function->external) return true;
+    if (function->blocks.empty()) {
+        this->report(NULL, NULL, "function has no blocks");
+        return false;
+    }
+    if (!function->entry()->preds.empty()) this->report(function->entry(), NULL, "entry block has predecessors");
+
+    // structure first, the rest assumes it holds
+    std::unordered_set<Block*> blocks(function->blocks.begin(), function->blocks.end());
+    std::unordered_set<Instruction*> defined;
+    std::unordered_set<int> ids;
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        Block *block = function->blocks[i];
+        if (block->function != function) this->report(block, NULL, "block belongs to another function");
+        if (block->id < 0 || block->id >= function->nextBlockId || !ids.insert(block->id).second) this->report(block, NULL, "block id isn't unique");
+        if (block->terminator() == NULL) this->report(block, NULL, "block doesn't end in a terminator");
+
+        int at = 0;
+        bool pastPhis = false;
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            Instruction *instruction = *it;
+            if (instruction->block != block) this->report(block, instruction, "instruction's block is stale");
+            if (instruction->isTerminator() && instruction != block->instructions.back()) this->report(block, instruction, "terminator in the middle of a block");
+            if (instruction->op == OP_PHI && pastPhis) this->report(block, instruction, "phi after a non phi");
+            if (instruction->op != OP_PHI) pastPhis = true;
+            for (size_t j = 0; j < instruction->targets.size(); j++) {
+                if (blocks.count(instruction->targets[j]) == 0) this->report(block, instruction, "branch to a block outside the function");
+            }
+            this->position[instruction] = at++;
+            defined.insert(instruction);
+        }
+    }
+    if (this->problems > 0) return false;
+
+    // every edge is recorded at both ends, as often as it appears
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        Block *block = function->blocks[i];
+        std::vector<Block*> succs = block->succs();
+        for (size_t j = 0; j < succs.size(); j++) {
+            long out = std::count(succs.begin(), succs.end(), succs[j]);
+            long in = std::count(succs[j]->preds.begin(), succs[j]->preds.end(), block);
+            if (out != in) this->report(block, NULL, "edge to b" + std::to_string(succs[j]->id) + " missing from its preds");
+        }
+        for (size_t j = 0; j < block->preds.size(); j++) {
+            if (blocks.count(block->preds[j]) == 0) {
+                this->report(block, NULL, "predecessor outside the function");
+                continue;
+            }
+            std::vector<Block*> predSuccs = block->preds[j]->succs();
+            if (std::find(predSuccs.begin(), predSuccs.end(), block) == predSuccs.end()) {
+                this->report(block, NULL, "b" + std::to_string(block->preds[j]->id) + " listed as a predecessor but doesn't branch here");
+            }
+        }
+    }
+    if (this->problems > 0) return false;
+
+    Cfg cfg(function);
+    DominatorTree dominators(cfg);
+    this->dominators = &dominators;
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        if (cfg.indexOf(function->blocks[i]) < 0) this->report(function->blocks[i], NULL, "block is unreachable");
+    }
+    if (this->problems > 0) return false;
+
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        Block *block = function->blocks[i];
+        for (std::list<Instruction*>::iterator it = block->instructions.begin(); it != block->instructions.end(); it++) {
+            Instruction *instruction = *it;
+            bool operandsKnown = true;
+            for (size_t j = 0; j < instruction->operands.size(); j++) {
+                Instruction *operand = instruction->operands[j];
+                if (operand == NULL || defined.count(operand) == 0) {
+                    this->report(block, instruction, "operand " + std::to_string(j) + " isn't defined in this function");
+                    operandsKnown = false;
+                    continue;
+                }
+                if (operand->type == IR_VOID) this->report(block, instruction, "operand " + std::to_string(j) + " has no value");
+                if (std::count(operand->users.begin(), operand->users.end(), instruction) != std::count(instruction->operands.begin(), instruction->operands.end(), operand)) {
+                    this->report(block, instruction, "use of %" + std::to_string(operand->id) + " missing from its users");
+                }
+
+                // a phi's value only has to be available at the end of its predecessor
+                if (instruction->op == OP_PHI) {
+                    if (j < block->preds.size() && !this->definedBefore(operand, NULL, block->preds[j])) {
+                        this->report(block, instruction, "%" + std::to_string(operand->id) + " doesn't dominate incoming edge " + std::to_string(j));
+                    }
+                }
+                else if (!this->definedBefore(operand, instruction, block)) {
+                    this->report(block, instruction, "%" + std::to_string(operand->id) + " doesn't dominate its use");
+                }
+            }
+            for (size_t j = 0; j < instruction->users.size(); j++) {
+                if (defined.count(instruction->users[j]) == 0) this->report(block, instruction, "used by an instruction outside the function");
+            }
+            if (operandsKnown) this->checkTypes(instruction);
+        }
+    }
+    return this->problems == 0;
+}
+
+bool verifyFunction(Function *function, std::ostream &errors) {
+    Verifier verifier(function, errors);
+    return verifier.run();
+}
+
+bool verifyModule(Module *module, std::ostream &errors) {
+    bool valid = true;
+    for (size_t i = 0; i < module->functions.size(); i++) {
+        if (module->functions[i]->module != module) {
+            errors << "IR Error: @" << module->functions[i]->name << " belongs to another module\n";
+            valid = false;
+        }
+        if (!verifyFunction(module->functions[i], errors)) valid = false;
+    }
+    return valid;
+}
@@ -0,0 +1,16 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <ostream>
+#include "ir.h"
+
+// checks the ir is well formed ssa: every block ends in its only terminator,
+// phis lead their block with one value per predecessor, edges agree both
+// ways, operand types fit their opcodes, calls match their callee, tail calls
+// are returned straight away, and every value is defined in a block
+// dominating its uses. problems are written to errors, one per line, and
+// false is returned when there were any
+bool verifyFunction(Function *function, std::ostream &errors);
+bool verifyModule(Module *module, std::ostream &errors);
+
+#endif
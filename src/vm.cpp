@@ -0,0 +1,338 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "stats.h"
+#include "vm.h"
+
+VirtualMachine::VirtualMachine(BcModule *module, std::istream &in, std::ostream &out) : module(module), in(in), out(out) {
+    this->globals.resize(module->globalSlots);
+    if (!this->globals.empty()) memset(this->globals.data(), 0, this->globals.size() * sizeof(VmSlot));
+    for (size_t i = 0; i < module->strings.size(); i++) this->constants.push_back(module->strings[i].c_str());
+}
+
+VirtualMachine::~VirtualMachine() {
+    for (size_t i = 0; i < this->memory.size(); i++) delete[] this->memory[i];
+}
+
+// count zeroed slots, given back when the function that took them returns
+VmSlot *VirtualMachine::allocate(int count) {
+    while (this->memoryBlock < this->memory.size() && this->memoryUsed + count > this->memorySizes[this->memoryBlock]) {
+        this->memoryBlock++;
+        this->memoryUsed = 0;
+    }
+    if (this->memoryBlock == this->memory.size()) {
+        size_t size = count > VM_MEMORY_BLOCK ? count : VM_MEMORY_BLOCK;
+        this->memory.push_back(new VmSlot[size]);
+        this->memorySizes.push_back(size);
+        this->memoryUsed = 0;
+    }
+    VmSlot *slots = this->memory[this->memoryBlock] + this->memoryUsed;
+    this->memoryUsed += count;
+    memset(slots, 0, count * sizeof(VmSlot));
+    return slots;
+}
+
+void VirtualMachine::fail(std::string message) {
+    const BcFunction &function = this->module->functions[this->frames.back().function];
+    if (this->error.empty()) this->error = message + " in @" + function.name;
+}
+
+// every opcode's code ends by going straight on to the next instruction's,
+// so each has a dispatch of its own for the branch predictor to learn
+#define R(field) regs[pc->field]
+#ifdef VM_SWITCH
+#define VM_OP(name) case BC_##name:
+#define VM_DISPATCH() continue
+#else
+#define VM_OP(name) op_##name:
+#define VM_DISPATCH() goto *pc->handler
+#endif
+#define VM_NEXT() { pc++; VM_DISPATCH(); }
+#define VM_JUMP_WHEN(condition, target) { pc = (condition) ? code + pc->target : pc + 1; VM_DISPATCH(); }
+
+bool VirtualMachine::run() {
+    double start = wallClockMs();
+#ifndef VM_SWITCH
+    // in opcode order
+    static const void *handlers[BC_COUNT] = {
+        &&op_MOVE, &&op_INT, &&op_FLOAT, &&op_STRING, &&op_GLOBAL, &&op_ALLOCA,
+        &&op_ADD_I, &&op_SUB_I, &&op_MUL_I, &&op_DIV_I, &&op_ADD_IK, &&op_SUB_IK, &&op_MUL_IK, &&op_DIV_IK,
+        &&op_NEG_I, &&op_AND, &&op_OR, &&op_NOT_I, &&op_NOT_B, &&op_TEST,
+        &&op_EQ_I, &&op_NE_I, &&op_LT_I, &&op_LE_I, &&op_GT_I, &&op_GE_I,
+        &&op_EQ_IK, &&op_NE_IK, &&op_LT_IK, &&op_LE_IK, &&op_GT_IK, &&op_GE_IK,
+        &&op_ADD_F, &&op_SUB_F, &&op_MUL_F, &&op_DIV_F, &&op_NEG_F,
+        &&op_EQ_F, &&op_NE_F, &&op_LT_F, &&op_LE_F, &&op_GT_F, &&op_GE_F,
+        &&op_ITOF, &&op_INDEX, &&op_LOAD, &&op_STORE,
+        &&op_LOAD_INDEX, &&op_STORE_INDEX, &&op_LOAD_INDEX_K, &&op_STORE_INDEX_K,
+        &&op_LOAD_GLOBAL, &&op_STORE_GLOBAL, &&op_ADD_LOAD_I, &&op_ADD_LOAD_F,
+        &&op_JUMP, &&op_JUMP_IF, &&op_JUMP_UNLESS,
+        &&op_JEQ_I, &&op_JNE_I, &&op_JLT_I, &&op_JLE_I, &&op_JGT_I, &&op_JGE_I,
+        &&op_JEQ_IK, &&op_JNE_IK, &&op_JLT_IK, &&op_JLE_IK, &&op_JGT_IK, &&op_JGE_IK,
+        &&op_JEQ_F, &&op_JNE_F, &&op_JLT_F, &&op_JLE_F, &&op_JGT_F, &&op_JGE_F,
+        &&op_CHECK, &&op_CALL, &&op_RET, &&op_RET_VOID,
+        &&op_PUT_I, &&op_PUT_F, &&op_PUT_B, &&op_PUT_S, &&op_GET_I, &&op_GET_F, &&op_GET_B, &&op_GET_S,
+        &&op_SQRT, &&op_STRCMP, &&op_FAIL,
+    };
+#endif
+
+    std::vector<std::vector<VmInstruction> > threaded(this->module->functions.size());
+    for (size_t f = 0; f < threaded.size(); f++) {
+        std::vector<BcInstruction> &code = this->module->functions[f].code;
+        for (size_t i = 0; i < code.size(); i++) {
+            VmInstruction instruction;
+#ifdef VM_SWITCH
+            instruction.op = code[i].op;
+#else
+            instruction.handler = handlers[code[i].op];
+#endif
+            instruction.a = code[i].a;
+            instruction.b = code[i].b;
+            instruction.c = code[i].c;
+            instruction.d = code[i].d;
+            threaded[f].push_back(instruction);
+        }
+    }
+    if (this->module->main < 0) {
+        this->error = "no @main to run";
+        this->ms = wallClockMs() - start;
+        return false;
+    }
+
+    const BcFunction *function = &this->module->functions[this->module->main];
+    VmFrame entry = {this->module->main, 0, 0, 0, 0, 0};
+    this->frames.push_back(entry);
+    this->stack.resize(function->registers > VM_MEMORY_BLOCK ? function->registers : VM_MEMORY_BLOCK);
+    this->calls++;
+    VmSlot *regs = this->stack.data();
+    VmSlot *globals = this->globals.data();
+    const VmInstruction *code = threaded[this->module->main].data(), *pc = code;
+
+#ifdef VM_SWITCH
+    for (;;) {
+        switch (pc->op) {
+#else
+    VM_DISPATCH();
+    {
+        {
+#endif
+            VM_OP(MOVE) R(a) = R(b); VM_NEXT();
+            VM_OP(INT) R(a).intValue = pc->b; VM_NEXT();
+            VM_OP(FLOAT) memcpy(&R(a).floatValue, &pc->b, sizeof(float)); VM_NEXT();
+            VM_OP(STRING) R(a).stringValue = this->constants[pc->b]; VM_NEXT();
+            VM_OP(GLOBAL) R(a).address = globals + pc->b; VM_NEXT();
+            VM_OP(ALLOCA) R(a).address = this->allocate(pc->b); VM_NEXT();
+
+            VM_OP(ADD_I) R(a).intValue = (int)((unsigned int)R(b).intValue + (unsigned int)R(c).intValue); VM_NEXT();
+            VM_OP(SUB_I) R(a).intValue = (int)((unsigned int)R(b).intValue - (unsigned int)R(c).intValue); VM_NEXT();
+            VM_OP(MUL_I) R(a).intValue = (int)((unsigned int)R(b).intValue * (unsigned int)R(c).intValue); VM_NEXT();
+            VM_OP(DIV_I) {
+                int divisor = R(c).intValue;
+                if (divisor == 0) {
+                    this->fail("division by zero");
+                    goto stopped;
+                }
+                // INT_MIN / -1 wraps
+                R(a).intValue = divisor == -1 ? (int)(0u - (unsigned int)R(b).intValue) : R(b).intValue / divisor;
+                VM_NEXT();
+            }
+            VM_OP(ADD_IK) R(a).intValue = (int)((unsigned int)R(b).intValue + (unsigned int)pc->c); VM_NEXT();
+            VM_OP(SUB_IK) R(a).intValue = (int)((unsigned int)R(b).intValue - (unsigned int)pc->c); VM_NEXT();
+            VM_OP(MUL_IK) R(a).intValue = (int)((unsigned int)R(b).intValue * (unsigned int)pc->c); VM_NEXT();
+            VM_OP(DIV_IK) R(a).intValue = R(b).intValue / pc->c; VM_NEXT();
+            VM_OP(NEG_I) R(a).intValue = (int)(0u - (unsigned int)R(b).intValue); VM_NEXT();
+            VM_OP(AND) R(a).intValue = R(b).intValue & R(c).intValue; VM_NEXT();
+            VM_OP(OR) R(a).intValue = R(b).intValue | R(c).intValue; VM_NEXT();
+            VM_OP(NOT_I) R(a).intValue = ~R(b).intValue; VM_NEXT();
+            VM_OP(NOT_B) R(a).intValue = !R(b).intValue; VM_NEXT();
+            VM_OP(TEST) R(a).intValue = R(b).intValue != 0; VM_NEXT();
+
+            VM_OP(EQ_I) R(a).intValue = R(b).intValue == R(c).intValue; VM_NEXT();
+            VM_OP(NE_I) R(a).intValue = R(b).intValue != R(c).intValue; VM_NEXT();
+            VM_OP(LT_I) R(a).intValue = R(b).intValue < R(c).intValue; VM_NEXT();
+            VM_OP(LE_I) R(a).intValue = R(b).intValue <= R(c).intValue; VM_NEXT();
+            VM_OP(GT_I) R(a).intValue = R(b).intValue > R(c).intValue; VM_NEXT();
+            VM_OP(GE_I) R(a).intValue = R(b).intValue >= R(c).intValue; VM_NEXT();
+            VM_OP(EQ_IK) R(a).intValue = R(b).intValue == pc->c; VM_NEXT();
+            VM_OP(NE_IK) R(a).intValue = R(b).intValue != pc->c; VM_NEXT();
+            VM_OP(LT_IK) R(a).intValue = R(b).intValue < pc->c; VM_NEXT();
+            VM_OP(LE_IK) R(a).intValue = R(b).intValue <= pc->c; VM_NEXT();
+            VM_OP(GT_IK) R(a).intValue = R(b).intValue > pc->c; VM_NEXT();
+            VM_OP(GE_IK) R(a).intValue = R(b).intValue >= pc->c; VM_NEXT();
+
+            VM_OP(ADD_F) R(a).floatValue = R(b).floatValue + R(c).floatValue; VM_NEXT();
+            VM_OP(SUB_F) R(a).floatValue = R(b).floatValue - R(c).floatValue; VM_NEXT();
+            VM_OP(MUL_F) R(a).floatValue = R(b).floatValue * R(c).floatValue; VM_NEXT();
+            VM_OP(DIV_F) R(a).floatValue = R(b).floatValue / R(c).floatValue; VM_NEXT();
+            VM_OP(NEG_F) R(a).floatValue = -R(b).floatValue; VM_NEXT();
+            VM_OP(EQ_F) R(a).intValue = R(b).floatValue == R(c).floatValue; VM_NEXT();
+            VM_OP(NE_F) R(a).intValue = R(b).floatValue != R(c).floatValue; VM_NEXT();
+            VM_OP(LT_F) R(a).intValue = R(b).floatValue < R(c).floatValue; VM_NEXT();
+            VM_OP(LE_F) R(a).intValue = R(b).floatValue <= R(c).floatValue; VM_NEXT();
+            VM_OP(GT_F) R(a).intValue = R(b).floatValue > R(c).floatValue; VM_NEXT();
+            VM_OP(GE_F) R(a).intValue = R(b).floatValue >= R(c).floatValue; VM_NEXT();
+            VM_OP(ITOF) R(a).floatValue = (float)R(b).intValue; VM_NEXT();
+
+            VM_OP(INDEX) R(a).address = R(b).address + R(c).intValue; VM_NEXT();
+            VM_OP(LOAD) R(a) = *R(b).address; VM_NEXT();
+            VM_OP(STORE) *R(a).address = R(b); VM_NEXT();
+            VM_OP(LOAD_INDEX) R(a) = R(b).address[R(c).intValue]; VM_NEXT();
+            VM_OP(STORE_INDEX) R(a).address[R(b).intValue] = R(c); VM_NEXT();
+            VM_OP(LOAD_INDEX_K) R(a) = R(b).address[pc->c]; VM_NEXT();
+            VM_OP(STORE_INDEX_K) R(a).address[pc->b] = R(c); VM_NEXT();
+            VM_OP(LOAD_GLOBAL) R(a) = globals[pc->b]; VM_NEXT();
+            VM_OP(STORE_GLOBAL) globals[pc->a] = R(b); VM_NEXT();
+            VM_OP(ADD_LOAD_I)
+                R(a).intValue = (int)((unsigned int)R(b).intValue + (unsigned int)R(c).address[R(d).intValue].intValue);
+                VM_NEXT();
+            VM_OP(ADD_LOAD_F) R(a).floatValue = R(b).floatValue + R(c).address[R(d).intValue].floatValue; VM_NEXT();
+
+            VM_OP(JUMP) pc = code + pc->a; VM_DISPATCH();
+            VM_OP(JUMP_IF) VM_JUMP_WHEN(R(a).intValue, b);
+            VM_OP(JUMP_UNLESS) VM_JUMP_WHEN(!R(a).intValue, b);
+            VM_OP(JEQ_I) VM_JUMP_WHEN(R(a).intValue == R(b).intValue, c);
+            VM_OP(JNE_I) VM_JUMP_WHEN(R(a).intValue != R(b).intValue, c);
+            VM_OP(JLT_I) VM_JUMP_WHEN(R(a).intValue < R(b).intValue, c);
+            VM_OP(JLE_I) VM_JUMP_WHEN(R(a).intValue <= R(b).intValue, c);
+            VM_OP(JGT_I) VM_JUMP_WHEN(R(a).intValue > R(b).intValue, c);
+            VM_OP(JGE_I) VM_JUMP_WHEN(R(a).intValue >= R(b).intValue, c);
+            VM_OP(JEQ_IK) VM_JUMP_WHEN(R(a).intValue == pc->b, c);
+            VM_OP(JNE_IK) VM_JUMP_WHEN(R(a).intValue != pc->b, c);
+            VM_OP(JLT_IK) VM_JUMP_WHEN(R(a).intValue < pc->b, c);
+            VM_OP(JLE_IK) VM_JUMP_WHEN(R(a).intValue <= pc->b, c);
+            VM_OP(JGT_IK) VM_JUMP_WHEN(R(a).intValue > pc->b, c);
+            VM_OP(JGE_IK) VM_JUMP_WHEN(R(a).intValue >= pc->b, c);
+            VM_OP(JEQ_F) VM_JUMP_WHEN(R(a).floatValue == R(b).floatValue, c);
+            VM_OP(JNE_F) VM_JUMP_WHEN(R(a).floatValue != R(b).floatValue, c);
+            VM_OP(JLT_F) VM_JUMP_WHEN(R(a).floatValue < R(b).floatValue, c);
+            VM_OP(JLE_F) VM_JUMP_WHEN(R(a).floatValue <= R(b).floatValue, c);
+            VM_OP(JGT_F) VM_JUMP_WHEN(R(a).floatValue > R(b).floatValue, c);
+            VM_OP(JGE_F) VM_JUMP_WHEN(R(a).floatValue >= R(b).floatValue, c);
+
+            VM_OP(CHECK)
+                if ((unsigned int)R(a).intValue >= (unsigned int)pc->b) {
+                    this->fail("index " + std::to_string(R(a).intValue) + " out of range for an array of " + std::to_string(pc->b));
+                    goto stopped;
+                }
+                VM_NEXT();
+            VM_OP(CALL) {
+                this->calls++;
+                const BcFunction *callee = &this->module->functions[pc->b];
+                if (this->frames.size() >= VM_MAX_DEPTH) {
+                    this->error = "stack overflow in @" + callee->name;
+                    goto stopped;
+                }
+                VmFrame &caller = this->frames.back();
+                VmFrame frame = {pc->b, caller.registers + function->registers, (int)(pc + 1 - code), pc->a,
+                    this->memoryBlock, this->memoryUsed};
+                if (frame.registers + callee->registers > (long)this->stack.size()) {
+                    this->stack.resize(2 * (frame.registers + callee->registers));
+                    regs = this->stack.data() + caller.registers;
+                }
+                VmSlot *next = this->stack.data() + frame.registers;
+                const int *args = function->args.data() + pc->c;
+                for (int i = 0; i < pc->d; i++) next[i] = regs[args[i]];
+                this->frames.push_back(frame);
+                function = callee;
+                regs = next;
+                code = pc = threaded[frame.function].data();
+                VM_DISPATCH();
+            }
+            VM_OP(RET) {
+                VmSlot result = R(a);
+                VmFrame frame = this->frames.back();
+                this->frames.pop_back();
+                this->memoryBlock = frame.memoryBlock;
+                this->memoryUsed = frame.memoryUsed;
+                if (this->frames.empty()) goto stopped;
+                VmFrame &caller = this->frames.back();
+                function = &this->module->functions[caller.function];
+                regs = this->stack.data() + caller.registers;
+                regs[frame.result] = result;
+                code = threaded[caller.function].data();
+                pc = code + frame.returnTo;
+                VM_DISPATCH();
+            }
+            VM_OP(RET_VOID) {
+                VmFrame frame = this->frames.back();
+                this->frames.pop_back();
+                this->memoryBlock = frame.memoryBlock;
+                this->memoryUsed = frame.memoryUsed;
+                if (this->frames.empty()) goto stopped;
+                VmFrame &caller = this->frames.back();
+                function = &this->module->functions[caller.function];
+                regs = this->stack.data() + caller.registers;
+                code = threaded[caller.function].data();
+                pc = code + frame.returnTo;
+                VM_DISPATCH();
+            }
+
+            // the runtime, which reads one whitespace separated word, and
+            // anything unreadable as the type asked for reads as its zero
+            VM_OP(PUT_I) this->calls++; this->out << R(b).intValue << "\n"; R(a).intValue = 1; VM_NEXT();
+            VM_OP(PUT_F) this->calls++; this->out << R(b).floatValue << "\n"; R(a).intValue = 1; VM_NEXT();
+            VM_OP(PUT_B) this->calls++; this->out << (R(b).intValue ? "true" : "false") << "\n"; R(a).intValue = 1; VM_NEXT();
+            VM_OP(PUT_S)
+                this->calls++;
+                this->out << (R(b).stringValue == NULL ? "" : R(b).stringValue) << "\n";
+                R(a).intValue = 1;
+                VM_NEXT();
+            VM_OP(GET_I) {
+                this->calls++;
+                std::string word;
+                this->in >> word;
+                R(a).intValue = atoi(word.c_str());
+                VM_NEXT();
+            }
+            VM_OP(GET_F) {
+                this->calls++;
+                std::string word;
+                this->in >> word;
+                R(a).floatValue = atof(word.c_str());
+                VM_NEXT();
+            }
+            VM_OP(GET_B) {
+                this->calls++;
+                std::string word;
+                this->in >> word;
+                R(a).intValue = word == "true" || atoi(word.c_str()) != 0;
+                VM_NEXT();
+            }
+            VM_OP(GET_S) {
+                this->calls++;
+                std::string word;
+                this->in >> word;
+                this->strings.push_back(word);
+                R(a).stringValue = this->strings.back().c_str();
+                VM_NEXT();
+            }
+            VM_OP(SQRT) this->calls++; R(a).floatValue = sqrtf((float)R(b).intValue); VM_NEXT();
+            VM_OP(STRCMP) {
+                this->calls++;
+                const char *first = R(b).stringValue, *second = R(c).stringValue;
+                int order = strcmp(first == NULL ? "" : first, second == NULL ? "" : second);
+                R(a).intValue = order < 0 ? -1 : order > 0;
+                VM_NEXT();
+            }
+            VM_OP(FAIL)
+                this->error = this->module->messages[pc->a];
+                goto stopped;
+        }
+    }
+
+stopped:
+    this->frames.clear();
+    this->out.flush();
+    this->ms = wallClockMs() - start;
+    return this->error.empty();
+}
+
+std::string VirtualMachine::toJson() {
+    std::ostringstream json;
+    json << "{\"calls\": " << this->calls << ", \"ms\": " << this->ms;
+    if (!this->error.empty()) json << ", \"error\": " << jsonString(this->error);
+    json << "}";
+    return json.str();
+}
@@ -0,0 +1,81 @@
+#ifndef VM_H
+#define VM_H
+
+#include <istream>
+#include <list>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+
+#define VM_MAX_DEPTH    10000 // calls deep before a run stops as a stack overflow, as in the interpreter
+#define VM_MEMORY_BLOCK 65536 // slots taken for allocas at a time
+
+// gcc and clang dispatch through the address of each opcode's code, kept in
+// the instruction, anything else through a switch. building with VM_SWITCH
+// picks the switch anyway, to compare the two
+#if !defined(__GNUC__) && !defined(VM_SWITCH)
+#define VM_SWITCH
+#endif
+
+// a register or a memory slot, ints and bools in intValue
+union VmSlot {
+    int intValue;
+    float floatValue;
+    const char *stringValue; // NULL reads as ""
+    VmSlot *address;
+};
+
+// an instruction as the vm runs it, with its jump targets still positions in its function
+struct VmInstruction {
+#ifdef VM_SWITCH
+    int op;
+#else
+    const void *handler;
+#endif
+    int a, b, c, d;
+};
+
+// a call in progress. its registers are a window onto the register stack,
+// which moves as it grows, so the frame keeps where the window starts
+struct VmFrame {
+    int function;
+    long registers;
+    int returnTo;          // the caller's next instruction
+    int result;            // the caller's register for the value returned
+    size_t memoryBlock;    // the allocas as the call found them
+    size_t memoryUsed;
+};
+
+// runs a bytecode module's @main. the runtime reads in and writes the
+// program's output to out, one value per line, the way the interpreter does
+class VirtualMachine {
+    BcModule *module;
+    std::istream &in;
+    std::ostream &out;
+    std::vector<VmSlot> globals;
+    std::vector<VmSlot> stack;          // every frame's registers, innermost last
+    std::vector<VmFrame> frames;
+    std::vector<VmSlot*> memory;        // blocks of slots allocas are taken from in turn
+    std::vector<size_t> memorySizes;
+    size_t memoryBlock = 0, memoryUsed = 0;
+    std::list<std::string> strings;     // read by GET_S, kept for the whole run
+    std::vector<const char*> constants; // the module's strings
+
+    VmSlot *allocate(int count);
+    void fail(std::string message);
+
+    public:
+        long calls = 0; // to functions and the runtime
+        double ms = 0.0;
+        std::string error; // what stopped the run, empty when main returned
+
+        VirtualMachine(BcModule *module, std::istream &in, std::ostream &out);
+        ~VirtualMachine();
+
+        // false when a runtime error stopped the run
+        bool run();
+        std::string toJson();
+};
+
+#endif
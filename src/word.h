@@ -15,7 +15,7 @@ struct Word {
     float floatValue = 0.0;
     bool boolValue = false;
     bool negated = false; // if the word has a T_SUB in front
-    bool isProcIdentifier; // otherwise it's a variable
+    bool isProcIdentifier = false; // otherwise it's a variable
     std::string strValue = "";
     std::list<int> arrayInt;
     std::list<float> arrayFloat;
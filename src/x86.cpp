@@ -0,0 +1,526 @@
+//  recursive descent compiler by Andrew Miller
+
+#include <algorithm>
+#include <sstream>
+#include "x86.h"
+
+static const char *names64[16] = {"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
+static const char *names32[16] = {"%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi", "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"};
+static const char *names8[16] = {"%al", "%cl", "%dl", "%bl", "%spl", "%bpl", "%sil", "%dil", "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"};
+static const char *conditionNames[16] = {"o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+// each instruction's name and the width its general registers are written
+// at, by operand
+struct OpInfo {
+    const char *name;
+    int widths[2];
+};
+
+static const OpInfo ops[X86_J] = {
+    {"movl", {32, 32}}, {"movq", {64, 64}}, {"movb", {8, 8}}, {"movzbl", {8, 32}}, {"movslq", {32, 64}},
+    {"leaq", {64, 64}}, {"movss", {32, 32}}, {"movaps", {32, 32}}, {"movd", {32, 32}},
+    {"addl", {32, 32}}, {"subl", {32, 32}}, {"andl", {32, 32}}, {"orl", {32, 32}}, {"xorl", {32, 32}}, {"cmpl", {32, 32}},
+    {"addq", {64, 64}}, {"subq", {64, 64}}, {"imull", {32, 32}}, {"negl", {32, 32}}, {"notl", {32, 32}},
+    {"incl", {32, 32}}, {"decl", {32, 32}}, {"idivl", {32, 32}}, {"testl", {32, 32}}, {"andb", {8, 8}}, {"orb", {8, 8}},
+    {"addss", {32, 32}}, {"subss", {32, 32}}, {"mulss", {32, 32}}, {"divss", {32, 32}}, {"ucomiss", {32, 32}},
+    {"cvtsi2ssl", {32, 32}}, {"pushq", {64, 64}}, {"call", {64, 64}}, {"jmp", {64, 64}}, {"leave", {0, 0}},
+    {"ret", {0, 0}}, {"cltd", {0, 0}}, {"rep stosb", {0, 0}},
+    {"movups", {32, 32}}, {"addps", {32, 32}}, {"subps", {32, 32}}, {"mulps", {32, 32}}, {"divps", {32, 32}},
+    {"paddd", {32, 32}}, {"psubd", {32, 32}}, {"unpcklps", {32, 32}}, {"psrldq", {32, 32}},
+};
+
+// the register's number within its class, as instructions encode it
+static int number(int reg) {
+    return reg >= REG_XMM0 ? reg - REG_XMM0 : reg;
+}
+
+static bool fitsByte(long value) {
+    return value >= -128 && value <= 127;
+}
+
+bool Operand::operator==(const Operand &other) const {
+    return kind == other.kind && reg == other.reg && index == other.index && scale == other.scale && value == other.value
+        && symbol == other.symbol;
+}
+
+Operand reg(int reg) {
+    Operand operand;
+    operand.kind = OPERAND_REGISTER;
+    operand.reg = reg;
+    return operand;
+}
+
+Operand imm(long value) {
+    Operand operand;
+    operand.kind = OPERAND_IMMEDIATE;
+    operand.value = value;
+    return operand;
+}
+
+Operand mem(int base, long displacement, int index, int scale) {
+    Operand operand;
+    operand.kind = OPERAND_MEMORY;
+    operand.reg = base;
+    operand.value = displacement;
+    operand.index = index;
+    operand.scale = scale;
+    return operand;
+}
+
+Operand ripRelative(const std::string &symbol, long displacement) {
+    Operand operand = mem(REG_RIP, displacement);
+    operand.symbol = symbol;
+    return operand;
+}
+
+Operand label(const std::string &name) {
+    Operand operand;
+    operand.kind = OPERAND_LABEL;
+    operand.symbol = name;
+    return operand;
+}
+
+Operand symbol(const std::string &name) {
+    Operand operand;
+    operand.kind = OPERAND_SYMBOL;
+    operand.symbol = name;
+    return operand;
+}
+
+AssemblyText::AssemblyText(std::ostream &out) : out(out) {}
+
+std::string AssemblyText::text(const Operand &operand, int width) {
+    switch (operand.kind) {
+        case OPERAND_REGISTER:
+            if (operand.reg >= REG_XMM0) return "%xmm" + std::to_string(operand.reg - REG_XMM0);
+            return width == 64 ? names64[operand.reg] : width == 8 ? names8[operand.reg] : names32[operand.reg];
+        case OPERAND_IMMEDIATE:
+            return "$" + std::to_string(operand.value);
+        case OPERAND_MEMORY: {
+            if (operand.reg == REG_RIP) {
+                std::string offset = operand.value == 0 ? "" : (operand.value > 0 ? "+" : "") + std::to_string(operand.value);
+                return operand.symbol + offset + "(%rip)";
+            }
+            std::string text = (operand.value != 0 ? std::to_string(operand.value) : "") + "(" + names64[operand.reg];
+            if (operand.index >= 0) text += "," + std::string(names64[operand.index]) + "," + std::to_string(operand.scale);
+            return text + ")";
+        }
+        default:
+            return operand.symbol;
+    }
+}
+
+void AssemblyText::instruction(int op, const Operand &a, const Operand &b) {
+    std::ostream &out = this->out;
+    if (op >= X86_SET) out << "    set" << conditionNames[op - X86_SET];
+    else if (op >= X86_J) out << "    j" << conditionNames[op - X86_J];
+    else out << "    " << ops[op].name;
+    const int *widths = op >= X86_SET ? ops[X86_MOVB].widths : ops[op >= X86_J ? X86_JMP : op].widths;
+    if (a.kind != OPERAND_NONE) out << " " << this->text(a, widths[0]);
+    if (b.kind != OPERAND_NONE) out << ", " << this->text(b, widths[1]);
+    out << "\n";
+}
+
+void AssemblyText::section(int section) {
+    if (section == SECTION_TEXT) this->out << "    .text\n";
+    else if (section == SECTION_BSS) this->out << "\n    .bss\n";
+    else this->out << "\n    .section .rodata\n";
+}
+
+void AssemblyText::label(const std::string &name) {
+    this->out << name << ":\n";
+}
+
+void AssemblyText::function(const std::string &name) {
+    this->out << "\n    .globl " << name << "\n";
+    this->out << "    .type " << name << ", @function\n";
+    this->out << name << ":\n";
+}
+
+void AssemblyText::endFunction(const std::string &name) {
+    this->out << "    .size " << name << ", .-" << name << "\n";
+}
+
+void AssemblyText::align(int bytes) {
+    this->out << "    .align " << bytes << "\n";
+}
+
+void AssemblyText::zero(int bytes) {
+    this->out << "    .zero " << bytes << "\n";
+}
+
+void AssemblyText::string(const std::string &text) {
+    std::ostream &out = this->out;
+    out << "    .string \"";
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (c < 32 || c > 126) out << '\\' << (char)('0' + (c >> 6)) << (char)('0' + ((c >> 3) & 7)) << (char)('0' + (c & 7));
+        else out << c;
+    }
+    out << "\"\n";
+}
+
+void AssemblyText::finish() {
+    this->out << "\n    .section .note.GNU-stack,\"\",@progbits\n";
+}
+
+std::string EncodeStats::toJson() {
+    std::ostringstream json;
+    json << "{\"instructions\": " << this->instructions << ", \"bytes\": " << this->bytes << ", \"branches\": " << this->branches
+        << ", \"shortBranches\": " << this->shortBranches << ", \"relocations\": " << this->relocations << "}";
+    return json.str();
+}
+
+MachineCode::MachineCode(EncodeStats &stats) : stats(stats) {}
+
+MachineCode::Place MachineCode::here() {
+    long at = this->current == SECTION_BSS ? this->bssSize : (long)this->raw[this->current].size();
+    return {this->current, at, this->current == SECTION_TEXT ? (int)this->branches.size() : 0};
+}
+
+// keeps the order symbols are first seen in, for the symbol table
+void MachineCode::note(const std::string &name) {
+    if (name.compare(0, 2, ".L") == 0 || this->symbols.count(name)) return;
+    this->symbols[name].name = name;
+    this->order.push_back(name);
+}
+
+void MachineCode::byte(int value) {
+    this->raw[this->current] += (char)value;
+}
+
+void MachineCode::immediate(long value, int bytes) {
+    for (int i = 0; i < bytes; i++) this->byte((value >> (8 * i)) & 0xff);
+}
+
+// a four byte field for the linker, here
+void MachineCode::relocate(int type, const std::string &symbol, long addend) {
+    this->note(symbol);
+    this->pending.push_back({this->here(), type, symbol, addend});
+    this->immediate(0, 4);
+}
+
+// an optional mandatory prefix, a rex prefix when one's needed, the opcode,
+// then modrm with reg in its reg field and rm register direct or addressed.
+// trailing is the bytes of immediate that will follow, which a rip relative
+// displacement counts from. bytes says which of reg (1) and rm (2) are byte
+// registers, where spl, bpl, sil and dil need a rex prefix to be named
+void MachineCode::encode(int prefix, int opcode, bool w, int reg, const Operand &rm, int trailing, int bytes) {
+    if (prefix != 0) this->byte(prefix);
+    bool direct = rm.kind == OPERAND_REGISTER;
+    int base = rm.kind == OPERAND_MEMORY && rm.reg != REG_RIP ? number(rm.reg) : direct ? number(rm.reg) : 0;
+    int index = rm.kind == OPERAND_MEMORY && rm.index >= 0 ? number(rm.index) : 0;
+    int rex = (w ? 8 : 0) | (reg >= 8 ? 4 : 0) | (index >= 8 ? 2 : 0) | (base >= 8 ? 1 : 0);
+    bool named = ((bytes & 1) && reg >= 4 && reg < 8) || ((bytes & 2) && direct && base >= 4 && base < 8);
+    if (rex != 0 || named) this->byte(0x40 | rex);
+    if (opcode > 0xff) this->byte(opcode >> 8);
+    this->byte(opcode & 0xff);
+
+    int field = (reg & 7) << 3;
+    if (direct) {
+        this->byte(0xc0 | field | (base & 7));
+        return;
+    }
+    if (rm.reg == REG_RIP) {
+        this->byte(field | 5);
+        this->relocate(RELOC_PC32, rm.symbol, rm.value - 4 - trailing);
+        return;
+    }
+    bool sib = rm.index >= 0 || (base & 7) == 4;
+    int mod = rm.value == 0 && (base & 7) != 5 ? 0 : fitsByte(rm.value) ? 1 : 2;
+    this->byte((mod << 6) | field | (sib ? 4 : base & 7));
+    if (sib) {
+        int scale = rm.index < 0 ? 0 : rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+        this->byte((scale << 6) | ((rm.index >= 0 ? index & 7 : 4) << 3) | (base & 7));
+    }
+    if (mod == 1) this->immediate(rm.value, 1);
+    else if (mod == 2) this->immediate(rm.value, 4);
+}
+
+// add, or, and, sub, xor and cmp, told apart by digit, the opcode extension
+// of their immediate forms and an eighth of their other opcodes
+void MachineCode::arithmetic(int digit, const Operand &a, const Operand &b, bool w) {
+    if (a.kind == OPERAND_IMMEDIATE) {
+        if (fitsByte(a.value)) {
+            this->encode(0, 0x83, w, digit, b, 1);
+            this->immediate(a.value, 1);
+        }
+        else if (b.isRegister() && b.reg == REG_RAX) {
+            if (w) this->byte(0x48);
+            this->byte(digit * 8 + 5);
+            this->immediate(a.value, 4);
+        }
+        else {
+            this->encode(0, 0x81, w, digit, b, 4);
+            this->immediate(a.value, 4);
+        }
+    }
+    else if (a.isRegister()) this->encode(0, digit * 8 + 1, w, number(a.reg), b);
+    else this->encode(0, digit * 8 + 3, w, number(b.reg), a);
+}
+
+// a jump to a label, or a jmp to a function, laid out once every label is known
+void MachineCode::branch(int condition, const Operand &target) {
+    bool function = target.kind == OPERAND_SYMBOL;
+    if (function) this->note(target.symbol);
+    this->branches.push_back({(long)this->raw[SECTION_TEXT].size(), condition, target.symbol, function});
+    this->stats.branches++;
+}
+
+void MachineCode::instruction(int op, const Operand &a, const Operand &b) {
+    this->stats.instructions++;
+    if (op >= X86_SET) {
+        this->encode(0, 0x0f90 + op - X86_SET, false, 0, a, 0, 2);
+        return;
+    }
+    if (op >= X86_J) {
+        this->branch(op - X86_J, a);
+        return;
+    }
+    switch (op) {
+        case X86_MOVL: case X86_MOVQ: {
+            bool w = op == X86_MOVQ;
+            if (a.kind == OPERAND_IMMEDIATE && b.isRegister() && !w) {
+                if (number(b.reg) >= 8) this->byte(0x41);
+                this->byte(0xb8 + (number(b.reg) & 7));
+                this->immediate(a.value, 4);
+            }
+            else if (a.kind == OPERAND_IMMEDIATE) {
+                this->encode(0, 0xc7, w, 0, b, 4);
+                this->immediate(a.value, 4);
+            }
+            else if (a.isRegister()) this->encode(0, 0x89, w, number(a.reg), b);
+            else this->encode(0, 0x8b, w, number(b.reg), a);
+            break;
+        }
+        case X86_MOVB:
+            if (a.kind == OPERAND_IMMEDIATE) {
+                this->encode(0, 0xc6, false, 0, b, 1);
+                this->immediate(a.value, 1);
+            }
+            else this->encode(0, 0x88, false, number(a.reg), b, 0, 1);
+            break;
+        case X86_MOVZBL: this->encode(0, 0x0fb6, false, number(b.reg), a, 0, 2); break;
+        case X86_MOVSLQ: this->encode(0, 0x63, true, number(b.reg), a); break;
+        case X86_LEAQ: this->encode(0, 0x8d, true, number(b.reg), a); break;
+        case X86_MOVSS:
+            if (b.isRegister()) this->encode(0xf3, 0x0f10, false, number(b.reg), a);
+            else this->encode(0xf3, 0x0f11, false, number(a.reg), b);
+            break;
+        case X86_MOVAPS: this->encode(0, 0x0f28, false, number(b.reg), a); break;
+        case X86_MOVD:
+            if (b.isRegister() && b.reg >= REG_XMM0) this->encode(0x66, 0x0f6e, false, number(b.reg), a);
+            else this->encode(0x66, 0x0f7e, false, number(a.reg), b);
+            break;
+        case X86_ADDL: case X86_ADDQ: this->arithmetic(0, a, b, op == X86_ADDQ); break;
+        case X86_ORL: this->arithmetic(1, a, b, false); break;
+        case X86_ANDL: this->arithmetic(4, a, b, false); break;
+        case X86_SUBL: case X86_SUBQ: this->arithmetic(5, a, b, op == X86_SUBQ); break;
+        case X86_XORL: this->arithmetic(6, a, b, false); break;
+        case X86_CMPL: this->arithmetic(7, a, b, false); break;
+        case X86_IMULL:
+            if (a.kind != OPERAND_IMMEDIATE) this->encode(0, 0x0faf, false, number(b.reg), a);
+            else if (fitsByte(a.value)) {
+                this->encode(0, 0x6b, false, number(b.reg), b, 1);
+                this->immediate(a.value, 1);
+            }
+            else {
+                this->encode(0, 0x69, false, number(b.reg), b, 4);
+                this->immediate(a.value, 4);
+            }
+            break;
+        case X86_NEGL: this->encode(0, 0xf7, false, 3, a); break;
+        case X86_NOTL: this->encode(0, 0xf7, false, 2, a); break;
+        case X86_IDIVL: this->encode(0, 0xf7, false, 7, a); break;
+        case X86_INCL: this->encode(0, 0xff, false, 0, a); break;
+        case X86_DECL: this->encode(0, 0xff, false, 1, a); break;
+        case X86_TESTL: this->encode(0, 0x85, false, number(a.reg), b); break;
+        case X86_ANDB: this->encode(0, 0x20, false, number(a.reg), b, 0, 3); break;
+        case X86_ORB: this->encode(0, 0x08, false, number(a.reg), b, 0, 3); break;
+        case X86_ADDSS: this->encode(0xf3, 0x0f58, false, number(b.reg), a); break;
+        case X86_SUBSS: this->encode(0xf3, 0x0f5c, false, number(b.reg), a); break;
+        case X86_MULSS: this->encode(0xf3, 0x0f59, false, number(b.reg), a); break;
+        case X86_DIVSS: this->encode(0xf3, 0x0f5e, false, number(b.reg), a); break;
+        case X86_UCOMISS: this->encode(0, 0x0f2e, false, number(b.reg), a); break;
+        case X86_CVTSI2SSL: this->encode(0xf3, 0x0f2a, false, number(b.reg), a); break;
+        case X86_PUSHQ:
+            if (a.isRegister()) {
+                if (a.reg >= 8) this->byte(0x41);
+                this->byte(0x50 + (a.reg & 7));
+            }
+            else if (a.kind == OPERAND_IMMEDIATE && fitsByte(a.value)) {
+                this->byte(0x6a);
+                this->immediate(a.value, 1);
+            }
+            else if (a.kind == OPERAND_IMMEDIATE) {
+                this->byte(0x68);
+                this->immediate(a.value, 4);
+            }
+            else this->encode(0, 0xff, false, 6, a);
+            break;
+        case X86_CALL:
+            this->byte(0xe8);
+            this->relocate(RELOC_PLT32, a.symbol, -4);
+            break;
+        case X86_JMP: this->branch(-1, a); break;
+        case X86_LEAVE: this->byte(0xc9); break;
+        case X86_RET: this->byte(0xc3); break;
+        case X86_CLTD: this->byte(0x99); break;
+        case X86_REP_STOSB: this->byte(0xf3); this->byte(0xaa); break;
+        case X86_MOVUPS:
+            if (b.isRegister()) this->encode(0, 0x0f10, false, number(b.reg), a);
+            else this->encode(0, 0x0f11, false, number(a.reg), b);
+            break;
+        case X86_ADDPS: this->encode(0, 0x0f58, false, number(b.reg), a); break;
+        case X86_SUBPS: this->encode(0, 0x0f5c, false, number(b.reg), a); break;
+        case X86_MULPS: this->encode(0, 0x0f59, false, number(b.reg), a); break;
+        case X86_DIVPS: this->encode(0, 0x0f5e, false, number(b.reg), a); break;
+        case X86_PADDD: this->encode(0x66, 0x0ffe, false, number(b.reg), a); break;
+        case X86_PSUBD: this->encode(0x66, 0x0ffa, false, number(b.reg), a); break;
+        case X86_UNPCKLPS: this->encode(0, 0x0f14, false, number(b.reg), a); break;
+        case X86_PSRLDQ:
+            this->encode(0x66, 0x0f73, false, 3, b, 1);
+            this->immediate(a.value, 1);
+            break;
+    }
+}
+
+void MachineCode::section(int section) {
+    this->current = section;
+}
+
+void MachineCode::label(const std::string &name) {
+    this->note(name);
+    this->labels[name] = this->here();
+}
+
+void MachineCode::function(const std::string &name) {
+    this->label(name);
+    this->symbols[name].global = this->symbols[name].function = true;
+}
+
+void MachineCode::endFunction(const std::string &name) {
+    this->ends[name] = this->here();
+}
+
+void MachineCode::align(int bytes) {
+    if (this->current == SECTION_BSS) this->bssSize = (this->bssSize + bytes - 1) / bytes * bytes;
+    else while (this->raw[this->current].size() % bytes != 0) this->byte(0);
+}
+
+void MachineCode::zero(int bytes) {
+    if (this->current == SECTION_BSS) this->bssSize += bytes;
+    else this->immediate(0, bytes);
+}
+
+void MachineCode::string(const std::string &text) {
+    this->raw[this->current] += text;
+    this->byte(0);
+}
+
+long MachineCode::finalOffset(const Place &place) {
+    if (place.section != SECTION_TEXT) return place.at;
+    return place.at + this->before[place.branches];
+}
+
+bool MachineCode::finish(std::string &error) {
+    std::vector<Branch> &branches = this->branches;
+    std::vector<long> &before = this->before;
+    // a jmp to a function defined elsewhere is always the long form, for the linker to fill in
+    for (size_t i = 0; i < branches.size(); i++) {
+        if (this->labels.count(branches[i].target)) continue;
+        branches[i].wide = true;
+        if (branches[i].function) continue;
+        error = branches[i].target;
+        return false;
+    }
+    // every jump starts short, and one that can't reach grows, moving the
+    // code after it, until none has to
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        before.assign(branches.size() + 1, 0);
+        for (size_t i = 0; i < branches.size(); i++) {
+            before[i + 1] = before[i] + (!branches[i].wide ? 2 : branches[i].condition < 0 ? 5 : 6);
+        }
+        for (size_t i = 0; i < branches.size(); i++) {
+            if (branches[i].wide) continue;
+            long end = branches[i].at + before[i] + 2;
+            long distance = this->finalOffset(this->labels[branches[i].target]) - end;
+            if (fitsByte(distance)) continue;
+            branches[i].wide = changed = true;
+        }
+    }
+
+    std::string &text = this->sections[SECTION_TEXT];
+    const std::string &raw = this->raw[SECTION_TEXT];
+    long at = 0;
+    for (size_t i = 0; i < branches.size(); i++) {
+        text.append(raw, at, branches[i].at - at);
+        at = branches[i].at;
+        Branch &branch = branches[i];
+        if (!this->labels.count(branch.target)) {
+            this->relocations.push_back({SECTION_TEXT, (long)text.size() + 1, RELOC_PLT32, branch.target, -1, -4});
+            text += (char)0xe9;
+            text.append(4, '\0');
+            continue;
+        }
+        long end = (long)text.size() + (!branch.wide ? 2 : branch.condition < 0 ? 5 : 6);
+        long distance = this->finalOffset(this->labels[branch.target]) - end;
+        if (!branch.wide) {
+            text += (char)(branch.condition < 0 ? 0xeb : 0x70 + branch.condition);
+            text += (char)distance;
+            this->stats.shortBranches++;
+            continue;
+        }
+        if (branch.condition < 0) text += (char)0xe9;
+        else {
+            text += (char)0x0f;
+            text += (char)(0x80 + branch.condition);
+        }
+        for (int k = 0; k < 4; k++) text += (char)((distance >> (8 * k)) & 0xff);
+    }
+    text.append(raw, at, std::string::npos);
+    this->sections[SECTION_RODATA] = this->raw[SECTION_RODATA];
+    this->sizes[SECTION_TEXT] = text.size();
+    this->sizes[SECTION_RODATA] = this->sections[SECTION_RODATA].size();
+    this->sizes[SECTION_BSS] = this->bssSize;
+    this->stats.bytes += text.size();
+
+    for (size_t i = 0; i < this->order.size(); i++) {
+        CodeSymbol symbol = this->symbols[this->order[i]];
+        std::map<std::string, Place>::iterator defined = this->labels.find(symbol.name);
+        if (defined != this->labels.end()) {
+            symbol.section = defined->second.section;
+            symbol.offset = this->finalOffset(defined->second);
+            if (this->ends.count(symbol.name)) symbol.size = this->finalOffset(this->ends[symbol.name]) - symbol.offset;
+        }
+        this->symbolTable.push_back(symbol);
+    }
+    for (size_t i = 0; i < this->pending.size(); i++) {
+        Pending &pending = this->pending[i];
+        Relocation relocation = {pending.place.section, this->finalOffset(pending.place), pending.type, pending.symbol, -1, pending.addend};
+        std::map<std::string, Place>::iterator defined = this->labels.find(pending.symbol);
+        if (defined != this->labels.end() && !this->symbols[pending.symbol].global) {
+            relocation.symbol = "";
+            relocation.target = defined->second.section;
+            relocation.addend += this->finalOffset(defined->second);
+        }
+        this->relocations.push_back(relocation);
+    }
+    // in the order the fields come, as the assembler lists them
+    std::sort(this->relocations.begin(), this->relocations.end(), [](const Relocation &a, const Relocation &b) {
+        return a.section != b.section ? a.section < b.section : a.offset < b.offset;
+    });
+    this->stats.relocations += this->relocations.size();
+    return true;
+}
+
+bool MachineCode::find(const std::string &name, int &section, long &offset) {
+    std::map<std::string, Place>::iterator defined = this->labels.find(name);
+    if (defined == this->labels.end()) return false;
+    section = defined->second.section;
+    offset = this->finalOffset(defined->second);
+    return true;
+}
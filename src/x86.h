@@ -0,0 +1,258 @@
+#ifndef X86_H
+#define X86_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "regalloc.h"
+
+// a memory operand's base when it's rip relative, past every real register
+#define REG_RIP REG_COUNT
+
+// condition codes, numbered the way jcc and setcc encode them, so each one's
+// opposite is the code with the low bit flipped
+#define CC_B  2
+#define CC_AE 3
+#define CC_E  4
+#define CC_NE 5
+#define CC_BE 6
+#define CC_A  7
+#define CC_P  10
+#define CC_NP 11
+#define CC_L  12
+#define CC_GE 13
+#define CC_LE 14
+#define CC_G  15
+
+// the instructions the code generator writes, by their gnu names. the ones
+// taking a condition code are numbered as a block, X86_J + CC_E being je
+#define X86_MOVL      0
+#define X86_MOVQ      1
+#define X86_MOVB      2
+#define X86_MOVZBL    3
+#define X86_MOVSLQ    4
+#define X86_LEAQ      5
+#define X86_MOVSS     6
+#define X86_MOVAPS    7
+#define X86_MOVD      8
+#define X86_ADDL      9
+#define X86_SUBL      10
+#define X86_ANDL      11
+#define X86_ORL       12
+#define X86_XORL      13
+#define X86_CMPL      14
+#define X86_ADDQ      15
+#define X86_SUBQ      16
+#define X86_IMULL     17
+#define X86_NEGL      18
+#define X86_NOTL      19
+#define X86_INCL      20
+#define X86_DECL      21
+#define X86_IDIVL     22
+#define X86_TESTL     23
+#define X86_ANDB      24
+#define X86_ORB       25
+#define X86_ADDSS     26
+#define X86_SUBSS     27
+#define X86_MULSS     28
+#define X86_DIVSS     29
+#define X86_UCOMISS   30
+#define X86_CVTSI2SSL 31
+#define X86_PUSHQ     32
+#define X86_CALL      33
+#define X86_JMP       34
+#define X86_LEAVE     35
+#define X86_RET       36
+#define X86_CLTD      37
+#define X86_REP_STOSB 38
+#define X86_MOVUPS    39 // the packed ones work on a whole xmm register, four lanes at once
+#define X86_ADDPS     40
+#define X86_SUBPS     41
+#define X86_MULPS     42
+#define X86_DIVPS     43
+#define X86_PADDD     44
+#define X86_PSUBD     45
+#define X86_UNPCKLPS  46
+#define X86_PSRLDQ    47 // by an immediate count of bytes
+#define X86_J         48 // to X86_J + 15
+#define X86_SET       64 // to X86_SET + 15
+#define X86_COUNT     80
+
+#define OPERAND_NONE      0
+#define OPERAND_REGISTER  1
+#define OPERAND_IMMEDIATE 2
+#define OPERAND_MEMORY    3 // displacement(base, index, scale), or symbol + displacement(%rip)
+#define OPERAND_LABEL     4 // a jump target in the same function
+#define OPERAND_SYMBOL    5 // a function called or jumped to, which may be defined elsewhere
+
+struct Operand {
+    int kind = OPERAND_NONE;
+    int reg = -1;       // the register, or a memory operand's base
+    int index = -1;     // a memory operand's index register, -1 for none
+    int scale = 1;
+    long value = 0;     // the immediate, or a memory operand's displacement
+    std::string symbol; // a rip relative operand's symbol, the label or the function
+
+    bool operator==(const Operand &other) const;
+    bool operator!=(const Operand &other) const { return !(*this == other); }
+    bool isRegister() const { return kind == OPERAND_REGISTER; }
+};
+
+Operand reg(int reg);
+Operand imm(long value);
+Operand mem(int base, long displacement, int index = -1, int scale = 1);
+Operand ripRelative(const std::string &symbol, long displacement = 0);
+Operand label(const std::string &name);
+Operand symbol(const std::string &name);
+
+#define SECTION_TEXT   0
+#define SECTION_RODATA 1
+#define SECTION_BSS    2
+#define SECTION_COUNT  3
+
+// where the code generator's instructions go, in the order they run. operands
+// are given in gnu order, source before destination
+class CodeSink {
+    public:
+        virtual void instruction(int op, const Operand &a = Operand(), const Operand &b = Operand()) = 0;
+        virtual void section(int section) = 0;
+        virtual void label(const std::string &name) = 0;
+        // a global function starting here, and where it ends
+        virtual void function(const std::string &name) = 0;
+        virtual void endFunction(const std::string &name) = 0;
+        virtual void align(int bytes) = 0;
+        virtual void zero(int bytes) = 0;
+        // text and its terminating nul
+        virtual void string(const std::string &text) = 0;
+        virtual ~CodeSink() = default;
+};
+
+// gnu assembler syntax, for cc to assemble
+class AssemblyText : public CodeSink {
+    std::ostream &out;
+
+    std::string text(const Operand &operand, int width);
+
+    public:
+        AssemblyText(std::ostream &out);
+        void instruction(int op, const Operand &a = Operand(), const Operand &b = Operand());
+        void section(int section);
+        void label(const std::string &name);
+        void function(const std::string &name);
+        void endFunction(const std::string &name);
+        void align(int bytes);
+        void zero(int bytes);
+        void string(const std::string &text);
+        // marks the stack non executable, once everything else is written
+        void finish();
+};
+
+#define RELOC_PC32  2 // R_X86_64_PC32, a rip relative displacement
+#define RELOC_PLT32 4 // R_X86_64_PLT32, a call or jump to a function
+
+// a symbol the machine code defines or refers to. labels starting .L are
+// the function's own and never leave the object
+struct CodeSymbol {
+    std::string name;
+    int section = -1;   // -1 while undefined
+    long offset = 0;
+    long size = 0;
+    bool global = false;
+    bool function = false;
+};
+
+// a four byte field to fill in with where symbol is, plus addend, less where
+// the field is. a symbol local to the code is replaced by the start of its
+// section, the way the assembler does it
+struct Relocation {
+    int section;
+    long offset;
+    int type;
+    std::string symbol; // empty when against target
+    int target;         // the section, when against one
+    long addend;
+};
+
+// counted over a module, reported under -stats as encode
+struct EncodeStats {
+    int instructions = 0;
+    int bytes = 0;         // of machine code
+    int branches = 0;      // jumps to labels, and jmps to functions
+    int shortBranches = 0; // of those, the ones an 8 bit displacement reaches
+    int relocations = 0;
+
+    std::string toJson();
+};
+
+// x86-64 machine code in its sections, as the assembler would have encoded
+// it from the same instructions: the shortest immediate and displacement
+// forms, and each jump to a label as short as the distance allows, found by
+// growing the ones that can't reach until none changes, jmps to the code's
+// own functions included. references to labels of other sections and to
+// symbols defined elsewhere become relocations
+class MachineCode : public CodeSink {
+    struct Branch {
+        long at;          // where it goes among the bytes around it
+        int condition;    // -1 for jmp
+        std::string target;
+        bool function;    // a jmp to a function, which a relocation reaches when it's defined elsewhere
+        bool wide = false;
+    };
+    struct Place {
+        int section;
+        long at;          // among the bytes, for text not counting branches
+        int branches;     // text branches before it
+    };
+    struct Pending {
+        Place place;
+        int type;
+        std::string symbol;
+        long addend;
+    };
+
+    EncodeStats &stats;
+    int current = SECTION_TEXT;
+    std::string raw[SECTION_COUNT];       // bytes written so far, text without its branches
+    long bssSize = 0;
+    std::vector<Branch> branches;
+    std::vector<long> before;             // once laid out, the bytes of branch before each
+    std::map<std::string, Place> labels;  // everything defined
+    std::map<std::string, Place> ends;    // of each function
+    std::map<std::string, CodeSymbol> symbols;
+    std::vector<std::string> order;       // symbols in the order defined or first used
+    std::vector<Pending> pending;
+
+    Place here();
+    void note(const std::string &name);
+    void byte(int value);
+    void immediate(long value, int bytes);
+    void relocate(int type, const std::string &symbol, long addend);
+    void encode(int prefix, int opcode, bool w, int reg, const Operand &rm, int trailing = 0, int bytes = 0);
+    void arithmetic(int digit, const Operand &a, const Operand &b, bool w);
+    void branch(int condition, const Operand &target);
+    long finalOffset(const Place &place);
+
+    public:
+        std::string sections[SECTION_COUNT]; // the finished bytes, bss none
+        long sizes[SECTION_COUNT] = {0, 0, 0};
+        std::vector<CodeSymbol> symbolTable;  // every symbol but the .L labels, in the order first seen
+        std::vector<Relocation> relocations;
+
+        MachineCode(EncodeStats &stats);
+        void instruction(int op, const Operand &a = Operand(), const Operand &b = Operand());
+        void section(int section);
+        void label(const std::string &name);
+        void function(const std::string &name);
+        void endFunction(const std::string &name);
+        void align(int bytes);
+        void zero(int bytes);
+        void string(const std::string &text);
+        // lays out the branches and fixes every offset, returning false with
+        // the label in error when a jump's target was never defined
+        bool finish(std::string &error);
+        // where a label or symbol ended up, false when it isn't defined
+        bool find(const std::string &name, int &section, long &offset);
+};
+
+#endif